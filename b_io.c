@@ -20,62 +20,587 @@
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <stdint.h>
+#include <pthread.h>
 #include "b_io.h"
-
-#define MIN_FREE_CONT_BLOCKS 5 // minimum free contiguous blocks to do a file write
-#define MAX_FCBS 20 // maximum number of file descriptors allowed concurrently
+#include "fsDentryCache.h"
+#include "fsExtent.h"
+#include "fsDirectory.h"
+#include "fsJournal.h"
+#include "fsIOBuffer.h"
+#include "fsFlusher.h"
+
+#define PREALLOC_BLOCKS 16 // blocks allocated ahead of a growing file, trimmed on close
+#define FCB_CHUNK_SIZE 64 // descriptors the descriptor table grows by at a time
+#define MAX_FCB_CHUNKS 1024 // so at most 65536 files can be open at once
+#define NO_FD -1 // marks the end of the free descriptor list
+#define FCB_POOL_BUFS 32 // most free file buffers kept for reuse
+#define NO_BUF_BLOCK UINT64_MAX // buf_block's value when buf does not hold a block
+#define FCB_BUF_BYTES (64 * 1024) // size of each file's buffer, rounded down to blocks
+#define MIN_READAHEAD_BLOCKS 4 // blocks a read refill loads, doubling while reads are sequential
+#define COPY_RUN_BLOCKS 2048 // most blocks b_copy reads, and writes, in one batch
+#define TRANSFER_BATCH_RUNS 64 // most runs of a file transferRuns queues at once
+
+// the bytes from start to end - 1 of a buffered block hold the file's data
+typedef struct block_range {
+	int start;
+	int end;
+} block_range;
 
 typedef struct b_fcb {
-	char *buf; // holds the open file buffer. buf is NULL when the fcb element is free
-	int buf_index; // holds the current position in the buffer
-	int buf_valid_bytes; // holds how many valid bytes there are in the buffer
+	int in_use; // FALSE if the descriptor is free
+	b_io_fd next_free; // the next free descriptor, while this one is free
+
+	// holds the open file buffer. taken from the buffer pool the first time the file
+	// is read or written through it, and NULL until then
+	char *buf;
+	uint64_t buf_capacity; // how many blocks buf can hold
+	uint64_t buf_block; // the first file block held in buf, or NO_BUF_BLOCK
+	uint64_t buf_num_blocks; // how many consecutive file blocks buf holds
+	// valid[i] is the part of the i-th buffered block that holds data. a block that was
+	// only partly written, and whose other bytes are still on disk, is partial. it is
+	// only read from disk and merged if it is read, or written back. valid is in the
+	// same allocation as buf, right after it.
+	block_range *valid;
+	uint64_t num_partial; // how many buffered blocks are partial
+	// the blocks from dirty_block to dirty_block + dirty_blocks - 1 are in buf and have
+	// changes that have not been written to disk. dirty_blocks is 0 if there are none.
+	uint64_t dirty_block;
+	uint64_t dirty_blocks;
+
+	// where the last read ended. a read that starts there continues a sequential
+	// stream, and its refills load ra_blocks blocks, doubling up to buf_capacity.
+	// any other read, e.g. after a seek, starts over at MIN_READAHEAD_BLOCKS.
+	uint64_t next_read_offset;
+	uint64_t ra_blocks; // blocks the last refill loaded, or 0 to start over
 
 	// the file pointer. it dictates where read/writes are done.
 	// measured in bytes from the start of the file
 	uint64_t file_offset;
 	uint64_t file_bytes; // size of the file in bytes
-	uint64_t file_start_block; // starting block of the file
-	uint64_t file_num_blocks; // size of the file in blocks
+	extent_list extents; // maps the file's blocks to blocks in the volume
+	uint64_t orig_num_blocks; // blocks the file had when opened. used to undo a write
 
 	uint64_t parent_dir_start_block; // start block of the parent directory of the file
-	// the directory entry index of the file in the parent directory. also used as a
-	// flag for a read error in b_write. set to ERROR when a read error occurs.
-	int entry_index;
+	// the directory entry index of the file in the parent directory, or NOT_FOUND for a
+	// new file. also used as a flag for a read error in b_write. set to ERROR when a
+	// read error occurs.
+	long long entry_index;
 	char filename[MAX_DE_NAME_LENGTH]; // the name of the file
 
 	int flags; // flag for whether we are reading, writing, etc.
 	int is_new_file; // flag for whether the file existed previously
+	int blocks_moved; // TRUE if blocks shared with a clone were given new blocks
 	
 	// flag that indicates whether to stop reading or writing,
-	// e.g. end of file, end of free space, or an error occurred
+	// e.g. end of free space, or an error occurred
 	int stop;
+
+	// held for reading by b_pread, and for writing by everything that changes the fcb
+	pthread_rwlock_t lock;
 } b_fcb;
 
 /* Prints the data members in the FCB. Used for debugging. */
 void printFCBcontents(b_fcb *fcb);
 
-b_fcb fcb_array[MAX_FCBS];
+// the descriptor table. descriptor fd is fcb_chunks[fd / FCB_CHUNK_SIZE] at
+// fd % FCB_CHUNK_SIZE. the table grows a chunk at a time, and chunks never move, so
+// an open file's fcb can be used without taking fcb_table_lock.
+b_fcb *fcb_chunks[MAX_FCB_CHUNKS];
+int num_fcb_chunks = 0; // read without the lock, so it is loaded and stored atomically
+b_io_fd free_fd = NO_FD; // the first free descriptor, linked through next_free
+char *buf_pool[FCB_POOL_BUFS]; // file buffers that are free to reuse
+int num_pooled_bufs = 0; // how many buffers are in buf_pool
+// held while descriptors are taken or given back, and while the pool is used.
+// everything else about an open file is guarded by its own lock.
+pthread_mutex_t fcb_table_lock = PTHREAD_MUTEX_INITIALIZER;
+
 int startup = FALSE; // whether the FCB has been initialized
 uint64_t block_size; // size of a block in bytes, not necessarily 512
+uint64_t fcb_buf_blocks; // how many blocks each file buffer holds
 
 /* Initializes our file system. */
 void b_init() {
-	// initialize fcb_array to all free
-	for (int i = 0; i < MAX_FCBS; i++) fcb_array[i].buf = NULL;
-
 	block_size = vcb->block_size; // init block size
+	fcb_buf_blocks = FCB_BUF_BYTES / block_size;
+	if (fcb_buf_blocks == 0) fcb_buf_blocks = 1;
 	startup = TRUE;
 }
 
-/* Gets a free FCB element. Returns the free FCB element's index,
- * or returns ERROR if all FCB elements are in use.
- * Not thread safe, but do not worry about it for this assignment. */
+/* Returns the fcb of descriptor fd, which may be free, or NULL if fd is not in the
+ * descriptor table. */
+static b_fcb *getFCB(b_io_fd fd) {
+	int num_chunks = __atomic_load_n(&num_fcb_chunks, __ATOMIC_ACQUIRE);
+	if (fd < 0 || fd >= num_chunks * FCB_CHUNK_SIZE) return NULL;
+
+	return &fcb_chunks[fd / FCB_CHUNK_SIZE][fd % FCB_CHUNK_SIZE];
+}
+
+/* Takes a free descriptor off the free list, growing the table by a chunk if there
+ * are none. Returns the descriptor, or ERROR if the table is full or memory ran out. */
 b_io_fd b_getFCB() {
-	for (int i = 0; i < MAX_FCBS; i++) {
-		if (fcb_array[i].buf == NULL) return i;
+	pthread_mutex_lock(&fcb_table_lock);
+
+	if (free_fd == NO_FD && num_fcb_chunks < MAX_FCB_CHUNKS) {
+		b_fcb *chunk = calloc(FCB_CHUNK_SIZE, sizeof(b_fcb));
+		if (chunk) {
+			// the new descriptors go on the free list lowest first
+			for (int i = FCB_CHUNK_SIZE - 1; i >= 0; i--) {
+				chunk[i].next_free = free_fd;
+				free_fd = num_fcb_chunks * FCB_CHUNK_SIZE + i;
+			}
+
+			fcb_chunks[num_fcb_chunks] = chunk;
+			__atomic_store_n(&num_fcb_chunks, num_fcb_chunks + 1, __ATOMIC_RELEASE);
+		}
+	}
+
+	b_io_fd fd = free_fd;
+	if (fd != NO_FD) {
+		b_fcb *fcb = getFCB(fd);
+		free_fd = fcb->next_free;
+		fcb->in_use = TRUE;
+	}
+
+	pthread_mutex_unlock(&fcb_table_lock);
+	return fd == NO_FD ? ERROR : fd;
+}
+
+/* Puts descriptor fd back on the free list, and its buffer back in the pool, or frees
+ * the buffer if the pool is full. The fcb belongs to the next b_open from then on, so
+ * the caller must be done with it. */
+static void releaseFCB(b_io_fd fd) {
+	b_fcb *fcb = getFCB(fd);
+
+	pthread_mutex_lock(&fcb_table_lock);
+
+	if (fcb->buf && num_pooled_bufs < FCB_POOL_BUFS) buf_pool[num_pooled_bufs++] = fcb->buf;
+	else free(fcb->buf);
+	fcb->buf = NULL;
+	fcb->valid = NULL;
+
+	fcb->in_use = FALSE;
+	fcb->next_free = free_fd;
+	free_fd = fd;
+
+	pthread_mutex_unlock(&fcb_table_lock);
+}
+
+/* Gives the fcb a buffer if it does not have one yet, from the pool if it has one.
+ * Returns ERROR if memory ran out, or SUCCESS. */
+static int getFCBbuf(b_fcb *fcb) {
+	if (fcb->buf) return SUCCESS;
+
+	pthread_mutex_lock(&fcb_table_lock);
+	char *buf = (num_pooled_bufs > 0) ? buf_pool[--num_pooled_bufs] : NULL;
+	pthread_mutex_unlock(&fcb_table_lock);
+
+	if (!buf) {
+		buf = allocIOBuffer(fcb->buf_capacity * (block_size + sizeof(block_range)));
+		if (!buf) return ERROR;
+	}
+
+	fcb->buf = buf;
+	fcb->valid = (block_range *) (buf + fcb->buf_capacity * block_size);
+	return SUCCESS;
+}
+
+/* Allocates up to num_blocks more blocks at the end of the file with
+ * allocateFileBlocks. The journal lock keeps other threads' operations, which free
+ * blocks too, out of the bitmap, the VCB and the free space index meanwhile.
+ * Returns how many blocks were allocated. */
+static uint64_t allocateBlocks(b_fcb *fcb, uint64_t num_blocks) {
+	journalLock();
+	uint64_t num_allocated = allocateFileBlocks(&fcb->extents, num_blocks);
+	journalUnlock();
+	return num_allocated;
+}
+
+/* Gives the num_blocks file blocks from first_block on that are shared with a clone
+ * blocks of their own with unshareFileBlocks. The caller must write all of them.
+ * Returns ERROR on error, or SUCCESS. */
+static int unshareBlocks(b_fcb *fcb, uint64_t first_block, uint64_t num_blocks) {
+	journalLock();
+	long long num_moved = unshareFileBlocks(&fcb->extents, first_block, num_blocks);
+	journalUnlock();
+
+	if (num_moved == ERROR) return ERROR;
+	if (num_moved > 0) fcb->blocks_moved = TRUE;
+	return SUCCESS;
+}
+
+/* Fills ios with a transfer for each run of blocks that are contiguous on disk among
+ * the num_blocks blocks of the file from file block first_block on, up to max_ios of
+ * them, which move the blocks between the disk and buffer. *num_mapped is set to how
+ * many blocks they cover. Returns how many transfers were filled, or ERROR if the file
+ * does not have the blocks. */
+static int mapRuns(b_fcb *fcb, char *buffer, uint64_t first_block, uint64_t num_blocks,
+                   int is_write, device_io *ios, int max_ios, uint64_t *num_mapped) {
+	int num_ios = 0;
+	uint64_t file_block = first_block;
+	while (file_block < first_block + num_blocks && num_ios < max_ios) {
+		uint64_t run_blocks; // blocks that are contiguous on disk from vol_block
+		uint64_t vol_block = mapFileBlock(&fcb->extents, file_block, &run_blocks);
+		if (vol_block == UNSIGNED_ERROR) {
+			printf("Error: The file does not have enough blocks. ");
+			return ERROR;
+		}
+
+		if (run_blocks > first_block + num_blocks - file_block) {
+			run_blocks = first_block + num_blocks - file_block;
+		}
+
+		ios[num_ios].buf = buffer + (file_block - first_block) * block_size;
+		ios[num_ios].lba_count = run_blocks;
+		ios[num_ios].lba_position = vol_block;
+		ios[num_ios].is_write = is_write;
+		ios[num_ios].iov = NULL;
+		ios[num_ios].iovcnt = 0;
+		num_ios++;
+
+		file_block += run_blocks;
+	}
+
+	*num_mapped = file_block - first_block;
+	return num_ios;
+}
+
+static int transferRuns(b_fcb *fcb, char *buffer, uint64_t first_block,
+                        uint64_t num_blocks, int is_write);
+
+/* Same as transferRuns, but the blocks are moved through a pooled buffer that is
+ * aligned for the device, a buffer's worth at a time, and copied to or from buffer.
+ * Returns ERROR on error, or SUCCESS otherwise. */
+static int bounceRuns(b_fcb *fcb, char *buffer, uint64_t first_block,
+                      uint64_t num_blocks, int is_write) {
+	uint64_t chunk_blocks = IO_BUFFER_BYTES / block_size;
+	char *bounce = getIOBuffer();
+	if (!bounce) return ERROR;
+
+	int result = SUCCESS;
+	while (num_blocks > 0 && result == SUCCESS) {
+		uint64_t blocks = num_blocks < chunk_blocks ? num_blocks : chunk_blocks;
+		if (is_write) memcpy(bounce, buffer, blocks * block_size);
+
+		result = transferRuns(fcb, bounce, first_block, blocks, is_write);
+		if (result == SUCCESS && !is_write) memcpy(buffer, bounce, blocks * block_size);
+
+		buffer += blocks * block_size;
+		first_block += blocks;
+		num_blocks -= blocks;
+	}
+
+	putIOBuffer(bounce);
+	return result;
+}
+
+/* Reads or writes num_blocks whole blocks of the file, starting at file block
+ * first_block, directly between the disk and buffer. The blocks are mapped through
+ * the file's extents, so each contiguous run of them takes a single read or write,
+ * and the runs of a fragmented file are queued on the device together.
+ * The fcb buffer is not looked at. Returns ERROR on error, or SUCCESS otherwise. */
+static int transferRuns(b_fcb *fcb, char *buffer, uint64_t first_block,
+                        uint64_t num_blocks, int is_write) {
+	// a buffer that O_DIRECT cannot use goes through an aligned one, so that the
+	// blocks still skip the page cache
+	uint64_t align = deviceAlignment();
+	if (align > 1 && (uintptr_t) buffer % align != 0 && block_size <= IO_BUFFER_BYTES) {
+		return bounceRuns(fcb, buffer, first_block, num_blocks, is_write);
+	}
+
+	device_io runs[TRANSFER_BATCH_RUNS];
+	while (num_blocks > 0) {
+		uint64_t num_mapped; // blocks the runs cover
+		int num_runs = mapRuns(fcb, buffer, first_block, num_blocks, is_write, runs,
+		                       TRANSFER_BATCH_RUNS, &num_mapped);
+		if (num_runs == ERROR) return ERROR;
+
+		if (customLBAbatch(runs, num_runs, "transferRuns") == ERROR) return ERROR;
+
+		buffer += num_mapped * block_size;
+		first_block += num_mapped;
+		num_blocks -= num_mapped;
+	}
+
+	return SUCCESS;
+}
+
+/* Returns TRUE if the fcb buffer holds file block file_block, FALSE otherwise. The
+ * block may be partial. */
+static int isBuffered(b_fcb *fcb, uint64_t file_block) {
+	return fcb->buf_block != NO_BUF_BLOCK && file_block >= fcb->buf_block
+	       && file_block < fcb->buf_block + fcb->buf_num_blocks;
+}
+
+/* Returns where file block file_block, which must be buffered, starts in the fcb buffer. */
+static char *getBufferedBlock(b_fcb *fcb, uint64_t file_block) {
+	return fcb->buf + (file_block - fcb->buf_block) * block_size;
+}
+
+/* Returns the valid range of file block file_block, which must be buffered. */
+static block_range *getValidRange(b_fcb *fcb, uint64_t file_block) {
+	return &fcb->valid[file_block - fcb->buf_block];
+}
+
+/* Marks the buffered file block file_block as changed. The dirty blocks are kept as
+ * one range, so any clean blocks between two changed ones are written back too. */
+static void markBufferDirty(b_fcb *fcb, uint64_t file_block) {
+	if (fcb->dirty_blocks == 0) {
+		fcb->dirty_block = file_block;
+		fcb->dirty_blocks = 1;
+		return;
+	}
+
+	uint64_t dirty_end = fcb->dirty_block + fcb->dirty_blocks;
+	if (file_block < fcb->dirty_block) fcb->dirty_block = file_block;
+	if (file_block >= dirty_end) dirty_end = file_block + 1;
+	fcb->dirty_blocks = dirty_end - fcb->dirty_block;
+}
+
+/* Reads the missing bytes of the partial buffered file block file_block from disk,
+ * keeping the bytes that were written. Returns ERROR on error, or SUCCESS otherwise. */
+static int fillPartialBlock(b_fcb *fcb, uint64_t file_block) {
+	block_range *valid = getValidRange(fcb, file_block);
+	char *block = getBufferedBlock(fcb, file_block);
+
+	uint64_t vol_block = mapFileBlock(&fcb->extents, file_block, NULL);
+	if (vol_block == UNSIGNED_ERROR) {
+		printf("Error: The file is smaller than its size says. ");
+		return ERROR;
+	}
+
+	char *disk_block = allocIOBuffer(block_size); // the block as it is on disk
+	if (!disk_block) return ERROR;
+
+	if (customLBAread(disk_block, 1, vol_block, "fillPartialBlock") == ERROR) {
+		free(disk_block);
+		disk_block = NULL;
+		return ERROR;
+	}
+
+	memcpy(block, disk_block, valid->start);
+	memcpy(block + valid->end, disk_block + valid->end, block_size - valid->end);
+
+	free(disk_block);
+	disk_block = NULL;
+
+	valid->start = 0;
+	valid->end = block_size;
+	fcb->num_partial--;
+	return SUCCESS;
+}
+
+/* Fills in every partial block in the fcb buffer, so that all of it can be read or
+ * written back. Returns ERROR on error, or SUCCESS otherwise. */
+static int fillPartialBlocks(b_fcb *fcb) {
+	for (uint64_t i = 0; fcb->num_partial > 0 && i < fcb->buf_num_blocks; i++) {
+		block_range *valid = &fcb->valid[i];
+		if (valid->start == 0 && valid->end == (int) block_size) continue;
+
+		if (fillPartialBlock(fcb, fcb->buf_block + i) == ERROR) return ERROR;
 	}
 
-	return ERROR; // all FCB elements are in use
+	return SUCCESS;
+}
+
+/* Writes the fcb buffer's changed blocks to disk, if it has any.
+ * Returns ERROR on error, or SUCCESS otherwise. */
+int flushFCBbuf(b_fcb *fcb) {
+	if (fcb->dirty_blocks == 0) return SUCCESS;
+
+	// only partial blocks are read before being written, and only now. their old
+	// contents must be read before the blocks are moved below.
+	if (fillPartialBlocks(fcb) == ERROR) return ERROR;
+
+	// blocks shared with a clone get blocks of their own before they change
+	if (unshareBlocks(fcb, fcb->dirty_block, fcb->dirty_blocks) == ERROR) {
+		return ERROR;
+	}
+
+	if (transferRuns(fcb, getBufferedBlock(fcb, fcb->dirty_block),
+	    fcb->dirty_block, fcb->dirty_blocks, TRUE) == ERROR) {
+		return ERROR;
+	}
+
+	fcb->dirty_blocks = 0;
+	return SUCCESS;
+}
+
+/* Empties the fcb buffer, writing out its changes first.
+ * Returns ERROR on error, or SUCCESS otherwise. */
+static int resetFCBbuf(b_fcb *fcb) {
+	if (flushFCBbuf(fcb) == ERROR) return ERROR;
+
+	fcb->buf_block = NO_BUF_BLOCK;
+	fcb->buf_num_blocks = 0;
+	fcb->num_partial = 0;
+	return SUCCESS;
+}
+
+/* Makes the fcb buffer hold file block file_block in full, writing out the blocks it
+ * held before if needed. If it does not hold it yet, up to num_blocks blocks from
+ * file_block on are loaded. Blocks past the end of the file's data are not read from
+ * disk, since they only hold garbage, and are zeroed instead.
+ * Returns ERROR on error, or SUCCESS otherwise. */
+int loadFCBbuf(b_fcb *fcb, uint64_t file_block, uint64_t num_blocks) {
+	if (isBuffered(fcb, file_block)) return fillPartialBlocks(fcb);
+	if (resetFCBbuf(fcb) == ERROR || getFCBbuf(fcb) == ERROR) return ERROR;
+
+	if (num_blocks > fcb->buf_capacity) num_blocks = fcb->buf_capacity;
+	if (num_blocks == 0) num_blocks = 1;
+
+	// only the blocks that hold some of the file's data are read
+	uint64_t data_blocks = (fcb->file_bytes + block_size - 1) / block_size;
+	uint64_t read_blocks = 0;
+	if (file_block < data_blocks) {
+		read_blocks = data_blocks - file_block;
+		if (read_blocks > num_blocks) read_blocks = num_blocks;
+
+		if (transferRuns(fcb, fcb->buf, file_block, read_blocks, FALSE) == ERROR) {
+			return ERROR;
+		}
+	}
+
+	memset(fcb->buf + read_blocks * block_size, 0,
+	       (num_blocks - read_blocks) * block_size);
+
+	for (uint64_t i = 0; i < num_blocks; i++) {
+		fcb->valid[i].start = 0;
+		fcb->valid[i].end = block_size;
+	}
+
+	fcb->buf_block = file_block;
+	fcb->buf_num_blocks = num_blocks;
+	return SUCCESS;
+}
+
+/* Copies bytes bytes from buffer into file block file_block at block_offset, within
+ * the one block. The block joins the fcb buffer if it is not there yet: at the end, if
+ * the buffer holds the blocks before it and has room, or else in place of what the
+ * buffer held. Nothing is read from disk unless the block was already partial and
+ * the write does not touch the bytes that were written to it before.
+ * Returns ERROR on error, or SUCCESS otherwise. */
+static int bufferWrite(b_fcb *fcb, uint64_t file_block, int block_offset, char *buffer,
+                       int bytes) {
+	if (!isBuffered(fcb, file_block)) {
+		int extends = fcb->buf_block != NO_BUF_BLOCK
+		              && file_block == fcb->buf_block + fcb->buf_num_blocks
+		              && fcb->buf_num_blocks < fcb->buf_capacity;
+		if (!extends) {
+			if (resetFCBbuf(fcb) == ERROR || getFCBbuf(fcb) == ERROR) return ERROR;
+			fcb->buf_block = file_block;
+		}
+		fcb->buf_num_blocks++;
+
+		// the bytes of the block that hold data on disk
+		uint64_t block_start = file_block * block_size;
+		uint64_t disk_bytes = 0;
+		if (fcb->file_bytes > block_start) {
+			disk_bytes = fcb->file_bytes - block_start;
+			if (disk_bytes > block_size) disk_bytes = block_size;
+		}
+
+		// a write that covers all the data on disk leaves nothing to read. the bytes
+		// past the data are zeroed, like in loadFCBbuf
+		block_range *valid = getValidRange(fcb, file_block);
+		char *block = getBufferedBlock(fcb, file_block);
+		if (block_offset == 0 && block_offset + bytes >= (int) disk_bytes) {
+			memset(block + bytes, 0, block_size - bytes);
+			valid->start = 0;
+			valid->end = block_size;
+		} else {
+			valid->start = block_offset;
+			valid->end = block_offset;
+			fcb->num_partial++;
+
+			if (block_offset + bytes >= (int) disk_bytes) { // nothing on disk after the write
+				memset(block + block_offset + bytes, 0, block_size - block_offset - bytes);
+				valid->end = block_size;
+			}
+		}
+	}
+
+	block_range *valid = getValidRange(fcb, file_block);
+	int write_end = block_offset + bytes;
+
+	// a partial block takes writes that touch the bytes written before. anything else
+	// would leave a hole in it, so the rest of it is read first.
+	if (valid->start != 0 || valid->end != (int) block_size) {
+		if (write_end < valid->start || block_offset > valid->end) {
+			if (fillPartialBlock(fcb, file_block) == ERROR) return ERROR;
+		} else {
+			if (block_offset < valid->start) valid->start = block_offset;
+			if (write_end > valid->end) valid->end = write_end;
+			if (valid->start == 0 && valid->end == (int) block_size) fcb->num_partial--;
+		}
+	}
+
+	memcpy(getBufferedBlock(fcb, file_block) + block_offset, buffer, bytes);
+	markBufferDirty(fcb, file_block);
+	return SUCCESS;
+}
+
+/* Returns how many blocks the next refill of a read loads. The window doubles with
+ * each refill of a sequential stream, up to the size of the buffer. */
+static uint64_t getReadaheadBlocks(b_fcb *fcb) {
+	uint64_t ra_blocks = fcb->ra_blocks * 2;
+	if (ra_blocks < MIN_READAHEAD_BLOCKS) ra_blocks = MIN_READAHEAD_BLOCKS;
+	if (ra_blocks > fcb->buf_capacity) ra_blocks = fcb->buf_capacity;
+
+	fcb->ra_blocks = ra_blocks;
+	return ra_blocks;
+}
+
+/* Reads or writes num_blocks whole blocks of the file, starting at file block
+ * first_block, directly between the disk and buffer, bypassing the fcb buffer.
+ * Returns ERROR on error, or SUCCESS otherwise. */
+int transferFileBlocks(b_fcb *fcb, char *buffer, uint64_t first_block,
+                       uint64_t num_blocks, int is_write) {
+	// the fcb buffer may hold some of these blocks. its changes must reach the disk
+	// before a read, and a write makes its contents stale.
+	if (fcb->buf_block != NO_BUF_BLOCK && fcb->buf_block < first_block + num_blocks
+	    && first_block < fcb->buf_block + fcb->buf_num_blocks) {
+		if (is_write) {
+			if (resetFCBbuf(fcb) == ERROR) return ERROR;
+		} else if (flushFCBbuf(fcb) == ERROR) return ERROR;
+	}
+
+	// blocks shared with a clone get blocks of their own before they change
+	if (is_write && unshareBlocks(fcb, first_block, num_blocks) == ERROR) return ERROR;
+
+	return transferRuns(fcb, buffer, first_block, num_blocks, is_write);
+}
+
+/* Copies up to count bytes of the file's data from offset on straight out of a view
+ * of the blocks they are in, when the device has one, so they are not read into a
+ * buffer first. Only the run of blocks that offset is in, and none of the blocks the
+ * fcb buffer holds from there on, are looked at. Returns how many bytes were copied,
+ * or 0 if there is no view of the blocks, so they must be read the usual way. */
+static ssize_t readFromView(b_fcb *fcb, char *buffer, ssize_t count, uint64_t offset) {
+	uint64_t file_block = offset / block_size;
+	uint64_t block_offset = offset % block_size;
+
+	uint64_t run_blocks; // blocks that are contiguous on disk from vol_block
+	uint64_t vol_block = mapFileBlock(&fcb->extents, file_block, &run_blocks);
+	if (vol_block == UNSIGNED_ERROR) return 0;
+
+	// the fcb buffer's copies of its blocks may be newer than the disk's
+	if (fcb->buf_block != NO_BUF_BLOCK && fcb->buf_block > file_block
+	    && fcb->buf_block - file_block < run_blocks) {
+		run_blocks = fcb->buf_block - file_block;
+	}
+
+	if ((uint64_t) count > run_blocks * block_size - block_offset) {
+		count = run_blocks * block_size - block_offset;
+	}
+
+	const char *view = customLBAview((block_offset + count + block_size - 1) / block_size,
+	                                 vol_block);
+	if (!view) return 0;
+
+	memcpy(buffer, view + block_offset, count);
+	customLBAunview(view);
+	return count;
 }
 
 /* Modification of interface for this assignment, flags match the Linux flags for open:
@@ -83,35 +608,35 @@ b_io_fd b_getFCB() {
 b_io_fd b_open(char *filename, int flags) {
 	if (startup == FALSE) b_init(); // initialize our system
 	
-	dir_entry *parent_dir = NULL; // holds the parent/temp directory
+	directory parent_dir; // holds the parent directory
+	int parent_dir_open = FALSE; // whether parent_dir needs to be closed
 	char *basename = NULL; // holds the name of the file
+	dir_entry entry; // the file's directory entry
 
-	char *buf[block_size]; // holds the current block's contents. used for O_APPEND
-	int buf_index; // the current position in buf
-	int buf_valid_bytes; // how many valid bytes are in the buffer
+	extent_list extents; // where the file's blocks are
+	initExtentList(&extents);
 
 	uint64_t file_offset; // where the reading/writing will start from
 	uint64_t file_bytes; // size of the file in bytes
-	uint64_t file_start_block; // start block for the file
-	uint64_t file_num_blocks; // number of blocks the file takes up
 
 	long long parent_dir_start_block; // the start block of the file's parent directory
-	int entry_index; // the directory entry index in parent_dir that refers to the file
+	long long entry_index; // the directory entry index in parent_dir that refers to the file
 	int valid_flag = FALSE; // flag for whether the required flags were entered
 	int is_new_file = FALSE; // flag for whether the file is new
 
+	// truncating a file is committed to the journal as one operation
+	journalBegin();
+
 	parent_dir_start_block = getParentBasenameStartBlock(filename);
 	if (parent_dir_start_block == ERROR) {
 		printf ("Error getting the parent's start block. ");
 		goto free_and_return_error;
 	}
 
-	// read into parent_dir
-	parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-	if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir_start_block,
-	    "b_open init parent_dir") == ERROR) {
+	if (openDirectory(parent_dir_start_block, &parent_dir) == ERROR) {
 		goto free_and_return_error;
 	}
+	parent_dir_open = TRUE;
 
 	if ((flags & O_WRONLY) || (flags & O_RDWR)) { // write mode
 		valid_flag = TRUE;
@@ -129,166 +654,62 @@ b_io_fd b_open(char *filename, int flags) {
 			goto free_and_return_error;
 		}
 
-		int file_already_exists = FALSE; // flag for if a file already exists
-
 		// searches in the parent dir and checks if a file with the same name already exists
-		entry_index = getDirEntryIndexByName(parent_dir, basename);
+		entry_index = findDirEntry(&parent_dir, basename, &entry);
 		if (entry_index == ERROR) { // error
 			printf("Error getting the directory entry index. ");
 			goto free_and_return_error;
 		} else if (entry_index != NOT_FOUND) { // file already exists
-			if (parent_dir[entry_index].type != FILE) { // can only write to files
+			if (entry.type != FILE) { // can only write to files
 				printf("You can only write to/overwrite files. ");
 				goto free_and_return_error;
 			}
 
-			file_already_exists = TRUE;
+			file_bytes = entry.size;
+			file_offset = (flags & O_APPEND) ? file_bytes : 0; // append to the end
 
-			file_bytes = parent_dir[entry_index].size;
-			file_start_block = parent_dir[entry_index].start_block;
-			file_num_blocks = ceilingDivide(file_bytes, block_size);
-		}
+			// truncate the old file and write over it
+			if (flags & O_TRUNC) {
+				// we truncate the file to be overwritten first by freeing
+				// its blocks and making its size 0
+				long long file_num_blocks = freeFileBlocks(&entry);
+				if (file_num_blocks == ERROR) goto free_and_return_error;
 
-		buf_valid_bytes = block_size;
+				entry.size = 0;
+				dentryCacheInvalidate(parent_dir_start_block, basename);
+				file_bytes = 0;
+				file_offset = 0;
 
-		// append to the end of the file
-		if (file_already_exists && (flags & O_APPEND)) {
-			if (file_bytes <= 0) { // if appending to an empty file
-				// find some free blocks for the file to be written to,
-				// since empty files are not stored on disk
-				file_start_block = getContiguousFreeBlocks(MIN_FREE_CONT_BLOCKS);
-				if (file_start_block == UNSIGNED_ERROR) {
-					printf("Not enough contiguous free blocks on disk for a new file. ");
+				// after modifying the entry, update it in disk
+				if (writeDirEntry(&parent_dir, entry_index, &entry) == ERROR) {
 					goto free_and_return_error;
 				}
 
-				buf_index = 0;
-				file_offset = 0;
-				file_bytes = 0;
-				file_num_blocks = 0;
-
-				// next time we search for free space we should try to fill in any gaps
-				// that appeared if file_num_blocks < MIN_FREE_CONT_BLOCKS
-				modStartBlockIndex(-MIN_FREE_CONT_BLOCKS);
-			} else { // appending to a non-empty file
-				uint64_t cur_block_in_vol = file_start_block + (file_bytes / block_size);
-				buf_index = file_bytes % block_size;
-				file_offset = file_bytes;
-
-				// read the last block of the file into buf, if its not empty.
-				// if we do not do this, we will write garbage data into the disk.
-				if (buf_index > 0) {
-					if (customLBAread(buf, 1, cur_block_in_vol, "b_open append") == ERROR) {
+				// only write the bitmap if the file took up space on disk
+				if (file_num_blocks > 0) {
+					// write to disk the updated vcb->num_free_blocks and bitmap
+					if (writeVCBandBitmap("b_open O_TRUNC update VCB and bitmap") == ERROR) {
 						goto free_and_return_error;
 					}
 				}
 			}
-		} // truncate the old file and write over it
-		else if (file_already_exists && (flags & O_TRUNC)) {
-			// we truncate the file to be overwritten first by making 
-			// its size and start block 0. then we free its blocks on disk.
-			parent_dir[entry_index].start_block = 0;
-			parent_dir[entry_index].size = 0;
-
-			// after modifying parent_dir, update it in disk
-			if (customLBAwrite(parent_dir, vcb->dir_blocks, parent_dir[0].start_block,
-                "b_open O_TRUNC update parent_dir") == ERROR) {
-				goto free_and_return_error;
-			}
 
-			// only modify the bitmap if the file took up space on disk
-			if (file_num_blocks > 0) {
-				for (int i = 0; i < file_num_blocks; i++) {
-					markBlockFree(bitmap, file_start_block + i);
-				}
-				vcb->num_free_blocks += file_num_blocks;
-
-				// Write vcb to disk after updating vcb->num_free_blocks.
-				if (customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK,
-				    "b_open O_TRUNC update VCB") == ERROR) {
-					goto free_and_return_error;
-				}
-
-				// write to disk the updated bitmap
-				if (customLBAwrite(bitmap, vcb->bitmap_blocks, vcb->bitmap_start_block,
-                    "b_open O_TRUNC update bitmap") == ERROR) {
-					goto free_and_return_error;
-				}
-			}
-
-			// find some free blocks for the file to be written to
-			file_start_block = getContiguousFreeBlocks(MIN_FREE_CONT_BLOCKS);
-			if (file_start_block == UNSIGNED_ERROR) {
-				printf("Not enough contiguous free blocks on disk for a new file. ");
+			if (loadExtentList(&entry.data, &extents) == ERROR) {
 				goto free_and_return_error;
 			}
-
-			buf_index = 0;
-			file_offset = 0;
-			file_bytes = 0;
-			file_num_blocks = 0;
-
-			// next time we search for free space we should try to fill in any gaps
-			// that appeared if file_num_blocks < MIN_FREE_CONT_BLOCKS
-			modStartBlockIndex(-MIN_FREE_CONT_BLOCKS);
-		} else if (file_already_exists) { // write to existing file starting at file offset 0
-			if (file_bytes <= 0) { // if writing to an empty file
-				// find some free blocks for the file to be written to,
-				// since empty files are not stored on disk
-				file_start_block = getContiguousFreeBlocks(MIN_FREE_CONT_BLOCKS);
-				if (file_start_block == UNSIGNED_ERROR) {
-					printf("Not enough contiguous free blocks on disk for a new file. ");
-					goto free_and_return_error;
-				}
-
-				buf_index = 0;
-				file_offset = 0;
-				file_bytes = 0;
-				file_num_blocks = 0;
-
-				// next time we search for free space we should try to fill in any gaps
-				// that appeared if file_num_blocks < MIN_FREE_CONT_BLOCKS
-				modStartBlockIndex(-MIN_FREE_CONT_BLOCKS);
-			} else { // if writing to a non-empty file
-				buf_index = 0;
-				file_offset = 0;
-			}
 		} else { // file does not exist. so make a new one
 			if (!(flags & O_CREAT)) {
 				printf("You cannot create a new file without O_CREAT set. ");
 				goto free_and_return_error;
 			}
 
-			// find a free directory entry in the parent directory
- 			entry_index = getDirFreeEntryIndex(parent_dir);
-			if (entry_index == ERROR) { // error
-				printf("Error getting the directory entry index. ");
-				goto free_and_return_error;
-			} else if (entry_index == NOT_FOUND) { // parent dir full
-				printf("The directory you are trying to make the new file in is full. ");
-				goto free_and_return_error;
-			}
-
-			// find some free blocks for the file to be written to
-			file_start_block = getContiguousFreeBlocks(MIN_FREE_CONT_BLOCKS);
-			if (file_start_block == UNSIGNED_ERROR) {
-				printf("Not enough contiguous free blocks on disk for a new file. ");
-				goto free_and_return_error;
-			}
-
-			buf_index = 0;
+			// the file's entry is added to the parent directory in b_close, and
+			// blocks are only allocated once the file is written to
 			file_offset = 0;
 			file_bytes = 0;
-			file_num_blocks = 0;
 			is_new_file = TRUE;
-
-			// next time we search for free space we should try to fill in any gaps
-			// that appeared if file_num_blocks < MIN_FREE_CONT_BLOCKS
-			modStartBlockIndex(-MIN_FREE_CONT_BLOCKS);
 		}
-	}
-	
-	if ((flags == O_RDONLY) || (flags & O_RDWR)) { // read mode
+	} else if (flags == O_RDONLY) { // read mode
 		valid_flag = TRUE;
 
 		// get the name of the file to be read. basename must be freed.
@@ -299,23 +720,22 @@ b_io_fd b_open(char *filename, int flags) {
 		}
 
 		// searches in the parent dir and looks for the file to read
-		entry_index = getDirEntryIndexByName(parent_dir, basename);
+		entry_index = findDirEntry(&parent_dir, basename, &entry);
 		if (entry_index == ERROR || entry_index == NOT_FOUND) {  // file not found
 			printf("The file '%s' could not be found. ", basename);
 			goto free_and_return_error;
 		}
 
-		if (parent_dir[entry_index].type != FILE) { // can only read from files
+		if (entry.type != FILE) { // can only read from files
 			printf("You can only read from files. ");
 			goto free_and_return_error;
 		}
 		
-		buf_index = 0;
-		buf_valid_bytes = 0;
 		file_offset = 0;
-		file_bytes = parent_dir[entry_index].size;
-		file_start_block = parent_dir[entry_index].start_block;
-		file_num_blocks = ceilingDivide(file_bytes, block_size);
+		file_bytes = entry.size;
+		if (loadExtentList(&entry.data, &extents) == ERROR) {
+			goto free_and_return_error;
+		}
 	}
 
 	if (!valid_flag) { // if flags do not include either read, write, or read/write
@@ -329,93 +749,233 @@ b_io_fd b_open(char *filename, int flags) {
 		goto free_and_return_error;
 	}
 
-	fcb_array[fd].buf = malloc(block_size);
-	memcpy(fcb_array[fd].buf, buf, block_size);
-	fcb_array[fd].buf_index = buf_index;
-	fcb_array[fd].buf_valid_bytes = buf_valid_bytes;
-
-	fcb_array[fd].file_offset = file_offset;
-	fcb_array[fd].file_bytes = file_bytes;
-	fcb_array[fd].file_start_block = file_start_block;
-	fcb_array[fd].file_num_blocks = file_num_blocks;
-
-	fcb_array[fd].parent_dir_start_block = parent_dir_start_block;
-	fcb_array[fd].entry_index = entry_index;
-	strcpy(fcb_array[fd].filename, basename);
-
-	fcb_array[fd].flags = flags;
-	fcb_array[fd].is_new_file = is_new_file;
-	fcb_array[fd].stop = FALSE;
-
-	free(parent_dir);
-	parent_dir = NULL;
+	// the buffer is only taken from the pool once the file is read or written
+	b_fcb *fcb = getFCB(fd);
+	fcb->buf = NULL;
+	fcb->valid = NULL;
+	fcb->buf_capacity = fcb_buf_blocks;
+	fcb->buf_block = NO_BUF_BLOCK;
+	fcb->buf_num_blocks = 0;
+	fcb->num_partial = 0;
+	fcb->dirty_blocks = 0;
+	fcb->next_read_offset = file_offset;
+	fcb->ra_blocks = 0;
+
+	fcb->file_offset = file_offset;
+	fcb->file_bytes = file_bytes;
+	fcb->extents = extents;
+	fcb->orig_num_blocks = extents.num_blocks;
+
+	fcb->parent_dir_start_block = parent_dir_start_block;
+	fcb->entry_index = entry_index;
+	strcpy(fcb->filename, basename);
+
+	fcb->flags = flags;
+	fcb->is_new_file = is_new_file;
+	fcb->blocks_moved = FALSE;
+	fcb->stop = FALSE;
+	pthread_rwlock_init(&fcb->lock, NULL);
+
+	closeDirectory(&parent_dir);
 	free(basename);
 	basename = NULL;
+	journalEnd();
 
 	return fd; // success
 
 	free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
-	free(parent_dir);
-	parent_dir = NULL;
+	if (parent_dir_open) closeDirectory(&parent_dir);
 	free(basename);
 	basename = NULL;
+	freeExtentList(&extents);
 
 	printf("File open failed.\n");
+	journalEnd();
 	return ERROR;
 }
 
-int b_seek(b_io_fd fd, off_t offset, int whence) {
+int b_preallocate(b_io_fd fd, uint64_t file_bytes) {
+	if (startup == FALSE) b_init(); // initialize our system
+
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return ERROR; // invalid file descriptor
+	else if (!fcb->in_use) { // preallocate called before open
+		printf("File not open for this descriptor. ");
+		return ERROR;
+	} else if (!((fcb->flags & O_WRONLY) || (fcb->flags & O_RDWR))) {
+		printf("The flags were not set to write mode. ");
+		return ERROR;
+	}
+
+	// b_write allocates whatever is still missing if the volume runs out
+	pthread_rwlock_wrlock(&fcb->lock);
+	uint64_t blocks_needed = (file_bytes + block_size - 1) / block_size;
+	if (blocks_needed > fcb->extents.num_blocks) {
+		allocateBlocks(fcb, blocks_needed - fcb->extents.num_blocks);
+	}
+	pthread_rwlock_unlock(&fcb->lock);
+
+	return SUCCESS;
+}
+
+long long b_copy(b_io_fd src_fd, b_io_fd dest_fd) {
 	if (startup == FALSE) b_init(); // initialize our system
 
-	if (fd < 0 || fd >= MAX_FCBS) return ERROR; // invalid file descriptor
+	b_fcb *src = getFCB(src_fd);
+	b_fcb *dest = getFCB(dest_fd);
+	if (!src || !dest || src_fd == dest_fd) {
+		return ERROR; // invalid file descriptor
+	} else if (!src->in_use || !dest->in_use) {
+		printf("File not open for this descriptor. File copy failed.\n");
+		return ERROR;
+	} else if (!((src->flags == O_RDONLY) || (src->flags & O_RDWR))
+	           || !((dest->flags & O_WRONLY) || (dest->flags & O_RDWR))) {
+		printf("The flags were not set to read and write mode. File copy failed.\n");
+		return ERROR;
+	} else if (dest->file_bytes > 0) {
+		printf("Files can only be copied into an empty file. File copy failed.\n");
+		return ERROR;
+	}
+
+	// holds two chunks of blocks on their way to the destination: the one being read,
+	// and the one read before it, which is being written
+	char *run_buf = NULL;
+	device_io *ios = NULL; // the transfers of one batch
+
+	// the locks are always taken in the same order, so two copies cannot deadlock
+	pthread_rwlock_wrlock(&(src_fd < dest_fd ? src : dest)->lock);
+	pthread_rwlock_wrlock(&(src_fd < dest_fd ? dest : src)->lock);
+
+	// the source's last changes must be on disk, since its blocks are read from there
+	if (flushFCBbuf(src) == ERROR) goto free_and_return_error;
 
-	long long file_offset = fcb_array[fd].file_offset;
+	uint64_t file_bytes = src->file_bytes;
+	uint64_t num_blocks = (file_bytes + block_size - 1) / block_size;
+
+	if (num_blocks > dest->extents.num_blocks) {
+		allocateBlocks(dest, num_blocks - dest->extents.num_blocks);
+
+		// if the volume is full, only copy what fits in the blocks we have
+		if (num_blocks > dest->extents.num_blocks) {
+			printf("Warning: The file was only partially copied, because the volume "
+			       "ran out of free blocks.\n");
+			dest->stop = TRUE;
+			num_blocks = dest->extents.num_blocks;
+			file_bytes = num_blocks * block_size;
+		}
+	}
+
+	uint64_t chunk_blocks = num_blocks < COPY_RUN_BLOCKS ? num_blocks : COPY_RUN_BLOCKS;
+	if (chunk_blocks > 0) {
+		run_buf = allocIOBuffer(2 * chunk_blocks * block_size);
+		// each chunk has at most one run per block in each file
+		ios = malloc(2 * chunk_blocks * sizeof(device_io));
+		if (!run_buf || !ios) goto free_and_return_error;
+	}
+
+	// each batch reads the next chunk of the source while it writes the chunk read by
+	// the batch before it to the destination, one transfer per run that is contiguous
+	// on disk, so the reads and writes are queued on the device together
+	uint64_t file_block = 0; // the first block of the next chunk to read
+	uint64_t write_block = 0; // the first block of the chunk to write
+	uint64_t write_blocks = 0; // how many blocks that chunk has
+	int read_half = 0; // the half of run_buf the next chunk is read into
+	while (file_block < num_blocks || write_blocks > 0) {
+		uint64_t read_blocks = num_blocks - file_block;
+		if (read_blocks > chunk_blocks) read_blocks = chunk_blocks;
+
+		uint64_t num_mapped;
+		int num_ios = 0;
+		if (read_blocks > 0) {
+			num_ios = mapRuns(src, run_buf + read_half * chunk_blocks * block_size,
+			                  file_block, read_blocks, FALSE, ios, chunk_blocks, &num_mapped);
+			if (num_ios == ERROR) goto free_and_return_error;
+		}
+		if (write_blocks > 0) {
+			int num_writes = mapRuns(dest, run_buf + !read_half * chunk_blocks * block_size,
+			                         write_block, write_blocks, TRUE, ios + num_ios,
+			                         chunk_blocks, &num_mapped);
+			if (num_writes == ERROR) goto free_and_return_error;
+			num_ios += num_writes;
+		}
+
+		if (customLBAbatch(ios, num_ios, "b_copy") == ERROR) goto free_and_return_error;
+
+		write_block = file_block;
+		write_blocks = read_blocks;
+		file_block += read_blocks;
+		read_half = !read_half;
+	}
+
+	src->file_offset = src->file_bytes;
+	dest->file_bytes = file_bytes;
+	dest->file_offset = file_bytes;
+
+	pthread_rwlock_unlock(&dest->lock);
+	pthread_rwlock_unlock(&src->lock);
+	free(run_buf);
+	run_buf = NULL;
+	free(ios);
+	ios = NULL;
+	return file_bytes; // success
+
+	free_and_return_error: // Label for error handling. Free the buffers and return ERROR.
+	dest->entry_index = ERROR; // tells b_close not to keep the copy
+	dest->stop = TRUE;
+	pthread_rwlock_unlock(&dest->lock);
+	pthread_rwlock_unlock(&src->lock);
+	free(run_buf);
+	run_buf = NULL;
+	free(ios);
+	ios = NULL;
+
+	printf("Aborting file copy.\n");
+	return ERROR;
+}
+
+off_t b_seek(b_io_fd fd, off_t offset, int whence) {
+	if (startup == FALSE) b_init(); // initialize our system
+
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return ERROR; // invalid file descriptor
+	else if (!fcb->in_use) { // seek called before open
+		printf("File not open for this descriptor. Seek failed.\n");
+		return ERROR;
+	}
+
+	pthread_rwlock_wrlock(&fcb->lock);
+	off_t file_offset; // the offset that offset is relative to
 
 	if (whence == SEEK_SET) { // the file offset is set to offset
-		file_offset = offset;
+		file_offset = 0;
 	} else if (whence == SEEK_CUR) { // the file offset is modified by offset
-		file_offset += offset;
+		file_offset = fcb->file_offset;
 	} else if (whence == SEEK_END) { // the file offset is set to the file size plus offset
-		file_offset = fcb_array[fd].file_bytes + offset;
+		file_offset = fcb->file_bytes;
 	} else { // invalid or unsupported whence directive
 		printf("An invalid or unsupported whence directive was given. ");
 		goto free_and_return_error;
 	}
 
+	if (offset > 0 && file_offset > LLONG_MAX - offset) { // overflow
+		printf("The resulting offset cannot be represented in a 64-bit integer. ");
+		goto free_and_return_error;
+	}
+
+	file_offset += offset;
 	if (file_offset < 0) {
 		printf("The resulting file offset cannot be negative. ");
 		goto free_and_return_error;
-	} // if offset is past end of volume
-	else if (fcb_array[fd].file_start_block + (file_offset / block_size) >= vcb->num_blocks) {
-		printf("The resulting file offset goes past the end of the volume. ");
-		goto free_and_return_error;
-	} else if (file_offset > INT_MAX) { // overflow
-		printf("The resulting offset cannot cannot be represented in a 32-bit integer. ");
-		goto free_and_return_error;
 	}
 
-	fcb_array[fd].file_offset = file_offset;
+	// the block at the new offset is loaded into the fcb buffer when it is needed
+	fcb->file_offset = file_offset;
 
-	// read the current block in volume into the fcb buf after seeking,
-	// if it is safe to do so
-	if (fcb_array[fd].file_offset <= fcb_array[fd].file_bytes) {
-		fcb_array[fd].buf_index = fcb_array[fd].file_offset % block_size;
+	pthread_rwlock_unlock(&fcb->lock);
+	return file_offset;
 
-		if (fcb_array[fd].buf_index > 0) { // do not read if there is nothing to read
-			uint64_t cur_vol_block = fcb_array[fd].file_start_block
-		                           + (fcb_array[fd].file_offset / block_size);
-
-			if (customLBAread(fcb_array[fd].buf, 1, cur_vol_block, "b_seek") == ERROR) {
-				goto free_and_return_error;
-			}
-
-			fcb_array[fd].buf_valid_bytes = block_size;
-		}
-	}
-
-	return file_offset; // guaranteed to fit in a 32-bit integer
-
-	free_and_return_error: // Label for error handling. Return ERROR.
+	free_and_return_error: // Label for error handling. Unlock the fcb and return ERROR.
+	pthread_rwlock_unlock(&fcb->lock);
 
 	printf("Seek failed.\n");
 	return ERROR;
@@ -440,564 +1000,610 @@ int b_seek(b_io_fd fd, off_t offset, int whence) {
  *  |             |                                                |        |
  *  | Part1       |  Part 2                                        | Part3  |
  *  +-------------+------------------------------------------------+--------+
+ *
+ * The buffer holds many blocks. b_read and b_write go through the parts in a loop,
+ * and only use part 2 for at least a buffer's worth of blocks, so that small requests
+ * go through the buffer too. Each refill for a read reads ahead, and the readahead
+ * window grows while the reads are sequential, so a file read in small pieces is
+ * still read from disk in large runs. Writes collect in the buffer until it is full
+ * or they stop being sequential, and are written back as runs. A block that is only
+ * partly written is not read from disk at all unless the rest of it holds data and
+ * is needed, i.e. it is read, or written back.
 */
 
-/* Sources: Robert Bierman's explanation of Assignment 2b. */
-int b_write(b_io_fd fd, char *buffer, int count) {
-	if (startup == FALSE) b_init(); // Initialize our system
-
-	if (fd < 0 || fd >= MAX_FCBS) return ERROR; // invalid file descriptor
-	else if (fcb_array[fd].buf == NULL) { // write called before open
-		printf("File not open for this descriptor. File write failed.\n");
-		return ERROR;
-	} else if (!((fcb_array[fd].flags & O_WRONLY) || (fcb_array[fd].flags & O_RDWR))) {
-		printf("The flags were not set to write mode. File write failed.\n");
-		return ERROR;
-	} else if (count < 0) { // error with read. do not write anything
-		printf("Could not read from the file. ");
-		fcb_array[fd].entry_index = ERROR; // tells b_close not to make a new file
-		fcb_array[fd].stop = TRUE;
-		return ERROR;
-	} else if (count == 0) return 0; // no bytes to write
-	// end of free space for the file or an error occurred. do not write any more
-	else if (fcb_array[fd].stop) {
+/* Writes count bytes from buffer to the file at offset, which is at most the file's
+ * size, allocating blocks as needed. The caller holds the fcb's lock for writing.
+ * Returns how many bytes were written, which is less than count only if the volume
+ * ran out of free blocks, or ERROR on error. */
+static ssize_t writeAt(b_fcb *fcb, char *buffer, ssize_t count, uint64_t offset) {
+	// out of free space or an error occurred. do not write any more
+	if (fcb->stop) {
 		printf("Warning: The file was only partially written to disk. This happened "
-		       "either because the next contiguous block was marked as used, "
+		       "either because the volume ran out of free blocks, "
 			   "or an error has occurred.\n");
 		return 0;
 	}
 
-	// repositions the file pointer if it exceeded the size of the file due to a seek.
-	// recalculate the fcb buf index and load in the file's last block into the fcb buf
-	if (fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-		fcb_array[fd].file_offset = fcb_array[fd].file_bytes;
-		fcb_array[fd].buf_index = fcb_array[fd].file_offset % block_size;
+	// make sure the file has blocks for everything being written. blocks are allocated
+	// a few at a time ahead of the file, so a file written in small pieces still ends
+	// up in a few large extents. any that go unused are freed in b_close.
+	uint64_t blocks_needed = ceilingDivide(offset + count, block_size);
+	if (blocks_needed > fcb->extents.num_blocks) {
+		uint64_t blocks_wanted = blocks_needed - fcb->extents.num_blocks;
+		if (blocks_wanted < PREALLOC_BLOCKS) blocks_wanted = PREALLOC_BLOCKS;
+
+		allocateBlocks(fcb, blocks_wanted);
+
+		// if the volume is full, only write what fits in the blocks we have
+		if (blocks_needed > fcb->extents.num_blocks) {
+			fcb->stop = TRUE;
+			uint64_t room = fcb->extents.num_blocks * block_size; // bytes the blocks hold
+			if (room <= offset) return 0;
+			count = room - offset;
+		}
+	}
+
+	ssize_t written = 0; // bytes taken from the caller's buffer so far
+	while (written < count) {
+		uint64_t file_block = offset / block_size;
+		int block_offset = offset % block_size;
+		ssize_t bytes; // bytes written by this pass
+
+		if (block_offset == 0 && (count - written) / block_size >= fcb->buf_capacity) {
+			// part 2: a buffer's worth or more of whole blocks goes directly to disk
+			uint64_t num_blocks_to_copy = (count - written) / block_size;
+			if (transferFileBlocks(fcb, buffer + written, file_block, num_blocks_to_copy,
+			    TRUE) == ERROR) {
+				goto free_and_return_error;
+			}
 
-		if (fcb_array[fd].buf_index > 0) { // do not read if there is nothing to read
-			uint64_t cur_vol_block = fcb_array[fd].file_start_block
-		                           + (fcb_array[fd].file_offset / block_size);
+			bytes = num_blocks_to_copy * block_size;
+		} else { // parts 1 and 3: up to one block at a time goes into the buffer
+			bytes = block_size - block_offset;
+			if (bytes > count - written) bytes = count - written;
 
-			if (customLBAread(fcb_array[fd].buf, 1, cur_vol_block,
-			    "b_write reposition offset") == ERROR) {
+			if (bufferWrite(fcb, file_block, block_offset, buffer + written, bytes) == ERROR) {
 				goto free_and_return_error;
 			}
 		}
-	}
 
-	int bytes_transferred = 0; // bytes transferred to the fcb buffer
-	int part1, part2, part3; // the three potential copy lengths, in bytes
-	int num_blocks_to_copy; // how many blocks to copy in part2
+		written += bytes;
+		offset += bytes;
 
-	// free bytes left in the fcb buffer
-	int fcb_buf_rem_bytes = block_size - fcb_array[fd].buf_index;
+		// bufferWrite goes by the file's size to tell which bytes of a block are on disk
+		if (offset > fcb->file_bytes) fcb->file_bytes = offset;
+	}
 
-	// the current block in the volume we are writing to
-	uint64_t cur_vol_block = fcb_array[fd].file_start_block
-	                       + (fcb_array[fd].file_offset / block_size);
+	return written; // success
 
-	uint64_t file_end_block; // the last block of the file
-	if (fcb_array[fd].file_num_blocks > 0) {
-		file_end_block = fcb_array[fd].file_start_block + fcb_array[fd].file_num_blocks - 1;
-	} else file_end_block = fcb_array[fd].file_start_block;
+	free_and_return_error: // Label for error handling. Set stop to TRUE and return ERROR.
+	fcb->stop = TRUE; // stop any further writes
 
-	// handle the case where file_offset is a multiple of block_size. cur_vol_block can
-	// be greater than file_end_block, and if cur_vol_block is used by some other file,
-	// we should not write anything to cur_vol_block. therefore we abort and return 0.
-	if ((cur_vol_block > file_end_block) && (getBlockStatus(bitmap, cur_vol_block) == USED)) {
-		// mark the buffer as empty if it was not empty already to stop
-		// b_close from writing cur_vol_block to disk
-		fcb_array[fd].buf_index = 0;
-		fcb_array[fd].stop = TRUE;
-		return 0;
-	} // if the next block after the file's end block is used,
-	// we should check that count does not result in us
-	// writing into the next block. if it does, set the stop flag.
-	else if ((cur_vol_block == file_end_block)
-	    && (getBlockStatus(bitmap, file_end_block + 1) == USED)
-	    && (count > fcb_buf_rem_bytes)) {
-		fcb_array[fd].stop = TRUE;
-	}
-
-	// fill up the fcb buffer to its capacity and write it to disk.
-	// since count > fcb_buf_rem_bytes, the caller's buffer will have enough data to copy.
-	// Return bytes_transferred and stop any further writes because the next block is used
-	if (fcb_array[fd].stop) {
-		memcpy(fcb_array[fd].buf + fcb_array[fd].buf_index, buffer, fcb_buf_rem_bytes);
-		fcb_array[fd].buf_index += fcb_buf_rem_bytes;
-		bytes_transferred += fcb_buf_rem_bytes;
-		
-		if (customLBAwrite(fcb_array[fd].buf, 1, cur_vol_block,
-		    "b_write stop flag") == ERROR) {
-			goto free_and_return_error;
-		}
+	printf("Aborting file write.\n");
+	return ERROR;
+}
 
-		fcb_array[fd].file_offset += block_size;
-		cur_vol_block = fcb_array[fd].file_start_block
-	                  + (fcb_array[fd].file_offset / block_size);
-		fcb_array[fd].buf_index = 0;
+/* Sources: Robert Bierman's explanation of Assignment 2b. */
+ssize_t b_write(b_io_fd fd, char *buffer, ssize_t count) {
+	if (startup == FALSE) b_init(); // Initialize our system
 
-		// if we wrote past the size of the file, we update our file size accordingly
-		if (fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-			fcb_array[fd].file_bytes = fcb_array[fd].file_offset;
-		}
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return ERROR; // invalid file descriptor
+	else if (!fcb->in_use) { // write called before open
+		printf("File not open for this descriptor. File write failed.\n");
+		return ERROR;
+	} else if (!((fcb->flags & O_WRONLY) || (fcb->flags & O_RDWR))) {
+		printf("The flags were not set to write mode. File write failed.\n");
+		return ERROR;
+	} else if (count == 0) return 0; // no bytes to write
 
-		// check if we filled up a free block. if we did, increase our file block count
-		if ((cur_vol_block > file_end_block)
-		    && (getBlockStatus(bitmap, cur_vol_block - 1) == FREE)) {
-			fcb_array[fd].file_num_blocks++;
-			file_end_block++;
-		}
+	pthread_rwlock_wrlock(&fcb->lock);
 
-		return bytes_transferred;
+	if (count < 0) { // error with read. do not write anything
+		printf("Could not read from the file. ");
+		fcb->entry_index = ERROR; // tells b_close not to make a new file
+		fcb->stop = TRUE;
+		pthread_rwlock_unlock(&fcb->lock);
+		return ERROR;
 	}
 
-	if (count <= fcb_buf_rem_bytes) { // fcb buffer can fit count
-		part1 = count;
-		part2 = 0;
-		part3 = 0;
-	} else { // fcb buffer cannot fit count
-		part1 = fcb_buf_rem_bytes;
-		part3 = count - fcb_buf_rem_bytes;
-
-		num_blocks_to_copy = part3 / block_size;
-		part2 = num_blocks_to_copy * block_size; // bytes directly writable
-		part3 -= part2; // part3 % block_size, the residue after part2
+	// repositions the file pointer if it exceeded the size of the file due to a seek
+	if (fcb->file_offset > fcb->file_bytes) {
+		fcb->file_offset = fcb->file_bytes;
 	}
 
-	if (part1 > 0) {
-		memcpy(fcb_array[fd].buf + fcb_array[fd].buf_index, buffer, part1);
-		fcb_array[fd].buf_index += part1;
-		bytes_transferred += part1;
-	}
+	ssize_t written = writeAt(fcb, buffer, count, fcb->file_offset);
+	if (written > 0) fcb->file_offset += written;
 
-	// fcb buffer completely full upon entering part 2
-	if (part2 > 0) {
-		// write the full buffer after part 1
-		if (customLBAwrite(fcb_array[fd].buf, 1, cur_vol_block,
-			"b_write in part 2, from part 1's buffer") == ERROR) {
-			goto free_and_return_error;
-		}
+	pthread_rwlock_unlock(&fcb->lock);
+	return written;
+}
 
-		fcb_array[fd].file_offset += block_size;
-		cur_vol_block = fcb_array[fd].file_start_block
-	                  + (fcb_array[fd].file_offset / block_size);
-		fcb_array[fd].buf_index = 0;
-		
-		if (fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-			fcb_array[fd].file_bytes = fcb_array[fd].file_offset;
-		}
+ssize_t b_pwrite(b_io_fd fd, char *buffer, ssize_t count, off_t offset) {
+	if (startup == FALSE) b_init(); // Initialize our system
 
-		if ((cur_vol_block > file_end_block)
-		    && (getBlockStatus(bitmap, cur_vol_block - 1) == FREE)) {
-			fcb_array[fd].file_num_blocks++;
-			file_end_block++;
-		}
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return ERROR; // invalid file descriptor
+	else if (!fcb->in_use) { // write called before open
+		printf("File not open for this descriptor. File write failed.\n");
+		return ERROR;
+	} else if (!((fcb->flags & O_WRONLY) || (fcb->flags & O_RDWR))) {
+		printf("The flags were not set to write mode. File write failed.\n");
+		return ERROR;
+	} else if (count < 0 || offset < 0) {
+		printf("The count and offset cannot be negative. File write failed.\n");
+		return ERROR;
+	} else if (count == 0) return 0; // no bytes to write
 
-		int temp_part2 = 0;
-		for (int i = 0; i < num_blocks_to_copy; i++) {
-			// if this block is used by some other file, stop writing
-			if ((cur_vol_block > file_end_block)
-			    && (getBlockStatus(bitmap, cur_vol_block) == USED)) {
-				fcb_array[fd].buf_index = 0;
-				fcb_array[fd].stop = TRUE;
-				return bytes_transferred;
-			}
+	pthread_rwlock_wrlock(&fcb->lock);
 
-			if (customLBAwrite(buffer + part1 + temp_part2, 1, cur_vol_block,
-			    "b_write part 2, direct writes") == ERROR) {
-				goto free_and_return_error;
-			}
-			
-			fcb_array[fd].file_offset += block_size;
-			cur_vol_block = fcb_array[fd].file_start_block
-	                      + (fcb_array[fd].file_offset / block_size);
+	// files cannot have holes, so a write can start at the end of the file at most
+	ssize_t written;
+	if ((uint64_t) offset > fcb->file_bytes) {
+		printf("The offset is past the end of the file. File write failed.\n");
+		written = ERROR;
+	} else written = writeAt(fcb, buffer, count, offset);
 
-			if (fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-				fcb_array[fd].file_bytes = fcb_array[fd].file_offset;
-			}
+	pthread_rwlock_unlock(&fcb->lock);
+	return written;
+}
 
-			if ((cur_vol_block > file_end_block)
-		    	&& (getBlockStatus(bitmap, cur_vol_block - 1) == FREE)) {
-				fcb_array[fd].file_num_blocks++;
-				file_end_block++;
-			}
+/* Reads up to count bytes at the file offset through the fcb buffer, and moves the
+ * offset past them. The caller holds the fcb's lock for writing.
+ * Returns how many bytes were read, or ERROR on error. */
+static ssize_t readBuffered(b_fcb *fcb, char *buffer, ssize_t count) {
+	// if the file offset is at end of file, there is nothing to read
+	if (fcb->file_offset >= fcb->file_bytes) return 0;
+	else if (fcb->stop) return 0; // an error occurred. stop reading
 
-			bytes_transferred += block_size;
-			temp_part2 += block_size;
-		}
+	// trims down count such that it will not read past the end of the file
+	if ((uint64_t) count > fcb->file_bytes - fcb->file_offset) {
+		count = fcb->file_bytes - fcb->file_offset;
+	}
 
-		part2 = temp_part2;
+	// a read that does not pick up where the last one ended starts a new stream
+	if (fcb->file_offset != fcb->next_read_offset) {
+		fcb->ra_blocks = 0;
 	}
 
-	// part3 will be less than block_size
-	if (part3 > 0) {
-		// if part2 > 0, the fcb buffer will be empty.
-		// otherwise, the fcb buffer will be full coming in.
-		if (part2 <= 0) {
-			if (customLBAwrite(fcb_array[fd].buf, 1, cur_vol_block,
-			    "b_write part3 where part2 <= 0") == ERROR) {
+	ssize_t copied = 0; // bytes copied to the caller's buffer so far
+	while (copied < count) {
+		uint64_t file_block = fcb->file_offset / block_size;
+		int block_offset = fcb->file_offset % block_size;
+		ssize_t bytes; // bytes copied by this pass
+
+		if (isBuffered(fcb, file_block)) { // part 1: fill from the buffer
+			if (fillPartialBlocks(fcb) == ERROR) goto free_and_return_error;
+
+			uint64_t buf_end = (fcb->buf_block + fcb->buf_num_blocks)
+			                   * block_size;
+			bytes = (buf_end - fcb->file_offset < (uint64_t) (count - copied))
+			        ? (ssize_t) (buf_end - fcb->file_offset) : count - copied;
+
+			memcpy(buffer + copied, getBufferedBlock(fcb, file_block) + block_offset, bytes);
+		} else if (block_offset == 0
+		           && (count - copied) / block_size >= fcb->buf_capacity) {
+			// part 2: a buffer's worth or more of whole blocks goes directly to the caller
+			uint64_t num_blocks_to_copy = (count - copied) / block_size;
+			if (transferFileBlocks(fcb, buffer + copied, file_block, num_blocks_to_copy,
+			    FALSE) == ERROR) {
 				goto free_and_return_error;
 			}
-			
-			fcb_array[fd].file_offset += block_size;
-			cur_vol_block = fcb_array[fd].file_start_block
-	        	          + (fcb_array[fd].file_offset / block_size);
-			fcb_array[fd].buf_index = 0;
-
-			if (fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-				fcb_array[fd].file_bytes = fcb_array[fd].file_offset;
-			}
 
-			if ((cur_vol_block > file_end_block)
-			    && (getBlockStatus(bitmap, cur_vol_block - 1) == FREE)) {
-				fcb_array[fd].file_num_blocks++;
-				file_end_block++;
+			bytes = num_blocks_to_copy * block_size;
+		} else {
+			// part 3: blocks the device keeps in memory are copied straight from there
+			bytes = readFromView(fcb, buffer + copied, count - copied, fcb->file_offset);
+
+			// part 4: otherwise refill the buffer, reading ahead, and fill from it next pass
+			if (bytes == 0) {
+				if (loadFCBbuf(fcb, file_block, getReadaheadBlocks(fcb)) == ERROR) {
+					goto free_and_return_error;
+				}
+
+				continue;
 			}
 		}
-		
-		// no guarantees that cur_vol_block is not used by some other file
-		if ((cur_vol_block > file_end_block)
-			&& (getBlockStatus(bitmap, cur_vol_block) == USED)) {
-			fcb_array[fd].buf_index = 0;
-			fcb_array[fd].stop = TRUE;
-			return bytes_transferred;
-		}
 
-		// at this point, the fcb buffer is empty
-		memcpy(fcb_array[fd].buf + fcb_array[fd].buf_index, buffer + part1 + part2, part3);
-		fcb_array[fd].buf_index += part3;
-		bytes_transferred += part3;
+		copied += bytes;
+		fcb->file_offset += bytes;
 	}
 
-	return bytes_transferred; // success
+	fcb->next_read_offset = fcb->file_offset;
+	return copied; // success
 
 	free_and_return_error: // Label for error handling. Set stop to TRUE and return ERROR.
-	fcb_array[fd].stop = TRUE; // stop any further writes
+	fcb->stop = TRUE; // stop any further reads
 
-	printf("Aborting file write.\n");
+	printf("Aborting file read.\n");
 	return ERROR;
 }
 
 /* Sources: Robert Bierman's explanation of Assignment 2b */
-int b_read(b_io_fd fd, char *buffer, int count) {
+ssize_t b_read(b_io_fd fd, char *buffer, ssize_t count) {
 	if (startup == FALSE) b_init(); // Initialize our system
 
-	if (fd < 0 || fd >= MAX_FCBS) return ERROR; // if invalid file descriptor
-	else if (fcb_array[fd].buf == NULL) { // read called before open
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return ERROR; // if invalid file descriptor
+	else if (!fcb->in_use) { // read called before open
 		printf("File not open for this descriptor. File read failed.\n");
 		return ERROR;
 	} // check if the read flag is on
-	else if (!((fcb_array[fd].flags == O_RDONLY) || (fcb_array[fd].flags & O_RDWR))) {
+	else if (!((fcb->flags == O_RDONLY) || (fcb->flags & O_RDWR))) {
 		printf("The flags were not set to read mode. File read failed.\n");
 		return ERROR;
 	} else if (count <= 0) return 0; // if no bytes to read
-	// if the file offset is at end of file, there is nothing to read
-	else if (fcb_array[fd].file_offset >= fcb_array[fd].file_bytes) return 0;
-	else if (fcb_array[fd].stop) return 0; // end of file or an error occurred. stop reading
-
-	int part1, part2, part3; // the three potential copy lengths, in bytes
-	int num_blocks_to_copy; // how many blocks to copy in part 2
-
-	// bytes available to copy from fcb buffer
-	int fcb_buf_rem_bytes = fcb_array[fd].buf_valid_bytes - fcb_array[fd].buf_index;
-	// the current block in the volume we are reading from
-	uint64_t cur_vol_block = fcb_array[fd].file_start_block
-	                       + (fcb_array[fd].file_offset / block_size);
-
-	// trims down count such that it will not read past the end of the file.
-	// if the trim occurs, set the stop flag so we do not read past the end of file.
-	// setting the stop flag is not necessary, it is just an extra safety measure
-	if (count + fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-		fcb_array[fd].stop = TRUE;
-		count = fcb_array[fd].file_bytes - fcb_array[fd].file_offset;
-	}
-
-	if (count <= fcb_buf_rem_bytes) { // if we can fill directly from fcb's buffer
-		part1 = count;
-		part2 = 0;
-		part3 = 0;
-	} else { // if the caller needs more bytes than what was in the fcb buffer
-		part1 = fcb_buf_rem_bytes;
-		part3 = count - fcb_buf_rem_bytes;
-
-		num_blocks_to_copy = part3 / block_size;
-		part2 = num_blocks_to_copy * block_size; // bytes directly readable
-		part3 -= part2; // part3 % block_size, the residue after part2
-	}
-
-	if (part1 > 0) {
-		memcpy(buffer, fcb_array[fd].buf + fcb_array[fd].buf_index, part1);
-		fcb_array[fd].buf_index += part1;
-		fcb_array[fd].file_offset += part1;
-		cur_vol_block = fcb_array[fd].file_start_block
-	                  + (fcb_array[fd].file_offset / block_size);
-	}
-
-	// fcb buffer completely copied upon entering part 2
-	if (part2 > 0) {
-		// directly copy num_blocks_to_copy to the caller's buffer
-		if (customLBAread(buffer + part1, num_blocks_to_copy, cur_vol_block,
-		    "b_read part2") == ERROR) {
-			goto free_and_return_error;
-		}
 
-		fcb_array[fd].file_offset += num_blocks_to_copy * block_size;
-		cur_vol_block = fcb_array[fd].file_start_block
-	                  + (fcb_array[fd].file_offset / block_size);
-	}
+	pthread_rwlock_wrlock(&fcb->lock);
+	ssize_t copied = readBuffered(fcb, buffer, count);
+	pthread_rwlock_unlock(&fcb->lock);
+	return copied;
+}
 
-	// fcb buffer empty or completely copied upon entering part 3.
-	// part3 will be less than block_size
-	if (part3 > 0) {
-		// caller still needs more bytes, so we refill the fcb buffer
-		if (customLBAread(fcb_array[fd].buf, 1, cur_vol_block,
-		    "b_read part3") == ERROR) {
-			goto free_and_return_error;
-		}
+/* Returns TRUE if the fcb buffer has changes to any of the blocks that count bytes
+ * from offset on are in, FALSE otherwise. */
+static int isRangeDirty(b_fcb *fcb, uint64_t offset, ssize_t count) {
+	if (fcb->dirty_blocks == 0) return FALSE;
 
-		fcb_array[fd].buf_index = 0;
-		fcb_array[fd].buf_valid_bytes = block_size;
+	uint64_t first_block = offset / block_size;
+	uint64_t last_block = (offset + count - 1) / block_size;
+	return first_block < fcb->dirty_block + fcb->dirty_blocks
+	       && last_block >= fcb->dirty_block;
+}
+
+/* Reads up to count bytes at offset straight from disk, without touching the fcb's
+ * buffer or offset, so that many threads can do it at once. Whole blocks go directly
+ * into buffer, and the blocks at either end, which are only partly read, go through a
+ * block of their own. The caller holds the fcb's lock for reading, and the buffer has
+ * no changes in the range. Returns how many bytes were read, or ERROR on error. */
+static ssize_t readDirect(b_fcb *fcb, char *buffer, ssize_t count, uint64_t offset) {
+	if (offset >= fcb->file_bytes || fcb->stop) return 0;
+
+	// trims down count such that it will not read past the end of the file
+	if ((uint64_t) count > fcb->file_bytes - offset) count = fcb->file_bytes - offset;
+
+	char *edge_block = NULL; // holds a block that is only partly read
+	ssize_t copied = 0; // bytes copied to the caller's buffer so far
+	while (copied < count) {
+		uint64_t file_block = offset / block_size;
+		int block_offset = offset % block_size;
+		ssize_t bytes; // bytes copied by this pass
+
+		if (block_offset == 0 && (uint64_t) (count - copied) >= block_size) {
+			uint64_t num_blocks_to_copy = (count - copied) / block_size;
+			if (transferRuns(fcb, buffer + copied, file_block, num_blocks_to_copy,
+			    FALSE) == ERROR) {
+				goto free_and_return_error;
+			}
+
+			bytes = num_blocks_to_copy * block_size;
+		} else {
+			bytes = block_size - block_offset;
+			if (bytes > count - copied) bytes = count - copied;
+
+			// the block is copied out of a view of it, or else read whole first
+			if (readFromView(fcb, buffer + copied, bytes, offset) == 0) {
+				if (!edge_block) {
+					edge_block = allocIOBuffer(block_size);
+					if (!edge_block) goto free_and_return_error;
+				}
+
+				if (transferRuns(fcb, edge_block, file_block, 1, FALSE) == ERROR) {
+					goto free_and_return_error;
+				}
+
+				memcpy(buffer + copied, edge_block + block_offset, bytes);
+			}
+		}
 
-		// fcb buffer has content so we copy some to the caller's buffer
-		memcpy(buffer + part1 + part2, fcb_array[fd].buf + fcb_array[fd].buf_index, part3);
-		fcb_array[fd].buf_index += part3;
-		fcb_array[fd].file_offset += part3;
-		cur_vol_block = fcb_array[fd].file_start_block
-	                  + (fcb_array[fd].file_offset / block_size);
+		copied += bytes;
+		offset += bytes;
 	}
 
-	return part1 + part2 + part3; // success
+	free(edge_block);
+	edge_block = NULL;
+	return copied; // success
 
-	free_and_return_error: // Label for error handling. Set stop to TRUE and return ERROR.
-	fcb_array[fd].stop = TRUE; // stop any further reads
+	free_and_return_error: // Label for error handling. Free the block and return ERROR.
+	free(edge_block);
+	edge_block = NULL;
 
 	printf("Aborting file read.\n");
 	return ERROR;
 }
 
-void b_close(b_io_fd fd) {
-	if (startup == FALSE) { // FCB not initialized
-		printf("Error: Close called before the file control block was initialized. "
-		       "File close failed.\n");
-		return;
-	} else if (fd < 0 || fd >= MAX_FCBS) return; // invalid file descriptor
-	else if (fcb_array[fd].buf == NULL) { // close called before open
-		printf("File not open for this descriptor. File close failed.\n");
-		return;
+ssize_t b_pread(b_io_fd fd, char *buffer, ssize_t count, off_t offset) {
+	if (startup == FALSE) b_init(); // Initialize our system
+
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return ERROR; // if invalid file descriptor
+	else if (!fcb->in_use) { // read called before open
+		printf("File not open for this descriptor. File read failed.\n");
+		return ERROR;
+	} // check if the read flag is on
+	else if (!((fcb->flags == O_RDONLY) || (fcb->flags & O_RDWR))) {
+		printf("The flags were not set to read mode. File read failed.\n");
+		return ERROR;
+	} else if (offset < 0) {
+		printf("The offset cannot be negative. File read failed.\n");
+		return ERROR;
+	} else if (count <= 0) return 0; // if no bytes to read
+
+	pthread_rwlock_rdlock(&fcb->lock);
+
+	// changes to the range that are still in the buffer must reach the disk first.
+	// that changes the fcb, so it is done with the lock held for writing.
+	while (isRangeDirty(fcb, offset, count)) {
+		pthread_rwlock_unlock(&fcb->lock);
+		pthread_rwlock_wrlock(&fcb->lock);
+		int result = flushFCBbuf(fcb);
+		if (result == ERROR) fcb->stop = TRUE;
+		pthread_rwlock_unlock(&fcb->lock);
+
+		if (result == ERROR) {
+			printf("Aborting file read.\n");
+			return ERROR;
+		}
+		pthread_rwlock_rdlock(&fcb->lock);
 	}
 
-	dir_entry *parent_dir = NULL; // parent_dir of file
+	ssize_t copied = readDirect(fcb, buffer, count, offset);
 
-	if ((fcb_array[fd].flags & O_WRONLY) || (fcb_array[fd].flags & O_RDWR)) { // write mode
-		// if an error occurred when reading the file, do not write anything
-		if (fcb_array[fd].entry_index == ERROR) {
-			if (fcb_array[fd].is_new_file) printf("No files were created.\n");
-			else printf("No files were modified.\n");
+	pthread_rwlock_unlock(&fcb->lock);
+	return copied;
+}
 
-			free(fcb_array[fd].buf);
-			fcb_array[fd].buf = NULL;
-			return;
-		} else if (fcb_array[fd].buf_index > 0) { // if buffer has content in it
-			uint64_t file_end_block; // the last block of the file
-			if (fcb_array[fd].file_num_blocks > 0) {
-				file_end_block = fcb_array[fd].file_start_block
-				               + fcb_array[fd].file_num_blocks - 1;
-			} else file_end_block = fcb_array[fd].file_start_block;
-
-			// cur_vol_block is guaranteed to not overwrite another file's block in this case
-			uint64_t cur_vol_block = fcb_array[fd].file_start_block
-	                               + (fcb_array[fd].file_offset / block_size);
-
-			// if the file pointer points to a new block, then we write the buffer's
-			// contents to a new block on disk, at cur_vol_block
-			if (cur_vol_block > file_end_block) {
-				if (customLBAwrite(fcb_array[fd].buf, 1, cur_vol_block,
-			    	"b_close write") == ERROR) {
-					goto free_and_print_error;
-				}
+/* Writes the file's size, extents and dates into its entry in parent_dir. A new
+ * file's entry is added to parent_dir, and from then on the file is not new.
+ * Returns ERROR on error, or SUCCESS. */
+static int storeFileEntry(b_fcb *fcb, directory *parent_dir) {
+	dir_entry entry; // the file's directory entry
 
-				fcb_array[fd].file_offset += fcb_array[fd].buf_index;
-				cur_vol_block = fcb_array[fd].file_start_block
-	                          + (fcb_array[fd].file_offset / block_size);
-		        fcb_array[fd].buf_index = 0;
+	if (fcb->is_new_file) {
+		// a new file has no entry yet, so it has no extent blocks to free
+		clearDirEntry(&entry);
 
-				if (fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-					fcb_array[fd].file_bytes = fcb_array[fd].file_offset;
-				}
+		if (findDirEntry(parent_dir, fcb->filename, NULL) != NOT_FOUND) {
+			printf("Error: '%s' already exists. ", fcb->filename);
+			return ERROR;
+		}
+	} else if (readDirEntry(parent_dir, fcb->entry_index, &entry) == ERROR) {
+		return ERROR;
+	}
 
-				fcb_array[fd].file_num_blocks++;
-				file_end_block++;
-			} // current vol block already has some of the file's contents.
-			// should only overwrite what is needed and not add garbage to the file,
-			// thus we need to read from disk to save the data we need to keep.
-			//
-			// or, this is the first block of a new file. its fine to read
-			// from disk first since we were writing there anyway.
-			else {
-				char *buf[block_size];
-				if (customLBAread(buf, 1, cur_vol_block, "b_close buf") == ERROR) {
-					goto free_and_print_error;
-				}
+	// update the entry's extents
+	if (storeExtentList(&entry.data, &fcb->extents) == ERROR) return ERROR;
+
+	// point the entry's start block at the file's first extent, or at 0 if empty
+	if (fcb->extents.num_extents > 0) {
+		entry.start_block = fcb->extents.extents[0].start_block;
+	} else entry.start_block = 0;
+
+	time_t curr_time = time(NULL);
+	strcpy(entry.name, fcb->filename);
+	entry.size = fcb->file_bytes;
+	entry.type = FILE;
+	dentryCacheInvalidate(fcb->parent_dir_start_block, fcb->filename);
+
+	if (fcb->is_new_file) entry.creation_date = curr_time;
+	entry.last_modified = curr_time;
+	entry.last_opened = curr_time;
+
+	// write the entry into parent_dir. a new file's entry is added to it, which also
+	// updates the parent's last modified date
+	if (fcb->is_new_file) {
+		long long slot = addDirEntry(parent_dir, &entry);
+		if (slot == ERROR) return ERROR;
+		if (touchDirectory(parent_dir, curr_time) == ERROR) return ERROR;
+
+		fcb->entry_index = slot;
+		fcb->is_new_file = FALSE;
+	} else if (writeDirEntry(parent_dir, fcb->entry_index, &entry) == ERROR) {
+		return ERROR;
+	}
 
-				// where we start overwriting in the block
-				int start = fcb_array[fd].file_offset % block_size;
-				int end = fcb_array[fd].buf_index; // where we stop overwriting in the block
+	return SUCCESS;
+}
 
-				memcpy(buf + start, fcb_array[fd].buf + start, end - start);
-				
-				// write the updated buf to disk
-				if (customLBAwrite(buf, 1, cur_vol_block, "b_close buffered write") == ERROR) {
-					goto free_and_print_error;
-				}
+int b_fsync(b_io_fd fd) {
+	if (startup == FALSE) { // FCB not initialized
+		printf("Error: Fsync called before the file control block was initialized. "
+		       "File sync failed.\n");
+		return ERROR;
+	}
 
-				fcb_array[fd].file_offset += end - start;
-				cur_vol_block = fcb_array[fd].file_start_block
-	                          + (fcb_array[fd].file_offset / block_size);
-		        fcb_array[fd].buf_index = 0;
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return ERROR; // invalid file descriptor
+	else if (!fcb->in_use) { // fsync called before open
+		printf("File not open for this descriptor. File sync failed.\n");
+		return ERROR;
+	}
 
-				if (fcb_array[fd].file_offset > fcb_array[fd].file_bytes) {
-					fcb_array[fd].file_bytes = fcb_array[fd].file_offset;
-				}
+	int is_write_mode = (fcb->flags & O_WRONLY) || (fcb->flags & O_RDWR);
+	if (!is_write_mode || fcb->entry_index == ERROR) return syncFileSystem();
 
-				// if we wrote to a free block, we increase our file's block count
-				if (getBlockStatus(bitmap, cur_vol_block) == FREE) {
-					fcb_array[fd].file_num_blocks++;
-				}
-			}
-		}
+	pthread_rwlock_wrlock(&fcb->lock);
 
-		// buffer is empty now; all data written to disk. load up parent_dir
-		parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-		if (customLBAread(parent_dir, vcb->dir_blocks, fcb_array[fd].parent_dir_start_block,
-		    "b_close write mode parent_dir") == ERROR) {
-			goto free_and_print_error;
-		}
+	// like b_close, the data goes to disk before the transaction that points the
+	// file's entry at it. blocks allocated past the end of the file are kept in the
+	// entry, since the file may still grow into them
+	if (flushFCBbuf(fcb) == ERROR) goto unlock_and_print_error;
 
-		// used for determining if any new blocks were used in a write.
-		// can contain garbage, so this value is only used for checking if an existing
-		// file was modified.
-		uint64_t previous_size = parent_dir[fcb_array[fd].entry_index].size;
+	journalBegin();
+	directory parent_dir; // parent directory of the file
+	if (openDirectory(fcb->parent_dir_start_block, &parent_dir) == ERROR) {
+		journalEnd();
+		goto unlock_and_print_error;
+	}
 
-		// update parent_dir. if the file is empty, i.e. file_bytes <= 0,
-		// set its start block to 0.
-		time_t curr_time = time(NULL);
-		strcpy(parent_dir[fcb_array[fd].entry_index].name, fcb_array[fd].filename);
-		parent_dir[fcb_array[fd].entry_index].start_block = (fcb_array[fd].file_bytes > 0)
-														  ? fcb_array[fd].file_start_block : 0;
-		parent_dir[fcb_array[fd].entry_index].size = fcb_array[fd].file_bytes;
-		parent_dir[fcb_array[fd].entry_index].type = FILE;
+	int result = storeFileEntry(fcb, &parent_dir);
+	if (closeDirectory(&parent_dir) == ERROR) result = ERROR;
 
-		if (fcb_array[fd].is_new_file) {
-			parent_dir[fcb_array[fd].entry_index].creation_date = curr_time;
-		}
-		
-		parent_dir[fcb_array[fd].entry_index].last_modified = curr_time;
-		parent_dir[fcb_array[fd].entry_index].last_opened = curr_time;
+	if (result == SUCCESS && (fcb->extents.num_blocks != fcb->orig_num_blocks
+	    || fcb->extents.num_extents > INLINE_EXTENTS || fcb->blocks_moved)) {
+		result = writeVCBandBitmap("b_fsync vcb and bitmap");
+	}
 
-		// only update parent's last modified date if we created a new file
-		if (fcb_array[fd].is_new_file) { 
-			parent_dir[0].last_modified = curr_time;
+	// the entry holds the file's blocks now, so a failed write does not give them back
+	if (result == SUCCESS) {
+		fcb->orig_num_blocks = fcb->extents.num_blocks;
+		fcb->blocks_moved = FALSE;
+	}
 
-			// if parent is root_dir, then also update root_dir[1] since root is its own parent
-			if (parent_dir[0].start_block == vcb->root_dir_start_block) {
-				parent_dir[1].last_modified = curr_time;
-			}
+	if (journalEnd() == ERROR) result = ERROR;
+	if (result == ERROR) goto unlock_and_print_error;
+
+	pthread_rwlock_unlock(&fcb->lock);
+	return syncFileSystem();
+
+	unlock_and_print_error: // Label for error handling. Unlock the fcb and return ERROR.
+	pthread_rwlock_unlock(&fcb->lock);
+	printf("File sync failed.\n");
+	return ERROR;
+}
+
+void b_close(b_io_fd fd) {
+	if (startup == FALSE) { // FCB not initialized
+		printf("Error: Close called before the file control block was initialized. "
+		       "File close failed.\n");
+		return;
+	}
+
+	b_fcb *fcb = getFCB(fd);
+	if (!fcb) return; // invalid file descriptor
+	else if (!fcb->in_use) { // close called before open
+		printf("File not open for this descriptor. File close failed.\n");
+		return;
+	}
+
+	directory parent_dir; // parent directory of the file
+	int parent_dir_open = FALSE; // whether parent_dir needs to be closed
+	dir_entry entry; // the file's directory entry
+	int is_write_mode = (fcb->flags & O_WRONLY) || (fcb->flags & O_RDWR);
+
+	// write out the changes still in the buffer. file data is not journaled,
+	// so this happens before the transaction starts.
+	int flush_result = SUCCESS;
+	if (is_write_mode && fcb->entry_index != ERROR) flush_result = flushFCBbuf(fcb);
+
+	// updating the file's entry and giving back blocks is one operation in the journal
+	journalBegin();
+	if (flush_result == ERROR) goto free_and_print_error;
+
+	if (is_write_mode) { // write mode
+		// if an error occurred when reading the file, do not write anything.
+		// give back the blocks that were allocated for the write.
+		if (fcb->entry_index == ERROR) {
+			if (fcb->is_new_file) printf("No files were created.\n");
+			else printf("No files were modified.\n");
+
+			truncateExtentList(&fcb->extents, fcb->orig_num_blocks);
+			goto free_and_return;
 		}
 
-		// after modifying parent_dir, update it in disk
-		if (customLBAwrite(parent_dir, vcb->dir_blocks, fcb_array[fd].parent_dir_start_block,
-		    "b_close write mode parent_dir") == ERROR) {
+		// all data is on disk. free the blocks allocated past the end of the file
+		if (truncateExtentList(&fcb->extents,
+		                       ceilingDivide(fcb->file_bytes, block_size)) == ERROR) {
 			goto free_and_print_error;
 		}
 
-		// only modify the bitmap if the file took up space on disk
-		if (fcb_array[fd].file_num_blocks > 0) {
-			for (int i = 0; i < fcb_array[fd].file_num_blocks; i++) {
-				markBlockUsed(bitmap, fcb_array[fd].file_start_block + i);
-			}
-			
-			if (fcb_array[fd].is_new_file) {
-				vcb->num_free_blocks -= fcb_array[fd].file_num_blocks;
-			} else { // only modify num_free_blocks by how many free blocks were used
-				uint64_t previous_num_blocks = ceilingDivide(previous_size, block_size);
-				vcb->num_free_blocks -= fcb_array[fd].file_num_blocks - previous_num_blocks;
-			}
-
-			// Write vcb to disk after updating vcb->num_free_blocks
-			if (customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK, "b_close vcb") == ERROR) {
-				goto free_and_print_error;
-			}
-
-			// write to disk the updated bitmap
-			if (customLBAwrite(bitmap, vcb->bitmap_blocks, vcb->bitmap_start_block,
-                "b_close bitmap") == ERROR) {
-				goto free_and_print_error;
-			}
+		// load up parent_dir
+		if (openDirectory(fcb->parent_dir_start_block, &parent_dir) == ERROR) {
+			goto free_and_print_error;
 		}
+		parent_dir_open = TRUE;
+
+		int is_new_file = fcb->is_new_file; // storeFileEntry gives it an entry
+		if (storeFileEntry(fcb, &parent_dir) == ERROR) goto free_and_print_error;
 
-		if (fcb_array[fd].is_new_file) {
+		if (is_new_file) {
 			printf("The %lu-byte file '%s' was created.\n",
-		           fcb_array[fd].file_bytes, fcb_array[fd].filename);
+		           fcb->file_bytes, fcb->filename);
 		} else {
 			printf("The %lu-byte file '%s' was modified.\n",
-		           fcb_array[fd].file_bytes, fcb_array[fd].filename);
+		           fcb->file_bytes, fcb->filename);
 		}
 	}
 
-	if ((fcb_array[fd].flags == O_RDONLY) || (fcb_array[fd].flags & O_RDWR)) { // read mode
+	if (fcb->flags == O_RDONLY) { // read mode
 		// load up parent_dir so we can update the last opened date for the file
-		parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-		if (customLBAread(parent_dir, vcb->dir_blocks, fcb_array[fd].parent_dir_start_block,
-		    "b_close read mode parent_dir") == ERROR) {
+		if (openDirectory(fcb->parent_dir_start_block, &parent_dir) == ERROR) {
 			goto free_and_print_error;
 		}
+		parent_dir_open = TRUE;
 
-		parent_dir[fcb_array[fd].entry_index].last_opened = time(NULL);
+		if (readDirEntry(&parent_dir, fcb->entry_index, &entry) == ERROR) {
+			goto free_and_print_error;
+		}
+
+		entry.last_opened = time(NULL);
+
+		// after modifying the entry, update it in disk
+		if (writeDirEntry(&parent_dir, fcb->entry_index, &entry) == ERROR) {
+			goto free_and_print_error;
+		}
+	}
+
+	free_and_return: // Label for closing the file. Write the bitmap if it changed.
+	if (parent_dir_open) {
+		parent_dir_open = FALSE;
+		if (closeDirectory(&parent_dir) == ERROR) goto free_and_print_error;
+	}
 
-		// after modifying parent_dir, update it in disk
-		if (customLBAwrite(parent_dir, vcb->dir_blocks, fcb_array[fd].parent_dir_start_block,
-		    "b_close read mode parent_dir") == ERROR) {
+	if (fcb->extents.num_blocks != fcb->orig_num_blocks
+	    || fcb->extents.num_extents > INLINE_EXTENTS || fcb->blocks_moved) {
+		// write to disk the updated vcb->num_free_blocks and bitmap
+		if (writeVCBandBitmap("b_close vcb and bitmap") == ERROR) {
 			goto free_and_print_error;
 		}
 	}
 
-	free(parent_dir);
-	parent_dir = NULL;
-	free(fcb_array[fd].buf);
-	fcb_array[fd].buf = NULL;
+	// another thread's b_open may take the descriptor as soon as it is released
+	freeExtentList(&fcb->extents);
+	pthread_rwlock_destroy(&fcb->lock);
+	releaseFCB(fd);
+	journalEnd();
 
 	return; // success
 
 	free_and_print_error: // Label for error handling. Free mallocs and close the file.
-	free(parent_dir);
-	parent_dir = NULL;
-	free(fcb_array[fd].buf);
-	fcb_array[fd].buf = NULL;
+	// the file's entry was not updated, so give back the blocks allocated for the write
+	if (is_write_mode) {
+		truncateExtentList(&fcb->extents, fcb->orig_num_blocks);
+	}
+
+	if (parent_dir_open) closeDirectory(&parent_dir);
+	freeExtentList(&fcb->extents);
+	pthread_rwlock_destroy(&fcb->lock);
+	releaseFCB(fd);
 
 	printf("File close aborted.\n");
+	journalEnd();
 	return;
 }
 
 void printFCBcontents(b_fcb *fcb) {
 	printf("\nFCB contents:\n"
-	       "buf:\n%.*s\n"
-		   "buf_index: %d\n"
-		   "buf_valid_bytes: %d\n\n"
+		   "buf_block: %lu\n"
+		   "buf_num_blocks: %lu\n"
+		   "dirty_blocks: %lu\n"
+		   "ra_blocks: %lu\n\n"
 		   
 		   "file_bytes: %lu\n"
-		   "file_start_block: %lu\n"
+		   "file_num_extents: %lu\n"
 		   "file_num_blocks: %lu\n"
 		   "file_offset: %lu\n\n"
 
 		   "parent_dir_start_block: %lu\n"
-		   "entry_index: %d\n"
+		   "entry_index: %lld\n"
 		   "filename: %s\n\n"
 		   
 		   "flags: 0x%x\n"
 		   "is_new_file: %d\n"
 		   "stop: %d\n\n",
-		   fcb->buf_index, fcb->buf, fcb->buf_index, fcb->buf_valid_bytes,
-		   fcb->file_bytes, fcb->file_start_block, fcb->file_num_blocks, fcb->file_offset,
+		   fcb->buf_block, fcb->buf_num_blocks, fcb->dirty_blocks, fcb->ra_blocks,
+		   fcb->file_bytes, fcb->extents.num_extents, fcb->extents.num_blocks,
+		   fcb->file_offset,
 		   fcb->parent_dir_start_block, fcb->entry_index, fcb->filename,
 		   fcb->flags, fcb->is_new_file, fcb->stop);
-}
\ No newline at end of file
+}
@@ -9,6 +9,13 @@
 * File: b_io.h
 *
 * Description: Interface for the key file I/O functions.
+*  Different files may be read and written from different threads at
+*  once. Opening, syncing and closing files, the fs_ calls that change
+*  directories and the writes that allocate blocks wait for each other,
+*  and only the metadata a thread changes is logged with its operation.
+*  A file must not be closed while another thread still uses it, and the
+*  fs_ calls that only look at directories must not run while another
+*  thread opens, syncs or closes a file or calls any other fs_ function.
 *
 **************************************************************/
 
@@ -24,16 +31,50 @@ typedef int b_io_fd;
  * On error, returns ERROR. */
 b_io_fd b_open(char *filename, int flags);
 
-/* Read count bytes from disk to the caller's buffer. Returns the number of bytes
- * transferred to the caller's buffer. Returns ERROR on error. */
-int b_read(b_io_fd fd, char *buffer, int count);
+/* Read count bytes from disk to the caller's buffer. count may be larger than 2 GB,
+ * and whole blocks go straight from disk to the caller's buffer. Returns the number
+ * of bytes transferred to the caller's buffer. Returns ERROR on error. */
+ssize_t b_read(b_io_fd fd, char *buffer, ssize_t count);
 
-/* Write count bytes from the caller's buffer to disk. Returns the number of bytes
- * transferred to the fcb buffer. Returns ERROR on error */
-int b_write(b_io_fd fd, char *buffer, int count);
+/* Write count bytes from the caller's buffer to disk. count may be larger than 2 GB.
+ * A negative count tells b_close not to keep the file, e.g. because its source could
+ * not be read. Returns the number of bytes transferred to the fcb buffer.
+ * Returns ERROR on error */
+ssize_t b_write(b_io_fd fd, char *buffer, ssize_t count);
 
-/* Modifies the file_offset. Returns the resulting file offset. On error, return ERROR. */
-int b_seek(b_io_fd fd, off_t offset, int whence);
+/* Reads up to count bytes at offset, without using or moving the file offset.
+ * Many threads may call b_pread on the same file at once, along with b_pwrite,
+ * b_read and b_write, which wait for each other. The file must not be closed while
+ * they do. Returns the number of bytes transferred to the caller's buffer,
+ * which is 0 at the end of the file. Returns ERROR on error. */
+ssize_t b_pread(b_io_fd fd, char *buffer, ssize_t count, off_t offset);
+
+/* Writes count bytes from the caller's buffer at offset, which can be at most the
+ * size of the file, without using or moving the file offset. Safe to call from many
+ * threads, like b_pread. Returns the number of bytes written, or ERROR on error. */
+ssize_t b_pwrite(b_io_fd fd, char *buffer, ssize_t count, off_t offset);
+
+/* Allocates blocks up front for a file opened for writing that will hold file_bytes
+ * bytes, so that it ends up in as few extents as possible. Blocks that go unused are
+ * freed in b_close. Returns ERROR on error, or SUCCESS, even if the volume did not
+ * have enough free blocks. */
+int b_preallocate(b_io_fd fd, uint64_t file_bytes);
+
+/* Copies the whole file open as src_fd into the empty file open for writing as dest_fd,
+ * block run by block run from disk to disk, without going through either file's
+ * buffer. The destination's blocks are allocated all at once. Leaves both file
+ * offsets at the end of the file. Returns the number of bytes copied, which is less
+ * than the file's size only if the volume ran out of free blocks, or ERROR on error. */
+long long b_copy(b_io_fd src_fd, b_io_fd dest_fd);
+
+/* Modifies the file_offset. Returns the resulting file offset, which is 64 bits.
+ * On error, return ERROR. */
+off_t b_seek(b_io_fd fd, off_t offset, int whence);
+
+/* Writes the file's changes, along with its size and blocks, to disk, then does the
+ * same as syncFileSystem for the rest of the volume, so that everything written
+ * before it returns survives a crash. Returns ERROR on error, or SUCCESS. */
+int b_fsync(b_io_fd fd);
 
 /* Closes the file. Does not return anything, so on error the close is aborted
  * before any further damage is done to the volume. */
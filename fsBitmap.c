@@ -0,0 +1,206 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsBitmap.c
+*
+* Description: Word-at-a-time bitmap kernels. The bitmap is stored as an
+*  array of uint32_t, and bit n lives in bitmap[n / 32]. Two neighbouring
+*  uint32_t values are combined into one 64-bit word, so bit n is also
+*  bit n % 64 of word n / 64. Runs of bits are found with count trailing
+*  zeros and counted with popcount, and fully used (or fully free) regions
+*  are skipped 256 bits at a time with AVX2 when the CPU has it.
+*
+**************************************************************/
+
+#include <stddef.h>
+#include "fsBitmap.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_AVX2_KERNEL 1
+#endif
+
+#define WORD_BITS 64 // bits in a bitmap word
+#define CHUNK_WORDS 4 // words in a 256-bit chunk
+#define ALL_ONES 0xFFFFFFFFFFFFFFFFull
+
+/* Returns 64-bit word w of the bitmap. */
+static inline uint64_t loadWord(const uint32_t *bitmap, uint64_t w) {
+    return (uint64_t) bitmap[2 * w] | ((uint64_t) bitmap[2 * w + 1] << 32);
+}
+
+/* Stores 64-bit word w of the bitmap. */
+static inline void storeWord(uint32_t *bitmap, uint64_t w, uint64_t word) {
+    bitmap[2 * w] = (uint32_t) word;
+    bitmap[2 * w + 1] = (uint32_t) (word >> 32);
+}
+
+/* Returns a mask with count bits set, starting at bit. bit + count must be <= 64. */
+static inline uint64_t rangeMask(uint64_t bit, uint64_t count) {
+    if (count >= WORD_BITS) return ALL_ONES;
+    return ((1ull << count) - 1) << bit;
+}
+
+/* Returns the first word at or after w that is not all ones (all_ones == 1) or not
+ * all zeros (all_ones == 0), looking at 4 words at a time and never going past
+ * limit_words. w must be a multiple of CHUNK_WORDS. */
+static uint64_t skipChunksScalar(const uint32_t *bitmap, uint64_t w, uint64_t limit_words,
+                                 int all_ones) {
+    uint64_t match = all_ones ? ALL_ONES : 0;
+
+    while (w + CHUNK_WORDS <= limit_words) {
+        uint64_t and_words = loadWord(bitmap, w) & loadWord(bitmap, w + 1)
+                           & loadWord(bitmap, w + 2) & loadWord(bitmap, w + 3);
+        uint64_t or_words = loadWord(bitmap, w) | loadWord(bitmap, w + 1)
+                          | loadWord(bitmap, w + 2) | loadWord(bitmap, w + 3);
+
+        if ((all_ones ? and_words : or_words) != match) break;
+        w += CHUNK_WORDS;
+    }
+
+    return w;
+}
+
+#ifdef HAVE_AVX2_KERNEL
+/* Same as skipChunksScalar, but tests a whole 256-bit chunk with one instruction. */
+__attribute__((target("avx2")))
+static uint64_t skipChunksAVX2(const uint32_t *bitmap, uint64_t w, uint64_t limit_words,
+                               int all_ones) {
+    const __m256i ones = _mm256_set1_epi32(-1);
+
+    while (w + CHUNK_WORDS <= limit_words) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i *) (bitmap + 2 * w));
+
+        if (all_ones ? !_mm256_testc_si256(chunk, ones) : !_mm256_testz_si256(chunk, chunk)) {
+            break;
+        }
+        w += CHUNK_WORDS;
+    }
+
+    return w;
+}
+#endif
+
+// the chunk skipping kernel for this CPU, picked the first time it is needed
+static uint64_t (*skipChunks)(const uint32_t *, uint64_t, uint64_t, int) = NULL;
+
+/* Picks the AVX2 kernel if the CPU supports it, or the scalar kernel otherwise. */
+static void selectKernel() {
+#ifdef HAVE_AVX2_KERNEL
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        skipChunks = skipChunksAVX2;
+        return;
+    }
+#endif
+    skipChunks = skipChunksScalar;
+}
+
+const char* bitmapKernelName() {
+    if (!skipChunks) selectKernel();
+
+#ifdef HAVE_AVX2_KERNEL
+    if (skipChunks == skipChunksAVX2) return "avx2";
+#endif
+    return "scalar";
+}
+
+void bitmapSetRange(uint32_t *bitmap, uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+
+    while (start < end) {
+        uint64_t bit = start % WORD_BITS;
+        uint64_t n = WORD_BITS - bit; // bits left in this word
+        if (n > end - start) n = end - start;
+
+        uint64_t w = start / WORD_BITS;
+        storeWord(bitmap, w, loadWord(bitmap, w) | rangeMask(bit, n));
+        start += n;
+    }
+}
+
+void bitmapClearRange(uint32_t *bitmap, uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+
+    while (start < end) {
+        uint64_t bit = start % WORD_BITS;
+        uint64_t n = WORD_BITS - bit; // bits left in this word
+        if (n > end - start) n = end - start;
+
+        uint64_t w = start / WORD_BITS;
+        storeWord(bitmap, w, loadWord(bitmap, w) & ~rangeMask(bit, n));
+        start += n;
+    }
+}
+
+uint64_t bitmapCountSet(uint32_t *bitmap, uint64_t start, uint64_t count) {
+    uint64_t end = start + count;
+    uint64_t num_set = 0;
+
+    while (start < end) {
+        uint64_t bit = start % WORD_BITS;
+        uint64_t n = WORD_BITS - bit; // bits left in this word
+        if (n > end - start) n = end - start;
+
+        num_set += __builtin_popcountll(loadWord(bitmap, start / WORD_BITS) & rangeMask(bit, n));
+        start += n;
+    }
+
+    return num_set;
+}
+
+/* Shared by bitmapNextClear and bitmapNextSet. find_clear selects which one. */
+static uint64_t bitmapNext(uint32_t *bitmap, uint64_t num_bits, uint64_t from, int find_clear) {
+    if (from >= num_bits) return num_bits;
+    if (!skipChunks) selectKernel();
+
+    uint64_t num_words = (num_bits + WORD_BITS - 1) / WORD_BITS;
+    uint64_t full_words = num_bits / WORD_BITS; // words with no bits past num_bits
+    uint64_t w = from / WORD_BITS;
+
+    // flip the word when looking for a clear bit, so we always look for a 1
+    uint64_t word = find_clear ? ~loadWord(bitmap, w) : loadWord(bitmap, w);
+    word &= ALL_ONES << (from % WORD_BITS); // ignore the bits before from
+
+    while (word == 0) {
+        w++;
+
+        // a used region (or a free one) is skipped a whole chunk at a time
+        if (w % CHUNK_WORDS == 0) w = skipChunks(bitmap, w, full_words, find_clear);
+        if (w >= num_words) return num_bits;
+
+        word = find_clear ? ~loadWord(bitmap, w) : loadWord(bitmap, w);
+    }
+
+    uint64_t found = w * WORD_BITS + __builtin_ctzll(word);
+    return (found < num_bits) ? found : num_bits;
+}
+
+uint64_t bitmapNextClear(uint32_t *bitmap, uint64_t num_bits, uint64_t from) {
+    return bitmapNext(bitmap, num_bits, from, 1);
+}
+
+uint64_t bitmapNextSet(uint32_t *bitmap, uint64_t num_bits, uint64_t from) {
+    return bitmapNext(bitmap, num_bits, from, 0);
+}
+
+uint64_t bitmapFindClearRun(uint32_t *bitmap, uint64_t num_bits,
+                            uint64_t from, uint64_t run_length) {
+    while (from < num_bits) {
+        uint64_t run_start = bitmapNextClear(bitmap, num_bits, from);
+        if (run_start >= num_bits || run_length > num_bits - run_start) return num_bits;
+
+        // only look as far as the end of the run we want
+        uint64_t run_end = bitmapNextSet(bitmap, run_start + run_length, run_start);
+        if (run_end - run_start >= run_length) return run_start;
+
+        from = run_end;
+    }
+
+    return num_bits;
+}
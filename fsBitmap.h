@@ -0,0 +1,49 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsBitmap.h
+*
+* Description: Interface for the bitmap kernels, which work on whole
+*  64-bit words of the bitmap instead of on one bit at a time. They do
+*  no bounds checking against the VCB; the helpers that call them do.
+*
+**************************************************************/
+
+#ifndef _FS_BITMAP_H
+#define _FS_BITMAP_H
+
+#include <sys/types.h>
+#include "fsLow.h"
+
+/* Sets bits start to start + count - 1. */
+void bitmapSetRange(uint32_t *bitmap, uint64_t start, uint64_t count);
+
+/* Clears bits start to start + count - 1. */
+void bitmapClearRange(uint32_t *bitmap, uint64_t start, uint64_t count);
+
+/* Returns how many of the bits start to start + count - 1 are set. */
+uint64_t bitmapCountSet(uint32_t *bitmap, uint64_t start, uint64_t count);
+
+/* Returns the first clear bit at or after from, or num_bits if every bit
+ * from from to num_bits - 1 is set. Fully set regions are skipped 256 bits
+ * at a time when the CPU supports AVX2. */
+uint64_t bitmapNextClear(uint32_t *bitmap, uint64_t num_bits, uint64_t from);
+
+/* Returns the first set bit at or after from, or num_bits if every bit
+ * from from to num_bits - 1 is clear. */
+uint64_t bitmapNextSet(uint32_t *bitmap, uint64_t num_bits, uint64_t from);
+
+/* Returns the first bit at or after from that starts a run of at least
+ * run_length clear bits, or num_bits if there is no such run. */
+uint64_t bitmapFindClearRun(uint32_t *bitmap, uint64_t num_bits,
+                            uint64_t from, uint64_t run_length);
+
+/* Returns the name of the bitmap scanning kernel picked for this CPU. */
+const char* bitmapKernelName();
+
+#endif
@@ -0,0 +1,815 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsCache.c
+*
+* Description: A write-back block cache in front of the block device.
+*  Blocks are found through a hash table keyed by block number and are
+*  evicted with the CLOCK (second chance) algorithm. Written blocks stay
+*  dirty in the cache until they are evicted or the cache is flushed.
+*  While pinning is on for a thread, the blocks it writes are also
+*  pinned: they are not written to disk until the journal logs them and
+*  unpins them. Since that only happens between operations, a write that
+*  would pin more blocks than the limit fails instead. A lock
+*  around every read, write and flush lets file data be read and written
+*  from several threads. Flushes and batches of large transfers are
+*  queued on the device all at once, and waited for together. Blocks go
+*  to and from the device through the I/O scheduler, which may hold the
+*  written back blocks a while to write them in order.
+*  Flushes and large transfers run on the device without the lock, so
+*  they neither wait for each other nor hold up cache hits. While they
+*  run, their blocks are in a table of running transfers: a transfer
+*  that would read blocks being written, or write blocks being read or
+*  written, waits for them, and a dirty block among them is not evicted.
+*  The slots a flush writes from are busy until it is done, so they are
+*  not changed or evicted meanwhile.
+*
+**************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "fsCache.h"
+#include "helperFunctions.h"
+#include "fsIOBuffer.h"
+#include "fsSched.h"
+
+#define NO_SLOT -1 // marks the end of a hash chain, or a slot with no block in it
+#define SLOT_BUSY -2 // no slot is free until a transfer that runs without the lock ends
+#define FLUSH_ALL 0 // a flush writes the queue and every dirty block that is not pinned
+#define FLUSH_DATA 1 // a flush writes the queue and the dirty blocks that were not journaled
+#define FLUSH_QUEUE 2 // a flush only writes the scheduler's queue
+
+typedef struct cache_slot {
+    uint64_t lba; // the block number held in this slot
+    int valid; // TRUE if the slot holds a block
+    int dirty; // TRUE if the slot's block is newer than the block on disk
+    int referenced; // CLOCK reference bit, set every time the block is used
+    int pinned; // TRUE if the block must not be written to disk until it is unpinned
+    int journaled; // TRUE if the block was last written while pinning was on
+    int busy; // TRUE while a flush writes the block to disk without the lock
+    uint64_t dirty_since_ms; // when the block became dirty, if it is
+    int next; // next slot in the same hash chain, or NO_SLOT
+} cache_slot;
+
+// a transfer that runs on the device without the lock
+typedef struct running_io {
+    uint64_t lba_count;
+    uint64_t lba_position;
+    int is_write;
+    struct running_io *next;
+} running_io;
+
+cache_slot *cache_slots = NULL; // metadata for each slot in the cache
+// CACHE_NUM_BLOCKS blocks of data, one block per slot. registered with the device,
+// since every flush writes from it
+char *cache_data = NULL;
+int *cache_buckets = NULL; // the first slot of each hash chain, or NO_SLOT
+uint64_t cache_block_size = 0; // size of a block in bytes
+int clock_hand = 0; // the next slot the CLOCK algorithm will look at
+cache_stats cache_counters; // hit/miss/eviction counters
+static __thread int pin_writes = FALSE; // TRUE if the blocks this thread writes are pinned
+uint64_t num_pinned = 0; // how many blocks are pinned
+uint64_t pin_limit = CACHE_NUM_BLOCKS; // most blocks that may be pinned at once
+// held while the cache is used, and while the disk is, except by the transfers that
+// are in running_ios
+pthread_mutex_t cache_lock;
+// broadcast when a transfer in running_ios ends, which also ends a flush
+pthread_cond_t io_done;
+int cache_lock_ready = FALSE; // TRUE once cache_lock and io_done are initialized
+running_io *running_ios = NULL; // the transfers that run without the lock
+int flushing = FALSE; // TRUE while a flush runs, since only one runs at a time
+
+static int compareSlotLBA(const void *a, const void *b);
+
+/* Returns the hash bucket a block number belongs to. */
+static int cacheHash(uint64_t lba) {
+    // Fibonacci hashing spreads out runs of consecutive block numbers
+    return (int) ((lba * 11400714819323198485ull) >> 40) & (CACHE_HASH_BUCKETS - 1);
+}
+
+/* Returns the data buffer for a slot. */
+static char* slotData(int slot) {
+    return cache_data + (uint64_t) slot * cache_block_size;
+}
+
+/* Returns the slot holding lba, or NO_SLOT if lba is not cached. */
+static int cacheLookup(uint64_t lba) {
+    for (int slot = cache_buckets[cacheHash(lba)]; slot != NO_SLOT;
+         slot = cache_slots[slot].next) {
+        if (cache_slots[slot].lba == lba) return slot;
+    }
+
+    return NO_SLOT;
+}
+
+/* Returns TRUE if a transfer in running_ios overlaps the lba_count blocks from
+ * lba_position on, and writes them if writes_only is TRUE. */
+static int isRunningIO(uint64_t lba_count, uint64_t lba_position, int writes_only) {
+    for (running_io *io = running_ios; io; io = io->next) {
+        if ((io->is_write || !writes_only) && io->lba_position < lba_position + lba_count
+            && lba_position < io->lba_position + io->lba_count) {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Adds a transfer to running_ios before the lock is let go for it. */
+static void startRunningIO(running_io *io, uint64_t lba_count, uint64_t lba_position,
+                           int is_write) {
+    io->lba_count = lba_count;
+    io->lba_position = lba_position;
+    io->is_write = is_write;
+    io->next = running_ios;
+    running_ios = io;
+}
+
+/* Removes a transfer from running_ios once the lock is held again. The caller
+ * broadcasts io_done. */
+static void endRunningIO(running_io *io) {
+    running_io **link = &running_ios;
+    while (*link && *link != io) link = &(*link)->next;
+    if (*link) *link = io->next;
+}
+
+/* Removes a slot from its hash chain. */
+static void cacheUnlink(int slot) {
+    int *link = &cache_buckets[cacheHash(cache_slots[slot].lba)];
+
+    while (*link != NO_SLOT && *link != slot) link = &cache_slots[*link].next;
+    if (*link == slot) *link = cache_slots[slot].next;
+
+    if (cache_slots[slot].pinned) num_pinned--;
+    cache_slots[slot].valid = FALSE;
+    cache_slots[slot].dirty = FALSE;
+    cache_slots[slot].pinned = FALSE;
+    cache_slots[slot].next = NO_SLOT;
+}
+
+/* Picks a slot to hold lba using the CLOCK algorithm, writing back the old block
+ * if it was dirty. The returned slot is valid, clean, and linked into its hash chain.
+ * Returns NO_SLOT if a dirty block could not be written back, or every slot is pinned.
+ * Returns SLOT_BUSY if the only slots that could be used are being written to disk
+ * without the lock, in which case the caller waits for io_done and tries again. */
+static int cacheGetSlot(uint64_t lba) {
+    int slot;
+    int num_checked = 0; // slots looked at since the search started
+    int num_busy = 0; // slots passed over until a transfer without the lock ends
+
+    while (TRUE) {
+        // every slot was pinned or busy for two rounds of the clock. the pin limit keeps
+        // every slot from being pinned unless it is as large as the cache
+        if (num_checked++ == 2 * CACHE_NUM_BLOCKS) return num_busy > 0 ? SLOT_BUSY : NO_SLOT;
+
+        slot = clock_hand;
+        clock_hand = (clock_hand + 1) % CACHE_NUM_BLOCKS;
+
+        if (!cache_slots[slot].valid) break; // unused slot
+        if (cache_slots[slot].pinned) continue; // cannot be written to disk yet
+
+        // writing the block back now could pass a transfer of it that is running
+        if (cache_slots[slot].busy
+            || (cache_slots[slot].dirty && isRunningIO(1, cache_slots[slot].lba, FALSE))) {
+            num_busy++;
+            continue;
+        }
+
+        if (cache_slots[slot].referenced) { // second chance
+            cache_slots[slot].referenced = FALSE;
+            continue;
+        }
+
+        // found a victim. save it to disk first if it was modified
+        if (cache_slots[slot].dirty) {
+            if (schedWrite(slotData(slot), 1, cache_slots[slot].lba) != 1) return NO_SLOT;
+            cache_counters.writebacks++;
+        }
+
+        cacheUnlink(slot);
+        cache_counters.evictions++;
+        break;
+    }
+
+    int bucket = cacheHash(lba);
+    cache_slots[slot].lba = lba;
+    cache_slots[slot].valid = TRUE;
+    cache_slots[slot].dirty = FALSE;
+    cache_slots[slot].pinned = FALSE;
+    cache_slots[slot].journaled = FALSE;
+    cache_slots[slot].busy = FALSE;
+    cache_slots[slot].referenced = TRUE;
+    cache_slots[slot].next = cache_buckets[bucket];
+    cache_buckets[bucket] = slot;
+
+    return slot;
+}
+
+int initBlockCache(uint64_t block_size) {
+    if (!cache_lock_ready) {
+        pthread_mutex_init(&cache_lock, NULL);
+        pthread_cond_init(&io_done, NULL);
+        cache_lock_ready = TRUE;
+    }
+
+    cache_block_size = block_size;
+    cache_slots = malloc(CACHE_NUM_BLOCKS * sizeof(cache_slot));
+    cache_data = allocIOBuffer(CACHE_NUM_BLOCKS * block_size);
+    cache_buckets = malloc(CACHE_HASH_BUCKETS * sizeof(int));
+
+    if (!cache_slots || !cache_data || !cache_buckets || initScheduler(block_size) == ERROR) {
+        exitBlockCache();
+        return ERROR;
+    }
+
+    // if the device cannot register it, flushes are only a little slower
+    struct iovec data_iov = { cache_data, CACHE_NUM_BLOCKS * block_size };
+    deviceRegisterBuffers(&data_iov, 1);
+
+    for (int i = 0; i < CACHE_NUM_BLOCKS; i++) {
+        cache_slots[i].valid = FALSE;
+        cache_slots[i].dirty = FALSE;
+        cache_slots[i].referenced = FALSE;
+        cache_slots[i].pinned = FALSE;
+        cache_slots[i].journaled = FALSE;
+        cache_slots[i].busy = FALSE;
+        cache_slots[i].next = NO_SLOT;
+    }
+    for (int i = 0; i < CACHE_HASH_BUCKETS; i++) cache_buckets[i] = NO_SLOT;
+
+    clock_hand = 0;
+    num_pinned = 0;
+    pin_writes = FALSE;
+    running_ios = NULL;
+    flushing = FALSE;
+    memset(&cache_counters, 0, sizeof(cache_stats));
+
+    return SUCCESS;
+}
+
+/* Copies the cached blocks among the lba_count blocks from lba_position on over buf,
+ * which was just read from disk without the lock. A cached block is never older than
+ * the disk's copy, and may have been written back while buf was read. */
+static void mergeCachedBlocks(char *buf, uint64_t lba_count, uint64_t lba_position) {
+    for (uint64_t i = 0; i < lba_count; i++) {
+        int slot = cacheLookup(lba_position + i);
+        if (slot != NO_SLOT) {
+            memcpy(buf + i * cache_block_size, slotData(slot), cache_block_size);
+        }
+    }
+
+    cache_counters.bypasses++;
+}
+
+/* Updates the cached copies of the lba_count blocks from lba_position on to buf, which
+ * was just written to disk, so they match the disk. */
+static void matchWrittenBlocks(char *buf, uint64_t lba_count, uint64_t lba_position) {
+    for (uint64_t i = 0; i < lba_count; i++) {
+        int slot = cacheLookup(lba_position + i);
+        if (slot != NO_SLOT) {
+            memcpy(slotData(slot), buf + i * cache_block_size, cache_block_size);
+            cache_slots[slot].dirty = FALSE;
+            if (cache_slots[slot].pinned) num_pinned--;
+            cache_slots[slot].pinned = FALSE; // the disk is up to date
+        }
+    }
+
+    cache_counters.bypasses++;
+}
+
+/* Returns TRUE if a transfer of lba_count blocks goes straight to or from disk.
+ * Writes that pin their blocks (pins == TRUE) cannot bypass the cache. */
+static int bypassesCache(uint64_t lba_count, int pins) {
+    return lba_count >= CACHE_BYPASS_BLOCKS && !pins;
+}
+
+/* Returns TRUE if io goes straight to or from disk. Its blocks are pinned if it is a
+ * write and pin is TRUE. */
+static int ioBypassesCache(device_io *io, int pin) {
+    return bypassesCache(io->lba_count, io->is_write && pin);
+}
+
+/* cacheLBAread without the lock, for transfers that do not bypass the cache. */
+static uint64_t cacheRead(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    char *dest = buf;
+
+    uint64_t i = 0;
+    while (i < lba_count) {
+        int slot = cacheLookup(lba_position + i);
+        if (slot != NO_SLOT) { // hit
+            memcpy(dest + i * cache_block_size, slotData(slot), cache_block_size);
+            cache_slots[slot].referenced = TRUE;
+            cache_counters.hits++;
+            i++;
+            continue;
+        }
+
+        // miss. read the whole run of uncached blocks with a single deviceRead
+        uint64_t run = 1;
+        while (i + run < lba_count && cacheLookup(lba_position + i + run) == NO_SLOT) run++;
+
+        // the disk's copy is not up to date until a write of the blocks ends
+        if (isRunningIO(run, lba_position + i, TRUE)) {
+            pthread_cond_wait(&io_done, &cache_lock);
+            continue;
+        }
+
+        if (schedRead(dest + i * cache_block_size, run, lba_position + i) != run) return i;
+        cache_counters.misses += run;
+
+        // the blocks are read either way, so the ones with no slot to spare are not cached
+        for (uint64_t j = i; j < i + run; j++) {
+            slot = cacheGetSlot(lba_position + j);
+            if (slot == NO_SLOT) return j;
+            if (slot == SLOT_BUSY) continue;
+            memcpy(slotData(slot), dest + j * cache_block_size, cache_block_size);
+        }
+
+        i += run;
+    }
+
+    return lba_count;
+}
+
+/* cacheLBAwrite without the lock, for transfers that do not bypass the cache. The
+ * blocks are pinned if pin is TRUE. */
+static uint64_t cacheWrite(void *buf, uint64_t lba_count, uint64_t lba_position, int pin) {
+    char *src = buf;
+
+    uint64_t i = 0;
+    while (i < lba_count) {
+        // whole blocks are written, so there is no need to read the old block first
+        int slot = cacheLookup(lba_position + i);
+        if (slot == NO_SLOT) slot = cacheGetSlot(lba_position + i);
+        if (slot == NO_SLOT) return i;
+
+        // a flush is writing the block to disk from its slot, or every slot that could
+        // make room
+        if (slot == SLOT_BUSY || cache_slots[slot].busy) {
+            pthread_cond_wait(&io_done, &cache_lock);
+            continue;
+        }
+
+        // the pinned blocks can only be unpinned once the operation is over
+        if (pin && !cache_slots[slot].pinned && num_pinned >= pin_limit) {
+            printf("Error: The operation changed too many blocks to fit in the journal. ");
+            return i;
+        }
+
+        memcpy(slotData(slot), src + i * cache_block_size, cache_block_size);
+        if (!cache_slots[slot].dirty) cache_slots[slot].dirty_since_ms = getMonotonicMs();
+        cache_slots[slot].dirty = TRUE;
+        cache_slots[slot].referenced = TRUE;
+
+        if (pin && !cache_slots[slot].pinned) {
+            cache_slots[slot].pinned = TRUE;
+            num_pinned++;
+        }
+        // a block that is still pinned from before goes into the journal as it is now
+        cache_slots[slot].journaled = cache_slots[slot].pinned;
+        i++;
+    }
+
+    return lba_count;
+}
+
+/* Hands the scheduler's queued blocks among the lba_count blocks from lba_position on
+ * to the device before they are moved straight to or from it, since the device's copy
+ * of a queued block is out of date, and a queued block written later would overwrite
+ * what is written now. Returns ERROR if they could not be written, or SUCCESS. */
+static int dispatchQueuedBlocks(uint64_t lba_count, uint64_t lba_position) {
+    return schedDispatchRange(lba_count, lba_position);
+}
+
+/* cacheTransferBatch with the lock held, which is let go while the transfers that
+ * bypass the cache run. They are passed to deviceTransferSegments together if vectored
+ * is TRUE, so the ones next to each other on disk are merged, or else queued on the
+ * device one by one. The blocks that are written are pinned if pin is TRUE.
+ * Returns ERROR if any of them did not move all of its blocks, or SUCCESS. */
+static int transferBatch(device_io *ios, int num_ios, int vectored, int pin) {
+    // the ones that go through the cache run first, so that any blocks they evict are
+    // on disk before the rest are read from there
+    int num_bypass = 0;
+    for (int i = 0; i < num_ios; i++) {
+        device_io *io = &ios[i];
+        if (ioBypassesCache(io, pin)) {
+            num_bypass++;
+            continue;
+        }
+
+        io->blocks = io->is_write ? cacheWrite(io->buf, io->lba_count, io->lba_position, pin)
+                                  : cacheRead(io->buf, io->lba_count, io->lba_position);
+    }
+
+    int result = SUCCESS;
+    int *run_ios = NULL; // the ones that bypass the cache and run
+    running_io *running = NULL; // each of run_ios while it runs
+    lba_segment *segs = NULL; // run_ios, if vectored
+    int num_run = 0;
+    if (num_bypass > 0) {
+        run_ios = malloc(num_bypass * sizeof(int));
+        running = malloc(num_bypass * sizeof(running_io));
+        segs = malloc(num_bypass * sizeof(lba_segment));
+        if (!run_ios || !running || !segs) {
+            num_bypass = 0;
+            result = ERROR;
+        }
+    }
+
+    // they wait for the transfers without the lock that they cannot run next to
+    int must_wait = TRUE;
+    while (num_bypass > 0 && must_wait) {
+        must_wait = FALSE;
+        for (int i = 0; i < num_ios && !must_wait; i++) {
+            device_io *io = &ios[i];
+            must_wait = ioBypassesCache(io, pin)
+                        && isRunningIO(io->lba_count, io->lba_position, !io->is_write);
+        }
+
+        if (must_wait) pthread_cond_wait(&io_done, &cache_lock);
+    }
+
+    for (int i = 0; i < num_ios && num_bypass > 0; i++) {
+        device_io *io = &ios[i];
+        if (!ioBypassesCache(io, pin)) continue;
+
+        io->blocks = 0;
+        if (dispatchQueuedBlocks(io->lba_count, io->lba_position) == ERROR) continue;
+
+        startRunningIO(&running[num_run], io->lba_count, io->lba_position, io->is_write);
+        segs[num_run] = (lba_segment) { io->buf, io->lba_count, io->lba_position };
+        run_ios[num_run++] = i;
+    }
+
+    if (num_run > 0) {
+        pthread_mutex_unlock(&cache_lock);
+
+        if (!vectored) {
+            for (int i = 0; i < num_run; i++) deviceSubmit(&ios[run_ios[i]]);
+            if (deviceWait() == ERROR) result = ERROR;
+        } else if (deviceTransferSegments(segs, num_run, ios[0].is_write) == SUCCESS) {
+            // there is no telling which of them moved unless they all did
+            for (int i = 0; i < num_run; i++) {
+                ios[run_ios[i]].blocks = ios[run_ios[i]].lba_count;
+            }
+        }
+
+        pthread_mutex_lock(&cache_lock);
+        for (int i = 0; i < num_run; i++) endRunningIO(&running[i]);
+        pthread_cond_broadcast(&io_done);
+    }
+
+    for (int i = 0; i < num_ios; i++) {
+        device_io *io = &ios[i];
+        if (io->blocks != io->lba_count) {
+            result = ERROR;
+            continue;
+        }
+        if (!ioBypassesCache(io, pin)) continue;
+
+        if (io->is_write) matchWrittenBlocks(io->buf, io->lba_count, io->lba_position);
+        else mergeCachedBlocks(io->buf, io->lba_count, io->lba_position);
+    }
+
+    free(run_ios);
+    run_ios = NULL;
+    free(running);
+    running = NULL;
+    free(segs);
+    segs = NULL;
+    return result;
+}
+
+/* Moves lba_count blocks from lba_position on like cacheTransferBatch, pinning the
+ * blocks that are written if pin is TRUE. Returns how many blocks were moved. */
+static uint64_t transferBlocks(void *buf, uint64_t lba_count, uint64_t lba_position,
+                               int is_write, int pin) {
+    device_io io = { buf, lba_count, lba_position, is_write, NULL, 0, 0, NULL };
+
+    pthread_mutex_lock(&cache_lock);
+    transferBatch(&io, 1, FALSE, pin);
+    pthread_mutex_unlock(&cache_lock);
+    return io.blocks;
+}
+
+uint64_t cacheLBAread(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    return transferBlocks(buf, lba_count, lba_position, FALSE, FALSE);
+}
+
+uint64_t cacheLBAwrite(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    return transferBlocks(buf, lba_count, lba_position, TRUE, pin_writes);
+}
+
+uint64_t cacheLBAwriteUnpinned(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    return transferBlocks(buf, lba_count, lba_position, TRUE, FALSE);
+}
+
+const void *cacheViewBlocks(uint64_t lba_count, uint64_t lba_position) {
+    const void *view = NULL;
+    pthread_mutex_lock(&cache_lock);
+
+    uint64_t i = 0;
+    for (; i < lba_count; i++) {
+        int slot = cacheLookup(lba_position + i);
+        if (slot != NO_SLOT && cache_slots[slot].dirty) break;
+    }
+    if (i == lba_count && !isRunningIO(lba_count, lba_position, TRUE)
+        && dispatchQueuedBlocks(lba_count, lba_position) == SUCCESS) {
+        view = deviceView(lba_count, lba_position);
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+    return view;
+}
+
+int cacheTransferBatch(device_io *ios, int num_ios) {
+    pthread_mutex_lock(&cache_lock);
+    int result = transferBatch(ios, num_ios, FALSE, pin_writes);
+    pthread_mutex_unlock(&cache_lock);
+    return result;
+}
+
+int cacheTransferSegments(lba_segment *segs, int num_segs, int is_write) {
+    if (num_segs <= 0) return SUCCESS;
+
+    device_io *ios = calloc(num_segs, sizeof(device_io));
+    if (!ios) return ERROR;
+
+    for (int i = 0; i < num_segs; i++) {
+        ios[i].buf = segs[i].buf;
+        ios[i].lba_count = segs[i].lba_count;
+        ios[i].lba_position = segs[i].lba_position;
+        ios[i].is_write = is_write;
+    }
+
+    pthread_mutex_lock(&cache_lock);
+    int result = transferBatch(ios, num_segs, TRUE, pin_writes);
+    pthread_mutex_unlock(&cache_lock);
+
+    free(ios);
+    ios = NULL;
+    return result;
+}
+
+void setCachePinning(int pin) { pin_writes = pin; }
+
+void setCachePinLimit(uint64_t limit) { pin_limit = limit; }
+
+uint64_t getNumPinnedBlocks() { return num_pinned; }
+
+uint64_t copyPinnedBlocks(uint64_t *lbas, char *data) {
+    int *pinned_slots = malloc(CACHE_NUM_BLOCKS * sizeof(int));
+    if (!pinned_slots) return UNSIGNED_ERROR;
+
+    pthread_mutex_lock(&cache_lock);
+
+    int num_found = 0;
+    for (int i = 0; i < CACHE_NUM_BLOCKS; i++) {
+        if (cache_slots[i].valid && cache_slots[i].pinned) pinned_slots[num_found++] = i;
+    }
+
+    qsort(pinned_slots, num_found, sizeof(int), compareSlotLBA);
+
+    for (int i = 0; i < num_found; i++) {
+        lbas[i] = cache_slots[pinned_slots[i]].lba;
+        memcpy(data + i * cache_block_size, slotData(pinned_slots[i]), cache_block_size);
+    }
+    pthread_mutex_unlock(&cache_lock);
+
+    free(pinned_slots);
+    pinned_slots = NULL;
+
+    return num_found;
+}
+
+void unpinAllBlocks() {
+    pthread_mutex_lock(&cache_lock);
+    for (int i = 0; i < CACHE_NUM_BLOCKS; i++) cache_slots[i].pinned = FALSE;
+    num_pinned = 0;
+    pthread_mutex_unlock(&cache_lock);
+}
+
+/* Used by qsort to sort slots by their block number. */
+static int compareSlotLBA(const void *a, const void *b) {
+    uint64_t lba_a = cache_slots[*(const int *) a].lba;
+    uint64_t lba_b = cache_slots[*(const int *) b].lba;
+
+    return (lba_a > lba_b) - (lba_a < lba_b);
+}
+
+/* Used by qsort to sort segments by their block number. */
+static int compareSegmentLBA(const void *a, const void *b) {
+    uint64_t lba_a = ((const lba_segment *) a)->lba_position;
+    uint64_t lba_b = ((const lba_segment *) b)->lba_position;
+
+    return (lba_a > lba_b) - (lba_a < lba_b);
+}
+
+/* Writes the scheduler's queue to disk, and unless mode is FLUSH_QUEUE, the dirty blocks
+ * that are not pinned, or only the ones that were not journaled if mode is FLUSH_DATA.
+ * A queued block that is cached and not pinned is written from its slot instead, which
+ * is at least as new. Each block is written straight from where it is, and the device
+ * merges runs of consecutive blocks into one vectored write. Every run is queued on the
+ * device at once, so they are all written together, without the lock.
+ * Returns ERROR if a block could not be written, or SUCCESS. */
+static int writeBack(int mode) {
+    int *busy_slots = malloc(CACHE_NUM_BLOCKS * sizeof(int));
+    // one per block, and one running transfer per run of them
+    lba_segment *segs = malloc((CACHE_NUM_BLOCKS + SCHED_QUEUE_BLOCKS) * sizeof(lba_segment));
+    running_io *running = malloc((CACHE_NUM_BLOCKS + SCHED_QUEUE_BLOCKS) * sizeof(running_io));
+    lba_segment *held = malloc(SCHED_QUEUE_BLOCKS * sizeof(lba_segment));
+    if (!busy_slots || !segs || !running || !held) {
+        free(busy_slots);
+        free(segs);
+        free(running);
+        free(held);
+        return ERROR;
+    }
+
+    // pinned blocks stay in the cache until the journal has logged them
+    int num_busy = 0;
+    int num_segs = 0;
+    int num_held = schedHoldQueue(held);
+    for (int i = 0; i < num_held; i++) {
+        int slot = cacheLookup(held[i].lba_position);
+        if (slot == NO_SLOT || cache_slots[slot].pinned) {
+            segs[num_segs++] = held[i];
+        } else {
+            cache_slots[slot].busy = TRUE;
+            busy_slots[num_busy++] = slot;
+        }
+    }
+
+    for (int i = 0; i < CACHE_NUM_BLOCKS && mode != FLUSH_QUEUE; i++) {
+        cache_slot *slot = &cache_slots[i];
+        if (!slot->valid || !slot->dirty || slot->pinned || slot->busy
+            || (mode == FLUSH_DATA && slot->journaled)) {
+            continue;
+        }
+
+        // a write that bypasses the cache is putting a newer copy on disk, which it
+        // makes the cached copy match once it ends
+        if (isRunningIO(1, slot->lba, TRUE)) continue;
+
+        slot->busy = TRUE;
+        busy_slots[num_busy++] = i;
+    }
+
+    for (int i = 0; i < num_busy; i++) {
+        segs[num_segs++] = (lba_segment) { slotData(busy_slots[i]), 1,
+                                           cache_slots[busy_slots[i]].lba };
+    }
+
+    qsort(segs, num_segs, sizeof(lba_segment), compareSegmentLBA);
+    int num_running = 0;
+    for (int i = 0; i < num_segs; i++) {
+        running_io *last = num_running > 0 ? &running[num_running - 1] : NULL;
+        if (last && last->lba_position + last->lba_count == segs[i].lba_position) {
+            last->lba_count += segs[i].lba_count;
+        } else {
+            startRunningIO(&running[num_running++], segs[i].lba_count,
+                           segs[i].lba_position, TRUE);
+        }
+    }
+
+    pthread_mutex_unlock(&cache_lock);
+    int result = deviceTransferSegments(segs, num_segs, TRUE);
+    pthread_mutex_lock(&cache_lock);
+
+    // the blocks stay dirty if any of them could not be written, so the next flush
+    // tries them all again
+    for (int i = 0; i < num_running; i++) endRunningIO(&running[i]);
+    for (int i = 0; i < num_busy; i++) {
+        cache_slots[busy_slots[i]].busy = FALSE;
+        if (result == SUCCESS) cache_slots[busy_slots[i]].dirty = FALSE;
+    }
+    if (result == SUCCESS) cache_counters.writebacks += num_busy;
+    schedReleaseHeld(result == SUCCESS);
+    pthread_cond_broadcast(&io_done);
+
+    free(busy_slots);
+    busy_slots = NULL;
+    free(segs);
+    segs = NULL;
+    free(running);
+    running = NULL;
+    free(held);
+    held = NULL;
+
+    return result;
+}
+
+/* writeBack with the lock held, once no other flush runs. Blocks held from a write that
+ * failed are written on their own first. Returns ERROR if a block could not be
+ * written, or SUCCESS. */
+static int flushDirtySlots(int mode) {
+    if (!cache_slots) return SUCCESS; // cache was never initialized
+
+    // only one flush runs at a time, so no block is written by two of them at once
+    while (flushing) pthread_cond_wait(&io_done, &cache_lock);
+    flushing = TRUE;
+
+    int result = SUCCESS;
+    int retry = TRUE;
+    while (result == SUCCESS && retry) {
+        retry = schedHasHeld();
+        result = writeBack(mode);
+    }
+
+    flushing = FALSE;
+    pthread_cond_broadcast(&io_done);
+    return result;
+}
+
+int flushBlockCache() {
+    pthread_mutex_lock(&cache_lock);
+    int result = flushDirtySlots(FLUSH_ALL);
+    pthread_mutex_unlock(&cache_lock);
+    return result;
+}
+
+int flushDataBlocks() {
+    pthread_mutex_lock(&cache_lock);
+    int result = flushDirtySlots(FLUSH_DATA);
+    pthread_mutex_unlock(&cache_lock);
+    return result;
+}
+
+int flushOldBlocks(uint64_t max_age_ms, uint64_t max_dirty) {
+    if (!cache_slots) return SUCCESS;
+
+    pthread_mutex_lock(&cache_lock);
+
+    // only the blocks that are not pinned can be written back
+    uint64_t now_ms = getMonotonicMs();
+    uint64_t num_dirty = 0;
+    int expired = FALSE;
+    for (int i = 0; i < CACHE_NUM_BLOCKS; i++) {
+        if (cache_slots[i].valid && cache_slots[i].dirty && !cache_slots[i].pinned) {
+            num_dirty++;
+            if (now_ms - cache_slots[i].dirty_since_ms >= max_age_ms) expired = TRUE;
+        }
+    }
+
+    int result = SUCCESS;
+    if (expired || num_dirty >= max_dirty) result = flushDirtySlots(FLUSH_ALL);
+    else if (schedQueueExpired(max_age_ms)) result = flushDirtySlots(FLUSH_QUEUE);
+
+    pthread_mutex_unlock(&cache_lock);
+    return result;
+}
+
+uint64_t cacheNextExpiryMs() {
+    if (!cache_slots) return UINT64_MAX;
+
+    pthread_mutex_lock(&cache_lock);
+    uint64_t expiry_ms = schedNextExpiryMs();
+    pthread_mutex_unlock(&cache_lock);
+    return expiry_ms;
+}
+
+int exitBlockCache() {
+    int result = flushBlockCache();
+    if (exitScheduler() == ERROR) result = ERROR;
+
+    if (cache_data) deviceRegisterBuffers(NULL, 0);
+
+    free(cache_slots);
+    cache_slots = NULL;
+    free(cache_data);
+    cache_data = NULL;
+    free(cache_buckets);
+    cache_buckets = NULL;
+
+    return result;
+}
+
+void getBlockCacheStats(cache_stats *stats) {
+    *stats = cache_counters;
+}
+
+void printBlockCacheStats() {
+    int num_cached = 0; // blocks currently held in the cache
+    int num_dirty = 0; // cached blocks that have not been written to disk yet
+
+    for (int i = 0; cache_slots && i < CACHE_NUM_BLOCKS; i++) {
+        if (cache_slots[i].valid) num_cached++;
+        if (cache_slots[i].valid && cache_slots[i].dirty) num_dirty++;
+    }
+
+    printf("Block cache: %d/%d blocks cached, %d dirty\n"
+           "  hits: %lu\n"
+           "  misses: %lu\n"
+           "  evictions: %lu\n"
+           "  writebacks: %lu\n"
+           "  bypasses: %lu\n",
+           num_cached, CACHE_NUM_BLOCKS, num_dirty, cache_counters.hits,
+           cache_counters.misses, cache_counters.evictions, cache_counters.writebacks,
+           cache_counters.bypasses);
+}
@@ -0,0 +1,112 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsCache.h
+*
+* Description: Interface for the write-back block cache that sits
+*  between customLBAread/customLBAwrite and the block device.
+*
+**************************************************************/
+
+#ifndef _FS_CACHE_H
+#define _FS_CACHE_H
+
+#include "fsDevice.h"
+
+#define CACHE_NUM_BLOCKS 1024 // number of blocks the block cache can hold
+#define CACHE_HASH_BUCKETS 2048 // number of hash buckets, must be a power of 2
+#define CACHE_BYPASS_BLOCKS 64 // transfers of at least this many blocks bypass the cache
+
+// Counters for the block cache, readable from the shell with the stats command
+typedef struct cache_stats {
+    uint64_t hits; // blocks found in the cache
+    uint64_t misses; // blocks that had to be read from disk
+    uint64_t evictions; // blocks removed from the cache to make room for another block
+    uint64_t writebacks; // dirty blocks written to disk on eviction or flush
+    uint64_t bypasses; // large transfers that went straight to disk
+} cache_stats;
+
+/* Allocates the block cache for blocks of block_size bytes.
+ * Returns ERROR if the cache could not be allocated. Returns SUCCESS otherwise. */
+int initBlockCache(uint64_t block_size);
+
+/* Same as deviceRead, but serves blocks from the cache when possible.
+ * Returns the number of blocks read into buf. */
+uint64_t cacheLBAread(void *buf, uint64_t lba_count, uint64_t lba_position);
+
+/* Same as deviceWrite, but the blocks are only marked dirty in the cache and are
+ * written to disk when they are evicted or flushed. Returns the number of blocks written. */
+uint64_t cacheLBAwrite(void *buf, uint64_t lba_count, uint64_t lba_position);
+
+/* Same as cacheLBAwrite, but the blocks are not pinned even while pinning is on, so
+ * they are written to disk like file data. Returns the number of blocks written. */
+uint64_t cacheLBAwriteUnpinned(void *buf, uint64_t lba_count, uint64_t lba_position);
+
+/* Same as deviceView, but returns NULL if the cache has changes to any of the blocks
+ * that have not reached the device yet, so the view would be out of date. The caller
+ * then reads the blocks with cacheLBAread. The view is given back with
+ * deviceReleaseView. */
+const void *cacheViewBlocks(uint64_t lba_count, uint64_t lba_position);
+
+/* Runs num_ios transfers that must not overlap or be vectored, as if each was passed to
+ * cacheLBAread or cacheLBAwrite, and sets each one's blocks. The ones that bypass the
+ * cache are queued on the device together, so they run at the same time.
+ * Returns ERROR if any of them did not move all of its blocks, or SUCCESS. */
+int cacheTransferBatch(device_io *ios, int num_ios);
+
+/* Runs num_segs segments that must not overlap, as if each was passed to
+ * cacheLBAread (is_write == FALSE) or cacheLBAwrite (is_write == TRUE). The ones that
+ * bypass the cache are passed to deviceTransferSegments together, without the cache's
+ * lock. Returns ERROR if any of them did not move all of its blocks, or SUCCESS. */
+int cacheTransferSegments(lba_segment *segs, int num_segs, int is_write);
+
+/* Writes every dirty block in the cache that is not pinned to disk, in order of block
+ * number. Returns ERROR if a block could not be written. Returns SUCCESS otherwise. */
+int flushBlockCache();
+
+/* Same as flushBlockCache, but only writes the blocks that were written while
+ * pinning was off, i.e. file data. Returns ERROR if a block could not be written. */
+int flushDataBlocks();
+
+/* Same as flushBlockCache, but only if a block that is not pinned has been dirty for
+ * max_age_ms, or at least max_dirty of them are dirty. Otherwise only the scheduler's
+ * writes that have been queued for max_age_ms are written. Returns ERROR if a block
+ * could not be written. Returns SUCCESS otherwise. */
+int flushOldBlocks(uint64_t max_age_ms, uint64_t max_dirty);
+
+/* Returns schedNextExpiryMs, the time at which flushOldBlocks will write the
+ * scheduler's queue, so that the flusher can wake up for it. */
+uint64_t cacheNextExpiryMs();
+
+/* Turns pinning of the blocks the calling thread writes on (TRUE) or off (FALSE). */
+void setCachePinning(int pin);
+
+/* Sets the most blocks that may be pinned at once. A write that would pin more fails. */
+void setCachePinLimit(uint64_t limit);
+
+/* Returns how many blocks are pinned. */
+uint64_t getNumPinnedBlocks();
+
+/* Copies the block numbers of the pinned blocks into lbas, in increasing order, and
+ * their data into data. lbas and data must have room for getNumPinnedBlocks() blocks.
+ * Returns how many blocks were copied, or UNSIGNED_ERROR if memory ran out. */
+uint64_t copyPinnedBlocks(uint64_t *lbas, char *data);
+
+/* Unpins every block. They stay dirty until they are evicted or flushed. */
+void unpinAllBlocks();
+
+/* Flushes the cache, then frees it. Returns the result of the flush. */
+int exitBlockCache();
+
+/* Copies the cache counters into stats. */
+void getBlockCacheStats(cache_stats *stats);
+
+/* Prints the cache counters. */
+void printBlockCacheStats();
+
+#endif
@@ -0,0 +1,332 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsCopy.c
+*
+* Description: The copy engine used by cp, cp2fs and cp2l. A copy within
+*  the volume is done by b_copy, block run by block run. A copy between
+*  the volume and Linux is a pipeline of two stages sharing
+*  COPY_NUM_BUFFERS buffers: the reading stage fills them in turn and the
+*  writing stage empties them in the same order. The Linux side runs on
+*  its own thread, and everything that touches the volume stays on the
+*  calling thread.
+*
+**************************************************************/
+
+#define _GNU_SOURCE // for sync_file_range
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "fsCopy.h"
+#include "b_io.h"
+#include "fsIOBuffer.h"
+
+// reads or writes count bytes. has the same form as b_read and b_write
+typedef ssize_t (*copy_io_fn)(int fd, char *buffer, ssize_t count);
+
+// the state shared by the two stages of a copy
+typedef struct copy_pipe {
+    pthread_mutex_t lock; // guards bytes, full, the failed flags and copied
+    pthread_cond_t changed; // signaled when a buffer is filled or emptied, or a stage fails
+
+    char *data[COPY_NUM_BUFFERS]; // the buffers
+    int bytes[COPY_NUM_BUFFERS]; // bytes in each full buffer
+    int full[COPY_NUM_BUFFERS]; // TRUE once a buffer is filled, FALSE once it is written
+    int chunk_bytes; // size of each buffer. a buffer with fewer bytes is the last one
+
+    copy_io_fn read_fn; // reads the source
+    int read_fd;
+    copy_io_fn write_fn; // writes the destination
+    int write_fd;
+
+    int read_failed; // TRUE if the source could not be read
+    int write_failed; // TRUE if the destination could not be written
+    long long copied; // bytes written to the destination
+} copy_pipe;
+
+// stage that runs on the second thread, and whether it is the reading stage
+typedef struct copy_thread_args {
+    copy_pipe *pipe;
+    int reads;
+} copy_thread_args;
+
+/* Drops the bytes bytes of the Linux file that end at its file offset from the page
+ * cache once the copy is done with them, if the volume skips the page cache too, so
+ * that a large copy does not push everything else out of it. Written pages are only
+ * dropped once they are on disk, so they are written out first. */
+static void dropLinuxPages(int fd, ssize_t bytes, int written) {
+    if (bytes <= 0 || deviceAlignment() == 1) return;
+
+    off_t end = lseek(fd, 0, SEEK_CUR);
+    if (end < bytes) return;
+
+    if (written) {
+        sync_file_range(fd, end - bytes, bytes, SYNC_FILE_RANGE_WAIT_BEFORE
+                        | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    }
+    posix_fadvise(fd, end - bytes, bytes, POSIX_FADV_DONTNEED);
+}
+
+static ssize_t readLinux(int fd, char *buffer, ssize_t count) {
+    ssize_t bytes = read(fd, buffer, count);
+    dropLinuxPages(fd, bytes, FALSE);
+    return bytes;
+}
+
+static ssize_t writeLinux(int fd, char *buffer, ssize_t count) {
+    ssize_t bytes = write(fd, buffer, count);
+    dropLinuxPages(fd, bytes, TRUE);
+    return bytes;
+}
+
+/* Returns COPY_CHUNK_BYTES rounded down to a multiple of the block size. */
+static int getChunkBytes() {
+    int chunk_bytes = COPY_CHUNK_BYTES / vcb->block_size * vcb->block_size;
+    return chunk_bytes > 0 ? chunk_bytes : vcb->block_size;
+}
+
+/* Reads until buffer holds count bytes or the source ends, since a read may return
+ * fewer bytes than asked for. Returns how many bytes were read, or ERROR. */
+static int fillChunk(copy_io_fn read_fn, int fd, char *buffer, int count) {
+    int total = 0;
+    while (total < count) {
+        ssize_t bytes = read_fn(fd, buffer + total, count - total);
+        if (bytes < 0) return ERROR;
+        if (bytes == 0) break; // end of the source
+
+        total += bytes;
+    }
+
+    return total;
+}
+
+/* Writes all count bytes of buffer. Returns ERROR if they could not all be written,
+ * e.g. because the volume is full, or SUCCESS. */
+static int drainChunk(copy_io_fn write_fn, int fd, char *buffer, int count) {
+    int total = 0;
+    while (total < count) {
+        ssize_t bytes = write_fn(fd, buffer + total, count - total);
+        if (bytes <= 0) return ERROR;
+
+        total += bytes;
+    }
+
+    return SUCCESS;
+}
+
+/* The reading stage. Fills the buffers in turn until the source ends, the source
+ * cannot be read, or the writing stage fails. */
+static void readStage(copy_pipe *pipe) {
+    for (int i = 0; ; i = (i + 1) % COPY_NUM_BUFFERS) {
+        pthread_mutex_lock(&pipe->lock);
+        while (pipe->full[i] && !pipe->write_failed) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        int stop = pipe->write_failed;
+        pthread_mutex_unlock(&pipe->lock);
+        if (stop) return;
+
+        int bytes = fillChunk(pipe->read_fn, pipe->read_fd, pipe->data[i], pipe->chunk_bytes);
+
+        pthread_mutex_lock(&pipe->lock);
+        if (bytes == ERROR) pipe->read_failed = TRUE;
+        else {
+            pipe->bytes[i] = bytes;
+            pipe->full[i] = TRUE;
+        }
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+
+        if (bytes == ERROR || bytes < pipe->chunk_bytes) return;
+    }
+}
+
+/* The writing stage. Empties the buffers in the order they were filled until the
+ * last one was written, a write fails, or the reading stage fails. */
+static void writeStage(copy_pipe *pipe) {
+    for (int i = 0; ; i = (i + 1) % COPY_NUM_BUFFERS) {
+        pthread_mutex_lock(&pipe->lock);
+        while (!pipe->full[i] && !pipe->read_failed) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        int stop = !pipe->full[i]; // the reading stage failed before filling it
+        pthread_mutex_unlock(&pipe->lock);
+        if (stop) return;
+
+        int bytes = pipe->bytes[i];
+        int result = drainChunk(pipe->write_fn, pipe->write_fd, pipe->data[i], bytes);
+
+        pthread_mutex_lock(&pipe->lock);
+        if (result == ERROR) pipe->write_failed = TRUE;
+        else {
+            pipe->full[i] = FALSE;
+            pipe->copied += bytes;
+        }
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+
+        if (result == ERROR || bytes < pipe->chunk_bytes) return;
+    }
+}
+
+/* Runs one stage of the copy on the second thread. */
+static void *copyThread(void *arg) {
+    copy_thread_args *args = arg;
+    if (args->reads) readStage(args->pipe);
+    else writeStage(args->pipe);
+    return NULL;
+}
+
+/* Copies from read_fn to write_fn. If linux_reads is TRUE, the reading stage runs on
+ * the second thread, otherwise the writing stage does. The failed flags in pipe tell
+ * which side failed. Returns how many bytes were copied, or ERROR on error. */
+static long long runPipe(copy_pipe *pipe, copy_io_fn read_fn, int read_fd,
+                         copy_io_fn write_fn, int write_fd, int linux_reads) {
+    memset(pipe, 0, sizeof(copy_pipe));
+    pipe->chunk_bytes = getChunkBytes();
+    pipe->read_fn = read_fn;
+    pipe->read_fd = read_fd;
+    pipe->write_fn = write_fn;
+    pipe->write_fd = write_fd;
+
+    long long result = ERROR;
+    int num_buffers = 0; // how many buffers were allocated
+    for (; num_buffers < COPY_NUM_BUFFERS; num_buffers++) {
+        pipe->data[num_buffers] = (pipe->chunk_bytes <= IO_BUFFER_BYTES)
+                                  ? getIOBuffer() : allocIOBuffer(pipe->chunk_bytes);
+        if (!pipe->data[num_buffers]) {
+            printf("Error: Out of memory for the copy buffers. ");
+            pipe->read_failed = TRUE; // nothing was read, so the destination is not kept
+            goto free_and_return;
+        }
+    }
+
+    pthread_mutex_init(&pipe->lock, NULL);
+    pthread_cond_init(&pipe->changed, NULL);
+
+    pthread_t thread;
+    copy_thread_args args = { pipe, linux_reads };
+    if (pthread_create(&thread, NULL, copyThread, &args) != 0) {
+        printf("Error: Could not start the copy thread. ");
+        pipe->read_failed = TRUE;
+    } else {
+        if (linux_reads) writeStage(pipe);
+        else readStage(pipe);
+        pthread_join(thread, NULL);
+    }
+
+    pthread_cond_destroy(&pipe->changed);
+    pthread_mutex_destroy(&pipe->lock);
+
+    if (!pipe->read_failed && !pipe->write_failed) result = pipe->copied;
+
+    free_and_return: // Label for freeing the buffers and returning result.
+    for (int i = 0; i < num_buffers; i++) {
+        putIOBuffer(pipe->data[i]);
+        pipe->data[i] = NULL;
+    }
+
+    return result;
+}
+
+long long copyToVolume(const char *src, const char *dest) {
+    int linux_fd = open(src, O_RDONLY);
+    if (linux_fd < 0) {
+        printf("Could not open the Linux file '%s'.\n", src);
+        return ERROR;
+    }
+
+    b_io_fd testfs_fd = b_open((char *) dest, O_WRONLY | O_CREAT | O_TRUNC);
+    if (testfs_fd == ERROR) {
+        close(linux_fd);
+        return ERROR;
+    }
+
+    // the whole file is allocated at once, so it is stored in as few extents as possible
+    struct stat src_stat;
+    if (fstat(linux_fd, &src_stat) == 0) b_preallocate(testfs_fd, src_stat.st_size);
+
+    copy_pipe pipe;
+    long long copied = runPipe(&pipe, readLinux, linux_fd, b_write, testfs_fd, TRUE);
+
+    // tells b_close not to keep a file that could not be read in full
+    if (pipe.read_failed) b_write(testfs_fd, NULL, ERROR);
+
+    b_close(testfs_fd);
+    close(linux_fd);
+    return copied;
+}
+
+long long copyFromVolume(const char *src, const char *dest) {
+    b_io_fd testfs_fd = b_open((char *) src, O_RDONLY);
+    if (testfs_fd == ERROR) return ERROR;
+
+    // calls linux's open with read and write permissions so that we do not need
+    // to manually change the permissions for each file to open them
+    // Credit: Robert Bierman
+    int linux_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC,
+                        S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
+    if (linux_fd < 0) {
+        printf("Could not open the Linux file '%s'.\n", dest);
+        b_close(testfs_fd);
+        return ERROR;
+    }
+
+    copy_pipe pipe;
+    long long copied = runPipe(&pipe, b_read, testfs_fd, writeLinux, linux_fd, FALSE);
+
+    b_close(testfs_fd);
+    close(linux_fd);
+    return copied;
+}
+
+/* Returns TRUE if the volume paths a and b name the same file, i.e. the same name in
+ * the same directory, FALSE otherwise. */
+static int isSameFile(const char *a, const char *b) {
+    long long a_parent = getParentBasenameStartBlock(a);
+    long long b_parent = getParentBasenameStartBlock(b);
+    if (a_parent == ERROR || b_parent == ERROR || a_parent != b_parent) return FALSE;
+
+    char *a_name = getBasename(a); // a_name and b_name must be freed
+    char *b_name = getBasename(b);
+    int same = a_name && b_name && strcmp(a_name, b_name) == 0;
+
+    free(a_name);
+    a_name = NULL;
+    free(b_name);
+    b_name = NULL;
+    return same;
+}
+
+long long copyInVolume(const char *src, const char *dest) {
+    // opening dest would truncate the file before it was read
+    if (isSameFile(src, dest)) {
+        printf("'%s' and '%s' are the same file.\n", src, dest);
+        return ERROR;
+    }
+
+    b_io_fd src_fd = b_open((char *) src, O_RDONLY);
+    if (src_fd == ERROR) return ERROR;
+
+    b_io_fd dest_fd = b_open((char *) dest, O_WRONLY | O_CREAT | O_TRUNC);
+    if (dest_fd == ERROR) {
+        b_close(src_fd);
+        return ERROR;
+    }
+
+    // both files are on the volume, so the blocks go from disk to disk
+    long long copied = b_copy(src_fd, dest_fd);
+
+    b_close(src_fd);
+    b_close(dest_fd);
+    return copied;
+}
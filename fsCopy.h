@@ -0,0 +1,41 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsCopy.h
+*
+* Description: Interface for the copy engine used by cp, cp2fs and cp2l.
+*  Data is moved in large chunks that are a multiple of the block size, so
+*  whole runs of blocks go straight between the caller's buffer and the
+*  disk. When one side of the copy is a Linux file, a second thread does
+*  the Linux reads or writes into one buffer while the volume side works
+*  on the other. A copy within the volume goes from disk to disk. The
+*  destination's blocks are allocated up front from the source's size.
+*
+**************************************************************/
+
+#ifndef _FS_COPY_H
+#define _FS_COPY_H
+
+#define COPY_CHUNK_BYTES (1024 * 1024) // bytes moved per read or write, rounded to blocks
+#define COPY_NUM_BUFFERS 2 // buffers the two sides of a copy take turns on
+
+/* Copies the Linux file src into the volume as dest.
+ * Returns how many bytes were copied, or ERROR on error. */
+long long copyToVolume(const char *src, const char *dest);
+
+/* Copies the volume file src out to the Linux file dest.
+ * Returns how many bytes were copied, or ERROR on error. */
+long long copyFromVolume(const char *src, const char *dest);
+
+/* Copies the volume file src to the volume file dest with b_copy, so the data does
+ * not pass through either file's buffer. Used by cp -f; a plain cp clones the file
+ * with fs_clone instead.
+ * Returns how many bytes were copied, or ERROR on error. */
+long long copyInVolume(const char *src, const char *dest);
+
+#endif
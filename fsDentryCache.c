@@ -0,0 +1,148 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsDentryCache.c
+*
+* Description: A set-associative dentry cache. Each (parent directory, name)
+*  pair hashes to one set of DCACHE_WAYS entries, so lookups and inserts
+*  only ever look at a handful of entries. Names that were searched for and
+*  not found are cached too, as negative entries.
+*
+**************************************************************/
+
+#include "fsDentryCache.h"
+
+typedef struct dentry_cache_entry {
+    uint64_t parent_start_block; // the directory the name was looked up in
+    uint64_t child_start_block; // start block of the entry with the matching name
+    int child_type; // DIRECTORY, FILE, or DCACHE_NEGATIVE
+    int valid; // TRUE if this cache entry is in use
+    char name[MAX_DE_NAME_LENGTH]; // the name that was looked up
+} dentry_cache_entry;
+
+dentry_cache_entry dentry_cache[DCACHE_SETS][DCACHE_WAYS];
+int dentry_cache_victim[DCACHE_SETS]; // the next way to replace in each set
+dentry_cache_stats dentry_counters;
+
+/* Returns the set that (parent_start_block, name) belongs to, using FNV-1a. */
+static int dentryCacheSet(uint64_t parent_start_block, const char *name) {
+    uint64_t hash = 14695981039346656037ull;
+
+    for (int i = 0; i < sizeof(uint64_t); i++) {
+        hash ^= (parent_start_block >> (i * 8)) & 0xFF;
+        hash *= 1099511628211ull;
+    }
+    for (const char *c = name; *c; c++) {
+        hash ^= (unsigned char) *c;
+        hash *= 1099511628211ull;
+    }
+
+    return (int) (hash & (DCACHE_SETS - 1));
+}
+
+/* Returns the cache entry for (parent_start_block, name), or NULL if it is not cached. */
+static dentry_cache_entry* dentryCacheFind(uint64_t parent_start_block, const char *name) {
+    dentry_cache_entry *set = dentry_cache[dentryCacheSet(parent_start_block, name)];
+
+    for (int way = 0; way < DCACHE_WAYS; way++) {
+        if (set[way].valid && set[way].parent_start_block == parent_start_block
+            && strcmp(set[way].name, name) == 0) {
+            return &set[way];
+        }
+    }
+
+    return NULL;
+}
+
+int dentryCacheLookup(uint64_t parent_start_block, const char *name,
+                      uint64_t *child_start_block, int *child_type) {
+    dentry_cache_entry *entry = dentryCacheFind(parent_start_block, name);
+    if (!entry) {
+        dentry_counters.misses++;
+        return FALSE;
+    }
+
+    if (entry->child_type == DCACHE_NEGATIVE) dentry_counters.negative_hits++;
+    else dentry_counters.hits++;
+
+    *child_start_block = entry->child_start_block;
+    *child_type = entry->child_type;
+    return TRUE;
+}
+
+void dentryCacheInsert(uint64_t parent_start_block, const char *name,
+                       uint64_t child_start_block, int child_type) {
+    if (strnlen(name, MAX_DE_NAME_LENGTH) >= MAX_DE_NAME_LENGTH) return; // cannot exist
+
+    int set = dentryCacheSet(parent_start_block, name);
+    dentry_cache_entry *entry = dentryCacheFind(parent_start_block, name);
+
+    if (!entry) { // use a free way if there is one, otherwise replace round robin
+        for (int way = 0; way < DCACHE_WAYS && !entry; way++) {
+            if (!dentry_cache[set][way].valid) entry = &dentry_cache[set][way];
+        }
+
+        if (!entry) {
+            entry = &dentry_cache[set][dentry_cache_victim[set]];
+            dentry_cache_victim[set] = (dentry_cache_victim[set] + 1) % DCACHE_WAYS;
+        }
+    }
+
+    entry->parent_start_block = parent_start_block;
+    entry->child_start_block = child_start_block;
+    entry->child_type = child_type;
+    entry->valid = TRUE;
+    strcpy(entry->name, name);
+}
+
+void dentryCacheInvalidate(uint64_t parent_start_block, const char *name) {
+    if (!name) return;
+
+    dentry_cache_entry *entry = dentryCacheFind(parent_start_block, name);
+    if (entry) {
+        entry->valid = FALSE;
+        dentry_counters.invalidations++;
+    }
+}
+
+void dentryCacheInvalidateDir(uint64_t dir_start_block) {
+    for (int set = 0; set < DCACHE_SETS; set++) {
+        for (int way = 0; way < DCACHE_WAYS; way++) {
+            if (dentry_cache[set][way].valid
+                && dentry_cache[set][way].parent_start_block == dir_start_block) {
+                dentry_cache[set][way].valid = FALSE;
+                dentry_counters.invalidations++;
+            }
+        }
+    }
+}
+
+void dentryCacheClear() {
+    for (int set = 0; set < DCACHE_SETS; set++) {
+        for (int way = 0; way < DCACHE_WAYS; way++) dentry_cache[set][way].valid = FALSE;
+    }
+}
+
+void printDentryCacheStats() {
+    int num_cached = 0; // entries currently in use
+
+    for (int set = 0; set < DCACHE_SETS; set++) {
+        for (int way = 0; way < DCACHE_WAYS; way++) {
+            if (dentry_cache[set][way].valid) num_cached++;
+        }
+    }
+
+    printf("Dentry cache: %d/%d entries cached\n"
+           "  hits: %lu\n"
+           "  negative hits: %lu\n"
+           "  misses: %lu\n"
+           "  invalidations: %lu\n",
+           num_cached, DCACHE_SETS * DCACHE_WAYS, dentry_counters.hits,
+           dentry_counters.negative_hits, dentry_counters.misses,
+           dentry_counters.invalidations);
+}
@@ -0,0 +1,60 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsDentryCache.h
+*
+* Description: Interface for the directory entry (dentry) cache used
+*  by path resolution. It maps a (parent directory, name) pair to the
+*  start block and type of the matching directory entry.
+*
+**************************************************************/
+
+#ifndef _FS_DENTRY_CACHE_H
+#define _FS_DENTRY_CACHE_H
+
+#include "fsInit.h"
+
+#define DCACHE_SETS 1024 // number of sets in the dentry cache, must be a power of 2
+#define DCACHE_WAYS 4 // number of entries in each set
+#define DCACHE_NEGATIVE -2 // cached type of a name that does not exist in its parent
+
+// Counters for the dentry cache, readable from the shell with the stats command
+typedef struct dentry_cache_stats {
+    uint64_t hits; // lookups answered with a cached entry
+    uint64_t negative_hits; // lookups answered with a cached "not found"
+    uint64_t misses; // lookups that had to search the directory on disk
+    uint64_t invalidations; // entries dropped because the directory changed
+} dentry_cache_stats;
+
+/* Looks up name in the directory starting at parent_start_block.
+ * Returns TRUE and fills in child_start_block and child_type on a hit.
+ * child_type is DCACHE_NEGATIVE if the name is known to not exist.
+ * Returns FALSE if the cache has no entry for the name. */
+int dentryCacheLookup(uint64_t parent_start_block, const char *name,
+                      uint64_t *child_start_block, int *child_type);
+
+/* Caches the result of searching for name in the directory starting at
+ * parent_start_block. Pass DCACHE_NEGATIVE as child_type if name was not found. */
+void dentryCacheInsert(uint64_t parent_start_block, const char *name,
+                       uint64_t child_start_block, int child_type);
+
+/* Drops the cached entry for name in the directory starting at parent_start_block.
+ * Must be called whenever that directory entry is created, removed, or changed. */
+void dentryCacheInvalidate(uint64_t parent_start_block, const char *name);
+
+/* Drops every cached entry inside the directory starting at dir_start_block.
+ * Must be called when that directory is removed, since its blocks can be reused. */
+void dentryCacheInvalidateDir(uint64_t dir_start_block);
+
+/* Drops every entry in the dentry cache. */
+void dentryCacheClear();
+
+/* Prints the dentry cache counters. */
+void printDentryCacheStats();
+
+#endif
@@ -0,0 +1,1180 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsDevice.c
+*
+* Description: The block device backends and the functions that pass
+*  each transfer to the backend that was started. The file backend lets
+*  startPartitionSystem create or check the volume file and its header
+*  block, then moves blocks with pread and pwrite on a descriptor of its
+*  own, so transfers from different threads never share a file offset.
+*  The thread pool and uring backends move blocks the same way, and also
+*  run queued transfers in the background. The io_uring rings are set up
+*  with the raw system calls, so no library is needed. The mmap backend
+*  maps the whole volume file, so its blocks can be looked at in place,
+*  and only msyncs the range written since the last flush. The direct
+*  backend is the uring backend with a second, O_DIRECT descriptor that
+*  every suitably aligned transfer uses instead of the first.
+*  Each thread's queued transfers are a batch of their own, which
+*  deviceWait waits for without waiting for anyone else's. With io_uring,
+*  one waiting thread at a time sleeps in the kernel while the others'
+*  transfers keep being queued, and it reaps every thread's completions.
+*
+**************************************************************/
+
+#define _GNU_SOURCE // for fallocate and O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "fsDevice.h"
+#include "helperFunctions.h"
+
+#define HEADER_BLOCKS 1 // the partition header comes before block 0 in a volume file
+
+static block_device *device = NULL; // the backend that was started, or NULL
+static uint64_t dev_block_size = 0; // size of a block in bytes
+static uint64_t dev_num_blocks = 0; // how many blocks the volume has
+static device_stats device_counters; // read/write/flush counters
+// held while transfers are queued or reaped, since the queues belong to the device
+static pthread_mutex_t io_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t num_queued = 0; // transfers queued by every thread and not waited for yet
+
+// the transfers one thread queued with deviceSubmit
+typedef struct device_batch {
+    uint64_t pending; // not completed yet. guarded by the backend's lock
+    uint64_t queued; // queued since the thread last called deviceWait
+} device_batch;
+
+static __thread device_batch thread_batch; // the calling thread's batch
+static uint64_t num_views = 0; // views handed out by deviceView and not yet released
+
+/* Adds n to a device counter. Transfers come from several threads, and the counters
+ * are not worth a lock. */
+static void countDevice(uint64_t *counter, uint64_t n) {
+    __atomic_fetch_add(counter, n, __ATOMIC_RELAXED);
+}
+
+/* Returns how many blocks the iovcnt buffers of iov hold. */
+static uint64_t iovecBlocks(const struct iovec *iov, int iovcnt) {
+    uint64_t bytes = 0;
+    for (int i = 0; i < iovcnt; i++) bytes += iov[i].iov_len;
+    return bytes / dev_block_size;
+}
+
+/* Returns TRUE if the lba_count blocks from lba_position on are all in the volume,
+ * FALSE otherwise. */
+static int isInVolume(uint64_t lba_count, uint64_t lba_position) {
+    return lba_position <= dev_num_blocks && lba_count <= dev_num_blocks - lba_position;
+}
+
+/************************************ file backend ************************************/
+
+static int file_fd = -1; // the volume file, opened for pread and pwrite
+static int direct_fd = -1; // the volume file opened with O_DIRECT by the direct backend
+static uint64_t direct_align = 1; // what O_DIRECT buffers, sizes and offsets are multiples of
+
+/* Returns where block lba_position starts in the volume file. */
+static off_t fileOffset(uint64_t lba_position) {
+    return (off_t) ((lba_position + HEADER_BLOCKS) * dev_block_size);
+}
+
+/* Returns TRUE if a transfer of bytes bytes between buf and offset can skip the page
+ * cache, i.e. O_DIRECT is on and all three are aligned for it, FALSE otherwise. */
+static int isDirectIO(const void *buf, uint64_t bytes, off_t offset) {
+    return direct_fd >= 0 && (uintptr_t) buf % direct_align == 0
+           && bytes % direct_align == 0 && (uint64_t) offset % direct_align == 0;
+}
+
+/* Returns the descriptor a transfer of bytes bytes between buf and offset uses:
+ * direct_fd if it can skip the page cache, or else file_fd. */
+static int pickDescriptor(const void *buf, uint64_t bytes, off_t offset) {
+    if (!isDirectIO(buf, bytes, offset)) return file_fd;
+
+    countDevice(&device_counters.direct_transfers, 1);
+    return direct_fd;
+}
+
+/* Reads or writes bytes bytes at offset in the volume file, since a single pread or
+ * pwrite may move fewer. Returns how many bytes were moved. */
+static uint64_t fileTransfer(char *buf, uint64_t bytes, off_t offset, int is_write) {
+    int fd = pickDescriptor(buf, bytes, offset);
+    uint64_t done = 0;
+    while (done < bytes) {
+        ssize_t moved = is_write ? pwrite(fd, buf + done, bytes - done, offset + done)
+                                 : pread(fd, buf + done, bytes - done, offset + done);
+
+        // the file system under the volume file may want more alignment than it
+        // said. the page cache takes the rest
+        if (moved < 0 && fd == direct_fd) {
+            fd = file_fd;
+            continue;
+        }
+        if (moved <= 0) break;
+
+        done += moved;
+    }
+
+    return done;
+}
+
+static int fileStart(char *filename, uint64_t *vol_size, uint64_t *block_size) {
+    int result = startPartitionSystem(filename, vol_size, block_size);
+    if (result != PART_NOERROR) return result;
+
+    file_fd = open(filename, O_RDWR);
+    if (file_fd < 0) {
+        printf("Error: Could not open the volume file '%s'.\n", filename);
+        closePartitionSystem();
+        return ERROR;
+    }
+
+    return PART_NOERROR;
+}
+
+static void fileStop() {
+    close(file_fd);
+    file_fd = -1;
+    closePartitionSystem();
+}
+
+static uint64_t fileRead(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    return fileTransfer(buf, lba_count * dev_block_size, fileOffset(lba_position), FALSE)
+           / dev_block_size;
+}
+
+static uint64_t fileWrite(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    return fileTransfer(buf, lba_count * dev_block_size, fileOffset(lba_position), TRUE)
+           / dev_block_size;
+}
+
+/* Returns the descriptor a transfer between the iovcnt buffers of iov and offset uses:
+ * direct_fd if every buffer is aligned for O_DIRECT, or else file_fd. */
+static int pickDescriptorv(const struct iovec *iov, int iovcnt, off_t offset) {
+    int aligned = direct_fd >= 0;
+    for (int i = 0; i < iovcnt && aligned; i++) {
+        aligned = isDirectIO(iov[i].iov_base, iov[i].iov_len, offset);
+    }
+
+    return aligned ? pickDescriptor(iov[0].iov_base, iov[0].iov_len, offset) : file_fd;
+}
+
+/* Moves the rest of iov, after the first done bytes, one buffer at a time from
+ * offset + done on. Returns how many bytes of iov were moved in all. */
+static uint64_t fileFinishv(const struct iovec *iov, int iovcnt, off_t offset,
+                            uint64_t done, int is_write) {
+    uint64_t start = 0; // where iov[i] starts, in bytes from offset
+    for (int i = 0; i < iovcnt; i++) {
+        uint64_t end = start + iov[i].iov_len;
+        if (done < end) {
+            uint64_t skip = done - start; // bytes of this buffer already moved
+            uint64_t rest = iov[i].iov_len - skip;
+            if (fileTransfer((char *) iov[i].iov_base + skip, rest, offset + done,
+                is_write) != rest) {
+                break;
+            }
+            done = end;
+        }
+        start = end;
+    }
+
+    return done;
+}
+
+/* Moves all of iov with one preadv or pwritev. If that moved less, e.g. because there
+ * are more than IOV_MAX buffers, the rest is moved one buffer at a time.
+ * Returns how many blocks were moved. */
+static uint64_t fileTransferv(const struct iovec *iov, int iovcnt, uint64_t lba_position,
+                              int is_write) {
+    off_t offset = fileOffset(lba_position);
+    int fd = pickDescriptorv(iov, iovcnt, offset);
+    ssize_t moved = is_write ? pwritev(fd, iov, iovcnt, offset)
+                             : preadv(fd, iov, iovcnt, offset);
+    uint64_t done = moved > 0 ? moved : 0; // bytes moved so far
+
+    return fileFinishv(iov, iovcnt, offset, done, is_write) / dev_block_size;
+}
+
+static uint64_t fileReadv(const struct iovec *iov, int iovcnt, uint64_t lba_position) {
+    return fileTransferv(iov, iovcnt, lba_position, FALSE);
+}
+
+static uint64_t fileWritev(const struct iovec *iov, int iovcnt, uint64_t lba_position) {
+    return fileTransferv(iov, iovcnt, lba_position, TRUE);
+}
+
+static int fileFlush() {
+    return fdatasync(file_fd) == 0 ? SUCCESS : ERROR;
+}
+
+/* Punches a hole where the blocks are, so the file system under the volume file can
+ * drop them. Not every file system can, which is not an error. */
+static int fileDiscard(uint64_t lba_count, uint64_t lba_position) {
+    fallocate(file_fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+              fileOffset(lba_position), lba_count * dev_block_size);
+    return SUCCESS;
+}
+
+static block_device file_device = {
+    "file", fileStart, fileStop, fileRead, fileWrite, fileReadv, fileWritev,
+    fileFlush, fileDiscard, NULL, NULL, NULL, NULL
+};
+
+/********************************* thread pool backend ********************************/
+
+static pthread_t pool_threads[POOL_THREADS];
+static int num_pool_threads = 0; // how many of pool_threads were started
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER; // guards the rest of these
+static pthread_cond_t pool_work = PTHREAD_COND_INITIALIZER; // signaled when work is queued
+// signaled when a batch has no transfers left
+static pthread_cond_t pool_done = PTHREAD_COND_INITIALIZER;
+static device_io *pool_head = NULL; // the queued transfers no thread has taken yet
+static device_io *pool_tail = NULL;
+static int pool_stopping = FALSE; // TRUE once the threads should exit
+
+/* Runs one transfer on the volume file and records how many blocks it moved. */
+static void runFileIO(device_io *io) {
+    if (io->iov) {
+        io->blocks = fileTransferv(io->iov, io->iovcnt, io->lba_position, io->is_write);
+        return;
+    }
+
+    io->blocks = fileTransfer(io->buf, io->lba_count * dev_block_size,
+                              fileOffset(io->lba_position), io->is_write) / dev_block_size;
+}
+
+/* Takes queued transfers and runs them until the pool stops. */
+static void *poolThread(void *arg) {
+    pthread_mutex_lock(&pool_lock);
+    while (TRUE) {
+        while (!pool_head && !pool_stopping) pthread_cond_wait(&pool_work, &pool_lock);
+        if (!pool_head) break; // stopping, and nothing is left
+
+        device_io *io = pool_head;
+        pool_head = io->next;
+        if (!pool_head) pool_tail = NULL;
+        pthread_mutex_unlock(&pool_lock);
+
+        device_batch *batch = io->batch; // io is the waiter's once it completes
+        runFileIO(io);
+
+        pthread_mutex_lock(&pool_lock);
+        if (--batch->pending == 0) pthread_cond_broadcast(&pool_done);
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    return NULL;
+}
+
+/* Starts the pool's threads. Returns ERROR if none could be started, or SUCCESS. */
+static int startPool() {
+    pool_stopping = FALSE;
+    for (num_pool_threads = 0; num_pool_threads < POOL_THREADS; num_pool_threads++) {
+        if (pthread_create(&pool_threads[num_pool_threads], NULL, poolThread, NULL) != 0) {
+            break;
+        }
+    }
+
+    return num_pool_threads > 0 ? SUCCESS : ERROR;
+}
+
+static void stopPool() {
+    pthread_mutex_lock(&pool_lock);
+    pool_stopping = TRUE;
+    pthread_cond_broadcast(&pool_work);
+    pthread_mutex_unlock(&pool_lock);
+
+    for (int i = 0; i < num_pool_threads; i++) pthread_join(pool_threads[i], NULL);
+    num_pool_threads = 0;
+}
+
+static int poolStart(char *filename, uint64_t *vol_size, uint64_t *block_size) {
+    int result = fileStart(filename, vol_size, block_size);
+    if (result != PART_NOERROR) return result;
+
+    if (startPool() == ERROR) {
+        printf("Error: Could not start the I/O threads.\n");
+        fileStop();
+        return ERROR;
+    }
+
+    return PART_NOERROR;
+}
+
+static void poolStop() {
+    stopPool();
+    fileStop();
+}
+
+static void poolSubmit(device_io *io) {
+    pthread_mutex_lock(&pool_lock);
+    io->next = NULL;
+    if (pool_tail) pool_tail->next = io;
+    else pool_head = io;
+    pool_tail = io;
+    io->batch->pending++;
+    pthread_cond_signal(&pool_work);
+    pthread_mutex_unlock(&pool_lock);
+}
+
+static int poolWait() {
+    pthread_mutex_lock(&pool_lock);
+    while (thread_batch.pending > 0) pthread_cond_wait(&pool_done, &pool_lock);
+    pthread_mutex_unlock(&pool_lock);
+
+    return SUCCESS;
+}
+
+static block_device pool_device = {
+    "threads", poolStart, poolStop, fileRead, fileWrite, fileReadv, fileWritev,
+    fileFlush, fileDiscard, poolSubmit, poolWait, NULL, NULL
+};
+
+/************************************ uring backend ***********************************/
+
+// the parts of the io_uring rings that are shared with the kernel
+typedef struct uring {
+    int fd; // the ring, or -1 if io_uring is not available and the pool is used
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    unsigned sq_entries;
+    unsigned cq_entries;
+
+    void *sq_map; // the mapped rings, for unmapping them
+    size_t sq_map_bytes;
+    void *cq_map; // the same as sq_map if the kernel maps both rings at once
+    size_t cq_map_bytes;
+    size_t sqes_bytes;
+
+    unsigned to_submit; // entries in the submission queue the kernel has not taken yet
+    unsigned in_flight; // transfers the kernel took that have not completed
+    // TRUE while a thread sleeps in the kernel for completions. only it reaps meanwhile,
+    // since it only wakes up once there is something left to reap
+    int reaping;
+} uring;
+
+static uring ring = { .fd = -1 };
+// signaled when transfers were reaped, or the reaping thread is done
+static pthread_cond_t ring_reaped = PTHREAD_COND_INITIALIZER;
+static struct iovec registered[MAX_REGISTERED_BUFFERS]; // the registered buffers
+static int num_registered = 0;
+
+static int uringSetup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uringEnter(unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return (int) syscall(__NR_io_uring_enter, ring.fd, to_submit, min_complete, flags,
+                         NULL, 0);
+}
+
+static int uringRegister(unsigned opcode, const void *arg, unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, ring.fd, opcode, arg, nr_args);
+}
+
+/* Returns TRUE if the kernel supports the operations the backend uses, FALSE if it
+ * is too old. */
+static int hasRingOps() {
+    int num_ops = IORING_OP_WRITE + 1; // the highest op that is probed for, plus one
+    size_t probe_bytes = sizeof(struct io_uring_probe)
+                         + num_ops * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, probe_bytes);
+    if (!probe) return FALSE;
+
+    int supported = uringRegister(IORING_REGISTER_PROBE, probe, num_ops) >= 0
+                    && probe->ops_len >= num_ops;
+    int ops[] = { IORING_OP_READ, IORING_OP_WRITE, IORING_OP_READ_FIXED,
+                  IORING_OP_WRITE_FIXED, IORING_OP_READV, IORING_OP_WRITEV };
+    for (size_t i = 0; supported && i < sizeof(ops) / sizeof(ops[0]); i++) {
+        supported = probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED;
+    }
+
+    free(probe);
+    probe = NULL;
+    return supported;
+}
+
+/* Unmaps the rings and closes them. */
+static void closeRing() {
+    if (ring.sqes && ring.sqes != MAP_FAILED) munmap(ring.sqes, ring.sqes_bytes);
+    if (ring.cq_map && ring.cq_map != MAP_FAILED && ring.cq_map != ring.sq_map) {
+        munmap(ring.cq_map, ring.cq_map_bytes);
+    }
+    if (ring.sq_map && ring.sq_map != MAP_FAILED) munmap(ring.sq_map, ring.sq_map_bytes);
+    if (ring.fd >= 0) close(ring.fd);
+
+    memset(&ring, 0, sizeof(uring));
+    ring.fd = -1;
+    num_registered = 0;
+}
+
+/* Sets up the rings and maps them. Returns ERROR if io_uring is not available, e.g.
+ * because the kernel is too old or does not allow it, or SUCCESS. */
+static int openRing() {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    memset(&ring, 0, sizeof(uring));
+
+    ring.fd = uringSetup(URING_ENTRIES, &params);
+    if (ring.fd < 0) return ERROR;
+    if (!hasRingOps()) goto free_and_return_error;
+
+    ring.sq_entries = params.sq_entries;
+    ring.cq_entries = params.cq_entries;
+    ring.sq_map_bytes = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring.cq_map_bytes = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring.sqes_bytes = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    int single_map = params.features & IORING_FEAT_SINGLE_MMAP;
+    if (single_map && ring.cq_map_bytes > ring.sq_map_bytes) {
+        ring.sq_map_bytes = ring.cq_map_bytes;
+    }
+
+    ring.sq_map = mmap(NULL, ring.sq_map_bytes, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQ_RING);
+    if (ring.sq_map == MAP_FAILED) goto free_and_return_error;
+
+    ring.cq_map = single_map ? ring.sq_map
+                             : mmap(NULL, ring.cq_map_bytes, PROT_READ | PROT_WRITE,
+                                    MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_CQ_RING);
+    if (ring.cq_map == MAP_FAILED) goto free_and_return_error;
+
+    ring.sqes = mmap(NULL, ring.sqes_bytes, PROT_READ | PROT_WRITE,
+                     MAP_SHARED | MAP_POPULATE, ring.fd, IORING_OFF_SQES);
+    if (ring.sqes == MAP_FAILED) goto free_and_return_error;
+
+    char *sq = ring.sq_map;
+    ring.sq_head = (unsigned *) (sq + params.sq_off.head);
+    ring.sq_tail = (unsigned *) (sq + params.sq_off.tail);
+    ring.sq_mask = (unsigned *) (sq + params.sq_off.ring_mask);
+    ring.sq_array = (unsigned *) (sq + params.sq_off.array);
+
+    char *cq = ring.cq_map;
+    ring.cq_head = (unsigned *) (cq + params.cq_off.head);
+    ring.cq_tail = (unsigned *) (cq + params.cq_off.tail);
+    ring.cq_mask = (unsigned *) (cq + params.cq_off.ring_mask);
+    ring.cqes = (struct io_uring_cqe *) (cq + params.cq_off.cqes);
+
+    return SUCCESS;
+
+    free_and_return_error: // Label for error handling. Close the rings and return ERROR.
+    closeRing();
+    return ERROR;
+}
+
+/* Records the completion of the transfer a completion queue entry is for. A transfer
+ * that failed or moved only part of its bytes, which is rare for a file, is finished
+ * here with pread or pwrite. */
+static void completeRingIO(struct io_uring_cqe *cqe) {
+    device_io *io = (device_io *) (uintptr_t) cqe->user_data;
+    uint64_t bytes = io->lba_count * dev_block_size;
+    uint64_t done = cqe->res > 0 ? (uint64_t) cqe->res : 0;
+
+    if (done < bytes && io->iov) {
+        done = fileFinishv(io->iov, io->iovcnt, fileOffset(io->lba_position), done,
+                           io->is_write);
+    } else if (done < bytes) {
+        done += fileTransfer((char *) io->buf + done, bytes - done,
+                             fileOffset(io->lba_position) + done, io->is_write);
+    }
+
+    io->blocks = done / dev_block_size;
+}
+
+/* Takes every entry from the completion queue without a system call, and wakes the
+ * threads whose batches they completed. Returns how many there were. */
+static unsigned reapRing() {
+    unsigned head = *ring.cq_head;
+    unsigned tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    unsigned reaped = tail - head;
+
+    for (; head != tail; head++) {
+        device_io *io = (device_io *) (uintptr_t) ring.cqes[head & *ring.cq_mask].user_data;
+        completeRingIO(&ring.cqes[head & *ring.cq_mask]);
+        io->batch->pending--;
+    }
+
+    __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+    ring.in_flight -= reaped;
+    if (reaped > 0) pthread_cond_broadcast(&ring_reaped);
+    return reaped;
+}
+
+/* Waits until some transfer in flight has completed and been reaped, letting go of
+ * io_lock meanwhile. Only one thread sleeps in the kernel at a time; the rest wait for
+ * it to reap. */
+static void waitRing() {
+    if (ring.reaping) {
+        pthread_cond_wait(&ring_reaped, &io_lock);
+        return;
+    }
+    if (reapRing() > 0 || ring.in_flight == 0) return;
+
+    ring.reaping = TRUE;
+    pthread_mutex_unlock(&io_lock);
+    uringEnter(0, 1, IORING_ENTER_GETEVENTS); // the caller looks again either way
+    pthread_mutex_lock(&io_lock);
+    ring.reaping = FALSE;
+
+    reapRing();
+    pthread_cond_broadcast(&ring_reaped); // another thread may sleep in the kernel now
+}
+
+/* Hands the queued entries to the kernel without waiting for any of them. If
+ * io_uring_enter fails, the entries it did not take are run here with pread and pwrite
+ * instead. */
+static void submitRing() {
+    while (ring.to_submit > 0) {
+        int submitted = uringEnter(ring.to_submit, 0, 0);
+        if (submitted >= 0) {
+            ring.to_submit -= submitted;
+            ring.in_flight += submitted;
+            continue;
+        }
+
+        if (errno == EINTR) continue;
+        // the kernel is short on resources until some transfers complete
+        if ((errno == EAGAIN || errno == EBUSY) && ring.in_flight > 0) {
+            waitRing();
+            continue;
+        }
+
+        unsigned head = __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE);
+        for (unsigned tail = *ring.sq_tail; head != tail; head++) {
+            unsigned index = ring.sq_array[head & *ring.sq_mask];
+            device_io *io = (device_io *) (uintptr_t) ring.sqes[index].user_data;
+            runFileIO(io);
+            io->batch->pending--;
+        }
+        __atomic_store_n(ring.sq_tail, head, __ATOMIC_RELEASE);
+        ring.to_submit = 0;
+        pthread_cond_broadcast(&ring_reaped);
+    }
+}
+
+/* Returns the index of the registered buffer that holds all of io's bytes, or -1. */
+static int findRegistered(device_io *io) {
+    char *start = io->buf;
+    uint64_t bytes = io->lba_count * dev_block_size;
+    for (int i = 0; i < num_registered; i++) {
+        char *reg_start = registered[i].iov_base;
+        if (start >= reg_start && start + bytes <= reg_start + registered[i].iov_len) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static int uringStart(char *filename, uint64_t *vol_size, uint64_t *block_size) {
+    int result = fileStart(filename, vol_size, block_size);
+    if (result != PART_NOERROR) return result;
+
+    if (openRing() == ERROR) {
+        printf("io_uring is not available. Using %d I/O threads instead.\n", POOL_THREADS);
+        if (startPool() == ERROR) {
+            printf("Error: Could not start the I/O threads.\n");
+            fileStop();
+            return ERROR;
+        }
+    }
+
+    return PART_NOERROR;
+}
+
+static void uringStop() {
+    if (ring.fd >= 0) closeRing();
+    else stopPool();
+    fileStop();
+}
+
+/* Adds io to the submission queue. The entries are handed to the kernel together when
+ * the queue is full or deviceWait is called. */
+static void uringSubmit(device_io *io) {
+    if (ring.fd < 0) {
+        poolSubmit(io);
+        return;
+    }
+
+    // the completion queue must have room for everything that is in flight
+    while (ring.to_submit == ring.sq_entries
+           || ring.to_submit + ring.in_flight >= ring.cq_entries) {
+        if (ring.to_submit > 0) submitRing();
+        else waitRing();
+    }
+
+    unsigned tail = *ring.sq_tail;
+    unsigned index = tail & *ring.sq_mask;
+    struct io_uring_sqe *sqe = &ring.sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+    off_t offset = fileOffset(io->lba_position);
+    int buf_index = io->iov ? -1 : findRegistered(io);
+    if (io->iov) {
+        sqe->opcode = io->is_write ? IORING_OP_WRITEV : IORING_OP_READV;
+        sqe->fd = pickDescriptorv(io->iov, io->iovcnt, offset);
+        sqe->addr = (uintptr_t) io->iov;
+        sqe->len = io->iovcnt;
+    } else {
+        if (buf_index >= 0) {
+            sqe->opcode = io->is_write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+            sqe->buf_index = buf_index;
+        } else sqe->opcode = io->is_write ? IORING_OP_WRITE : IORING_OP_READ;
+
+        sqe->fd = pickDescriptor(io->buf, io->lba_count * dev_block_size, offset);
+        sqe->addr = (uintptr_t) io->buf;
+        sqe->len = io->lba_count * dev_block_size;
+    }
+
+    sqe->off = offset;
+    sqe->user_data = (uintptr_t) io;
+
+    ring.sq_array[index] = index;
+    __atomic_store_n(ring.sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring.to_submit++;
+    io->batch->pending++;
+}
+
+/* Submits the queued entries, then waits for the calling thread's transfers, only
+ * sleeping in the kernel while none of them has completed. */
+static int uringWait() {
+    if (ring.fd < 0) return poolWait();
+
+    pthread_mutex_lock(&io_lock);
+    while (thread_batch.pending > 0) {
+        if (ring.to_submit > 0) submitRing();
+        else waitRing();
+    }
+    pthread_mutex_unlock(&io_lock);
+
+    return SUCCESS;
+}
+
+static int uringRegisterBuffers(const struct iovec *iov, int iovcnt) {
+    if (ring.fd < 0) return SUCCESS; // the threads pass plain pointers to pread and pwrite
+
+    if (num_registered > 0) {
+        uringRegister(IORING_UNREGISTER_BUFFERS, NULL, 0);
+        num_registered = 0;
+    }
+    if (iovcnt == 0) return SUCCESS;
+
+    // e.g. the locked memory limit is too low
+    if (uringRegister(IORING_REGISTER_BUFFERS, iov, iovcnt) < 0) return ERROR;
+
+    memcpy(registered, iov, iovcnt * sizeof(struct iovec));
+    num_registered = iovcnt;
+    return SUCCESS;
+}
+
+static block_device uring_device = {
+    "uring", uringStart, uringStop, fileRead, fileWrite, fileReadv, fileWritev,
+    fileFlush, fileDiscard, uringSubmit, uringWait, uringRegisterBuffers, NULL
+};
+
+/*********************************** direct backend ***********************************/
+
+/* Opens the volume file a second time with O_DIRECT, and finds the smallest alignment
+ * that O_DIRECT reads of the header block work with. Leaves direct_fd at -1 if the
+ * file system under the volume file does not support O_DIRECT. */
+static void openDirect(char *filename) {
+    direct_fd = open(filename, O_RDWR | O_DIRECT);
+    if (direct_fd < 0) return;
+
+    void *probe = NULL;
+    if (posix_memalign(&probe, DIRECT_MAX_ALIGN, DIRECT_MAX_ALIGN) != 0) probe = NULL;
+
+    direct_align = 0;
+    for (uint64_t align = MINBLOCKSIZE; probe && align <= DIRECT_MAX_ALIGN; align *= 2) {
+        if (pread(direct_fd, probe, align, 0) == (ssize_t) align) {
+            direct_align = align;
+            break;
+        }
+    }
+    free(probe);
+    probe = NULL;
+
+    if (direct_align == 0) {
+        close(direct_fd);
+        direct_fd = -1;
+        direct_align = 1;
+    }
+}
+
+/* The uring backend, with every transfer that is aligned for it done with O_DIRECT,
+ * so that large transfers do not pass through, or push anything out of, the page
+ * cache. The rest, e.g. single blocks smaller than the alignment, still use it. */
+static int directStart(char *filename, uint64_t *vol_size, uint64_t *block_size) {
+    int result = uringStart(filename, vol_size, block_size);
+    if (result != PART_NOERROR) return result;
+
+    openDirect(filename);
+    if (direct_fd < 0) printf("O_DIRECT is not available for '%s'. Using the page cache.\n",
+                              filename);
+    return PART_NOERROR;
+}
+
+static void directStop() {
+    if (direct_fd >= 0) close(direct_fd);
+    direct_fd = -1;
+    direct_align = 1;
+    uringStop();
+}
+
+static block_device direct_device = {
+    "direct", directStart, directStop, fileRead, fileWrite, fileReadv, fileWritev,
+    fileFlush, fileDiscard, uringSubmit, uringWait, uringRegisterBuffers, NULL
+};
+
+/************************************ RAM backend *************************************/
+
+// the volume's blocks, in memory or mapped from the volume file by the mmap backend
+static char *mem_blocks = NULL;
+
+/* Returns where block lba_position starts in memory. */
+static char *ramBlock(uint64_t lba_position) {
+    return mem_blocks + lba_position * dev_block_size;
+}
+
+/* Makes a zeroed volume of *vol_size bytes, rounded down to blocks. Nothing is kept
+ * from one start to the next, so filename is not used. */
+static int ramStart(char *filename, uint64_t *vol_size, uint64_t *block_size) {
+    // the same block sizes startPartitionSystem accepts
+    if (*block_size < MINBLOCKSIZE || (*block_size & (*block_size - 1)) != 0
+        || *vol_size < *block_size) {
+        return PART_ERR_INVALID;
+    }
+
+    mem_blocks = calloc(*vol_size / *block_size, *block_size);
+    if (!mem_blocks) return -2; // insufficient space for the volume
+
+    *vol_size = *vol_size / *block_size * *block_size;
+    printf("Created a RAM volume with %lu bytes, broken into %lu blocks of %lu bytes.\n",
+           *vol_size, *vol_size / *block_size, *block_size);
+    return PART_NOERROR;
+}
+
+static void ramStop() {
+    free(mem_blocks);
+    mem_blocks = NULL;
+}
+
+static uint64_t ramRead(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    memcpy(buf, ramBlock(lba_position), lba_count * dev_block_size);
+    return lba_count;
+}
+
+static uint64_t ramWrite(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    memcpy(ramBlock(lba_position), buf, lba_count * dev_block_size);
+    return lba_count;
+}
+
+static uint64_t ramReadv(const struct iovec *iov, int iovcnt, uint64_t lba_position) {
+    char *block = ramBlock(lba_position);
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(iov[i].iov_base, block, iov[i].iov_len);
+        block += iov[i].iov_len;
+    }
+
+    return iovecBlocks(iov, iovcnt);
+}
+
+static uint64_t ramWritev(const struct iovec *iov, int iovcnt, uint64_t lba_position) {
+    char *block = ramBlock(lba_position);
+    for (int i = 0; i < iovcnt; i++) {
+        memcpy(block, iov[i].iov_base, iov[i].iov_len);
+        block += iov[i].iov_len;
+    }
+
+    return iovecBlocks(iov, iovcnt);
+}
+
+static int ramFlush() { return SUCCESS; } // memory is as durable as it gets
+
+static int ramDiscard(uint64_t lba_count, uint64_t lba_position) {
+    memset(ramBlock(lba_position), 0, lba_count * dev_block_size);
+    return SUCCESS;
+}
+
+static void *ramView(uint64_t lba_position) { return ramBlock(lba_position); }
+
+static block_device ram_device = {
+    "ram", ramStart, ramStop, ramRead, ramWrite, ramReadv, ramWritev, ramFlush, ramDiscard,
+    NULL, NULL, NULL, ramView
+};
+
+/************************************ mmap backend ************************************/
+
+static char *map_base = NULL; // the whole volume file, header block included
+static uint64_t map_bytes = 0; // how many bytes are mapped
+static pthread_mutex_t map_lock = PTHREAD_MUTEX_INITIALIZER; // guards the dirty range
+static uint64_t map_dirty_start = UINT64_MAX; // the blocks written since the last flush,
+static uint64_t map_dirty_end = 0;            // from map_dirty_start to map_dirty_end - 1
+
+/* Widens the dirty range to take in the lba_count blocks from lba_position on. */
+static void markMapDirty(uint64_t lba_count, uint64_t lba_position) {
+    pthread_mutex_lock(&map_lock);
+    if (lba_position < map_dirty_start) map_dirty_start = lba_position;
+    if (lba_position + lba_count > map_dirty_end) map_dirty_end = lba_position + lba_count;
+    pthread_mutex_unlock(&map_lock);
+}
+
+/* Opens the volume file like the file backend, then maps all of it, so that reads and
+ * writes are copies to and from the page cache, and views need no copy at all. The
+ * mapping starts at the header block, since it must start on a page. */
+static int mmapStart(char *filename, uint64_t *vol_size, uint64_t *block_size) {
+    int result = fileStart(filename, vol_size, block_size);
+    if (result != PART_NOERROR) return result;
+
+    // a mapping past the end of the file would fault when it is touched
+    struct stat file_stat;
+    map_bytes = (*vol_size / *block_size + HEADER_BLOCKS) * *block_size;
+    if (fstat(file_fd, &file_stat) != 0 || (uint64_t) file_stat.st_size < map_bytes) {
+        printf("Error: The volume file '%s' is shorter than the volume.\n", filename);
+        fileStop();
+        return ERROR;
+    }
+
+    map_base = mmap(NULL, map_bytes, PROT_READ | PROT_WRITE, MAP_SHARED, file_fd, 0);
+    if (map_base == MAP_FAILED) {
+        printf("Error: Could not map the volume file '%s'.\n", filename);
+        map_base = NULL;
+        fileStop();
+        return ERROR;
+    }
+
+    mem_blocks = map_base + HEADER_BLOCKS * *block_size;
+    map_dirty_start = UINT64_MAX;
+    map_dirty_end = 0;
+    return PART_NOERROR;
+}
+
+/* msyncs the dirty range, rounded out to pages, and empties it. */
+static int mmapFlush() {
+    pthread_mutex_lock(&map_lock);
+    uint64_t start = map_dirty_start, end = map_dirty_end;
+    map_dirty_start = UINT64_MAX;
+    map_dirty_end = 0;
+    pthread_mutex_unlock(&map_lock);
+
+    if (start >= end) return SUCCESS; // nothing was written
+
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t first_byte = (start + HEADER_BLOCKS) * dev_block_size / page_size * page_size;
+    uint64_t end_byte = (end + HEADER_BLOCKS) * dev_block_size;
+    if (msync(map_base + first_byte, end_byte - first_byte, MS_SYNC) != 0) {
+        markMapDirty(end - start, start); // still not durable
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+static void mmapStop() {
+    mmapFlush();
+    munmap(map_base, map_bytes);
+    map_base = NULL;
+    mem_blocks = NULL;
+    fileStop();
+}
+
+static uint64_t mmapWrite(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    markMapDirty(lba_count, lba_position);
+    return ramWrite(buf, lba_count, lba_position);
+}
+
+static uint64_t mmapWritev(const struct iovec *iov, int iovcnt, uint64_t lba_position) {
+    markMapDirty(iovecBlocks(iov, iovcnt), lba_position);
+    return ramWritev(iov, iovcnt, lba_position);
+}
+
+static block_device mmap_device = {
+    "mmap", mmapStart, mmapStop, ramRead, mmapWrite, ramReadv, mmapWritev,
+    mmapFlush, fileDiscard, NULL, NULL, NULL, ramView
+};
+
+/**************************************************************************************/
+
+static block_device *backends[] = {
+    &file_device, &ram_device, &pool_device, &uring_device, &mmap_device, &direct_device
+};
+
+int startDevice(char *name, char *filename, uint64_t *vol_size, uint64_t *block_size) {
+    if (!name) name = DEFAULT_DEVICE;
+
+    block_device *backend = NULL;
+    for (size_t i = 0; i < sizeof(backends) / sizeof(backends[0]); i++) {
+        if (strcmp(backends[i]->name, name) == 0) backend = backends[i];
+    }
+
+    if (!backend) {
+        printf("Error: There is no '%s' device. ", name);
+        return PART_ERR_INVALID;
+    }
+
+    int result = backend->start(filename, vol_size, block_size);
+    if (result != PART_NOERROR) return result;
+
+    device = backend;
+    dev_block_size = *block_size;
+    dev_num_blocks = *vol_size / *block_size;
+    memset(&device_counters, 0, sizeof(device_stats));
+    return PART_NOERROR;
+}
+
+void stopDevice() {
+    if (!device) return;
+
+    device->stop();
+    device = NULL;
+}
+
+uint64_t deviceRead(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    if (!device || !isInVolume(lba_count, lba_position)) return 0;
+
+    uint64_t blocks = device->read(buf, lba_count, lba_position);
+    countDevice(&device_counters.reads, 1);
+    countDevice(&device_counters.blocks_read, blocks);
+    return blocks;
+}
+
+uint64_t deviceWrite(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    if (!device || !isInVolume(lba_count, lba_position)) return 0;
+
+    uint64_t blocks = device->write(buf, lba_count, lba_position);
+    countDevice(&device_counters.writes, 1);
+    countDevice(&device_counters.blocks_written, blocks);
+    return blocks;
+}
+
+uint64_t deviceReadv(const struct iovec *iov, int iovcnt, uint64_t lba_position) {
+    if (!device || !isInVolume(iovecBlocks(iov, iovcnt), lba_position)) return 0;
+
+    uint64_t blocks = device->readv(iov, iovcnt, lba_position);
+    countDevice(&device_counters.reads, 1);
+    countDevice(&device_counters.blocks_read, blocks);
+    return blocks;
+}
+
+uint64_t deviceWritev(const struct iovec *iov, int iovcnt, uint64_t lba_position) {
+    if (!device || !isInVolume(iovecBlocks(iov, iovcnt), lba_position)) return 0;
+
+    uint64_t blocks = device->writev(iov, iovcnt, lba_position);
+    countDevice(&device_counters.writes, 1);
+    countDevice(&device_counters.blocks_written, blocks);
+    return blocks;
+}
+
+int deviceFlush() {
+    if (!device) return ERROR;
+
+    countDevice(&device_counters.flushes, 1);
+    return device->flush();
+}
+
+int deviceDiscard(uint64_t lba_count, uint64_t lba_position) {
+    if (!device || !isInVolume(lba_count, lba_position)) return ERROR;
+    // a discard is only a hint, and must not pull blocks out from under a view
+    if (lba_count == 0 || __atomic_load_n(&num_views, __ATOMIC_ACQUIRE) > 0) return SUCCESS;
+
+    countDevice(&device_counters.discards, 1);
+    return device->discard(lba_count, lba_position);
+}
+
+const void *deviceView(uint64_t lba_count, uint64_t lba_position) {
+    if (!device || !device->view || lba_count == 0 || !isInVolume(lba_count, lba_position)) {
+        return NULL;
+    }
+
+    __atomic_fetch_add(&num_views, 1, __ATOMIC_ACQ_REL);
+    countDevice(&device_counters.views, 1);
+    countDevice(&device_counters.blocks_viewed, lba_count);
+    return device->view(lba_position);
+}
+
+void deviceReleaseView(const void *view) {
+    if (view) __atomic_fetch_sub(&num_views, 1, __ATOMIC_ACQ_REL);
+}
+
+uint64_t deviceAlignment() {
+    return direct_fd >= 0 ? direct_align : 1;
+}
+
+uint64_t deviceNumBlocks() {
+    return device ? dev_num_blocks : 0;
+}
+
+int deviceSubmit(device_io *io) {
+    io->blocks = 0;
+    if (!device || !isInVolume(io->lba_count, io->lba_position)) return ERROR;
+
+    if (io->is_write) {
+        countDevice(&device_counters.writes, 1);
+        countDevice(&device_counters.blocks_written, io->lba_count);
+    } else {
+        countDevice(&device_counters.reads, 1);
+        countDevice(&device_counters.blocks_read, io->lba_count);
+    }
+
+    // io_uring takes at most 4 GB at a time, and a transfer that large gains nothing
+    // from being run in the background
+    if (!device->submit || io->lba_count * dev_block_size > MAX_ASYNC_BYTES) {
+        if (io->iov) {
+            io->blocks = io->is_write ? device->writev(io->iov, io->iovcnt, io->lba_position)
+                                      : device->readv(io->iov, io->iovcnt, io->lba_position);
+        } else {
+            io->blocks = io->is_write
+                         ? device->write(io->buf, io->lba_count, io->lba_position)
+                         : device->read(io->buf, io->lba_count, io->lba_position);
+        }
+        return SUCCESS;
+    }
+
+    pthread_mutex_lock(&io_lock);
+    io->batch = &thread_batch;
+    device->submit(io);
+    thread_batch.queued++;
+    num_queued++;
+    if (num_queued > device_counters.max_queued) device_counters.max_queued = num_queued;
+    device_counters.submitted++;
+    pthread_mutex_unlock(&io_lock);
+
+    return SUCCESS;
+}
+
+int deviceWait() {
+    if (!device) return ERROR;
+    if (!device->wait) return SUCCESS; // everything ran when it was submitted
+
+    // the backend only waits for the calling thread's batch
+    int result = device->wait();
+
+    pthread_mutex_lock(&io_lock);
+    num_queued -= thread_batch.queued;
+    thread_batch.queued = 0;
+    pthread_mutex_unlock(&io_lock);
+
+    return result;
+}
+
+/* Orders segments by block number, for qsort. */
+static int compareSegments(const void *a, const void *b) {
+    const lba_segment *seg_a = *(const lba_segment * const *) a;
+    const lba_segment *seg_b = *(const lba_segment * const *) b;
+    if (seg_a->lba_position < seg_b->lba_position) return -1;
+    return seg_a->lba_position > seg_b->lba_position;
+}
+
+int deviceTransferSegments(lba_segment *segs, int num_segs, int is_write) {
+    if (num_segs <= 0) return SUCCESS;
+
+    int result = ERROR;
+    lba_segment **sorted = malloc(num_segs * sizeof(lba_segment *));
+    struct iovec *iovs = malloc(num_segs * sizeof(struct iovec));
+    device_io *ios = malloc(num_segs * sizeof(device_io)); // at most one per segment
+    if (!sorted || !iovs || !ios) goto free_and_return;
+
+    for (int i = 0; i < num_segs; i++) sorted[i] = &segs[i];
+    qsort(sorted, num_segs, sizeof(lba_segment *), compareSegments);
+
+    // each run of segments whose blocks follow on from each other is one transfer, with
+    // a buffer per segment. the iovecs are in the same order as the sorted segments
+    int num_ios = 0;
+    for (int i = 0; i < num_segs; ) {
+        device_io *io = &ios[num_ios++];
+        memset(io, 0, sizeof(device_io));
+        io->lba_position = sorted[i]->lba_position;
+        io->is_write = is_write;
+        io->iov = &iovs[i];
+
+        int j = i;
+        do {
+            iovs[j].iov_base = sorted[j]->buf;
+            iovs[j].iov_len = sorted[j]->lba_count * dev_block_size;
+            io->lba_count += sorted[j]->lba_count;
+            j++;
+        } while (j < num_segs && j - i < IOV_MAX
+                 && sorted[j]->lba_position == io->lba_position + io->lba_count);
+
+        io->iovcnt = j - i;
+        if (io->iovcnt == 1) { // a plain transfer can use a registered buffer
+            io->buf = iovs[i].iov_base;
+            io->iov = NULL;
+        }
+        i = j;
+    }
+
+    result = SUCCESS;
+    for (int i = 0; i < num_ios; i++) {
+        if (deviceSubmit(&ios[i]) == ERROR) result = ERROR;
+    }
+    if (deviceWait() == ERROR) result = ERROR;
+
+    for (int i = 0; i < num_ios; i++) {
+        if (ios[i].blocks != ios[i].lba_count) result = ERROR;
+    }
+
+    free_and_return: // Label for freeing the arrays and returning result.
+    free(sorted);
+    sorted = NULL;
+    free(iovs);
+    iovs = NULL;
+    free(ios);
+    ios = NULL;
+
+    return result;
+}
+
+int deviceRegisterBuffers(const struct iovec *iov, int iovcnt) {
+    if (!device || iovcnt > MAX_REGISTERED_BUFFERS) return ERROR;
+    if (!device->register_buffers) return SUCCESS;
+
+    pthread_mutex_lock(&io_lock);
+    int result = device->register_buffers(iov, iovcnt);
+    pthread_mutex_unlock(&io_lock);
+
+    return result;
+}
+
+void printDeviceStats() {
+    if (!device) {
+        printf("Device: none\n");
+        return;
+    }
+
+    char *engine = ""; // how queued transfers are run
+    if (device == &uring_device || device == &direct_device) {
+        engine = ring.fd >= 0 ? " (io_uring)" : " (I/O threads)";
+    }
+
+    printf("Device: %s%s, %lu blocks of %lu bytes\n"
+           "  reads: %lu (%lu blocks)\n"
+           "  writes: %lu (%lu blocks)\n"
+           "  flushes: %lu\n"
+           "  discards: %lu\n"
+           "  views: %lu (%lu blocks), %lu in use\n"
+           "  O_DIRECT transfers: %lu, aligned to %lu bytes\n"
+           "  queued transfers: %lu, at most %lu at once, %d buffers registered\n",
+           device->name, engine, dev_num_blocks, dev_block_size,
+           device_counters.reads, device_counters.blocks_read,
+           device_counters.writes, device_counters.blocks_written,
+           device_counters.flushes, device_counters.discards,
+           device_counters.views, device_counters.blocks_viewed, num_views,
+           device_counters.direct_transfers, deviceAlignment(),
+           device_counters.submitted, device_counters.max_queued, num_registered);
+}
@@ -0,0 +1,187 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsDevice.h
+*
+* Description: Interface for the block device the volume is stored on.
+*  Everything below the block cache and the journal reads and writes
+*  blocks through the device that was started, which is one of several
+*  backends behind the same table of functions. The file backend keeps
+*  the volume in a Linux file, laid out the way startPartitionSystem
+*  creates it. The RAM backend keeps it in memory, so the file system
+*  can be run and measured without any disk I/O, and is gone once the
+*  device is stopped. The uring backend uses the same file, and also
+*  runs many transfers at once: callers queue them with deviceSubmit and
+*  collect them with deviceWait, and io_uring takes the whole batch in
+*  one system call. Where io_uring is not available, a pool of threads
+*  doing pread and pwrite runs the queued transfers instead. Backends
+*  without either run each transfer as it is submitted. The mmap backend
+*  maps the volume file into memory. It and the RAM backend can hand out
+*  views of their blocks, so a reader can look at them without copying.
+*  The direct backend is the uring backend with O_DIRECT, for transfers
+*  whose buffers, sizes and offsets are aligned, so they skip the page
+*  cache of the file system the volume file is on.
+*
+**************************************************************/
+
+#ifndef _FS_DEVICE_H
+#define _FS_DEVICE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include "fsLow.h"
+
+#define DEFAULT_DEVICE "uring" // backend used when none is named
+#define URING_ENTRIES 128 // size of the io_uring submission queue
+#define POOL_THREADS 4 // threads that run transfers when io_uring is not available
+#define MAX_ASYNC_BYTES (1024 * 1024 * 1024) // larger transfers are run when submitted
+#define MAX_REGISTERED_BUFFERS 8 // most buffers that can be registered at once
+#define DIRECT_MAX_ALIGN 4096 // the most alignment the direct backend works with
+
+// one transfer queued with deviceSubmit. the caller fills in the first six members,
+// and must not touch the struct or its buffers until deviceWait returns.
+typedef struct device_io {
+    void *buf;
+    uint64_t lba_count;
+    uint64_t lba_position;
+    int is_write; // TRUE to write buf to the blocks, FALSE to read them into it
+    // if not NULL, the blocks are scattered across or gathered from these iovcnt
+    // buffers instead of buf. each holds a whole number of blocks, lba_count in all
+    const struct iovec *iov;
+    int iovcnt;
+    uint64_t blocks; // how many blocks were transferred, set once it completes
+    struct device_io *next; // used by the backend while the transfer is queued
+    struct device_batch *batch; // the queuing thread's batch, which the backend counts
+} device_io;
+
+// one piece of a vectored transfer: lba_count blocks from lba_position on, in buf
+typedef struct lba_segment {
+    void *buf;
+    uint64_t lba_count;
+    uint64_t lba_position;
+} lba_segment;
+
+// the operations a backend provides. block counts and positions are in blocks, and
+// every iovec passed to readv and writev holds a whole number of blocks.
+typedef struct block_device {
+    char *name; // the name the backend is selected by
+
+    // same as startPartitionSystem
+    int (*start)(char *filename, uint64_t *vol_size, uint64_t *block_size);
+    void (*stop)();
+
+    // each returns how many blocks were transferred
+    uint64_t (*read)(void *buf, uint64_t lba_count, uint64_t lba_position);
+    uint64_t (*write)(void *buf, uint64_t lba_count, uint64_t lba_position);
+    uint64_t (*readv)(const struct iovec *iov, int iovcnt, uint64_t lba_position);
+    uint64_t (*writev)(const struct iovec *iov, int iovcnt, uint64_t lba_position);
+
+    int (*flush)(); // makes everything written so far durable. returns ERROR or SUCCESS
+    // tells the device the blocks no longer hold data. returns ERROR or SUCCESS
+    int (*discard)(uint64_t lba_count, uint64_t lba_position);
+
+    // queues a transfer. NULL if the backend cannot run transfers in the background
+    void (*submit)(device_io *io);
+    // waits for every transfer the calling thread queued. returns ERROR or SUCCESS
+    int (*wait)();
+    // registers buffers with the backend, replacing any registered before. may be NULL
+    int (*register_buffers)(const struct iovec *iov, int iovcnt);
+    // returns where block lba_position is in memory. NULL if the blocks are not in memory
+    void *(*view)(uint64_t lba_position);
+} block_device;
+
+// device counters, printed by the stats command
+typedef struct device_stats {
+    uint64_t reads; // read calls, vectored or not
+    uint64_t writes; // write calls, vectored or not
+    uint64_t blocks_read;
+    uint64_t blocks_written;
+    uint64_t flushes;
+    uint64_t discards;
+    uint64_t views; // views handed out by deviceView
+    uint64_t blocks_viewed;
+    uint64_t direct_transfers; // transfers that skipped the page cache
+    uint64_t submitted; // transfers queued to run in the background
+    uint64_t max_queued; // most transfers that were queued at once
+} device_stats;
+
+/* Starts the backend named name, or DEFAULT_DEVICE if name is NULL, on the volume
+ * filename. Takes and returns the same values as startPartitionSystem, and returns
+ * PART_ERR_INVALID if there is no such backend. */
+int startDevice(char *name, char *filename, uint64_t *vol_size, uint64_t *block_size);
+
+/* Stops the device. A RAM device's blocks are freed. */
+void stopDevice();
+
+/* Same as LBAread and LBAwrite, on the device that was started. A transfer that runs
+ * past the end of the volume moves nothing. Returns how many blocks were transferred. */
+uint64_t deviceRead(void *buf, uint64_t lba_count, uint64_t lba_position);
+uint64_t deviceWrite(void *buf, uint64_t lba_count, uint64_t lba_position);
+
+/* Reads or writes consecutive blocks from lba_position on, scattered across or
+ * gathered from iovcnt buffers that each hold a whole number of blocks.
+ * Returns how many blocks were transferred. */
+uint64_t deviceReadv(const struct iovec *iov, int iovcnt, uint64_t lba_position);
+uint64_t deviceWritev(const struct iovec *iov, int iovcnt, uint64_t lba_position);
+
+/* Makes every block written so far durable. Returns ERROR on error, or SUCCESS. */
+int deviceFlush();
+
+/* Tells the device the blocks no longer hold data, so it may drop them. They read back
+ * as zeros or as their old contents. Returns ERROR on error, or SUCCESS. */
+int deviceDiscard(uint64_t lba_count, uint64_t lba_position);
+
+/* Returns a read-only view of the lba_count blocks from lba_position on, where they
+ * are in the device's memory, or NULL if the backend does not keep its blocks in
+ * memory. The view stays valid until it is given back with deviceReleaseView, and the
+ * device skips discards until then. Blocks written meanwhile change under it. */
+const void *deviceView(uint64_t lba_count, uint64_t lba_position);
+
+/* Gives back a view from deviceView. Does nothing if view is NULL. */
+void deviceReleaseView(const void *view);
+
+/* Returns what a buffer's address, as well as a transfer's size and position, must be
+ * a multiple of for the transfer to skip the page cache, or 1 if it makes no
+ * difference. */
+uint64_t deviceAlignment();
+
+/* Returns how many blocks the volume has, or 0 if no device was started. */
+uint64_t deviceNumBlocks();
+
+/* Queues io to be run in the background, and sets io->blocks to 0 until it completes.
+ * Queued transfers are handed to the device in batches, and all of the ones the
+ * calling thread queued have completed once it calls deviceWait and it returns.
+ * Transfers that are queued together must not overlap. If the backend cannot run transfers in the background, io is run before
+ * deviceSubmit returns. Returns ERROR if io is outside the volume, or SUCCESS. */
+int deviceSubmit(device_io *io);
+
+/* Hands every queued transfer to the device and waits for the ones the calling thread
+ * queued to complete, while other threads' transfers keep running. Each one's blocks
+ * tells whether it moved everything. Returns ERROR if the device failed,
+ * or SUCCESS. */
+int deviceWait();
+
+/* Reads (is_write == FALSE) or writes (is_write == TRUE) num_segs segments, which must
+ * not overlap, in any order. Segments whose blocks follow on from each other's are
+ * merged into one vectored transfer, and every transfer is queued on the device at
+ * once, so they all run together. Returns ERROR if any segment was not moved in full,
+ * or SUCCESS. */
+int deviceTransferSegments(lba_segment *segs, int num_segs, int is_write);
+
+/* Registers iovcnt buffers, at most MAX_REGISTERED_BUFFERS, with the device, so that
+ * transfers to and from them skip mapping the memory each time. They replace any
+ * buffers registered before, and an iovcnt of 0 unregisters them. Nothing may be
+ * queued. Returns ERROR if the backend could not register them, which only costs
+ * speed, or SUCCESS. */
+int deviceRegisterBuffers(const struct iovec *iov, int iovcnt);
+
+/* Prints which backend is in use and the device counters. */
+void printDeviceStats();
+
+#endif
@@ -9,44 +9,62 @@
 * File: fsDirOps.c
 *
 * Description: Functions for the shell commands pertaining to directories,
-*  i.e. list (ls).
+*  i.e. list (ls), and for walking a directory tree.
 *
 **************************************************************/
 
+#include <pthread.h>
 #include "mfs.h"
+#include "fsDirectory.h"
 
 #define DIRMAX_LEN 4096 // maximum length of a path
-#define PARENT_ENTRY_INDEX 1 // index of the parent entry in a dir
 #define DIR_TYPE_CHAR 'D' // char that represents the type 'dir'
 #define FILE_TYPE_CHAR '-' // char that represents the type 'file'
 #define UNKNOWN_TYPE_CHAR '?' // char that represents a type that is neither a file nor dir
-
-struct fs_diriteminfo *di = NULL;
-dir_entry *dir = NULL;
-fdDir *dirp = NULL;
+#define WALK_PREFETCH_QUEUE (FS_WALK_PREFETCH_DIRS * 4) // most subdirectories waiting to be prefetched
+
+// subdirectories that fs_walk's prefetch thread reads into the block cache
+typedef struct walk_prefetch {
+	pthread_t thread;
+	int running; // TRUE if the thread was started
+	int stopping; // TRUE once the walk is done and the thread should exit
+	pthread_mutex_t lock; // protects the members below
+	pthread_cond_t queued; // signaled when a block is queued or stopping is set
+	uint64_t blocks[WALK_PREFETCH_QUEUE]; // header blocks of the queued subdirectories
+	int head; // index of the oldest queued block
+	int count; // number of queued blocks
+} walk_prefetch;
+
+// state shared by every directory of one fs_walk
+typedef struct walk_state {
+	fs_walk_fn fn; // the visitor
+	int flags; // the flags passed to fs_walk
+	char path[PATH_MAX_LEN]; // path of the entry being visited
+	walk_prefetch prefetch; // reads subdirectories ahead of the visitor
+} walk_state;
 
 int fs_isFile(char *path) {
-	dir_entry *parent_dir = NULL; // holds the parent directory
+	directory parent_dir; // holds the parent directory
+	int parent_dir_open = FALSE; // whether parent_dir needs to be closed
 	char *dir_name = NULL; // the directory's filename
 
-	int parent_dir_start_block = getParentBasenameStartBlock(path);
+	long long parent_dir_start_block = getParentBasenameStartBlock(path);
 	if (parent_dir_start_block == ERROR) {
 		printf("Error getting the parent directory's start block.\n");
 		goto free_and_return_false;
 	}
 
-	// read from disk into parent_dir
-	parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-	if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir_start_block,
-	    "fs_isFile init parent_dir") == ERROR) {
-		goto free_and_return_false;
-	}
-
 	dir_name = getBasename(path); // dir_name must be freed
 	if (!dir_name) return FALSE; // if path was "/". root dir is not a file
+
+	if (openDirectory(parent_dir_start_block, &parent_dir) == ERROR) {
+		goto free_and_return_false;
+	}
+	parent_dir_open = TRUE;
 	
 	// searches in the parent dir and searches for an entry with the matching name
-	int entry_index = getDirEntryIndexByName(parent_dir, dir_name);
+	dir_entry entry;
+	long long entry_index = findDirEntry(&parent_dir, dir_name, &entry);
 	if (entry_index == ERROR) { // error
 		printf("Error getting the directory entry index.\n");
 		goto free_and_return_false;
@@ -55,18 +73,16 @@ int fs_isFile(char *path) {
 	}
 
 	int is_file = FALSE;
-	if (parent_dir[entry_index].type == FILE) is_file = TRUE;
+	if (entry.type == FILE) is_file = TRUE;
 
-	free(parent_dir);
-	parent_dir = NULL;
+	closeDirectory(&parent_dir);
 	free(dir_name);
 	dir_name = NULL;
 
 	return is_file;
 
 	free_and_return_false: // Label for error handling. Free the mallocs and return FALSE.
-	free(parent_dir);
-	parent_dir = NULL;
+	if (parent_dir_open) closeDirectory(&parent_dir);
 	free(dir_name);
 	dir_name = NULL;
 
@@ -74,241 +90,376 @@ int fs_isFile(char *path) {
 }
 
 int fs_isDir(char *path) {
-	int parent_dir_start_block = getParentBasenameStartBlock(path);
+	long long parent_dir_start_block = getParentBasenameStartBlock(path);
 	if (parent_dir_start_block == ERROR) {
 		printf("Error getting the parent's start block.\n");
 		return FALSE;
 	}
 
-	// read from disk into parent_dir
-	dir_entry *parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-	if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir_start_block,
-	    "fs_isDir init parent_dir") == ERROR) {
-		free(parent_dir);
-		parent_dir = NULL;
-		return FALSE;
-	}
-
 	char *dir_name = getBasename(path); // dir_name needs to be freed
 	if (!dir_name) return TRUE; // path was "/". the root directory is indeed a directory
+
+	directory parent_dir;
+	if (openDirectory(parent_dir_start_block, &parent_dir) == ERROR) {
+		free(dir_name);
+		dir_name = NULL;
+		return FALSE;
+	}
 	
 	// searches in the parent dir and searches for an entry with the matching name
-	int entry_index = getDirEntryIndexByName(parent_dir, dir_name);
+	dir_entry entry;
+	long long entry_index = findDirEntry(&parent_dir, dir_name, &entry);
+	closeDirectory(&parent_dir);
+	free(dir_name);
+	dir_name = NULL;
+
 	if (entry_index == ERROR) { // error
 		printf("Error searching the parent directory.\n");
-		free(dir_name);
-		dir_name = NULL;
-		free(parent_dir);
-		parent_dir = NULL;
 		return FALSE;
 	} else if (entry_index == NOT_FOUND) { // the entry doesnt exist
-		// error message handled by shell
-		free(dir_name);
-		dir_name = NULL;
-		free(parent_dir);
-		parent_dir = NULL;
-		return FALSE;
+		return FALSE; // error message handled by shell
 	}
 
-	int is_dir = FALSE;
-	if (parent_dir[entry_index].type == DIRECTORY) is_dir = TRUE;
-
-	free(dir_name);
-	dir_name = NULL;
-	free(parent_dir);
-	parent_dir = NULL;
-
-	return is_dir;
+	return entry.type == DIRECTORY;
 }
 
-fdDir *fs_opendir(const char *name) {
-	if (strcmp(name, "/") == 0) { // is root
-		dirp = malloc(sizeof(fdDir)); // Freed in fs_closedir.
-
-		dirp->d_reclen = sizeof(dir_entry);
-		dirp->dirEntryPosition = (unsigned short) 0; // start at the first entry of root_dir
-		dirp->directoryStartLocation = vcb->root_dir_start_block;
-		
-		dir = malloc(vcb->dir_blocks * vcb->block_size); // Freed in fs_closedir.
-
-		// read into dir
-		if (customLBAread(dir, vcb->dir_blocks, vcb->root_dir_start_block,
-            "fs_opendir root_dir dir") == ERROR) {
-			free(dir); // free upon error, but not upon success
-			dir = NULL;
-			return NULL;
-		}
-
-		di = malloc(sizeof(struct fs_diriteminfo)); // Freed in fs_closedir.
-		return dirp;
+/* Finds the entry of the file or directory at path and copies it into entry. The root
+ * directory is not in a parent directory, so its '.' entry is copied instead.
+ * Returns the entry's slot, NOT_FOUND if there is no such entry, or ERROR. */
+static long long lookupEntry(const char *path, dir_entry *entry) {
+	long long parent_dir_start_block = getParentBasenameStartBlock(path);
+	if (parent_dir_start_block == ERROR) return NOT_FOUND; // error message handled by shell
+
+	char *name = getBasename(path); // name must be freed
+	directory parent_dir;
+	if (openDirectory(name ? parent_dir_start_block : vcb->root_dir_start_block,
+		&parent_dir) == ERROR) {
+		free(name);
+		name = NULL;
+		return ERROR;
 	}
 
-	int parent_dir_start_block = getParentBasenameStartBlock(name);
-	if (parent_dir_start_block == ERROR) {
-		printf("Error getting the parent directory's start block.\n");
-		return NULL;
+	long long entry_index = SELF_ENTRY_INDEX;
+	if (!name) { // path was "/"
+		if (readDirEntry(&parent_dir, SELF_ENTRY_INDEX, entry) == ERROR) entry_index = ERROR;
+	} else {
+		entry_index = findDirEntry(&parent_dir, name, entry);
 	}
 
-	// read from disk into parent_dir
-	dir_entry *parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-	if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir_start_block,
-	    "fs_opendir init parent_dir") == ERROR) {
-		free(parent_dir);
-		parent_dir = NULL;
-		return NULL;
-	}
+	closeDirectory(&parent_dir);
+	free(name);
+	name = NULL;
 
-	char *dir_name = getBasename(name); // dir_name must be freed
-	if (!dir_name) {
-		printf("Directory name was empty. Failed to open directory.\n");
-		free(parent_dir);
-		parent_dir = NULL;
-		free(dir_name);
-		dir_name = NULL;
-		return NULL;
-	}
-	
-	// searches in the parent dir and searches for an entry with the matching name
-	int entry_index = getDirEntryIndexByName(parent_dir, dir_name);
-	if (entry_index == ERROR || entry_index == NOT_FOUND) { // the entry doesnt exist
-		// error message handled by shell
-		free(dir_name);
-		dir_name = NULL;
-		free(parent_dir);
-		parent_dir = NULL;
-		return NULL;
+	return entry_index;
+}
+
+/* Fills buf from entry. A directory's size changes as it grows, and is only kept up
+ * to date in the directory itself, so it is read from the directory's header.
+ * Returns ERROR on error, or SUCCESS. */
+static int fillStat(dir_entry *entry, struct fs_stat *buf) {
+	uint64_t size = entry->size;
+	if (entry->type == DIRECTORY) {
+		size = readDirSize(entry->start_block);
+		if (size == UNSIGNED_ERROR) return ERROR;
 	}
 
-	dirp = malloc(sizeof(fdDir)); // Freed in fs_closedir.
+	buf->st_size = (off_t) size;
+	buf->st_blksize = (blksize_t) vcb->block_size;
+	buf->st_blocks = (blkcnt_t) ceilingDivide(size, vcb->block_size);
 
-	dirp->d_reclen = sizeof(dir_entry);
-	dirp->dirEntryPosition = (unsigned short) 0; // start at first entry in the directory
-	dirp->directoryStartLocation = parent_dir[entry_index].start_block;
+	buf->st_accesstime = entry->last_opened;
+	buf->st_modtime = entry->last_modified;
+	buf->st_createtime = entry->creation_date;
 
-	dir = malloc(vcb->dir_blocks * vcb->block_size); // Freed in fs_closedir
+	return SUCCESS;
+}
 
-	// read into dir
-	if (customLBAread(dir, vcb->dir_blocks, dirp->directoryStartLocation,
-	    "fs_opendir dir") == ERROR) {
-		free(dir_name);
-		dir_name = NULL;
-		free(parent_dir);
-		parent_dir = NULL;
-		free(dir); // free upon error, but not upon success
-		dir = NULL; 
+/* Reads the next entry of the directory into dirp->di and advances the position.
+ * The entry is copied into entry too. Returns NULL if there are no more entries. */
+static struct fs_diriteminfo *readNextItem(fdDir *dirp, dir_entry *entry) {
+	if (!dirp || !dirp->dir) return NULL; // called read before open
+
+	// find the next used entry, starting at the current position
+	long long entry_index = nextDirEntry(dirp->dir, dirp->dirEntryPosition, entry);
+
+	// if nothing more to list
+	if (entry_index == ERROR || entry_index == NOT_FOUND) return NULL;
+
+	// convert dir_entry's integer for file type into an unsigned char for fs_diriteminfo
+	if (entry->type == DIRECTORY) dirp->di.fileType = DIR_TYPE_CHAR;
+	else if (entry->type == FILE) dirp->di.fileType = FILE_TYPE_CHAR;
+	else dirp->di.fileType = UNKNOWN_TYPE_CHAR;
+
+	dirp->di.d_reclen = sizeof(dir_entry);
+	strcpy(dirp->di.d_name, entry->name);
+
+	dirp->dirEntryPosition = entry_index + 1;
+	return &dirp->di;
+}
+
+fdDir *fs_opendir(const char *name) {
+	dir_entry entry;
+	long long entry_index = lookupEntry(name, &entry);
+
+	// the entry doesnt exist. error message handled by shell
+	if (entry_index == ERROR || entry_index == NOT_FOUND) return NULL;
+	if (entry.type != DIRECTORY) return NULL;
+
+	fdDir *dirp = malloc(sizeof(fdDir)); // Freed in fs_closedir.
+	if (!dirp) return NULL;
+
+	dirp->dir = malloc(sizeof(directory)); // Freed in fs_closedir.
+	if (!dirp->dir || openDirectory(entry.start_block, dirp->dir) == ERROR) {
+		free(dirp->dir); // free upon error, but not upon success
+		free(dirp);
 		return NULL;
 	}
 
-	di = malloc(sizeof(struct fs_diriteminfo)); // Freed in fs_closedir
-
-	free(dir_name);
-	dir_name = NULL;
-	free(parent_dir);
-	parent_dir = NULL;
+	dirp->d_reclen = sizeof(dir_entry);
+	dirp->dirEntryPosition = 0; // start at first entry in the directory
+	dirp->directoryStartLocation = entry.start_block;
 
 	return dirp;
 }
 
 struct fs_diriteminfo* fs_readdir(fdDir *dirp) {
-	if (!di) return NULL; // called read before open
-	if (dirp->dirEntryPosition >= MAX_DIRECTORY_ENTRIES) return NULL;
+	dir_entry entry;
+	return readNextItem(dirp, &entry);
+}
 
-	// convert dir_entry's integer for file type into an unsigned char for fs_diriteminfo
-	int dir_entry_type = dir[dirp->dirEntryPosition].type;
-	if (dir_entry_type == DIRECTORY) di->fileType = DIR_TYPE_CHAR;
-	else if (dir_entry_type == FILE) di->fileType = FILE_TYPE_CHAR;
-	else di->fileType = UNKNOWN_TYPE_CHAR;
+struct fs_diriteminfo* fs_readdirplus(fdDir *dirp, struct fs_stat *buf) {
+	dir_entry entry;
+	struct fs_diriteminfo *item = readNextItem(dirp, &entry);
+	if (!item) return NULL;
 
-	di->d_reclen = sizeof(dir_entry);
-	strcpy(di->d_name, dir[dirp->dirEntryPosition].name);
+	if (fillStat(&entry, buf) == ERROR) {
+		printf("fs_readdirplus failed to stat %s.\n", entry.name);
+		return NULL;
+	}
 
-	// update last opened metadata, except for the entry about the parent
-	if (dirp->dirEntryPosition != PARENT_ENTRY_INDEX) {
-		dir[dirp->dirEntryPosition].last_opened = time(NULL);
+	return item;
+}
+
+int fs_stat(const char *path, struct fs_stat *buf) {
+	dir_entry entry;
+	long long entry_index = lookupEntry(path, &entry);
+	if (entry_index == ERROR || entry_index == NOT_FOUND) {
+		printf("The basename directory entry was not found. ");
+		goto free_and_return_error;
 	}
 
-	dirp->dirEntryPosition++;
-	if (dirp->dirEntryPosition >= MAX_DIRECTORY_ENTRIES) return NULL;
+	if (fillStat(&entry, buf) == ERROR) goto free_and_return_error;
 
-	dirp->dirEntryPosition = getDirNextUsedEntryIndex(dir, dirp->dirEntryPosition);
+	return SUCCESS;
 
-	// if nothing more to list
-	if (dirp->dirEntryPosition == ERROR || dirp->dirEntryPosition == NOT_FOUND) return NULL;
-	
-	return di;
+	free_and_return_error: // Label for error handling. Return ERROR.
+	printf("fs_stat failed.\n");
+	return ERROR;
 }
 
-/* The argument is called path but it is actually a filename, since di->d_name is a filename.
- * Therefore we need to concatenate the absolute path of the parent directory and the d_name
- * if getParentBasenameStartBlock is to actually return the parent directory's start block. */
-int fs_stat(const char *path, struct fs_stat *buf) {
-	if (!dir) return ERROR; // fs_stat called before opendir
+int fs_closedir(fdDir *dirp) {
+	if (!dirp) return SUCCESS;
 
-	dir_entry *parent_dir = NULL; // holds the parent directory
+	if (dirp->dir) closeDirectory(dirp->dir);
+	free(dirp->dir);
+	dirp->dir = NULL;
+	free(dirp);
 
-	char full_path[DIRMAX_LEN] = {0}; // stores the absolute path of the filename
-	if (!getDirAbsPath(dir, full_path, DIRMAX_LEN - D_NAME_MAX_LEN - 1)) {
-		printf("Error getting the absolute path. ");
-		goto free_and_return_error;
+	return SUCCESS;
+}
+
+/* Prefetches the subdirectories queued in the walk_prefetch arg, oldest first, until
+ * the walk is done. */
+static void *prefetchThread(void *arg) {
+	walk_prefetch *prefetch = arg;
+
+	pthread_mutex_lock(&prefetch->lock);
+	while (TRUE) {
+		while (!prefetch->stopping && prefetch->count == 0) {
+			pthread_cond_wait(&prefetch->queued, &prefetch->lock);
+		}
+		if (prefetch->stopping) break;
+
+		uint64_t start_block = prefetch->blocks[prefetch->head];
+		prefetch->head = (prefetch->head + 1) % WALK_PREFETCH_QUEUE;
+		prefetch->count--;
+
+		// the walk goes on while the blocks are read
+		pthread_mutex_unlock(&prefetch->lock);
+		prefetchDirectory(start_block);
+		pthread_mutex_lock(&prefetch->lock);
 	}
+	pthread_mutex_unlock(&prefetch->lock);
 
-	if (full_path[strlen(full_path) - 1] != '/') strcat(full_path, "/");
-	strcat(full_path, path);
+	return NULL;
+}
 
-	// check that we did not overwrite memory
-	if (strlen(full_path) >= DIRMAX_LEN) {
-		printf("The absolute path exceeded %d characters. ", DIRMAX_LEN);
-		goto free_and_return_error;
+/* Starts the prefetch thread. If it cannot be started, the walk goes on without it. */
+static void startPrefetch(walk_prefetch *prefetch) {
+	prefetch->stopping = FALSE;
+	prefetch->head = 0;
+	prefetch->count = 0;
+	pthread_mutex_init(&prefetch->lock, NULL);
+	pthread_cond_init(&prefetch->queued, NULL);
+	prefetch->running = pthread_create(&prefetch->thread, NULL, prefetchThread, prefetch) == 0;
+}
+
+/* Queues the directory at start_block to be read into the block cache by the prefetch
+ * thread. It is only a hint, so it is dropped if the queue is full. */
+static void queuePrefetch(walk_prefetch *prefetch, uint64_t start_block) {
+	if (!prefetch->running) return;
+
+	pthread_mutex_lock(&prefetch->lock);
+	if (prefetch->count < WALK_PREFETCH_QUEUE) {
+		prefetch->blocks[(prefetch->head + prefetch->count) % WALK_PREFETCH_QUEUE] = start_block;
+		prefetch->count++;
+		pthread_cond_signal(&prefetch->queued);
 	}
+	pthread_mutex_unlock(&prefetch->lock);
+}
 
-	int parent_dir_start_block = getParentBasenameStartBlock(full_path);
-	if (parent_dir_start_block == ERROR) {
-		printf("Error getting parent directory start block. ");
-		goto free_and_return_error;
+/* Stops the prefetch thread, dropping whatever is still queued, and waits for it to
+ * exit, so that nothing is read after the walk returns. */
+static void stopPrefetch(walk_prefetch *prefetch) {
+	if (prefetch->running) {
+		pthread_mutex_lock(&prefetch->lock);
+		prefetch->stopping = TRUE;
+		pthread_cond_signal(&prefetch->queued);
+		pthread_mutex_unlock(&prefetch->lock);
+
+		pthread_join(prefetch->thread, NULL);
+		prefetch->running = FALSE;
 	}
 
-	// read from disk into parent_dir
-	parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-	if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir_start_block,
-	    "fs_stat init parent_dir") == ERROR) {
-		goto free_and_return_error;
+	pthread_cond_destroy(&prefetch->queued);
+	pthread_mutex_destroy(&prefetch->lock);
+}
+
+static int walkDirectory(walk_state *walk, uint64_t start_block, size_t path_len, int level);
+
+/* Visits entry, whose path is in walk->path, and everything under it if it is a
+ * directory. base is the offset of the entry's name in the path.
+ * Returns SUCCESS, the visitor's return value if it was non-zero, or ERROR. */
+static int walkEntry(walk_state *walk, dir_entry *entry, int base, int level) {
+	struct fs_stat stat;
+	if (fillStat(entry, &stat) == ERROR) return ERROR;
+
+	struct fs_walkinfo info = { level, base };
+	if (entry->type != DIRECTORY) return walk->fn(walk->path, &stat, FS_WALK_FILE, &info);
+
+	int result;
+	if (!(walk->flags & FS_WALK_DEPTH)) {
+		result = walk->fn(walk->path, &stat, FS_WALK_DIR, &info);
+		if (result != SUCCESS) return result;
 	}
 
-	// searches in parent_dir for an entry with the matching filename
-	int entry_index = getDirEntryIndexByName(parent_dir, path);
-	if (entry_index == ERROR || entry_index == NOT_FOUND) {
-		printf("The basename directory entry was not found. ");
-		goto free_and_return_error;
+	result = walkDirectory(walk, entry->start_block, strlen(walk->path), level + 1);
+	if (result != SUCCESS) return result;
+
+	if (walk->flags & FS_WALK_DEPTH) return walk->fn(walk->path, &stat, FS_WALK_DIR_POST, &info);
+	return SUCCESS;
+}
+
+/* Visits every entry of the directory at start_block, except '.' and '..'. The
+ * directory's path is the first path_len chars of walk->path.
+ * Returns SUCCESS, the visitor's return value if it was non-zero, or ERROR. */
+static int walkDirectory(walk_state *walk, uint64_t start_block, size_t path_len, int level) {
+	if (level > MAX_PATHNAME_DEPTH) {
+		printf("Error: The directories are nested too deeply. ");
+		return ERROR;
 	}
 
-	buf->st_size = (off_t) parent_dir[entry_index].size;
-	buf->st_blksize = (blksize_t) vcb->block_size;
-	buf->st_blocks = (blkcnt_t) ceilingDivide(parent_dir[entry_index].size, vcb->block_size);
+	directory dir;
+	if (openDirectory(start_block, &dir) == ERROR) return ERROR;
+
+	// names are appended after a '/'
+	int base = path_len;
+	if (path_len == 0 || walk->path[path_len - 1] != '/') base++;
+
+	uint64_t slot = PARENT_ENTRY_INDEX + 1; // where to look for the next entry to visit
+	uint64_t ahead_slot = slot; // where to look for the next subdirectory to prefetch
+	int ahead_dirs = 0; // subdirectories queued for prefetching but not visited yet
+	int ahead_done = FALSE; // TRUE once every subdirectory was queued
+	int result = SUCCESS;
+
+	while (TRUE) {
+		// keep the next few subdirectories queued for the prefetch thread ahead of the visitor
+		while (!ahead_done && ahead_dirs < FS_WALK_PREFETCH_DIRS) {
+			dir_entry ahead;
+			long long ahead_index = nextDirEntry(&dir, ahead_slot, &ahead);
+			if (ahead_index == ERROR || ahead_index == NOT_FOUND) {
+				ahead_done = TRUE;
+				break;
+			}
+
+			ahead_slot = ahead_index + 1;
+			if (ahead.type == DIRECTORY) {
+				queuePrefetch(&walk->prefetch, ahead.start_block);
+				ahead_dirs++;
+			}
+		}
+
+		dir_entry entry;
+		long long entry_index = nextDirEntry(&dir, slot, &entry);
+		if (entry_index == ERROR) {
+			result = ERROR;
+			break;
+		} else if (entry_index == NOT_FOUND) {
+			break;
+		}
 
-	buf->st_accesstime = parent_dir[entry_index].last_opened;
-	buf->st_modtime = parent_dir[entry_index].last_modified;
-	buf->st_createtime = parent_dir[entry_index].creation_date;
+		slot = entry_index + 1;
+		if (entry.type == DIRECTORY && (uint64_t) entry_index < ahead_slot && ahead_dirs > 0) {
+			ahead_dirs--;
+		}
 
-	free(parent_dir);
-	parent_dir = NULL;
+		if (base + strlen(entry.name) >= PATH_MAX_LEN) {
+			printf("Error: The path of %s is too long. ", entry.name);
+			result = ERROR;
+			break;
+		}
 
-	return SUCCESS;
+		walk->path[path_len] = '\0';
+		if (base > path_len) strcat(walk->path, "/");
+		strcat(walk->path, entry.name);
 
-	free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
-	free(parent_dir);
-	parent_dir = NULL;
+		result = walkEntry(walk, &entry, base, level);
+		if (result != SUCCESS) break;
+	}
 
-	printf("fs_stat failed.\n");
-	return ERROR;
+	closeDirectory(&dir);
+	walk->path[path_len] = '\0';
+	return result;
 }
 
-int fs_closedir(fdDir *dirp) {
-	free(di);
-	di = NULL;
-	free(dir);
-	dir = NULL;
-	free(dirp);
-	dirp = NULL;
+int fs_walk(const char *path, fs_walk_fn fn, int flags) {
+	if (strlen(path) >= PATH_MAX_LEN) return ERROR;
 
-	return SUCCESS;
-}
\ No newline at end of file
+	dir_entry entry;
+	long long entry_index = lookupEntry(path, &entry);
+	if (entry_index == ERROR || entry_index == NOT_FOUND) return ERROR;
+
+	walk_state *walk = malloc(sizeof(walk_state));
+	if (!walk) return ERROR;
+
+	walk->fn = fn;
+	walk->flags = flags;
+	strcpy(walk->path, path);
+
+	// drop trailing slashes, so that "dir/" is visited as "dir", unless the path is just "/"
+	size_t path_len = strlen(walk->path);
+	while (path_len > 1 && walk->path[path_len - 1] == '/') walk->path[--path_len] = '\0';
+
+	// the basename starts after the last '/', unless the path is just "/"
+	char *last_slash = strrchr(walk->path, '/');
+	int base = 0;
+	if (last_slash && last_slash[1] != '\0') base = last_slash + 1 - walk->path;
+
+	startPrefetch(&walk->prefetch);
+	int result = walkEntry(walk, &entry, base, 0);
+	stopPrefetch(&walk->prefetch);
+
+	free(walk);
+	walk = NULL;
+	return result;
+}
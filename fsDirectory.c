@@ -0,0 +1,776 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsDirectory.c
+*
+* Description: Functions for opening, searching, and changing directories.
+*  Every entry is found through the hash index, which is kept at most
+*  half full and doubles in size when it would go over. The slot array
+*  grows by its own size (up to DIR_MAX_GROW_BLOCKS blocks at a time)
+*  when there are no free slots left.
+*
+**************************************************************/
+
+#include "fsDirectory.h"
+
+#define FNV_OFFSET_BASIS 2166136261u // 32-bit FNV-1a constants
+#define FNV_PRIME 16777619u
+
+/* Returns how many directory entries fit in one block. A slot never spans two blocks. */
+static uint64_t slotsPerBlock() { return vcb->block_size / sizeof(dir_entry); }
+
+/* Returns how many buckets fit in one block. */
+static uint64_t bucketsPerBlock() { return vcb->block_size / sizeof(dir_bucket); }
+
+/* Returns the 32-bit FNV-1a hash of name. */
+static uint32_t hashName(const char *name) {
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for (const unsigned char *c = (const unsigned char *) name; *c; c++) {
+        hash ^= *c;
+        hash *= FNV_PRIME;
+    }
+    return hash;
+}
+
+/* Returns the volume block that block file_block of the slot array (is_index == FALSE)
+ * or of the hash index (is_index == TRUE) is in, or UNSIGNED_ERROR. */
+static uint64_t mapDirBlock(directory *dir, uint64_t file_block, int is_index) {
+    uint64_t vol_block = mapFileBlock(is_index ? &dir->index : &dir->slots, file_block, NULL);
+    if (vol_block == UNSIGNED_ERROR) {
+        printf("Error: The directory is smaller than its header says. ");
+    }
+
+    return vol_block;
+}
+
+/* Reads block file_block of the slot array (is_index == FALSE) or of the hash index
+ * (is_index == TRUE) into dir->block. Returns the volume block, or UNSIGNED_ERROR. */
+static uint64_t readDirBlock(directory *dir, uint64_t file_block, int is_index) {
+    uint64_t vol_block = mapDirBlock(dir, file_block, is_index);
+    if (vol_block == UNSIGNED_ERROR) return UNSIGNED_ERROR;
+
+    if (customLBAread(dir->block, 1, vol_block, "readDirBlock") == ERROR) return UNSIGNED_ERROR;
+    return vol_block;
+}
+
+/* Returns block file_block of the slot array or hash index, to be looked at but not
+ * changed: a view of it in place if the device has one, or else a copy of it read
+ * into dir->block. It is given back with releaseDirBlock. Returns NULL on error. */
+static const char *getDirBlock(directory *dir, uint64_t file_block, int is_index) {
+    uint64_t vol_block = mapDirBlock(dir, file_block, is_index);
+    if (vol_block == UNSIGNED_ERROR) return NULL;
+
+    const char *view = customLBAview(1, vol_block);
+    if (view) return view;
+
+    if (customLBAread(dir->block, 1, vol_block, "getDirBlock") == ERROR) return NULL;
+    return dir->block;
+}
+
+/* Gives back a block from getDirBlock. */
+static void releaseDirBlock(directory *dir, const char *block) {
+    if (block != dir->block) customLBAunview(block);
+}
+
+/* Copies the entry in slot into entry. */
+static int readSlot(directory *dir, uint64_t slot, dir_entry *entry) {
+    if (slot >= dir->header.num_slots) {
+        printf("Error: Directory slot %lu is out of range. ", slot);
+        return ERROR;
+    }
+
+    uint64_t per_block = slotsPerBlock();
+    const char *block = getDirBlock(dir, slot / per_block, FALSE);
+    if (!block) return ERROR;
+
+    memcpy(entry, block + (slot % per_block) * sizeof(dir_entry), sizeof(dir_entry));
+    releaseDirBlock(dir, block);
+    return SUCCESS;
+}
+
+/* Writes entry into slot. */
+static int writeSlot(directory *dir, uint64_t slot, dir_entry *entry) {
+    if (slot >= dir->header.num_slots) {
+        printf("Error: Directory slot %lu is out of range. ", slot);
+        return ERROR;
+    }
+
+    uint64_t per_block = slotsPerBlock();
+    uint64_t vol_block = readDirBlock(dir, slot / per_block, FALSE);
+    if (vol_block == UNSIGNED_ERROR) return ERROR;
+
+    memcpy(dir->block + (slot % per_block) * sizeof(dir_entry), entry, sizeof(dir_entry));
+    return customLBAwrite(dir->block, 1, vol_block, "writeSlot") == ERROR ? ERROR : SUCCESS;
+}
+
+/* Copies bucket b of the hash index into bucket. */
+static int readBucket(directory *dir, uint64_t b, dir_bucket *bucket) {
+    uint64_t per_block = bucketsPerBlock();
+    const char *block = getDirBlock(dir, b / per_block, TRUE);
+    if (!block) return ERROR;
+
+    memcpy(bucket, block + (b % per_block) * sizeof(dir_bucket), sizeof(dir_bucket));
+    releaseDirBlock(dir, block);
+    return SUCCESS;
+}
+
+/* Writes bucket into bucket b of the hash index. */
+static int writeBucket(directory *dir, uint64_t b, dir_bucket *bucket) {
+    uint64_t per_block = bucketsPerBlock();
+    uint64_t vol_block = readDirBlock(dir, b / per_block, TRUE);
+    if (vol_block == UNSIGNED_ERROR) return ERROR;
+
+    memcpy(dir->block + (b % per_block) * sizeof(dir_bucket), bucket, sizeof(dir_bucket));
+    return customLBAwrite(dir->block, 1, vol_block, "writeBucket") == ERROR ? ERROR : SUCCESS;
+}
+
+/* Returns how many blocks num_buckets buckets take up. */
+static uint64_t indexBlocksNeeded(uint64_t num_buckets) {
+    uint64_t per_block = bucketsPerBlock();
+    return (num_buckets + per_block - 1) / per_block;
+}
+
+/* Returns how many buckets a new directory's index has: as many as fit in one
+ * block, rounded down to a power of 2. */
+static uint64_t initialNumBuckets() {
+    uint64_t num_buckets = 1;
+    while (num_buckets * 2 <= bucketsPerBlock()) num_buckets *= 2;
+    return num_buckets;
+}
+
+/* Puts slot into the first empty bucket at or after its home bucket. */
+static int indexInsert(directory *dir, uint64_t slot, uint32_t hash) {
+    uint64_t mask = dir->header.num_buckets - 1;
+    dir_bucket bucket;
+
+    for (uint64_t b = hash & mask, probes = 0; probes < dir->header.num_buckets;
+         b = (b + 1) & mask, probes++) {
+        if (readBucket(dir, b, &bucket) == ERROR) return ERROR;
+        if (bucket.slot != 0) continue;
+
+        bucket.slot = (uint32_t) (slot + 1);
+        bucket.hash = hash;
+        return writeBucket(dir, b, &bucket);
+    }
+
+    printf("Error: The directory's index is full. ");
+    return ERROR;
+}
+
+/* Returns the bucket that points at slot, whose entry is named name, or ERROR. */
+static long long indexFindSlot(directory *dir, uint64_t slot, const char *name) {
+    uint32_t hash = hashName(name);
+    uint64_t mask = dir->header.num_buckets - 1;
+    dir_bucket bucket;
+
+    for (uint64_t b = hash & mask, probes = 0; probes < dir->header.num_buckets;
+         b = (b + 1) & mask, probes++) {
+        if (readBucket(dir, b, &bucket) == ERROR) return ERROR;
+        if (bucket.slot == 0) break;
+        if (bucket.slot == slot + 1) return b;
+    }
+
+    printf("Error: The directory's index is missing '%s'. ", name);
+    return ERROR;
+}
+
+/* Empties bucket b. The buckets after it in the same probe run are shifted back, so
+ * that no lookup stops early at the hole, which means no tombstones are needed. */
+static int indexRemove(directory *dir, uint64_t b) {
+    uint64_t mask = dir->header.num_buckets - 1;
+    dir_bucket bucket, empty = {0, 0};
+    uint64_t hole = b;
+
+    for (uint64_t next = (b + 1) & mask; next != b; next = (next + 1) & mask) {
+        if (readBucket(dir, next, &bucket) == ERROR) return ERROR;
+        if (bucket.slot == 0) break;
+
+        // the bucket can fill the hole only if its home is not between the hole and it
+        uint64_t home = bucket.hash & mask;
+        int home_after_hole = (hole <= next) ? (hole < home && home <= next)
+                                             : (hole < home || home <= next);
+        if (home_after_hole) continue;
+
+        if (writeBucket(dir, hole, &bucket) == ERROR) return ERROR;
+        hole = next;
+    }
+
+    return writeBucket(dir, hole, &empty);
+}
+
+/* Doubles the hash index. The new index is built in memory from the entries in the
+ * slot array and written to new blocks, so the old index stays intact until the new
+ * one is complete. Nothing points at the new blocks until the header does, so they
+ * are not logged, however many there are. */
+static int growIndex(directory *dir) {
+    uint64_t new_num_buckets = dir->header.num_buckets * 2;
+    uint64_t mask = new_num_buckets - 1;
+    uint64_t per_block = bucketsPerBlock();
+    uint64_t blocks_needed = indexBlocksNeeded(new_num_buckets);
+    extent_list new_index;
+    initExtentList(&new_index);
+
+    char *index = calloc(blocks_needed, vcb->block_size);
+    if (!index) return ERROR;
+
+    dir->blocks_changed = TRUE;
+    if (allocateFileBlocks(&new_index, blocks_needed) < blocks_needed) {
+        printf("Not enough free blocks on disk to grow the directory's index. ");
+        goto free_and_return_error;
+    }
+
+    // each entry goes in the first empty bucket at or after its home bucket
+    dir_entry entry;
+    for (long long slot = nextDirEntry(dir, 0, &entry); slot != NOT_FOUND;
+         slot = nextDirEntry(dir, slot + 1, &entry)) {
+        if (slot == ERROR) goto free_and_return_error;
+
+        uint32_t hash = hashName(entry.name);
+        dir_bucket *bucket = NULL;
+        for (uint64_t b = hash & mask, probes = 0; probes < new_num_buckets;
+             b = (b + 1) & mask, probes++) {
+            bucket = (dir_bucket *) (index + (b / per_block) * vcb->block_size
+                                     + (b % per_block) * sizeof(dir_bucket));
+            if (bucket->slot == 0) break;
+        }
+
+        if (bucket->slot != 0) {
+            printf("Error: The directory's index is full. ");
+            goto free_and_return_error;
+        }
+        bucket->slot = (uint32_t) (slot + 1);
+        bucket->hash = hash;
+    }
+
+    char *next_block = index;
+    for (uint64_t i = 0; i < new_index.num_extents; i++) {
+        if (customLBAwriteNew(next_block, new_index.extents[i].num_blocks,
+            new_index.extents[i].start_block, "growIndex") == ERROR) {
+            goto free_and_return_error;
+        }
+        next_block += new_index.extents[i].num_blocks * vcb->block_size;
+    }
+
+    // the new index is complete, so the old one can go
+    if (freeExtentMap(&dir->header.index_map) == ERROR) goto free_and_return_error;
+    freeExtentList(&dir->index);
+    dir->index = new_index;
+    dir->header.num_buckets = new_num_buckets;
+
+    free(index);
+    index = NULL;
+
+    if (storeExtentList(&dir->header.index_map, &dir->index) == ERROR) return ERROR;
+
+    dir->header_dirty = TRUE;
+    return SUCCESS;
+
+    free_and_return_error: // Label for error handling. Free the new index and return ERROR.
+    free(index);
+    index = NULL;
+    truncateExtentList(&new_index, 0);
+    freeExtentList(&new_index);
+
+    return ERROR;
+}
+
+/* Adds free slots to the end of the slot array. Only called when there are no free
+ * slots, so the new slots become the whole free list. */
+static int growSlots(directory *dir) {
+    uint64_t per_block = slotsPerBlock();
+    uint64_t old_num_blocks = dir->slots.num_blocks;
+
+    uint64_t blocks_wanted = old_num_blocks;
+    if (blocks_wanted > DIR_MAX_GROW_BLOCKS) blocks_wanted = DIR_MAX_GROW_BLOCKS;
+    if (blocks_wanted == 0) blocks_wanted = 1;
+
+    uint64_t num_allocated = allocateFileBlocks(&dir->slots, blocks_wanted);
+    if (num_allocated > 0) dir->blocks_changed = TRUE;
+    if (num_allocated == 0) {
+        printf("Not enough free blocks on disk to grow the directory. ");
+        return ERROR;
+    }
+
+    // chain the new slots together in order, so they are handed out front to back
+    uint64_t first_slot = old_num_blocks * per_block;
+    uint64_t end_slot = (old_num_blocks + num_allocated) * per_block;
+    dir->header.num_slots = end_slot;
+
+    for (uint64_t file_block = old_num_blocks; file_block < old_num_blocks + num_allocated;
+         file_block++) {
+        uint64_t vol_block = mapFileBlock(&dir->slots, file_block, NULL);
+        memset(dir->block, 0, vcb->block_size);
+
+        for (uint64_t i = 0; i < per_block; i++) {
+            uint64_t slot = file_block * per_block + i;
+            dir_entry *entry = (dir_entry *) (dir->block + i * sizeof(dir_entry));
+            entry->type = FREE_ENTRY;
+            entry->start_block = (slot + 1 < end_slot) ? slot + 1 : DIR_NO_SLOT;
+        }
+
+        // the new blocks are not logged, like the new blocks of the index
+        if (customLBAwriteNew(dir->block, 1, vol_block, "growSlots") == ERROR) return ERROR;
+    }
+
+    dir->header.free_slot = first_slot;
+    dir->header_dirty = TRUE;
+    if (storeExtentList(&dir->header.slot_map, &dir->slots) == ERROR) return ERROR;
+
+    // '.' holds the directory's size
+    dir_entry self;
+    if (readSlot(dir, SELF_ENTRY_INDEX, &self) == ERROR) return ERROR;
+    self.size = getDirSize(dir);
+    return writeSlot(dir, SELF_ENTRY_INDEX, &self);
+}
+
+int openDirectory(uint64_t start_block, directory *dir) {
+    dir->start_block = start_block;
+    dir->header_dirty = FALSE;
+    dir->blocks_changed = FALSE;
+    initExtentList(&dir->slots);
+    initExtentList(&dir->index);
+
+    dir->block = malloc(vcb->block_size);
+    if (!dir->block) return ERROR;
+
+    if (start_block == 0 || start_block >= vcb->num_blocks) goto not_a_directory;
+
+    if (customLBAread(dir->block, 1, start_block, "openDirectory") == ERROR) {
+        goto free_and_return_error;
+    }
+    memcpy(&dir->header, dir->block, sizeof(dir_header));
+
+    uint64_t num_buckets = dir->header.num_buckets;
+    if (dir->header.signature != DIR_SIGNATURE || num_buckets == 0
+        || (num_buckets & (num_buckets - 1)) != 0) {
+        goto not_a_directory;
+    }
+
+    if (loadExtentList(&dir->header.slot_map, &dir->slots) == ERROR
+        || loadExtentList(&dir->header.index_map, &dir->index) == ERROR) {
+        goto free_and_return_error;
+    }
+
+    if (dir->slots.num_blocks * slotsPerBlock() < dir->header.num_slots
+        || dir->index.num_blocks < indexBlocksNeeded(num_buckets)) {
+        goto not_a_directory;
+    }
+
+    return SUCCESS;
+
+    not_a_directory: // Label for a bad header. Falls through to the error handling.
+    printf("Error: Block %lu does not hold a directory. ", start_block);
+
+    free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
+    free(dir->block);
+    dir->block = NULL;
+    freeExtentList(&dir->slots);
+    freeExtentList(&dir->index);
+
+    return ERROR;
+}
+
+int closeDirectory(directory *dir) {
+    int result = SUCCESS;
+
+    if (dir->header_dirty) {
+        memset(dir->block, 0, vcb->block_size);
+        memcpy(dir->block, &dir->header, sizeof(dir_header));
+
+        if (customLBAwrite(dir->block, 1, dir->start_block, "closeDirectory header") == ERROR) {
+            result = ERROR;
+        }
+    }
+
+    if (dir->blocks_changed) {
+        // write to disk the updated vcb->num_free_blocks and bitmap
+        if (writeVCBandBitmap("closeDirectory VCB and bitmap") == ERROR) {
+            result = ERROR;
+        }
+    }
+
+    free(dir->block);
+    dir->block = NULL;
+    freeExtentList(&dir->slots);
+    freeExtentList(&dir->index);
+
+    return result;
+}
+
+long long findDirEntry(directory *dir, const char *name, dir_entry *entry) {
+    uint32_t hash = hashName(name);
+    uint64_t mask = dir->header.num_buckets - 1;
+    uint64_t per_block = slotsPerBlock();
+    dir_bucket bucket;
+
+    for (uint64_t b = hash & mask, probes = 0; probes < dir->header.num_buckets;
+         b = (b + 1) & mask, probes++) {
+        if (readBucket(dir, b, &bucket) == ERROR) return ERROR;
+        if (bucket.slot == 0) break; // the end of the probe run
+        if (bucket.hash != hash) continue;
+
+        uint64_t slot = bucket.slot - 1;
+        if (slot >= dir->header.num_slots) {
+            printf("Error: Directory slot %lu is out of range. ", slot);
+            return ERROR;
+        }
+
+        // the name is compared where the entry is, and only a match is copied out
+        const char *block = getDirBlock(dir, slot / per_block, FALSE);
+        if (!block) return ERROR;
+
+        const dir_entry *found = (const dir_entry *) (block
+                                 + (slot % per_block) * sizeof(dir_entry));
+        int is_match = found->type != FREE_ENTRY && strcmp(found->name, name) == 0;
+        if (is_match && entry) memcpy(entry, found, sizeof(dir_entry));
+        releaseDirBlock(dir, block);
+
+        if (is_match) return slot;
+    }
+
+    return NOT_FOUND;
+}
+
+long long findDirEntryByStartBlock(directory *dir, uint64_t start_block, dir_entry *entry) {
+    long long slot = nextDirEntry(dir, PARENT_ENTRY_INDEX + 1, entry);
+
+    while (slot != NOT_FOUND && slot != ERROR) {
+        if (entry->start_block == start_block) return slot;
+        slot = nextDirEntry(dir, slot + 1, entry);
+    }
+
+    return slot;
+}
+
+int readDirEntry(directory *dir, uint64_t slot, dir_entry *entry) {
+    return readSlot(dir, slot, entry);
+}
+
+int writeDirEntry(directory *dir, uint64_t slot, dir_entry *entry) {
+    dir_entry old_entry;
+    if (readSlot(dir, slot, &old_entry) == ERROR) return ERROR;
+
+    if (old_entry.type == FREE_ENTRY) {
+        printf("Error: Directory slot %lu is free. ", slot);
+        return ERROR;
+    }
+
+    // a renamed entry moves to the bucket for its new name
+    int renamed = (strcmp(old_entry.name, entry->name) != 0);
+    if (renamed) {
+        long long b = indexFindSlot(dir, slot, old_entry.name);
+        if (b == ERROR || indexRemove(dir, b) == ERROR) return ERROR;
+    }
+
+    if (writeSlot(dir, slot, entry) == ERROR) return ERROR;
+    if (renamed) return indexInsert(dir, slot, hashName(entry->name));
+
+    return SUCCESS;
+}
+
+long long addDirEntry(directory *dir, dir_entry *entry) {
+    if (dir->header.free_slot == DIR_NO_SLOT && growSlots(dir) == ERROR) return ERROR;
+
+    // keep the index at most half full, so probe runs stay short
+    if ((dir->header.num_used + 1) * 2 > dir->header.num_buckets
+        && growIndex(dir) == ERROR) {
+        return ERROR;
+    }
+
+    uint64_t slot = dir->header.free_slot;
+    dir_entry free_entry;
+    if (readSlot(dir, slot, &free_entry) == ERROR) return ERROR;
+
+    if (free_entry.type != FREE_ENTRY) {
+        printf("Error: The directory's free slot list is corrupted. ");
+        return ERROR;
+    }
+
+    if (writeSlot(dir, slot, entry) == ERROR) return ERROR;
+    if (indexInsert(dir, slot, hashName(entry->name)) == ERROR) return ERROR;
+
+    dir->header.free_slot = free_entry.start_block; // the next free slot
+    dir->header.num_used++;
+    dir->header_dirty = TRUE;
+
+    return slot;
+}
+
+int removeDirEntry(directory *dir, uint64_t slot) {
+    if (slot <= PARENT_ENTRY_INDEX) {
+        printf("Error: '.' and '..' cannot be removed from a directory. ");
+        return ERROR;
+    }
+
+    dir_entry entry;
+    if (readSlot(dir, slot, &entry) == ERROR) return ERROR;
+
+    if (entry.type == FREE_ENTRY) {
+        printf("Error: Directory slot %lu is already free. ", slot);
+        return ERROR;
+    }
+
+    long long b = indexFindSlot(dir, slot, entry.name);
+    if (b == ERROR || indexRemove(dir, b) == ERROR) return ERROR;
+
+    // the slot goes on the front of the free list
+    clearDirEntry(&entry);
+    entry.start_block = dir->header.free_slot;
+    if (writeSlot(dir, slot, &entry) == ERROR) return ERROR;
+
+    dir->header.free_slot = slot;
+    dir->header.num_used--;
+    dir->header_dirty = TRUE;
+
+    return SUCCESS;
+}
+
+long long nextDirEntry(directory *dir, uint64_t slot, dir_entry *entry) {
+    uint64_t per_block = slotsPerBlock();
+    uint64_t loaded_block = UINT64_MAX; // the slot array block that block holds
+    const char *block = NULL;
+
+    for (; slot < dir->header.num_slots; slot++) {
+        // get each block once, not once per slot
+        if (slot / per_block != loaded_block) {
+            if (block) releaseDirBlock(dir, block);
+            loaded_block = slot / per_block;
+            block = getDirBlock(dir, loaded_block, FALSE);
+            if (!block) return ERROR;
+        }
+
+        const dir_entry *slot_entry = (const dir_entry *) (block
+                                      + (slot % per_block) * sizeof(dir_entry));
+        if (slot_entry->type != FREE_ENTRY) {
+            memcpy(entry, slot_entry, sizeof(dir_entry));
+            releaseDirBlock(dir, block);
+            return slot;
+        }
+    }
+
+    if (block) releaseDirBlock(dir, block);
+    return NOT_FOUND;
+}
+
+int isDirEmpty(directory *dir) { return dir->header.num_used <= PARENT_ENTRY_INDEX + 1; }
+
+uint64_t getDirSize(directory *dir) { return dir->header.num_slots * sizeof(dir_entry); }
+
+uint64_t readDirSize(uint64_t start_block) {
+    if (start_block == 0 || start_block >= vcb->num_blocks) return UNSIGNED_ERROR;
+
+    char *block = malloc(vcb->block_size);
+    if (!block) return UNSIGNED_ERROR;
+
+    if (customLBAread(block, 1, start_block, "readDirSize") == ERROR) {
+        free(block);
+        block = NULL;
+        return UNSIGNED_ERROR;
+    }
+
+    dir_header header;
+    memcpy(&header, block, sizeof(dir_header));
+    free(block);
+    block = NULL;
+
+    if (header.signature != DIR_SIGNATURE) return UNSIGNED_ERROR;
+    return header.num_slots * sizeof(dir_entry);
+}
+
+void prefetchDirectory(uint64_t start_block) {
+    if (start_block == 0 || start_block >= vcb->num_blocks) return;
+
+    char *blocks = malloc(DIR_PREFETCH_BLOCKS * vcb->block_size);
+    if (!blocks) return;
+
+    if (customLBAread(blocks, 1, start_block, "prefetchDirectory header") == ERROR) {
+        goto free_and_return;
+    }
+
+    dir_header header;
+    memcpy(&header, blocks, sizeof(dir_header));
+    if (header.signature != DIR_SIGNATURE) goto free_and_return;
+
+    // only the extents in the header. a slot array that big is not worth prefetching
+    uint64_t budget = DIR_PREFETCH_BLOCKS;
+    uint64_t num_extents = header.slot_map.num_extents;
+    if (num_extents > INLINE_EXTENTS) num_extents = INLINE_EXTENTS;
+
+    for (uint64_t i = 0; i < num_extents && budget > 0; i++) {
+        extent *ext = &header.slot_map.extents[i];
+        uint64_t count = ext->num_blocks < budget ? ext->num_blocks : budget;
+        if (ext->start_block >= vcb->num_blocks || count > vcb->num_blocks - ext->start_block) break;
+
+        if (customLBAread(blocks, count, ext->start_block, "prefetchDirectory slots") == ERROR) break;
+        budget -= count;
+    }
+
+    free_and_return: // Label for freeing the buffer and returning.
+    free(blocks);
+    blocks = NULL;
+}
+
+int touchDirectory(directory *dir, time_t curr_time) {
+    dir_entry self;
+    if (readSlot(dir, SELF_ENTRY_INDEX, &self) == ERROR) return ERROR;
+    self.last_modified = curr_time;
+    if (writeSlot(dir, SELF_ENTRY_INDEX, &self) == ERROR) return ERROR;
+
+    // if dir is the root directory, then update its '..' too since root is its own parent
+    if (dir->start_block == vcb->root_dir_start_block) {
+        dir_entry parent;
+        if (readSlot(dir, PARENT_ENTRY_INDEX, &parent) == ERROR) return ERROR;
+        parent.last_modified = curr_time;
+        if (writeSlot(dir, PARENT_ENTRY_INDEX, &parent) == ERROR) return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+uint64_t getNewDirBlocks() {
+    uint64_t slot_blocks = (DIR_INITIAL_SLOTS + slotsPerBlock() - 1) / slotsPerBlock();
+    return 1 + slot_blocks + indexBlocksNeeded(initialNumBuckets());
+}
+
+uint64_t createDirectory(dir_entry *parent, time_t curr_time) {
+    uint64_t per_block = slotsPerBlock();
+    uint64_t slot_blocks = (DIR_INITIAL_SLOTS + per_block - 1) / per_block;
+    uint64_t num_buckets = initialNumBuckets();
+    uint64_t index_blocks = indexBlocksNeeded(num_buckets);
+    uint64_t dir_blocks = 1 + slot_blocks + index_blocks;
+
+    directory dir;
+    dir.block = NULL;
+
+    // Try to get enough contiguous free blocks in the volume for the directory. they go
+    // in the smallest hole that fits, since most directories never grow.
+    uint64_t dir_start_block = getBestFitFreeBlocks(dir_blocks);
+    if (dir_start_block == UNSIGNED_ERROR) {
+        printf("Not enough contiguous free blocks on disk for the new directory. ");
+        return UNSIGNED_ERROR;
+    }
+
+    markBlockRangeUsed(bitmap, dir_start_block, dir_blocks);
+    vcb->num_free_blocks -= dir_blocks;
+
+    // the header block comes first, then the slot array, then the index
+    dir_header header;
+    memset(&header, 0, sizeof(dir_header));
+    header.signature = DIR_SIGNATURE;
+    header.num_slots = slot_blocks * per_block;
+    header.num_used = 0;
+    header.free_slot = 0;
+    header.num_buckets = num_buckets;
+    header.slot_map.num_extents = 1;
+    header.slot_map.extents[0].start_block = dir_start_block + 1;
+    header.slot_map.extents[0].num_blocks = slot_blocks;
+    header.index_map.num_extents = 1;
+    header.index_map.extents[0].start_block = dir_start_block + 1 + slot_blocks;
+    header.index_map.extents[0].num_blocks = index_blocks;
+
+    char *block = calloc(1, vcb->block_size);
+    if (!block) goto free_and_return_error;
+
+    // an empty index
+    for (uint64_t i = 0; i < index_blocks; i++) {
+        if (customLBAwriteNew(block, 1, header.index_map.extents[0].start_block + i,
+            "createDirectory index") == ERROR) {
+            goto free_and_return_error;
+        }
+    }
+
+    // every slot starts out on the free list, so '.' and '..' get slots 0 and 1
+    for (uint64_t i = 0; i < slot_blocks; i++) {
+        memset(block, 0, vcb->block_size);
+
+        for (uint64_t j = 0; j < per_block; j++) {
+            uint64_t slot = i * per_block + j;
+            dir_entry *entry = (dir_entry *) (block + j * sizeof(dir_entry));
+            entry->type = FREE_ENTRY;
+            entry->start_block = (slot + 1 < header.num_slots) ? slot + 1 : DIR_NO_SLOT;
+        }
+
+        if (customLBAwriteNew(block, 1, header.slot_map.extents[0].start_block + i,
+            "createDirectory slots") == ERROR) {
+            goto free_and_return_error;
+        }
+    }
+
+    memset(block, 0, vcb->block_size);
+    memcpy(block, &header, sizeof(dir_header));
+    if (customLBAwriteNew(block, 1, dir_start_block, "createDirectory header") == ERROR) {
+        goto free_and_return_error;
+    }
+
+    free(block);
+    block = NULL;
+
+    if (openDirectory(dir_start_block, &dir) == ERROR) goto free_and_return_error;
+
+    // initialize the '.' entry in the new directory
+    dir_entry self;
+    memset(&self, 0, sizeof(dir_entry));
+    strcpy(self.name, ".");
+    self.start_block = dir_start_block;
+    self.size = getDirSize(&dir);
+    self.type = DIRECTORY;
+    self.creation_date = curr_time;
+    self.last_modified = curr_time;
+    self.last_opened = curr_time;
+
+    // initialize the '..' entry in the new directory.
+    // the '..' entry is the same as '.' save for the name in the root directory
+    dir_entry parent_entry = parent ? *parent : self;
+    strcpy(parent_entry.name, "..");
+    if (parent) parent_entry.last_modified = curr_time;
+
+    if (addDirEntry(&dir, &self) != SELF_ENTRY_INDEX
+        || addDirEntry(&dir, &parent_entry) != PARENT_ENTRY_INDEX) {
+        goto free_and_return_error;
+    }
+
+    if (closeDirectory(&dir) == ERROR) {
+        dir.block = NULL; // closeDirectory freed it
+        goto free_and_return_error;
+    }
+
+    return dir_start_block;
+
+    free_and_return_error: // Label for error handling. Free the blocks and return UNSIGNED_ERROR.
+    free(block);
+    block = NULL;
+    if (dir.block) closeDirectory(&dir);
+
+    markBlockRangeFree(bitmap, dir_start_block, dir_blocks);
+    vcb->num_free_blocks += dir_blocks;
+
+    return UNSIGNED_ERROR;
+}
+
+long long freeDirectory(uint64_t start_block) {
+    directory dir;
+    if (openDirectory(start_block, &dir) == ERROR) return ERROR;
+
+    long long num_freed = 0;
+    long long num_slot_blocks = freeExtentMap(&dir.header.slot_map);
+    long long num_index_blocks = freeExtentMap(&dir.header.index_map);
+
+    if (num_slot_blocks != ERROR && num_index_blocks != ERROR) {
+        markBlockRangeFree(bitmap, start_block, 1);
+        vcb->num_free_blocks++;
+        num_freed = num_slot_blocks + num_index_blocks + 1;
+    } else num_freed = ERROR;
+
+    // the header is not written back, so nothing on disk points at the freed blocks
+    free(dir.block);
+    dir.block = NULL;
+    freeExtentList(&dir.slots);
+    freeExtentList(&dir.index);
+
+    return num_freed;
+}
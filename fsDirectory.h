@@ -0,0 +1,136 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsDirectory.h
+*
+* Description: Interface for directories. A directory starts with a
+*  header block, whose block number identifies the directory. The header
+*  holds the extent maps of two growable areas:
+*   - the slot array, where each slot holds one directory entry. Slot 0 is
+*     '.' and slot 1 is '..'. Free slots are chained into a free list.
+*   - the hash index, an open addressing hash table with linear probing
+*     that maps the hash of an entry's name to its slot.
+*  Both areas grow on demand, so a directory can hold any number of
+*  entries, and name lookups and finding a free slot are O(1) on average.
+*
+**************************************************************/
+
+#ifndef _FS_DIRECTORY_H
+#define _FS_DIRECTORY_H
+
+#include <stdint.h>
+#include "mfs.h"
+#include "fsExtent.h"
+
+#define DIR_SIGNATURE 0xD1EC7041 // marks a directory's header block
+#define DIR_NO_SLOT UINT64_MAX // end of the free slot list
+#define DIR_INITIAL_SLOTS 8 // slots a new directory starts with, including '.' and '..'
+#define DIR_MAX_GROW_BLOCKS 256 // the slot array grows by at most this many blocks at once
+#define DIR_PREFETCH_BLOCKS 32 // most slot array blocks prefetchDirectory reads
+#define SELF_ENTRY_INDEX 0 // slot of the '.' entry
+#define PARENT_ENTRY_INDEX 1 // slot of the '..' entry
+
+// a directory's header block starts with this
+typedef struct dir_header {
+    uint64_t signature; // DIR_SIGNATURE
+    uint64_t num_slots; // slots in the slot array, used or free
+    uint64_t num_used; // slots that hold an entry, including '.' and '..'
+    uint64_t free_slot; // first slot in the free slot list, or DIR_NO_SLOT
+    uint64_t num_buckets; // buckets in the hash index, always a power of 2
+    extent_map slot_map; // where the slot array is
+    extent_map index_map; // where the hash index is
+} dir_header;
+
+// one bucket of the hash index
+typedef struct dir_bucket {
+    uint32_t slot; // the entry's slot plus 1, or 0 if the bucket is empty
+    uint32_t hash; // hash of the entry's name, so most mismatches skip reading the slot
+} dir_bucket;
+
+// an open directory
+typedef struct directory {
+    uint64_t start_block; // the directory's header block
+    dir_header header; // the header. written back on close if it changed
+    extent_list slots; // maps the blocks of the slot array to volume blocks
+    extent_list index; // maps the blocks of the hash index to volume blocks
+    char *block; // holds one block while reading or changing a slot or bucket
+    int header_dirty; // TRUE if the header changed since it was read
+    int blocks_changed; // TRUE if blocks were allocated or freed, so the bitmap changed
+} directory;
+
+/* Opens the directory whose header block is start_block.
+ * Returns ERROR if it could not be read or is not a directory. Returns SUCCESS otherwise. */
+int openDirectory(uint64_t start_block, directory *dir);
+
+/* Writes back the header, and the VCB and bitmap if the directory's blocks changed,
+ * then frees the memory held by dir. dir is closed even if ERROR is returned. */
+int closeDirectory(directory *dir);
+
+/* Searches dir for the entry named name and copies it into entry, unless entry is NULL.
+ * Returns the entry's slot, NOT_FOUND if there is no such entry, or ERROR. */
+long long findDirEntry(directory *dir, const char *name, dir_entry *entry);
+
+/* Searches dir for an entry other than '.' and '..' whose start block is start_block,
+ * and copies it into entry. This is a linear scan, since the index is keyed by name.
+ * Returns the entry's slot, NOT_FOUND if there is no such entry, or ERROR. */
+long long findDirEntryByStartBlock(directory *dir, uint64_t start_block, dir_entry *entry);
+
+/* Copies the entry in slot into entry. Returns ERROR if slot is out of range. */
+int readDirEntry(directory *dir, uint64_t slot, dir_entry *entry);
+
+/* Overwrites the used entry in slot with entry, updating the index if the name
+ * changed. The caller must make sure the new name is not already in use.
+ * Returns ERROR on error, or SUCCESS. */
+int writeDirEntry(directory *dir, uint64_t slot, dir_entry *entry);
+
+/* Puts entry into a free slot, growing the directory if it is full. The caller must
+ * make sure the name is not already in use. Returns the entry's slot, or ERROR. */
+long long addDirEntry(directory *dir, dir_entry *entry);
+
+/* Removes the entry in slot and puts the slot on the free list. The entry's blocks
+ * are not freed. '.' and '..' cannot be removed. Returns ERROR on error, or SUCCESS. */
+int removeDirEntry(directory *dir, uint64_t slot);
+
+/* Finds the first used slot at or after slot and copies its entry into entry.
+ * Returns that slot, NOT_FOUND if there are no more entries, or ERROR. */
+long long nextDirEntry(directory *dir, uint64_t slot, dir_entry *entry);
+
+/* Returns TRUE if dir holds nothing but '.' and '..', FALSE otherwise. */
+int isDirEmpty(directory *dir);
+
+/* Returns the size of the directory in bytes, i.e. the size of its slot array. */
+uint64_t getDirSize(directory *dir);
+
+/* Returns the size in bytes of the directory whose header block is start_block,
+ * reading only its header. Returns UNSIGNED_ERROR on error. */
+uint64_t readDirSize(uint64_t start_block);
+
+/* Reads the header of the directory whose header block is start_block and the start
+ * of its slot array into the block cache, with one read per extent, so that opening
+ * and listing it later does not wait on the disk. Errors are ignored. */
+void prefetchDirectory(uint64_t start_block);
+
+/* Sets the last modified date of '.' to curr_time, and of '..' too if dir is the
+ * root directory, since the root is its own parent. Returns ERROR on error, or SUCCESS. */
+int touchDirectory(directory *dir, time_t curr_time);
+
+/* Makes an empty directory. parent is the '.' entry of the parent directory, which is
+ * copied into '..'. For the root directory, parent is NULL and '..' is a copy of '.'.
+ * Changes the bitmap and VCB in memory only.
+ * Returns the new directory's start block, or UNSIGNED_ERROR on error. */
+uint64_t createDirectory(dir_entry *parent, time_t curr_time);
+
+/* Frees every block of the directory whose header block is start_block. The entries
+ * in it are not freed. Changes the bitmap and VCB in memory only.
+ * Returns how many blocks were freed, or ERROR on error. */
+long long freeDirectory(uint64_t start_block);
+
+/* Returns how many blocks a new directory takes up. */
+uint64_t getNewDirBlocks();
+
+#endif
@@ -0,0 +1,481 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsExtent.c
+*
+* Description: Functions for loading, storing, growing, and freeing the
+*  extent lists that map a file's blocks to blocks in the volume.
+*
+**************************************************************/
+
+#include "fsExtent.h"
+#include "fsRefcount.h"
+
+#define MIN_EXTENT_CAPACITY 8 // extents an extent list can hold when first grown
+
+/* Returns how many extents fit in one extent block. */
+static uint64_t extentsPerBlock() {
+    return (vcb->block_size - sizeof(extent_block_header)) / sizeof(extent);
+}
+
+/* Returns how many extent blocks a file with num_extents extents needs. */
+static uint64_t extentBlocksNeeded(uint64_t num_extents) {
+    if (num_extents <= INLINE_EXTENTS) return 0;
+    return ceilingDivide(num_extents - INLINE_EXTENTS, extentsPerBlock());
+}
+
+/* Returns TRUE if the extent lies entirely inside the volume, FALSE otherwise. */
+static int isValidExtent(extent *e) {
+    return e->num_blocks > 0 && e->start_block > 0 && e->start_block < vcb->num_blocks
+        && e->num_blocks <= vcb->num_blocks - e->start_block;
+}
+
+/* Adds an extent to the end of the list, merging it into the last extent if it
+ * starts right where the last extent ends. Returns ERROR if memory ran out. */
+static int appendExtent(extent_list *list, uint64_t start_block, uint64_t num_blocks) {
+    if (list->num_extents > 0) {
+        extent *last = &list->extents[list->num_extents - 1];
+        if (last->start_block + last->num_blocks == start_block) {
+            last->num_blocks += num_blocks;
+            list->num_blocks += num_blocks;
+            return SUCCESS;
+        }
+    }
+
+    if (list->num_extents == list->capacity) { // grow both arrays
+        uint64_t capacity = (list->capacity > 0) ? list->capacity * 2 : MIN_EXTENT_CAPACITY;
+
+        extent *extents = realloc(list->extents, capacity * sizeof(extent));
+        if (!extents) return ERROR;
+        list->extents = extents;
+
+        uint64_t *file_blocks = realloc(list->file_blocks, capacity * sizeof(uint64_t));
+        if (!file_blocks) return ERROR;
+        list->file_blocks = file_blocks;
+
+        list->capacity = capacity;
+    }
+
+    list->extents[list->num_extents].start_block = start_block;
+    list->extents[list->num_extents].num_blocks = num_blocks;
+    list->file_blocks[list->num_extents] = list->num_blocks;
+    list->num_extents++;
+    list->num_blocks += num_blocks;
+
+    return SUCCESS;
+}
+
+/* Maps the num_blocks file blocks from file_block on to the blocks from new_start_block
+ * on, splitting the extents they were in. Returns ERROR if memory ran out, in which
+ * case list is unchanged. */
+static int remapFileBlocks(extent_list *list, uint64_t file_block, uint64_t num_blocks,
+                           uint64_t new_start_block) {
+    extent_list new_list;
+    initExtentList(&new_list);
+
+    uint64_t end_block = file_block + num_blocks;
+    for (uint64_t i = 0; i < list->num_extents; i++) {
+        extent *e = &list->extents[i];
+        uint64_t e_file_block = list->file_blocks[i];
+        uint64_t e_end_block = e_file_block + e->num_blocks;
+
+        if (e_end_block <= file_block || e_file_block >= end_block) { // not remapped
+            if (appendExtent(&new_list, e->start_block, e->num_blocks) == ERROR) goto out_of_memory;
+            continue;
+        }
+
+        // the part before the remapped blocks, the remapped part, and the part after
+        uint64_t from = (e_file_block > file_block) ? e_file_block : file_block;
+        uint64_t to = (e_end_block < end_block) ? e_end_block : end_block;
+        if ((from > e_file_block && appendExtent(&new_list, e->start_block,
+             from - e_file_block) == ERROR)
+            || appendExtent(&new_list, new_start_block + (from - file_block), to - from) == ERROR
+            || (to < e_end_block && appendExtent(&new_list, e->start_block + (to - e_file_block),
+             e_end_block - to) == ERROR)) {
+            goto out_of_memory;
+        }
+    }
+
+    freeExtentList(list);
+    *list = new_list;
+    return SUCCESS;
+
+    out_of_memory: // Label for running out of memory. Leave list as it was.
+    freeExtentList(&new_list);
+    return ERROR;
+}
+
+/* Marks the extent blocks in the chain starting at first_block as free.
+ * Returns how many blocks were freed, or ERROR if the chain could not be read. */
+static long long freeExtentBlockChain(uint64_t first_block) {
+    extent_block_header *header = malloc(vcb->block_size);
+    if (!header) return ERROR;
+
+    long long num_freed = 0;
+    uint64_t block = first_block;
+    while (block != 0) {
+        if (block >= vcb->num_blocks || getBlockStatus(bitmap, block) == FREE) {
+            printf("Error: The extent blocks are corrupted. ");
+            free(header);
+            return ERROR;
+        }
+
+        if (customLBAread(header, 1, block, "freeExtentBlockChain") == ERROR) {
+            free(header);
+            return ERROR;
+        }
+
+        markBlockRangeFree(bitmap, block, 1);
+        vcb->num_free_blocks++;
+        num_freed++;
+
+        block = header->next_block;
+    }
+
+    free(header);
+    return num_freed;
+}
+
+void initExtentList(extent_list *list) {
+    list->extents = NULL;
+    list->file_blocks = NULL;
+    list->num_extents = 0;
+    list->capacity = 0;
+    list->num_blocks = 0;
+}
+
+void freeExtentList(extent_list *list) {
+    free(list->extents);
+    free(list->file_blocks);
+    initExtentList(list);
+}
+
+int loadExtentList(extent_map *map, extent_list *list) {
+    extent_block_header *header = NULL; // holds an extent block
+    initExtentList(list);
+
+    // the inline extents come first
+    uint64_t num_inline = (map->num_extents < INLINE_EXTENTS)
+                        ? map->num_extents : INLINE_EXTENTS;
+    for (uint64_t i = 0; i < num_inline; i++) {
+        if (!isValidExtent(&map->extents[i])) goto corrupted;
+        if (appendExtent(list, map->extents[i].start_block,
+            map->extents[i].num_blocks) == ERROR) {
+            goto free_and_return_error;
+        }
+    }
+
+    // then the ones in the extent blocks
+    uint64_t num_remaining = map->num_extents - num_inline;
+    uint64_t block = map->extent_block;
+    if (num_remaining > 0) {
+        header = malloc(vcb->block_size);
+        if (!header) goto free_and_return_error;
+    }
+
+    while (num_remaining > 0) {
+        if (block == 0 || block >= vcb->num_blocks) goto corrupted;
+
+        if (customLBAread(header, 1, block, "loadExtentList") == ERROR) {
+            goto free_and_return_error;
+        }
+
+        if (header->num_extents == 0 || header->num_extents > extentsPerBlock()
+            || header->num_extents > num_remaining) {
+            goto corrupted;
+        }
+
+        extent *extents = (extent *) (header + 1); // the extents follow the header
+        for (uint64_t i = 0; i < header->num_extents; i++) {
+            if (!isValidExtent(&extents[i])) goto corrupted;
+            if (appendExtent(list, extents[i].start_block, extents[i].num_blocks) == ERROR) {
+                goto free_and_return_error;
+            }
+        }
+
+        num_remaining -= header->num_extents;
+        block = header->next_block;
+    }
+
+    free(header);
+    header = NULL;
+
+    return SUCCESS;
+
+    corrupted: // Label for a corrupted extent list. Falls through to the error handling.
+    printf("Error: The extents are corrupted. ");
+
+    free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
+    free(header);
+    header = NULL;
+    freeExtentList(list);
+
+    return ERROR;
+}
+
+/* Writes the extents in list past the first num_inline into a new chain of extent
+ * blocks. Returns the chain's first block, or UNSIGNED_ERROR on error. */
+static uint64_t writeExtentBlockChain(extent_list *list, uint64_t num_inline) {
+    extent_block_header *header = NULL; // holds an extent block
+    uint64_t *chain = NULL; // the blocks of the new extent block chain
+    uint64_t num_remaining = list->num_extents - num_inline;
+    uint64_t per_block = extentsPerBlock();
+    uint64_t chain_blocks = extentBlocksNeeded(list->num_extents);
+
+    header = malloc(vcb->block_size);
+    chain = malloc(chain_blocks * sizeof(uint64_t));
+    if (!header || !chain) goto free_and_return_error;
+
+    for (uint64_t i = 0; i < chain_blocks; i++) {
+        chain[i] = getContiguousFreeBlocks(1);
+        if (chain[i] == UNSIGNED_ERROR) {
+            printf("Not enough free blocks on disk for the file's extents. ");
+            goto free_and_return_error;
+        }
+
+        markBlockRangeUsed(bitmap, chain[i], 1);
+        vcb->num_free_blocks--;
+    }
+
+    extent *next_extent = list->extents + num_inline; // next extent to be written
+    for (uint64_t i = 0; i < chain_blocks; i++) {
+        memset(header, 0, vcb->block_size);
+        header->next_block = (i + 1 < chain_blocks) ? chain[i + 1] : 0;
+        header->num_extents = (num_remaining < per_block) ? num_remaining : per_block;
+        memcpy(header + 1, next_extent, header->num_extents * sizeof(extent));
+
+        // the chain is new, so it is not logged until the map that points at it is
+        if (customLBAwriteNew(header, 1, chain[i], "storeExtentList") == ERROR) {
+            goto free_and_return_error;
+        }
+
+        next_extent += header->num_extents;
+        num_remaining -= header->num_extents;
+    }
+
+    uint64_t first_block = chain[0];
+
+    free(header);
+    header = NULL;
+    free(chain);
+    chain = NULL;
+
+    return first_block;
+
+    free_and_return_error: // Label for error handling. Free the mallocs and return UNSIGNED_ERROR.
+    free(header);
+    header = NULL;
+    free(chain);
+    chain = NULL;
+
+    return UNSIGNED_ERROR;
+}
+
+int storeExtentList(extent_map *map, extent_list *list) {
+    // the first extents go inline in the map, and the rest spill over into a chain of
+    // extent blocks
+    uint64_t num_inline = (list->num_extents < INLINE_EXTENTS)
+                        ? list->num_extents : INLINE_EXTENTS;
+    uint64_t first_block = 0;
+    if (list->num_extents > num_inline) {
+        first_block = writeExtentBlockChain(list, num_inline);
+        if (first_block == UNSIGNED_ERROR) return ERROR;
+    }
+
+    // the old chain is freed only now, so the new one never overwrites blocks that the
+    // map on disk still points at
+    if (map->extent_block != 0 && freeExtentBlockChain(map->extent_block) == ERROR) {
+        return ERROR;
+    }
+
+    memset(map->extents, 0, sizeof(map->extents));
+    memcpy(map->extents, list->extents, num_inline * sizeof(extent));
+    map->num_extents = list->num_extents;
+    map->extent_block = first_block;
+
+    return SUCCESS;
+}
+
+uint64_t mapFileBlock(extent_list *list, uint64_t file_block, uint64_t *run_blocks) {
+    if (file_block >= list->num_blocks) return UNSIGNED_ERROR;
+
+    // binary search for the last extent that starts at or before file_block
+    uint64_t low = 0, high = list->num_extents - 1;
+    while (low < high) {
+        uint64_t mid = low + (high - low + 1) / 2;
+        if (list->file_blocks[mid] <= file_block) low = mid;
+        else high = mid - 1;
+    }
+
+    uint64_t offset = file_block - list->file_blocks[low]; // offset into the extent
+    if (run_blocks) *run_blocks = list->extents[low].num_blocks - offset;
+
+    return list->extents[low].start_block + offset;
+}
+
+uint64_t allocateFileBlocks(extent_list *list, uint64_t num_blocks) {
+    uint64_t num_allocated = 0;
+
+    while (num_allocated < num_blocks) {
+        // keep enough blocks free to store the extent blocks, in case this adds an extent
+        uint64_t num_reserved = extentBlocksNeeded(list->num_extents + 1);
+        if (vcb->num_free_blocks <= num_reserved) break;
+
+        uint64_t wanted = num_blocks - num_allocated;
+        if (wanted > vcb->num_free_blocks - num_reserved) {
+            wanted = vcb->num_free_blocks - num_reserved;
+        }
+        uint64_t start_block = UNSIGNED_ERROR;
+        uint64_t num_found = 0;
+
+        // grow the last extent in place if the blocks right after it are free
+        if (list->num_extents > 0) {
+            extent *last = &list->extents[list->num_extents - 1];
+            uint64_t next_block = last->start_block + last->num_blocks;
+
+            start_block = next_block;
+            num_found = getFreeRunLength(next_block, wanted);
+        }
+
+        // otherwise start a new extent, asking for less each time nothing fits
+        while (num_found == 0 && wanted > 0) {
+            start_block = getContiguousFreeBlocks(wanted);
+            if (start_block != UNSIGNED_ERROR) num_found = wanted;
+            else wanted /= 2;
+        }
+
+        if (num_found == 0) break; // no free blocks left at all
+
+        if (appendExtent(list, start_block, num_found) == ERROR) {
+            printf("Error: Out of memory for the file's extents. ");
+            break;
+        }
+
+        markBlockRangeUsed(bitmap, start_block, num_found);
+        vcb->num_free_blocks -= num_found;
+        num_allocated += num_found;
+    }
+
+    return num_allocated;
+}
+
+long long unshareFileBlocks(extent_list *list, uint64_t file_block, uint64_t num_blocks) {
+    long long num_remapped = 0;
+    uint64_t end_block = file_block + num_blocks;
+
+    while (file_block < end_block) {
+        uint64_t run_blocks; // blocks that are contiguous on disk from vol_block
+        uint64_t vol_block = mapFileBlock(list, file_block, &run_blocks);
+        if (vol_block == UNSIGNED_ERROR) return ERROR;
+        if (run_blocks > end_block - file_block) run_blocks = end_block - file_block;
+
+        int is_shared;
+        uint64_t same_blocks = getSharedRun(vol_block, run_blocks, &is_shared);
+        if (!is_shared) {
+            file_block += same_blocks;
+            continue;
+        }
+
+        // move the shared blocks to new ones, asking for fewer each time nothing fits
+        uint64_t new_start_block = UNSIGNED_ERROR;
+        while (same_blocks > 0) {
+            new_start_block = getContiguousFreeBlocks(same_blocks);
+            if (new_start_block != UNSIGNED_ERROR) break;
+            same_blocks /= 2;
+        }
+
+        if (same_blocks == 0) {
+            printf("Error: Not enough free blocks to copy the shared blocks. ");
+            return ERROR;
+        }
+
+        // make sure the old blocks can be released before the file lets go of them
+        if (reserveRefcounts(1) == ERROR
+            || remapFileBlocks(list, file_block, same_blocks, new_start_block) == ERROR) {
+            printf("Error: Out of memory for the file's extents. ");
+            return ERROR;
+        }
+
+        markBlockRangeUsed(bitmap, new_start_block, same_blocks);
+        vcb->num_free_blocks -= same_blocks;
+        if (releaseBlocks(vol_block, same_blocks) == ERROR) return ERROR;
+
+        file_block += same_blocks;
+        num_remapped += same_blocks;
+    }
+
+    return num_remapped;
+}
+
+int truncateExtentList(extent_list *list, uint64_t num_blocks) {
+    // each extent past num_blocks is released once, so none of them can fail halfway
+    if (list->num_blocks > num_blocks && reserveRefcounts(list->num_extents) == ERROR) {
+        return ERROR;
+    }
+
+    while (list->num_blocks > num_blocks) {
+        extent *last = &list->extents[list->num_extents - 1];
+        uint64_t num_excess = list->num_blocks - num_blocks;
+        if (num_excess > last->num_blocks) num_excess = last->num_blocks;
+
+        // blocks shared with a clone are only freed by the last file to let go of them
+        uint64_t free_start_block = last->start_block + last->num_blocks - num_excess;
+        long long num_freed = releaseBlocks(free_start_block, num_excess);
+        if (num_freed == ERROR) return ERROR;
+
+        // let the next search for free blocks reuse the gap if it just skipped over it
+        if ((uint64_t) num_freed == num_excess
+            && free_start_block + num_excess == modStartBlockIndex(0)) {
+            modStartBlockIndex(-(long long) num_excess);
+        }
+
+        last->num_blocks -= num_excess;
+        list->num_blocks -= num_excess;
+        if (last->num_blocks == 0) list->num_extents--;
+    }
+
+    return SUCCESS;
+}
+
+long long freeExtentMap(extent_map *map) {
+    extent_list list;
+    if (loadExtentList(map, &list) == ERROR) return ERROR;
+
+    // every block is given up, even the ones a clone still holds
+    if (reserveRefcounts(list.num_extents) == ERROR) {
+        freeExtentList(&list);
+        return ERROR;
+    }
+
+    long long num_freed = 0;
+    for (uint64_t i = 0; i < list.num_extents; i++) {
+        if (releaseBlocks(list.extents[i].start_block, list.extents[i].num_blocks) == ERROR) {
+            freeExtentList(&list);
+            return ERROR;
+        }
+        num_freed += list.extents[i].num_blocks;
+    }
+    freeExtentList(&list);
+
+    if (map->extent_block != 0) {
+        long long num_chain_freed = freeExtentBlockChain(map->extent_block);
+        if (num_chain_freed == ERROR) return ERROR;
+        num_freed += num_chain_freed;
+    }
+
+    memset(map, 0, sizeof(extent_map));
+    return num_freed;
+}
+
+long long freeFileBlocks(dir_entry *entry) {
+    long long num_freed = freeExtentMap(&entry->data);
+    if (num_freed == ERROR) return ERROR;
+
+    entry->start_block = 0;
+    return num_freed;
+}
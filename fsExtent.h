@@ -0,0 +1,91 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsExtent.h
+*
+* Description: Interface for file extent lists. A file's data is stored in
+*  one or more extents, i.e. runs of contiguous blocks. The first
+*  INLINE_EXTENTS extents are kept in an extent map, which lives in the
+*  file's directory entry, and the rest spill over into a chain of extent
+*  blocks on disk. Directories keep the maps for their own blocks in their
+*  header block.
+*
+**************************************************************/
+
+#ifndef _FS_EXTENT_H
+#define _FS_EXTENT_H
+
+#include "fsInit.h"
+
+// an extent block starts with this header, and the rest of the block is extents
+typedef struct extent_block_header {
+    uint64_t next_block; // the next extent block in the chain. 0 if this is the last one
+    uint64_t num_extents; // how many extents are stored in this block
+} extent_block_header;
+
+// a file's extents, loaded into memory
+typedef struct extent_list {
+    extent *extents; // the file's extents, in file order
+    uint64_t *file_blocks; // file_blocks[i] is the file block that extents[i] starts at
+    uint64_t num_extents; // how many extents are in use
+    uint64_t capacity; // how many extents the arrays can hold before growing
+    uint64_t num_blocks; // total blocks in all extents
+} extent_list;
+
+/* Initializes an empty extent list. */
+void initExtentList(extent_list *list);
+
+/* Frees the memory held by an extent list. Does not touch the disk. */
+void freeExtentList(extent_list *list);
+
+/* Loads the extents in an extent map and its extent blocks into list.
+ * Returns ERROR if the extents could not be read. Returns SUCCESS otherwise. */
+int loadExtentList(extent_map *map, extent_list *list);
+
+/* Stores list into an extent map, writing the extents that do not fit inline
+ * into a new chain of extent blocks. The map's old extent blocks are freed.
+ * Changes the bitmap and VCB in memory only. Returns ERROR on error, or SUCCESS. */
+int storeExtentList(extent_map *map, extent_list *list);
+
+/* Returns the volume block that holds file block file_block. If run_blocks is not
+ * NULL, it is set to how many blocks from there on are contiguous on disk.
+ * Returns UNSIGNED_ERROR if the file does not have that many blocks. */
+uint64_t mapFileBlock(extent_list *list, uint64_t file_block, uint64_t *run_blocks);
+
+/* Allocates up to num_blocks more blocks at the end of the file, extending the last
+ * extent in place when the blocks after it are free. Enough free blocks are always
+ * left for storeExtentList to write the extent blocks. Marks the blocks used in the
+ * bitmap and VCB in memory only. Returns how many blocks were allocated, which is
+ * less than num_blocks only if the volume ran out of free blocks. */
+uint64_t allocateFileBlocks(extent_list *list, uint64_t num_blocks);
+
+/* Gives the num_blocks file blocks from file_block on that are shared with a clone
+ * new blocks of their own, so that they can be written without changing the clone.
+ * Their contents are not copied, so the caller must write every one of them. The
+ * clone keeps the old blocks. Changes the bitmap and VCB in memory only.
+ * Returns how many blocks were moved, or ERROR on error. */
+long long unshareFileBlocks(extent_list *list, uint64_t file_block, uint64_t num_blocks);
+
+/* Frees the blocks of the file past its first num_blocks blocks. Blocks that are
+ * shared with a clone are only freed once no file holds them.
+ * Changes the bitmap and VCB in memory only. Returns ERROR if memory ran out for the
+ * reference counts, in which case nothing changes, or SUCCESS. */
+int truncateExtentList(extent_list *list, uint64_t num_blocks);
+
+/* Frees all the blocks and extent blocks in an extent map, and clears the map.
+ * Blocks that are shared with a clone are only freed once no file holds them.
+ * Changes the bitmap and VCB in memory only.
+ * Returns how many blocks the map gave up, or ERROR on error. */
+long long freeExtentMap(extent_map *map);
+
+/* Frees all the data blocks and extent blocks of the file in entry, and clears
+ * the entry's extents. Changes the bitmap and VCB in memory only.
+ * Returns how many blocks the file gave up, or ERROR on error. */
+long long freeFileBlocks(dir_entry *entry);
+
+#endif
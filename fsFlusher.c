@@ -0,0 +1,139 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsFlusher.c
+*
+* Description: The flusher thread. It sleeps on a condition variable for
+*  FLUSH_INTERVAL_MS at a time, so stopping it does not wait out the
+*  interval. The journal is committed before the cache is written back,
+*  since the metadata blocks stay pinned in the cache until then. While
+*  the flusher runs, the journal leaves its group commits to it.
+*
+**************************************************************/
+
+#include <pthread.h>
+#include "fsFlusher.h"
+#include "fsJournal.h"
+#include "fsCache.h"
+
+static uint64_t flush_window_ms = FLUSH_WINDOW_MS; // how old a change may get
+static pthread_t flusher_thread;
+static int flusher_running = FALSE; // TRUE while flusher_thread is running
+static int flusher_stopping = FALSE; // TRUE once the thread should exit
+// guards flusher_stopping and the counters, and wakes the thread when it is stopped
+static pthread_mutex_t flusher_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t flusher_wakeup = PTHREAD_COND_INITIALIZER;
+static flusher_stats flusher_counters;
+
+/* Commits and writes back whatever is older than the window, or all of it if too much
+ * of the cache is dirty. Returns how many of the two steps failed. */
+static uint64_t flushOldChanges() {
+    uint64_t max_dirty = CACHE_NUM_BLOCKS * FLUSH_DIRTY_PERCENT / 100;
+    uint64_t num_errors = 0;
+
+    if (commitOldOps(flush_window_ms, max_dirty) == ERROR) num_errors++;
+    if (flushOldBlocks(flush_window_ms, max_dirty) == ERROR) num_errors++;
+    return num_errors;
+}
+
+/* Returns how long the flusher sleeps before it looks for work again, which is
+ * FLUSH_INTERVAL_MS, or less if the scheduler's queue expires before then. */
+static uint64_t flushWaitMs() {
+    uint64_t now_ms = getMonotonicMs();
+    uint64_t expiry_ms = cacheNextExpiryMs();
+
+    if (expiry_ms >= now_ms + FLUSH_INTERVAL_MS) return FLUSH_INTERVAL_MS;
+    return expiry_ms > now_ms ? expiry_ms - now_ms : 0;
+}
+
+/* Runs in flusher_thread until the flusher is stopped. */
+static void *runFlusher(void *arg) {
+    (void) arg;
+
+    // the cache's lock is not taken while flusher_lock is held
+    uint64_t wait_ms = flushWaitMs();
+
+    pthread_mutex_lock(&flusher_lock);
+    while (!flusher_stopping) {
+        struct timespec wake_time;
+        clock_gettime(CLOCK_REALTIME, &wake_time);
+        wake_time.tv_nsec += (wait_ms % 1000) * 1000000L;
+        wake_time.tv_sec += wait_ms / 1000 + wake_time.tv_nsec / 1000000000L;
+        wake_time.tv_nsec %= 1000000000L;
+
+        pthread_cond_timedwait(&flusher_wakeup, &flusher_lock, &wake_time);
+        if (flusher_stopping) break;
+
+        // the journal and the cache have their own locks
+        pthread_mutex_unlock(&flusher_lock);
+        uint64_t num_errors = flushOldChanges();
+        wait_ms = flushWaitMs();
+        pthread_mutex_lock(&flusher_lock);
+
+        flusher_counters.wakeups++;
+        flusher_counters.errors += num_errors;
+    }
+    pthread_mutex_unlock(&flusher_lock);
+
+    return NULL;
+}
+
+void setFlushWindow(uint64_t window_ms) { flush_window_ms = window_ms; }
+
+int startFlusher() {
+    if (flusher_running || flush_window_ms == 0) return SUCCESS;
+
+    memset(&flusher_counters, 0, sizeof(flusher_stats));
+    flusher_stopping = FALSE;
+    if (pthread_create(&flusher_thread, NULL, runFlusher, NULL) != 0) return ERROR;
+
+    flusher_running = TRUE;
+    setBackgroundCommits(TRUE);
+    return SUCCESS;
+}
+
+void stopFlusher() {
+    if (!flusher_running) return;
+
+    pthread_mutex_lock(&flusher_lock);
+    flusher_stopping = TRUE;
+    pthread_cond_signal(&flusher_wakeup);
+    pthread_mutex_unlock(&flusher_lock);
+
+    pthread_join(flusher_thread, NULL);
+    flusher_running = FALSE;
+    setBackgroundCommits(FALSE);
+}
+
+int syncFileSystem() {
+    pthread_mutex_lock(&flusher_lock);
+    flusher_counters.syncs++;
+    pthread_mutex_unlock(&flusher_lock);
+
+    // the operations that ended are committed, which unpins their blocks
+    if (commitOldOps(0, 0) == ERROR || flushBlockCache() == ERROR) return ERROR;
+
+    return deviceFlush();
+}
+
+void printFlusherStats() {
+    pthread_mutex_lock(&flusher_lock);
+    flusher_stats counters = flusher_counters;
+    pthread_mutex_unlock(&flusher_lock);
+
+    if (!flusher_running) {
+        printf("Flusher: not running, %lu syncs\n", counters.syncs);
+        return;
+    }
+
+    printf("Flusher: writes back changes older than %lu ms\n"
+           "  wakeups: %lu\n"
+           "  syncs: %lu\n"
+           "  errors: %lu\n",
+           flush_window_ms, counters.wakeups, counters.syncs, counters.errors);
+}
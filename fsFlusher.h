@@ -0,0 +1,59 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsFlusher.h
+*
+* Description: Interface for the flusher, a thread that writes changes
+*  back in the background so that operations do not wait for the disk.
+*  Every FLUSH_INTERVAL_MS it commits the journal's operations once the
+*  first of them is older than the flush window, and writes back the
+*  cache's dirty blocks, which hold the VCB, bitmap, directories and
+*  file data, once one of them is older than the window or too much of
+*  the cache is dirty. So an operation reaches the device at most about
+*  one window after it ended. It also wakes up early when the deadline
+*  scheduler's queue expires, so that the queue is written on time.
+*  sync writes everything back right away.
+*
+**************************************************************/
+
+#ifndef _FS_FLUSHER_H
+#define _FS_FLUSHER_H
+
+#include <stdint.h>
+
+#define FLUSH_INTERVAL_MS 100 // how often the flusher looks for work
+#define FLUSH_WINDOW_MS 5000 // default age at which changes are written back
+#define FLUSH_DIRTY_PERCENT 25 // share of the cache that may be dirty before a write back
+
+// flusher counters, printed by the stats command
+typedef struct flusher_stats {
+    uint64_t wakeups; // times the flusher looked for work
+    uint64_t syncs; // times everything was written back by sync or b_fsync
+    uint64_t errors; // commits or write backs by the flusher that failed
+} flusher_stats;
+
+/* Sets how old, in milliseconds, a change may get before the flusher writes it back.
+ * A window of 0 leaves every change to be written back as if there were no flusher. */
+void setFlushWindow(uint64_t window_ms);
+
+/* Starts the flusher thread on the mounted volume, unless the window is 0.
+ * Returns ERROR if the thread could not be started, or SUCCESS. */
+int startFlusher();
+
+/* Stops the flusher thread, if it is running, and waits for it to exit. */
+void stopFlusher();
+
+/* Commits the journal, writes back every dirty block and everything the scheduler
+ * queued, and makes it durable on the device. Can be called from any thread.
+ * Returns ERROR on error, or SUCCESS. */
+int syncFileSystem();
+
+/* Prints the flush window and the flusher counters. */
+void printFlusherStats();
+
+#endif
@@ -0,0 +1,359 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsFreeSpace.c
+*
+* Description: The free extent index. Every run of free blocks in the
+*  bitmap is one extent, and every extent is a node in two treaps
+*  (randomized balanced binary search trees):
+*   - the start tree is ordered by start block, and each node also stores
+*     the longest extent in its subtree, which makes next fit O(log n).
+*   - the length tree is ordered by (length, start block), which makes
+*     best fit O(log n).
+*  The bitmap on disk is not changed in any way; this index only lives in memory.
+*
+**************************************************************/
+
+#include <stdlib.h>
+#include "fsFreeSpace.h"
+#include "helperFunctions.h"
+#include "fsBitmap.h"
+
+typedef struct free_extent {
+    uint64_t start; // first free block of the extent
+    uint64_t length; // number of free blocks in the extent
+    uint32_t priority; // random treap priority, shared by both trees
+
+    struct free_extent *start_left, *start_right; // children in the start tree
+    uint64_t max_length; // longest extent in this node's start subtree
+
+    struct free_extent *length_left, *length_right; // children in the length tree
+} free_extent;
+
+free_extent *start_tree = NULL; // root of the tree ordered by start block
+free_extent *length_tree = NULL; // root of the tree ordered by (length, start block)
+int index_built = FALSE; // TRUE once buildFreeSpaceIndex has run
+uint32_t priority_state = 2463534242u; // xorshift state for treap priorities
+
+/* Returns the next pseudo-random treap priority. */
+static uint32_t nextPriority() {
+    priority_state ^= priority_state << 13;
+    priority_state ^= priority_state >> 17;
+    priority_state ^= priority_state << 5;
+    return priority_state;
+}
+
+/* Recomputes a start tree node's max_length from its children. */
+static void updateMaxLength(free_extent *node) {
+    node->max_length = node->length;
+    if (node->start_left && node->start_left->max_length > node->max_length) {
+        node->max_length = node->start_left->max_length;
+    }
+    if (node->start_right && node->start_right->max_length > node->max_length) {
+        node->max_length = node->start_right->max_length;
+    }
+}
+
+/* Splits the start tree into nodes with start < key (left) and start >= key (right). */
+static void splitByStart(free_extent *tree, uint64_t key, free_extent **left, free_extent **right) {
+    if (!tree) {
+        *left = *right = NULL;
+    } else if (tree->start < key) {
+        splitByStart(tree->start_right, key, &tree->start_right, right);
+        updateMaxLength(tree);
+        *left = tree;
+    } else {
+        splitByStart(tree->start_left, key, left, &tree->start_left);
+        updateMaxLength(tree);
+        *right = tree;
+    }
+}
+
+/* Joins two start trees where every start in left is less than every start in right. */
+static free_extent* mergeByStart(free_extent *left, free_extent *right) {
+    if (!left) return right;
+    if (!right) return left;
+
+    if (left->priority > right->priority) {
+        left->start_right = mergeByStart(left->start_right, right);
+        updateMaxLength(left);
+        return left;
+    }
+
+    right->start_left = mergeByStart(left, right->start_left);
+    updateMaxLength(right);
+    return right;
+}
+
+/* Returns TRUE if extent a comes before extent b in the length tree. */
+static int lengthLess(uint64_t a_length, uint64_t a_start, uint64_t b_length, uint64_t b_start) {
+    return (a_length < b_length) || (a_length == b_length && a_start < b_start);
+}
+
+/* Splits the length tree into nodes before (length, start) and the rest. */
+static void splitByLength(free_extent *tree, uint64_t length, uint64_t start,
+                          free_extent **left, free_extent **right) {
+    if (!tree) {
+        *left = *right = NULL;
+    } else if (lengthLess(tree->length, tree->start, length, start)) {
+        splitByLength(tree->length_right, length, start, &tree->length_right, right);
+        *left = tree;
+    } else {
+        splitByLength(tree->length_left, length, start, left, &tree->length_left);
+        *right = tree;
+    }
+}
+
+/* Joins two length trees where every node in left comes before every node in right. */
+static free_extent* mergeByLength(free_extent *left, free_extent *right) {
+    if (!left) return right;
+    if (!right) return left;
+
+    if (left->priority > right->priority) {
+        left->length_right = mergeByLength(left->length_right, right);
+        return left;
+    }
+
+    right->length_left = mergeByLength(left, right->length_left);
+    return right;
+}
+
+/* Creates an extent and inserts it into both trees.
+ * Returns ERROR if memory ran out, or SUCCESS. */
+static int insertExtent(uint64_t start, uint64_t length) {
+    free_extent *node = malloc(sizeof(free_extent));
+    if (!node) return ERROR;
+
+    node->start = start;
+    node->length = length;
+    node->priority = nextPriority();
+    node->start_left = node->start_right = NULL;
+    node->length_left = node->length_right = NULL;
+    node->max_length = length;
+
+    free_extent *left, *right;
+    splitByStart(start_tree, start, &left, &right);
+    start_tree = mergeByStart(mergeByStart(left, node), right);
+
+    splitByLength(length_tree, length, start, &left, &right);
+    length_tree = mergeByLength(mergeByLength(left, node), right);
+
+    return SUCCESS;
+}
+
+/* Removes an extent from both trees and frees it. */
+static void removeExtent(free_extent *node) {
+    free_extent *left, *middle, *right;
+
+    // the node is the only one with its start block in the start tree
+    splitByStart(start_tree, node->start, &left, &middle);
+    splitByStart(middle, node->start + 1, &middle, &right);
+    start_tree = mergeByStart(left, right);
+
+    // and the only one with its (length, start) pair in the length tree
+    splitByLength(length_tree, node->length, node->start, &left, &middle);
+    splitByLength(middle, node->length, node->start + 1, &middle, &right);
+    length_tree = mergeByLength(left, right);
+
+    free(node);
+}
+
+/* Returns the extent with the greatest start block <= block, or NULL if none. */
+static free_extent* findFloor(uint64_t block) {
+    free_extent *node = start_tree, *floor = NULL;
+
+    while (node) {
+        if (node->start <= block) {
+            floor = node;
+            node = node->start_right;
+        } else node = node->start_left;
+    }
+
+    return floor;
+}
+
+/* Returns the extent with the smallest start block >= block, or NULL if none. */
+static free_extent* findCeiling(uint64_t block) {
+    free_extent *node = start_tree, *ceiling = NULL;
+
+    while (node) {
+        if (node->start >= block) {
+            ceiling = node;
+            node = node->start_left;
+        } else node = node->start_right;
+    }
+
+    return ceiling;
+}
+
+/* Returns the extent with the smallest start >= from_block whose length is at least
+ * num_blocks. Subtrees whose max_length is too small are skipped entirely. */
+static free_extent* findFirstFit(free_extent *tree, uint64_t from_block, uint64_t num_blocks) {
+    if (!tree || tree->max_length < num_blocks) return NULL;
+    if (tree->start < from_block) return findFirstFit(tree->start_right, from_block, num_blocks);
+
+    free_extent *fit = findFirstFit(tree->start_left, from_block, num_blocks);
+    if (fit) return fit;
+    if (tree->length >= num_blocks) return tree;
+    return findFirstFit(tree->start_right, from_block, num_blocks);
+}
+
+/* Returns the first extent in the length tree after (length, start), or NULL if none. */
+static free_extent* findLengthCeiling(uint64_t length, uint64_t start) {
+    free_extent *node = length_tree, *ceiling = NULL;
+
+    while (node) {
+        if (!lengthLess(node->length, node->start, length, start)) {
+            ceiling = node;
+            node = node->length_left;
+        } else node = node->length_right;
+    }
+
+    return ceiling;
+}
+
+/* Frees every node in a start tree. */
+static void freeStartTree(free_extent *tree) {
+    if (!tree) return;
+    freeStartTree(tree->start_left);
+    freeStartTree(tree->start_right);
+    free(tree);
+}
+
+/* Drops the index after an extent could not be inserted, since it no longer matches
+ * the bitmap. Allocations scan the bitmap from then on. Returns ERROR. */
+static int dropIndex() {
+    printf("Error: Out of memory in the free extent index. Using the bitmap instead.\n");
+    freeFreeSpaceIndex();
+    return ERROR;
+}
+
+int buildFreeSpaceIndex(uint32_t *bitmap, uint64_t num_blocks) {
+    freeFreeSpaceIndex();
+
+    // each run of clear bits in the bitmap becomes one extent
+    uint64_t run_start = bitmapNextClear(bitmap, num_blocks, 0);
+    while (run_start < num_blocks) {
+        uint64_t run_end = bitmapNextSet(bitmap, num_blocks, run_start);
+        if (insertExtent(run_start, run_end - run_start) == ERROR) return dropIndex();
+        run_start = bitmapNextClear(bitmap, num_blocks, run_end);
+    }
+
+    index_built = TRUE;
+    return SUCCESS;
+}
+
+void freeFreeSpaceIndex() {
+    freeStartTree(start_tree); // every node is in both trees, so only free them once
+    start_tree = NULL;
+    length_tree = NULL;
+    index_built = FALSE;
+}
+
+int freeSpaceIndexBuilt() { return index_built; }
+
+int freeSpaceAddRange(uint64_t start_block, uint64_t num_blocks) {
+    if (!index_built || num_blocks == 0) return SUCCESS;
+
+    uint64_t start = start_block;
+    uint64_t end = start_block + num_blocks; // one past the last block
+
+    // merge with an extent that overlaps or ends right before the range
+    free_extent *floor = findFloor(start);
+    if (floor && floor->start + floor->length >= start) {
+        start = floor->start;
+        if (floor->start + floor->length > end) end = floor->start + floor->length;
+        removeExtent(floor);
+    }
+
+    // merge with every extent that overlaps or starts right after the range
+    free_extent *ceiling = findCeiling(start);
+    while (ceiling && ceiling->start <= end) {
+        if (ceiling->start + ceiling->length > end) end = ceiling->start + ceiling->length;
+        removeExtent(ceiling);
+        ceiling = findCeiling(start);
+    }
+
+    if (insertExtent(start, end - start) == ERROR) return dropIndex();
+    return SUCCESS;
+}
+
+int freeSpaceRemoveRange(uint64_t start_block, uint64_t num_blocks) {
+    if (!index_built || num_blocks == 0) return SUCCESS;
+
+    uint64_t end = start_block + num_blocks; // one past the last block
+
+    // the first extent that could overlap the range may start before it
+    free_extent *node = findFloor(start_block);
+    if (!node || node->start + node->length <= start_block) node = findCeiling(start_block);
+
+    while (node && node->start < end) {
+        uint64_t node_start = node->start;
+        uint64_t node_end = node->start + node->length;
+        removeExtent(node);
+
+        // keep the parts of the extent that are outside the range
+        if ((node_start < start_block
+             && insertExtent(node_start, start_block - node_start) == ERROR)
+            || (node_end > end && insertExtent(end, node_end - end) == ERROR)) {
+            return dropIndex();
+        }
+
+        node = findCeiling(node_start + 1);
+    }
+
+    return SUCCESS;
+}
+
+uint64_t freeSpaceNextFit(uint64_t from_block, uint64_t num_blocks) {
+    if (!index_built || num_blocks == 0) return UNSIGNED_ERROR;
+
+    // from_block may be in the middle of a free extent that is still big enough
+    free_extent *floor = findFloor(from_block);
+    if (floor && floor->start + floor->length >= from_block + num_blocks) return from_block;
+
+    free_extent *fit = findFirstFit(start_tree, from_block, num_blocks);
+    if (!fit) return UNSIGNED_ERROR;
+
+    return fit->start;
+}
+
+uint64_t freeSpaceBestFit(uint64_t min_block, uint64_t num_blocks) {
+    if (!index_built || num_blocks == 0) return UNSIGNED_ERROR;
+
+    // smallest extent with length >= num_blocks. extents below min_block are skipped,
+    // which does not happen in practice since those blocks hold the VCB and bitmap.
+    free_extent *fit = findLengthCeiling(num_blocks, 0);
+    while (fit && fit->start < min_block) fit = findLengthCeiling(fit->length, fit->start + 1);
+
+    if (!fit) return UNSIGNED_ERROR;
+    return fit->start;
+}
+
+/* Adds up the extents in a start tree. */
+static void countExtents(free_extent *tree, uint64_t *num_extents, uint64_t *free_blocks) {
+    if (!tree) return;
+    countExtents(tree->start_left, num_extents, free_blocks);
+    (*num_extents)++;
+    *free_blocks += tree->length;
+    countExtents(tree->start_right, num_extents, free_blocks);
+}
+
+void printFreeSpaceStats() {
+    uint64_t num_extents = 0;
+    uint64_t free_blocks = 0;
+    countExtents(start_tree, &num_extents, &free_blocks);
+
+    if (!index_built) {
+        printf("Free space: no index, allocating from the bitmap\n");
+    } else {
+        printf("Free space: %lu extents, %lu free blocks, largest extent %lu blocks\n",
+               num_extents, free_blocks, start_tree ? start_tree->max_length : 0);
+    }
+    printf("  bitmap kernel: %s\n", bitmapKernelName());
+}
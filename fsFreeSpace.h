@@ -0,0 +1,58 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsFreeSpace.h
+*
+* Description: Interface for the in-memory free extent index. The index
+*  is rebuilt from the bitmap when the volume is mounted and is kept in
+*  sync with the bitmap by markBlockUsed and markBlockFree. If memory
+*  runs out while it is changed, the index is dropped, and allocations
+*  scan the bitmap instead until it is rebuilt.
+*
+**************************************************************/
+
+#ifndef _FS_FREE_SPACE_H
+#define _FS_FREE_SPACE_H
+
+#include "fsLow.h"
+
+/* Builds the free extent index from the free blocks in the bitmap.
+ * Any previous index is freed first. Returns ERROR if memory ran out, in which case
+ * there is no index. Returns SUCCESS otherwise. */
+int buildFreeSpaceIndex(uint32_t *bitmap, uint64_t num_blocks);
+
+/* Frees the free extent index. */
+void freeFreeSpaceIndex();
+
+/* Returns TRUE if the free extent index has been built, FALSE otherwise. */
+int freeSpaceIndexBuilt();
+
+/* Records the blocks from start_block to start_block + num_blocks - 1 as free,
+ * merging them with any neighbouring free extents. Returns ERROR if memory ran out,
+ * in which case the index is dropped. Returns SUCCESS otherwise. */
+int freeSpaceAddRange(uint64_t start_block, uint64_t num_blocks);
+
+/* Records the blocks from start_block to start_block + num_blocks - 1 as used,
+ * splitting any free extents they were part of. Returns ERROR if memory ran out,
+ * in which case the index is dropped. Returns SUCCESS otherwise. */
+int freeSpaceRemoveRange(uint64_t start_block, uint64_t num_blocks);
+
+/* Next fit: returns the first block at or after from_block that starts
+ * num_blocks contiguous free blocks, without looking below from_block.
+ * Returns UNSIGNED_ERROR if there is no such run. */
+uint64_t freeSpaceNextFit(uint64_t from_block, uint64_t num_blocks);
+
+/* Best fit: returns the start of the smallest free extent that can hold
+ * num_blocks blocks and starts at or after min_block.
+ * Returns UNSIGNED_ERROR if there is no such extent. */
+uint64_t freeSpaceBestFit(uint64_t min_block, uint64_t num_blocks);
+
+/* Prints how many free extents there are, the largest one, and the total free blocks. */
+void printFreeSpaceStats();
+
+#endif
@@ -0,0 +1,49 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsIOBuffer.c
+*
+* Description: The aligned buffer allocator and the pool of reusable
+*  buffers. The pool is shared by every thread, so it has a lock.
+*
+**************************************************************/
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "fsIOBuffer.h"
+
+static char *io_pool[IO_BUFFER_POOL_MAX]; // buffers that are free to reuse
+static int num_pooled = 0; // how many buffers are in io_pool
+static pthread_mutex_t io_pool_lock = PTHREAD_MUTEX_INITIALIZER; // guards the pool
+
+void *allocIOBuffer(uint64_t bytes) {
+    void *buf = NULL;
+    if (posix_memalign(&buf, IO_BUFFER_ALIGN, bytes > 0 ? bytes : 1) != 0) return NULL;
+    return buf;
+}
+
+char *getIOBuffer() {
+    pthread_mutex_lock(&io_pool_lock);
+    char *buf = (num_pooled > 0) ? io_pool[--num_pooled] : NULL;
+    pthread_mutex_unlock(&io_pool_lock);
+
+    return buf ? buf : allocIOBuffer(IO_BUFFER_BYTES);
+}
+
+void putIOBuffer(char *buf) {
+    if (!buf) return;
+
+    pthread_mutex_lock(&io_pool_lock);
+    if (num_pooled < IO_BUFFER_POOL_MAX) {
+        io_pool[num_pooled++] = buf;
+        buf = NULL;
+    }
+    pthread_mutex_unlock(&io_pool_lock);
+
+    free(buf); // the pool was full
+}
@@ -0,0 +1,41 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsIOBuffer.h
+*
+* Description: Interface for the buffers that blocks are moved through.
+*  Every one starts on a page, so the direct backend can move blocks
+*  straight between it and the disk with O_DIRECT. Buffers of
+*  IO_BUFFER_BYTES, used by the copy engine and by large transfers to
+*  and from a caller's buffer that is not aligned, are kept in a pool
+*  and reused instead of being allocated for each copy or transfer.
+*
+**************************************************************/
+
+#ifndef _FS_IO_BUFFER_H
+#define _FS_IO_BUFFER_H
+
+#include <stdint.h>
+
+#define IO_BUFFER_ALIGN 4096 // every buffer starts on a multiple of this
+#define IO_BUFFER_BYTES (1024 * 1024) // size of each pooled buffer
+#define IO_BUFFER_POOL_MAX 8 // most free pooled buffers kept for reuse
+
+/* Allocates bytes bytes starting on a multiple of IO_BUFFER_ALIGN. The buffer is freed
+ * with free. Returns NULL if memory ran out. */
+void *allocIOBuffer(uint64_t bytes);
+
+/* Returns a buffer of IO_BUFFER_BYTES bytes from the pool, or a new one if the pool is
+ * empty. Returns NULL if memory ran out. */
+char *getIOBuffer();
+
+/* Gives a buffer from getIOBuffer back to the pool, or frees it if the pool is full.
+ * Does nothing if buf is NULL. */
+void putIOBuffer(char *buf);
+
+#endif
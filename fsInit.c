@@ -15,16 +15,32 @@
 
 #include "fsInit.h"
 #include "mfs.h"
-
-#define VCB_MAGIC_NUMBER 0xDEADED // used for checking if the VCB is already initialized
+#include "fsFreeSpace.h"
+#include "fsDirectory.h"
+#include "fsMigrate.h"
+#include "fsJournal.h"
+#include "fsRefcount.h"
+#include "fsFlusher.h"
+
+#define VCB_MAGIC_NUMBER 0x5EEDED // used for checking if the VCB is already initialized
+#define LEGACY_VCB_MAGIC_NUMBER 0xDEADED // volumes from before the VCB had a format version
+#define FORMAT_VERSION 4 // increase whenever the on-disk format changes
+#define FIRST_GROWABLE_DIR_VERSION 2 // the first format with growable directories
+#define FIRST_JOURNAL_VERSION 3 // the first format with a metadata journal
+#define FIRST_REFCOUNT_VERSION 4 // the first format with files that share blocks
 #define BLOCKS_TO_BYTES_DENOM 8 // 1 block = 1 bit = 1/8 bytes in the bitmap
-#define BLOCKS_TO_INTS_DENOM 32 // 1 block = 1 bit = 1/32th of an integer
 
 // The VCB and bitmap are shared by all files due to the extern keyword in the header.
 VCB *vcb = NULL;
 uint32_t *bitmap = NULL;
 
 int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
+	// every read and write below goes through the block cache
+	if (initBlockCache(blockSize) == ERROR) {
+		printf("Error: Could not allocate the block cache.\n");
+		return ERROR;
+	}
+
 	// load up the vcb
 	vcb = malloc(blockSize);
 	if (!vcb) return ERROR;
@@ -35,8 +51,43 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
 		return ERROR;
 	}
 
+	// volumes made with a newer on-disk format cannot be read, so stop before
+	// anything gets written to them
+	if (vcb->signature == VCB_MAGIC_NUMBER && vcb->format_version > FORMAT_VERSION) {
+		printf("Error: The volume was made with a newer version of the file system "
+		       "and cannot be mounted.\n");
+		free(vcb);
+		vcb = NULL;
+		return ERROR;
+	}
+
+	// volumes made with an older on-disk format are upgraded once their bitmap is loaded
+	int is_legacy = vcb->signature == LEGACY_VCB_MAGIC_NUMBER;
+	if (is_legacy) vcb->format_version = 0; // legacy VCBs have no format version
+
 	// if signature matches, then the volume has already been initialized
-	if (vcb->signature == VCB_MAGIC_NUMBER) {
+	if (vcb->signature == VCB_MAGIC_NUMBER || is_legacy) {
+		if (vcb->format_version < FIRST_JOURNAL_VERSION) { // older volumes have no journal
+			vcb->journal_start_block = 0;
+			vcb->journal_blocks = 0;
+		} else if (vcb->journal_blocks > 0) {
+			// finish the operations that were committed before the volume was last
+			// closed. the VCB may have been one of the blocks in the journal.
+			if (replayJournal() == ERROR
+			    || customLBAread(vcb, VCB_BLOCKS, VCB_START_BLOCK, "init replayed VCB")
+			    == ERROR) {
+				free(vcb);
+				vcb = NULL;
+				return ERROR;
+			}
+		}
+
+		// older volumes have no shared blocks
+		if (vcb->format_version < FIRST_REFCOUNT_VERSION) {
+			vcb->refcount_start_block = 0;
+			vcb->refcount_blocks = 0;
+		}
+
 		// initialize bitmap with what was written in disk
 		bitmap = malloc(vcb->bitmap_blocks * vcb->block_size);
 		if (!bitmap) {
@@ -53,6 +104,56 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
 			bitmap = NULL;
 			return ERROR;
 		}
+
+		// allocations are looked up in the free extent index instead of the bitmap,
+		// unless memory runs out, in which case they scan the bitmap
+		buildFreeSpaceIndex(bitmap, vcb->num_blocks);
+
+		// only the bitmap blocks that change from here on get written
+		if (initBitmapDirtyBlocks(FALSE) == ERROR) {
+			free(vcb);
+			vcb = NULL;
+			free(bitmap);
+			bitmap = NULL;
+			return ERROR;
+		}
+
+		// blocks shared by cloned files are only freed once no file holds them
+		if (loadRefcounts() == ERROR) {
+			free(vcb);
+			vcb = NULL;
+			free(bitmap);
+			bitmap = NULL;
+			return ERROR;
+		}
+
+		// rebuild the fixed-size directories of older volumes as growable directories
+		if (vcb->format_version < FIRST_GROWABLE_DIR_VERSION) {
+			if (migrateVolume(is_legacy) == ERROR) {
+				free(vcb);
+				vcb = NULL;
+				free(bitmap);
+				bitmap = NULL;
+				return ERROR;
+			}
+		}
+
+		if (vcb->format_version < FORMAT_VERSION) {
+			vcb->signature = VCB_MAGIC_NUMBER;
+			vcb->format_version = FORMAT_VERSION;
+
+			// write the upgraded VCB and bitmap to disk. like a new volume, the
+			// upgraded volume is flushed out of the cache right away
+			if (writeBitmap("init upgraded bitmap") == ERROR
+			    || customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK,
+			    "init upgraded VCB") == ERROR || flushBlockCache() == ERROR) {
+				free(vcb);
+				vcb = NULL;
+				free(bitmap);
+				bitmap = NULL;
+				return ERROR;
+			}
+		}
 	} else { // initialize the volume
 		// check that the volume can actually hold the VCB
 		if (VCB_BLOCKS > numberOfBlocks) {
@@ -70,6 +171,9 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
 		vcb->free_space_start_block = 0;
 		vcb->bitmap_start_block = VCB_BLOCKS; // bitmap starts after the VCB
 		vcb->signature = VCB_MAGIC_NUMBER;
+		vcb->format_version = FORMAT_VERSION;
+		vcb->refcount_start_block = 0; // the reference counts are made on the first clone
+		vcb->refcount_blocks = 0;
 		
 		// initialize bitmap and root directory, and the rest of vcb's data members
 		// bitmap has been malloced at this point
@@ -81,6 +185,17 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
 			return ERROR;
 		}
 		
+		// the journal goes right after the bitmap
+		vcb->journal_start_block = 0;
+		vcb->journal_blocks = getNewJournalBlocks(numberOfBlocks);
+		if (vcb->journal_blocks > 0 && formatJournal() == ERROR) {
+			free(vcb);
+			vcb = NULL;
+			free(bitmap);
+			bitmap = NULL;
+			return ERROR;
+		}
+
 		if (initRootDirectory() == ERROR) {
 			free(vcb);
 			vcb = NULL;
@@ -92,8 +207,10 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
 		// once the root directory is initialized, free space starts after it
 		vcb->free_space_start_block = vcb->root_dir_start_block + vcb->dir_blocks;
 
-		// Write the VCB to disk
-		if (customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK, "VCB first init") == ERROR) {
+		// Write the VCB to disk. the new volume is flushed out of the cache right away,
+		// since only the changes made after this are journaled
+		if (customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK, "VCB first init") == ERROR
+		    || flushBlockCache() == ERROR) {
 			free(vcb);
 			vcb = NULL;
 			free(bitmap);
@@ -102,6 +219,21 @@ int initFileSystem(uint64_t numberOfBlocks, uint64_t blockSize) {
 		}
 	}
 
+	// from here on, changes to the metadata are journaled
+	if (openJournal() == ERROR) {
+		free(vcb);
+		vcb = NULL;
+		free(bitmap);
+		bitmap = NULL;
+		return ERROR;
+	}
+
+	// the volume works without the flusher, only with slower operations
+	if (startFlusher() == ERROR) {
+		printf("Error: Could not start the flusher. Changes are written back as the "
+		       "journal and the cache fill up.\n");
+	}
+
 	// initialize CWD's start block with the root dir's start block
 	setCWDstartBlock(vcb->root_dir_start_block);
 
@@ -122,19 +254,21 @@ int initBitmap() {
 		return ERROR;
 	}
 
-	// numbers of ints needed to represent the bits in the bitmap
-	uint64_t bitmap_ints = ceilingDivide(vcb->num_blocks, BLOCKS_TO_INTS_DENOM);
-
 	bitmap = malloc(bitmap_blocks * vcb->block_size);
 	if (!bitmap) return ERROR;
 
-	// initialize all bits in the bitmap to be free
-	for (int i = 0; i < bitmap_ints; i++) bitmap[i] = FREE;
+	// initialize all bits in the bitmap to be free, including the unused bits
+	// past the last block, since the bitmap kernels read whole words
+	memset(bitmap, FREE, bitmap_blocks * vcb->block_size);
 
 	// mark the blocks the VCB and the bitmap will take up as used
-	for (int i = 0; i < VCB_BLOCKS + bitmap_blocks; i++) markBlockUsed(bitmap, i);
+	markBlockRangeUsed(bitmap, 0, VCB_BLOCKS + bitmap_blocks);
 	vcb->num_free_blocks -= VCB_BLOCKS + bitmap_blocks;
 
+	// allocations are looked up in the free extent index instead of the bitmap,
+	// unless memory runs out, in which case they scan the bitmap
+	buildFreeSpaceIndex(bitmap, vcb->num_blocks);
+
 	// write the bitmap to disk
 	if (customLBAwrite(bitmap, bitmap_blocks, vcb->bitmap_start_block,
 		"write bitmap to LBA") == ERROR) {
@@ -143,70 +277,31 @@ int initBitmap() {
 		return ERROR;
 	}
 
+	// only the bitmap blocks that change from here on get written
+	if (initBitmapDirtyBlocks(FALSE) == ERROR) {
+		free(bitmap);
+		bitmap = NULL;
+		return ERROR;
+	}
+
 	return SUCCESS;
 }
 
 int initRootDirectory() {
-	// bytes needed for a directory
-	int dir_bytes = MAX_DIRECTORY_ENTRIES * sizeof(dir_entry);
-
-	// blocks needed for a directory
-	int dir_blocks = ceilingDivide(dir_bytes, vcb->block_size);
-	vcb->dir_blocks = dir_blocks;
-
-	// Try to get enough contiguous free blocks for the root directory
-	uint64_t root_dir_start_block = getContiguousFreeBlocks(dir_blocks);
+	// the root directory is made like any other directory, but is its own parent
+	uint64_t root_dir_start_block = createDirectory(NULL, time(NULL));
 	if (root_dir_start_block == UNSIGNED_ERROR) {
 		printf("Error: Not enough free blocks in the volume to hold the root directory.\n");
 		return ERROR;
 	}
 	vcb->root_dir_start_block = root_dir_start_block;
-
-	dir_entry *root_dir = calloc(dir_blocks, vcb->block_size);
-	if (!root_dir) return ERROR;
-	
-	time_t curr_time = time(NULL);
-
-	// initialize the '.' entry in the root directory
-	strcpy(root_dir[0].name, ".");
-	root_dir[0].start_block = root_dir_start_block;
-	root_dir[0].size = dir_bytes;
-	root_dir[0].type = DIRECTORY;
-	root_dir[0].creation_date = curr_time;
-	root_dir[0].last_modified = curr_time;
-	root_dir[0].last_opened = curr_time;
-
-	// initialize the '..' entry in the root directory
-	// the '..' entry is the same as '.' save for the name in the root directory
-	root_dir[1] = root_dir[0];
-	strcpy(root_dir[1].name, "..");
-
-	// initialize the remaining directory entries
-	for (int i = 2; i < MAX_DIRECTORY_ENTRIES; i++) root_dir[i].type = FREE_ENTRY;
-
-	// write the root directory to disk
-	if (customLBAwrite(root_dir, dir_blocks, root_dir_start_block,
-		"init root_dir") == ERROR) {
-		free(root_dir);
-		root_dir = NULL;
-		return ERROR;
-	}
-
-	// mark the blocks the root directory took up as used
-	for (int i = 0; i < dir_blocks; i++) markBlockUsed(bitmap, root_dir_start_block + i);
-	vcb->num_free_blocks -= dir_blocks; // vcb written to disk later
+	vcb->dir_blocks = getNewDirBlocks(); // vcb written to disk later
 
 	// write to disk the updated bitmap
-	if (customLBAwrite(bitmap, vcb->bitmap_blocks, vcb->bitmap_start_block,
-		"root_dir bitmap") == ERROR) {
-		free(root_dir);
-		root_dir = NULL;
+	if (writeBitmap("root_dir bitmap") == ERROR) {
 		return ERROR;
 	}
 
-	free(root_dir);
-	root_dir = NULL;
-
 	return SUCCESS;
 }
 
@@ -222,12 +317,26 @@ int setCWDstartBlock(uint64_t start_block) {
 
 uint64_t getCWDstartBlock() { return cwd_start_block; }
 
-/* Frees the global pointers. */
+/* Stops the flusher, commits the journal and writes the dirty blocks in the block
+ * cache to disk, then frees the global pointers. */
 void exitFileSystem() {
+	stopFlusher();
+
+	if (closeJournal() == ERROR) {
+		printf("Error: The journal could not be committed.\n");
+	}
+
+	if (exitBlockCache() == ERROR) {
+		printf("Error: Some cached blocks could not be written to disk.\n");
+	}
+
 	free(vcb);
 	vcb = NULL;
 	free(bitmap);
 	bitmap = NULL;
+	freeFreeSpaceIndex();
+	freeBitmapDirtyBlocks();
+	freeRefcounts();
 
 	printf("System exiting.\n");
 }
\ No newline at end of file
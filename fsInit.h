@@ -33,8 +33,8 @@
 #define FILE 0 // directory entry is a file
 #define FREE_ENTRY -1 // directory entry has no type yet and is free to use
 
-#define MAX_DIRECTORY_ENTRIES 52 // maximum directory entries in a directory
 #define MAX_DE_NAME_LENGTH 64 // maximum length of a directory entry's name
+#define INLINE_EXTENTS 4 // extents stored in an extent map
 
 typedef struct VCB {
     uint64_t num_blocks; // total number of blocks in volume
@@ -45,12 +45,32 @@ typedef struct VCB {
     uint64_t bitmap_start_block; // the block the bitmap starts on
     uint64_t bitmap_blocks; // size of the bitmap in blocks
     uint64_t root_dir_start_block; // the block the root directory starts on
-    uint64_t dir_blocks; // size of a directory in blocks
+    uint64_t dir_blocks; // size of a new directory in blocks. directories grow from there
 
     uint64_t signature; // magic number used to tell if the volume is initialized
+    uint64_t format_version; // version of the on-disk format the volume was made with
+
+    uint64_t journal_start_block; // the block the metadata journal starts on
+    uint64_t journal_blocks; // size of the journal in blocks. 0 if the volume has none
+
+    uint64_t refcount_start_block; // the block the shared block reference counts start on
+    uint64_t refcount_blocks; // size of the reference counts in blocks. 0 if nothing is shared
 } VCB;
 
 #pragma pack(1) // remove the padding
+typedef struct extent {
+	uint64_t start_block; // the first block of the extent
+	uint64_t num_blocks; // number of contiguous blocks in the extent
+} extent;
+
+// where a file's (or a directory's) blocks are. they are stored in num_extents extents.
+// the first INLINE_EXTENTS are stored here, and the rest are in a chain of extent blocks.
+typedef struct extent_map {
+	uint64_t num_extents; // number of extents the blocks are stored in
+	extent extents[INLINE_EXTENTS]; // the first extents
+	uint64_t extent_block; // first block of the extent block chain. 0 if there is none
+} extent_map;
+
 typedef struct dir_entry {
 	char name[MAX_DE_NAME_LENGTH]; // identifier for the entry
 	uint64_t start_block; // the starting block of the entry
@@ -60,6 +80,8 @@ typedef struct dir_entry {
 	time_t creation_date; // date the entry was created
 	time_t last_modified; // date the entry was last modified
 	time_t last_opened; // date the entry was last opened
+
+	extent_map data; // where the file's data is. unused for directories
 } dir_entry;
 
 // The VCB and bitmap will be accessible and shared by every file
@@ -0,0 +1,578 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsJournal.c
+*
+* Description: The metadata journal. Records are appended one after the
+*  other starting at the journal's second block, and are written straight
+*  to disk instead of through the block cache. A record is only replayed
+*  if its sequence number is the next one expected and its checksum
+*  matches, so a record that was cut short by a crash is ignored, along
+*  with everything after it. The device may write blocks back in any
+*  order, so it is flushed between the steps that must not pass each
+*  other: the file data before the record that points at it, the record
+*  before its blocks are written home, and the blocks home before the
+*  journal's first block moves past their record. An operation is never
+*  committed before it ends, so each one starts with room in the pin limit
+*  for the blocks it is expected to change, and blocks it allocates are
+*  written like file data instead of being logged. For the same reason, blocks an
+*  operation frees are not allocated again until it is committed.
+*
+**************************************************************/
+
+#include <pthread.h>
+#include "fsJournal.h"
+#include "fsBitmap.h"
+#include "fsFreeSpace.h"
+
+#define FNV_OFFSET_BASIS 14695981039346656037ull // FNV-1a 64-bit starting value
+#define FNV_PRIME 1099511628211ull // FNV-1a 64-bit multiplier
+
+int journal_open = FALSE; // TRUE if the volume has a journal and it is in use
+int transaction_depth = 0; // how many transactions are nested right now
+uint64_t uncommitted_ops = 0; // operations that ended since the last commit
+uint64_t first_uncommitted_ms = 0; // when the first of the uncommitted operations ended
+int background_commits = FALSE; // TRUE if another thread commits the operations in time
+uint64_t journal_head = 1; // the journal block the next record goes in
+uint64_t next_sequence = 1; // sequence number of the next record
+uint64_t journal_pin_limit = 0; // most blocks that may be pinned before a commit
+uint32_t *logged_blocks = NULL; // one bit per volume block, set if logged since the checkpoint
+// one bit per volume block, set if an operation that is not committed yet freed it
+uint32_t *pending_free = NULL;
+uint64_t num_pending_free = 0; // how many bits are set in pending_free
+journal_stats journal_counters; // counters for the stats command
+// held through every transaction and every commit that is not part of one, so that
+// a commit from another thread never logs half an operation, and by journalLock. so
+// the bitmap, the VCB and the free space index change on one thread at a time, even
+// on a volume without a journal. recursive, since transactions nest
+pthread_mutex_t journal_lock;
+int journal_lock_ready = FALSE; // TRUE once journal_lock is initialized
+
+/* Continues a FNV-1a hash of data. */
+static uint64_t hashBytes(uint64_t hash, const void *data, uint64_t num_bytes) {
+    const unsigned char *bytes = data;
+    for (uint64_t i = 0; i < num_bytes; i++) {
+        hash ^= bytes[i];
+        hash *= FNV_PRIME;
+    }
+
+    return hash;
+}
+
+/* Returns how many blocks the header and block numbers of a record with num_blocks
+ * logged blocks take up. */
+static uint64_t recordHeaderBlocks(uint64_t num_blocks) {
+    uint64_t header_bytes = sizeof(journal_record) + num_blocks * sizeof(uint64_t);
+    return (header_bytes + vcb->block_size - 1) / vcb->block_size;
+}
+
+/* Writes the journal's first block, which says which record to replay first.
+ * Returns ERROR on error, or SUCCESS. */
+static int writeJournalSuper(uint64_t sequence) {
+    char *block = calloc(1, vcb->block_size);
+    if (!block) return ERROR;
+
+    journal_super *super = (journal_super *) block;
+    super->signature = JOURNAL_SIGNATURE;
+    super->sequence = sequence;
+
+    uint64_t blocks_written = deviceWrite(block, 1, vcb->journal_start_block);
+    free(block);
+    block = NULL;
+
+    if (blocks_written != 1) {
+        printf("Error: Could not write the journal. ");
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+/* Makes everything written to the device so far durable, so that nothing written
+ * after it can reach the disk first. Returns ERROR on error, or SUCCESS. */
+static int journalBarrier() {
+    if (deviceFlush() == ERROR) {
+        printf("Error: Could not flush the device. ");
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+/* Returns how many bitmap blocks one operation is expected to change: the one that
+ * holds the allocation hint and the one after it, since allocations start there,
+ * and a few more for the blocks it frees or allocates elsewhere. */
+static uint64_t opBitmapBlocks() {
+    uint64_t hint_block = modStartBlockIndex(0) / (vcb->block_size * 8);
+    uint64_t num_blocks = (hint_block + 1 < vcb->bitmap_blocks) ? 2 : 1;
+    num_blocks += JOURNAL_OP_BITMAP_BLOCKS;
+
+    return num_blocks < vcb->bitmap_blocks ? num_blocks : vcb->bitmap_blocks;
+}
+
+/* Returns how many blocks one operation is expected to pin: the VCB, the bitmap
+ * blocks from opBitmapBlocks, the reference count blocks, and the few directory and
+ * extent blocks it changes. */
+static uint64_t opPinBlocks() {
+    return VCB_BLOCKS + opBitmapBlocks() + vcb->refcount_blocks + JOURNAL_OP_BLOCKS;
+}
+
+/* Writes every logged block to its home location, then starts the journal over.
+ * The blocks that are still pinned have not been logged, so they stay in the cache.
+ * Returns ERROR on error, or SUCCESS. */
+static int checkpointJournal() {
+    if (flushBlockCache() == ERROR || journalBarrier() == ERROR) return ERROR;
+    if (writeJournalSuper(next_sequence) == ERROR) return ERROR;
+
+    journal_head = 1;
+    memset(logged_blocks, 0, (vcb->num_blocks + 63) / 64 * sizeof(uint64_t));
+    journal_counters.checkpoints++;
+
+    return SUCCESS;
+}
+
+/* Adds the blocks that were freed by the operations that were just committed to the
+ * free extent index, so they can be allocated again. */
+static void releasePendingFrees() {
+    uint64_t run_start = bitmapNextSet(pending_free, vcb->num_blocks, 0);
+    while (num_pending_free > 0 && run_start < vcb->num_blocks) {
+        uint64_t run_end = bitmapNextClear(pending_free, vcb->num_blocks, run_start);
+        bitmapClearRange(pending_free, run_start, run_end - run_start);
+        num_pending_free -= run_end - run_start;
+
+        // only the blocks that are still free in the bitmap
+        uint64_t free_start = bitmapNextClear(bitmap, run_end, run_start);
+        while (free_start < run_end) {
+            uint64_t free_end = bitmapNextSet(bitmap, run_end, free_start);
+            freeSpaceAddRange(free_start, free_end - free_start);
+            free_start = bitmapNextClear(bitmap, run_end, free_end);
+        }
+
+        run_start = bitmapNextSet(pending_free, vcb->num_blocks, run_end);
+    }
+
+    num_pending_free = 0;
+}
+
+uint64_t getNewJournalBlocks(uint64_t num_blocks) {
+    uint64_t journal_blocks = num_blocks / JOURNAL_SIZE_DENOM;
+
+    if (journal_blocks < JOURNAL_MIN_BLOCKS) return 0; // too small to be worth it
+    if (journal_blocks > JOURNAL_MAX_BLOCKS) journal_blocks = JOURNAL_MAX_BLOCKS;
+
+    return journal_blocks;
+}
+
+int formatJournal() {
+    vcb->journal_start_block = VCB_BLOCKS + vcb->bitmap_blocks;
+
+    // check that the volume can actually hold the journal
+    if (vcb->journal_blocks > vcb->num_blocks - vcb->journal_start_block) {
+        printf("Error: Not enough free blocks in the volume to hold the journal.\n");
+        return ERROR;
+    }
+
+    markBlockRangeUsed(bitmap, vcb->journal_start_block, vcb->journal_blocks);
+    vcb->num_free_blocks -= vcb->journal_blocks;
+
+    return writeJournalSuper(1);
+}
+
+int replayJournal() {
+    char *block = malloc(vcb->block_size);
+    char *record = NULL;
+    if (!block) return ERROR;
+
+    if (deviceRead(block, 1, vcb->journal_start_block) != 1) {
+        printf("Error: Could not read the journal.\n");
+        goto free_and_return_error;
+    }
+
+    journal_super *super = (journal_super *) block;
+    if (super->signature != JOURNAL_SIGNATURE) {
+        printf("Error: The journal is corrupted.\n");
+        goto free_and_return_error;
+    }
+
+    uint64_t sequence = super->sequence;
+    uint64_t head = 1;
+    uint64_t num_replayed = 0;
+
+    while (head < vcb->journal_blocks) {
+        if (deviceRead(block, 1, vcb->journal_start_block + head) != 1) break;
+
+        // anything but the next record means the journal ends here
+        journal_record *header = (journal_record *) block;
+        if (header->signature != JOURNAL_RECORD_SIGNATURE || header->sequence != sequence
+            || header->num_blocks > vcb->journal_blocks) {
+            break;
+        }
+
+        uint64_t header_blocks = recordHeaderBlocks(header->num_blocks);
+        uint64_t record_blocks = header_blocks + header->num_blocks;
+        if (record_blocks > vcb->journal_blocks - head) break;
+
+        free(record);
+        record = malloc(record_blocks * vcb->block_size);
+        if (!record) goto free_and_return_error;
+
+        if (deviceRead(record, record_blocks, vcb->journal_start_block + head)
+            != record_blocks) {
+            break;
+        }
+
+        header = (journal_record *) record;
+        uint64_t *home_blocks = (uint64_t *) (record + sizeof(journal_record));
+        char *data = record + header_blocks * vcb->block_size;
+
+        // a record that was only partly written does not match its checksum
+        uint64_t checksum = hashBytes(FNV_OFFSET_BASIS, home_blocks,
+                                      header->num_blocks * sizeof(uint64_t));
+        checksum = hashBytes(checksum, data, header->num_blocks * vcb->block_size);
+        if (checksum != header->checksum) break;
+
+        for (uint64_t i = 0; i < header->num_blocks; i++) {
+            if (home_blocks[i] >= vcb->num_blocks) {
+                printf("Error: The journal is corrupted.\n");
+                goto free_and_return_error;
+            }
+
+            if (customLBAwrite(data + i * vcb->block_size, 1, home_blocks[i],
+                "replayJournal") == ERROR) {
+                goto free_and_return_error;
+            }
+        }
+
+        head += record_blocks;
+        sequence++;
+        num_replayed++;
+    }
+
+    // the replayed blocks must be home before the journal forgets them
+    if (flushBlockCache() == ERROR || journalBarrier() == ERROR
+        || writeJournalSuper(sequence) == ERROR) {
+        goto free_and_return_error;
+    }
+
+    if (num_replayed > 0) {
+        printf("Replayed %lu journal records from before the volume was last closed.\n",
+               num_replayed);
+    }
+
+    journal_counters.replayed += num_replayed;
+    next_sequence = sequence;
+
+    free(block);
+    block = NULL;
+    free(record);
+    record = NULL;
+    return SUCCESS;
+
+    free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
+    free(block);
+    block = NULL;
+    free(record);
+    record = NULL;
+    return ERROR;
+}
+
+int openJournal() {
+    if (!journal_lock_ready) {
+        pthread_mutexattr_t attr;
+        pthread_mutexattr_init(&attr);
+        pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+        pthread_mutex_init(&journal_lock, &attr);
+        pthread_mutexattr_destroy(&attr);
+        journal_lock_ready = TRUE;
+    }
+
+    if (vcb->journal_blocks == 0) return SUCCESS; // the volume has no journal
+
+    char *block = malloc(vcb->block_size);
+    if (!block) return ERROR;
+
+    if (deviceRead(block, 1, vcb->journal_start_block) != 1
+        || ((journal_super *) block)->signature != JOURNAL_SIGNATURE) {
+        printf("Error: Could not read the journal.\n");
+        free(block);
+        return ERROR;
+    }
+
+    // new records pick up where the sequence left off, so old records are never replayed
+    next_sequence = ((journal_super *) block)->sequence;
+    free(block);
+    block = NULL;
+
+    logged_blocks = calloc((vcb->num_blocks + 63) / 64, sizeof(uint64_t));
+    pending_free = calloc((vcb->num_blocks + 63) / 64, sizeof(uint64_t));
+    if (!logged_blocks || !pending_free) {
+        free(logged_blocks);
+        logged_blocks = NULL;
+        free(pending_free);
+        pending_free = NULL;
+        return ERROR;
+    }
+    num_pending_free = 0;
+
+    // a record must fit in the journal along with its header blocks, and leave room in
+    // the cache for the blocks that are not pinned
+    journal_pin_limit = vcb->journal_blocks - 1 - recordHeaderBlocks(vcb->journal_blocks - 1);
+    if (journal_pin_limit > CACHE_NUM_BLOCKS / 2) journal_pin_limit = CACHE_NUM_BLOCKS / 2;
+    if (journal_pin_limit < opPinBlocks()) {
+        printf("Warning: The journal only has room for %lu changed blocks. Operations "
+               "that change more fail.\n", journal_pin_limit);
+    }
+
+    journal_head = 1;
+    transaction_depth = 0;
+    uncommitted_ops = 0;
+    journal_open = TRUE;
+
+    // an operation that pins too many blocks fails, since it cannot be committed
+    // before it is done
+    setCachePinLimit(journal_pin_limit);
+
+    return SUCCESS;
+}
+
+int closeJournal() {
+    if (!journal_open) return SUCCESS;
+
+    pthread_mutex_lock(&journal_lock);
+    int result = commitJournal();
+    if (result == SUCCESS) result = checkpointJournal();
+
+    setCachePinLimit(CACHE_NUM_BLOCKS);
+    setCachePinning(FALSE);
+    free(logged_blocks);
+    logged_blocks = NULL;
+    free(pending_free);
+    pending_free = NULL;
+    num_pending_free = 0;
+    journal_open = FALSE;
+    pthread_mutex_unlock(&journal_lock);
+
+    return result;
+}
+
+void journalBegin() {
+    if (!journal_lock_ready) return;
+
+    pthread_mutex_lock(&journal_lock);
+    if (transaction_depth++ > 0 || !journal_open) return;
+
+    // commit first if the operation might not fit. if that fails, the operation fails
+    // once it runs out of room
+    if (getNumPinnedBlocks() + opPinBlocks() > journal_pin_limit) commitJournal();
+    setCachePinning(TRUE);
+}
+
+int journalEnd() {
+    if (!journal_lock_ready || transaction_depth == 0) return SUCCESS;
+
+    int result = SUCCESS;
+    if (--transaction_depth == 0 && journal_open) {
+        setCachePinning(FALSE);
+        if (uncommitted_ops++ == 0) first_uncommitted_ms = getMonotonicMs();
+        journal_counters.ops++;
+
+        // group commits are left to the thread that commits in the background, if
+        // there is one
+        if (!background_commits && uncommitted_ops >= JOURNAL_GROUP_OPS) {
+            result = commitJournal();
+        }
+    }
+
+    pthread_mutex_unlock(&journal_lock);
+    return result;
+}
+
+void journalLock() {
+    if (journal_lock_ready) pthread_mutex_lock(&journal_lock);
+}
+
+void journalUnlock() {
+    if (journal_lock_ready) pthread_mutex_unlock(&journal_lock);
+}
+
+int commitOldOps(uint64_t max_age_ms, uint64_t max_pinned) {
+    if (!journal_open) return SUCCESS;
+
+    pthread_mutex_lock(&journal_lock);
+    int result = SUCCESS;
+    if (uncommitted_ops > 0 && (getMonotonicMs() - first_uncommitted_ms >= max_age_ms
+                                || getNumPinnedBlocks() >= max_pinned)) {
+        result = commitJournal();
+    }
+    pthread_mutex_unlock(&journal_lock);
+
+    return result;
+}
+
+void setBackgroundCommits(int on) { background_commits = on; }
+
+int commitJournal() {
+    if (!journal_open) return SUCCESS;
+
+    // with nothing pinned, no record is left to free the blocks
+    uint64_t num_blocks = getNumPinnedBlocks();
+    if (num_blocks == 0) {
+        releasePendingFrees();
+        uncommitted_ops = 0;
+        return SUCCESS;
+    }
+
+    uint64_t header_blocks = recordHeaderBlocks(num_blocks);
+    uint64_t record_blocks = header_blocks + num_blocks;
+    if (record_blocks > vcb->journal_blocks - 1) {
+        printf("Error: Too many blocks changed to fit in the journal. ");
+        return ERROR;
+    }
+
+    char *record = calloc(record_blocks, vcb->block_size);
+    if (!record) return ERROR;
+
+    journal_record *header = (journal_record *) record;
+    uint64_t *home_blocks = (uint64_t *) (record + sizeof(journal_record));
+    char *data = record + header_blocks * vcb->block_size;
+
+    if (copyPinnedBlocks(home_blocks, data) != num_blocks) {
+        free(record);
+        return ERROR;
+    }
+
+    header->signature = JOURNAL_RECORD_SIGNATURE;
+    header->sequence = next_sequence;
+    header->num_blocks = num_blocks;
+    header->num_ops = uncommitted_ops;
+    header->checksum = hashBytes(FNV_OFFSET_BASIS, home_blocks, num_blocks * sizeof(uint64_t));
+    header->checksum = hashBytes(header->checksum, data, num_blocks * vcb->block_size);
+
+    // the file data the record points at goes to disk before the record does
+    if (flushDataBlocks() == ERROR || journalBarrier() == ERROR) {
+        free(record);
+        return ERROR;
+    }
+
+    // start the journal over if the record does not fit after the last one
+    if (record_blocks > vcb->journal_blocks - journal_head && checkpointJournal() == ERROR) {
+        free(record);
+        return ERROR;
+    }
+
+    // the whole record goes to disk in one sequential write
+    if (deviceWrite(record, record_blocks, vcb->journal_start_block + journal_head)
+        != record_blocks) {
+        printf("Error: Could not write to the journal. ");
+        free(record);
+        return ERROR;
+    }
+
+    // and is durable before any of its blocks can be written home
+    if (journalBarrier() == ERROR) {
+        free(record);
+        return ERROR;
+    }
+
+    for (uint64_t i = 0; i < num_blocks; i++) bitmapSetRange(logged_blocks, home_blocks[i], 1);
+
+    // a crash can no longer bring back the operations that freed the blocks, so they
+    // may be allocated and written again
+    releasePendingFrees();
+
+    journal_head += record_blocks;
+    next_sequence++;
+    uncommitted_ops = 0;
+    journal_counters.commits++;
+    journal_counters.blocks_logged += num_blocks;
+
+    // the blocks are logged, so the cache may write them home whenever it wants to
+    unpinAllBlocks();
+
+    free(record);
+    record = NULL;
+    return SUCCESS;
+}
+
+/* Checkpoints the journal if any of the blocks were logged since the last checkpoint,
+ * unless the write is part of a transaction and in_transaction is FALSE, since the
+ * transaction logs them again. Returns ERROR on error, or SUCCESS. */
+static int checkOverwrite(uint64_t start_block, uint64_t num_blocks, int in_transaction) {
+    if (!journal_open) return SUCCESS;
+    if (start_block >= vcb->num_blocks || num_blocks > vcb->num_blocks - start_block) {
+        return SUCCESS; // the write itself fails
+    }
+
+    // waits for another thread's transaction, which may log the blocks. a checkpoint
+    // in the middle of a transaction leaves its pinned blocks alone
+    pthread_mutex_lock(&journal_lock);
+    int result = SUCCESS;
+    if ((transaction_depth == 0 || in_transaction)
+        && bitmapCountSet(logged_blocks, start_block, num_blocks) > 0) {
+        result = checkpointJournal();
+    }
+    pthread_mutex_unlock(&journal_lock);
+
+    return result;
+}
+
+int checkJournalOverwrite(uint64_t start_block, uint64_t num_blocks) {
+    return checkOverwrite(start_block, num_blocks, FALSE);
+}
+
+int checkJournalNewBlocks(uint64_t start_block, uint64_t num_blocks) {
+    return checkOverwrite(start_block, num_blocks, TRUE);
+}
+
+int journalDeferFree(uint64_t start_block, uint64_t num_blocks) {
+    if (!journal_open) return FALSE;
+
+    pthread_mutex_lock(&journal_lock);
+    num_pending_free += num_blocks - bitmapCountSet(pending_free, start_block, num_blocks);
+    bitmapSetRange(pending_free, start_block, num_blocks);
+    pthread_mutex_unlock(&journal_lock);
+
+    return TRUE;
+}
+
+uint64_t journalFirstPendingFree(uint64_t start_block, uint64_t num_blocks) {
+    if (!journal_open || num_pending_free == 0) return start_block + num_blocks;
+    return bitmapNextSet(pending_free, start_block + num_blocks, start_block);
+}
+
+int commitPendingFrees() {
+    if (!journal_open || num_pending_free == 0) return FALSE;
+
+    // the running transaction cannot be committed before it ends
+    pthread_mutex_lock(&journal_lock);
+    int freed = FALSE;
+    if (transaction_depth == 0 && num_pending_free > 0) {
+        freed = (commitJournal() == SUCCESS);
+    }
+    pthread_mutex_unlock(&journal_lock);
+
+    return freed;
+}
+
+void printJournalStats() {
+    if (!journal_open) {
+        printf("Journal: none\n");
+        return;
+    }
+
+    printf("Journal: %lu/%lu blocks used, %lu blocks pinned\n"
+           "  blocks waiting to be freed: %lu\n"
+           "  operations: %lu\n"
+           "  commits: %lu\n"
+           "  blocks logged: %lu\n"
+           "  checkpoints: %lu\n"
+           "  records replayed: %lu\n",
+           journal_head, vcb->journal_blocks, getNumPinnedBlocks(), num_pending_free,
+           journal_counters.ops, journal_counters.commits, journal_counters.blocks_logged,
+           journal_counters.checkpoints, journal_counters.replayed);
+}
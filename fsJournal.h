@@ -0,0 +1,150 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsJournal.h
+*
+* Description: Interface for the metadata journal, a region of the volume
+*  right after the bitmap. Every operation that changes the file system's
+*  metadata runs as a transaction, one at a time. The blocks it writes are
+*  pinned in the block cache, and the pinned blocks of many transactions
+*  are logged together as one record with a single sequential write
+*  (group commit).
+*  File data is written to disk before the record that points at it.
+*  Once logged, the blocks are written to their home locations whenever
+*  the cache writes them back. When the journal fills up, the cache is
+*  flushed and the journal starts over (checkpoint). On mount, the records
+*  logged since the last checkpoint are replayed, so the volume always
+*  reflects whole operations. Blocks that an operation frees are only
+*  allocated again once it is committed.
+*
+**************************************************************/
+
+#ifndef _FS_JOURNAL_H
+#define _FS_JOURNAL_H
+
+#include "fsInit.h"
+
+#define JOURNAL_SIGNATURE 0x4A524E4C // marks the journal's first block
+#define JOURNAL_RECORD_SIGNATURE 0x4A524543 // marks the first block of a record
+#define JOURNAL_MIN_BLOCKS 64 // smallest journal a new volume gets
+#define JOURNAL_MAX_BLOCKS 4096 // largest journal a new volume gets
+#define JOURNAL_SIZE_DENOM 32 // a new volume's journal takes up 1/32 of it, within the bounds
+#define JOURNAL_GROUP_OPS 16 // operations that are committed together
+#define JOURNAL_OP_BLOCKS 16 // most directory and extent blocks one operation changes
+// bitmap blocks one operation is expected to change away from the allocation hint
+#define JOURNAL_OP_BITMAP_BLOCKS 32
+
+// the journal's first block
+typedef struct journal_super {
+    uint64_t signature; // JOURNAL_SIGNATURE
+    uint64_t sequence; // sequence number of the first record to replay
+} journal_super;
+
+// a record starts with this, followed by the home block number of each logged block.
+// the logged blocks come after the blocks holding the header and block numbers.
+typedef struct journal_record {
+    uint64_t signature; // JOURNAL_RECORD_SIGNATURE
+    uint64_t sequence; // one more than the previous record's
+    uint64_t num_blocks; // how many blocks are logged
+    uint64_t num_ops; // how many operations the record commits
+    uint64_t checksum; // checksum of the block numbers and the logged blocks
+} journal_record;
+
+// journal counters, printed by the stats command
+typedef struct journal_stats {
+    uint64_t ops; // operations that ended
+    uint64_t commits; // records written
+    uint64_t blocks_logged; // blocks written into records
+    uint64_t checkpoints; // times the journal filled up and started over
+    uint64_t replayed; // records replayed on mount
+} journal_stats;
+
+/* Returns how many journal blocks a new volume of num_blocks blocks gets, or 0 if
+ * the volume is too small for a journal. */
+uint64_t getNewJournalBlocks(uint64_t num_blocks);
+
+/* Reserves vcb->journal_blocks blocks right after the bitmap for the journal and
+ * writes an empty journal there. Changes the bitmap and VCB in memory only.
+ * Returns ERROR on error, or SUCCESS. */
+int formatJournal();
+
+/* Writes the blocks of every record logged since the last checkpoint to their home
+ * locations, then empties the journal. Must be called before the VCB and bitmap are
+ * used, and the VCB reread after. Returns ERROR on error, or SUCCESS. */
+int replayJournal();
+
+/* Starts journaling if the volume has a journal. Returns ERROR on error, or SUCCESS. */
+int openJournal();
+
+/* Commits the operations that have not been committed yet, writes every block to its
+ * home location, and empties the journal. Returns ERROR on error, or SUCCESS. */
+int closeJournal();
+
+/* Starts a transaction. Transactions can nest, and only the outermost one counts.
+ * Waits for the transaction running on another thread, if any, and commits the
+ * operations before it first if it might not fit after them. Only the blocks the
+ * calling thread writes are logged. Even without a journal, transactions run one at
+ * a time. */
+void journalBegin();
+
+/* Ends a transaction, and commits it along with the other uncommitted operations once
+ * there are enough of them. Returns ERROR if a commit failed, or SUCCESS. */
+int journalEnd();
+
+/* Waits for the transaction running on another thread, if any, and holds off the
+ * others until journalUnlock, without starting one. For changes to the bitmap and VCB
+ * in memory that a later transaction writes. Can be called inside a transaction. */
+void journalLock();
+
+/* Lets other threads start transactions again after journalLock. */
+void journalUnlock();
+
+/* Logs every block the uncommitted operations wrote as one record.
+ * Returns ERROR on error, or SUCCESS. */
+int commitJournal();
+
+/* Same as commitJournal, but only if the first uncommitted operation ended max_age_ms
+ * ago, or at least max_pinned blocks are pinned. Waits for the transaction that is
+ * running, if any, so it can be called from any thread.
+ * Returns ERROR if the commit failed, or SUCCESS. */
+int commitOldOps(uint64_t max_age_ms, uint64_t max_pinned);
+
+/* Tells the journal whether another thread calls commitOldOps often enough (TRUE) or
+ * not (FALSE). While it does, ending a transaction only commits when the journal or
+ * the cache is running out of room, instead of every JOURNAL_GROUP_OPS operations. */
+void setBackgroundCommits(int on);
+
+/* Called before blocks are written outside of a transaction. If any of them were
+ * logged since the last checkpoint, the journal is checkpointed first, so that
+ * replaying it cannot overwrite the new data. Returns ERROR on error, or SUCCESS. */
+int checkJournalOverwrite(uint64_t start_block, uint64_t num_blocks);
+
+/* Same as checkJournalOverwrite, but also inside a transaction. Called before blocks
+ * that were just allocated are written without being logged.
+ * Returns ERROR on error, or SUCCESS. */
+int checkJournalNewBlocks(uint64_t start_block, uint64_t num_blocks);
+
+/* Called when blocks are freed. If the volume has a journal, it holds on to them until
+ * the operation that freed them is committed, since a crash before then brings the
+ * operation back along with its blocks, and returns TRUE. Then it adds them to the
+ * free extent index. Returns FALSE if the caller adds them to the index itself. */
+int journalDeferFree(uint64_t start_block, uint64_t num_blocks);
+
+/* Returns the first of the num_blocks blocks from start_block on that the journal is
+ * holding on to after they were freed, or start_block + num_blocks if there is none.
+ * Those blocks are free in the bitmap, but must not be allocated yet. */
+uint64_t journalFirstPendingFree(uint64_t start_block, uint64_t num_blocks);
+
+/* Commits the operations that freed the blocks the journal is holding on to, unless a
+ * transaction is running. Returns TRUE if the blocks were freed, FALSE otherwise. */
+int commitPendingFrees();
+
+/* Prints the journal counters. */
+void printJournalStats();
+
+#endif
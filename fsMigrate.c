@@ -0,0 +1,205 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsMigrate.c
+*
+* Description: Upgrades volumes made with an older on-disk format. Each
+*  old fixed-size directory is rebuilt as a growable directory, starting
+*  from the root, and the old directories are freed at the end.
+*
+**************************************************************/
+
+#include "fsMigrate.h"
+#include "fsDirectory.h"
+#include "fsFreeSpace.h"
+
+// the start blocks of the old directories, freed once the migration is done
+typedef struct old_dir_list {
+    uint64_t *start_blocks;
+    uint64_t num_dirs;
+    uint64_t capacity;
+} old_dir_list;
+
+/* Adds start_block to the list. Returns ERROR if memory ran out, or SUCCESS. */
+static int addOldDir(old_dir_list *list, uint64_t start_block) {
+    if (list->num_dirs == list->capacity) {
+        uint64_t new_capacity = list->capacity ? list->capacity * 2 : 16;
+        uint64_t *new_blocks = realloc(list->start_blocks, new_capacity * sizeof(uint64_t));
+        if (!new_blocks) return ERROR;
+
+        list->start_blocks = new_blocks;
+        list->capacity = new_capacity;
+    }
+
+    list->start_blocks[list->num_dirs++] = start_block;
+    return SUCCESS;
+}
+
+/* Copies entry i of an old directory into entry. Legacy entries have no extents,
+ * so the file's blocks are described by its start block and size. */
+static void readOldDirEntry(char *old_dir, int i, int is_legacy, dir_entry *entry) {
+    memset(entry, 0, sizeof(dir_entry));
+
+    if (!is_legacy) {
+        memcpy(entry, old_dir + i * sizeof(dir_entry), sizeof(dir_entry));
+        return;
+    }
+
+    // a legacy entry is laid out like the start of the current one
+    memcpy(entry, old_dir + i * LEGACY_DIR_ENTRY_SIZE, LEGACY_DIR_ENTRY_SIZE);
+    if (entry->type == FILE && entry->size > 0) {
+        entry->data.num_extents = 1;
+        entry->data.extents[0].start_block = entry->start_block;
+        entry->data.extents[0].num_blocks = ceilingDivide(entry->size, vcb->block_size);
+    }
+}
+
+/* Rebuilds the old directory at old_start_block and everything under it. parent is
+ * the new '.' entry of the parent directory, or NULL for the root. The new
+ * directory's '.' entry is copied into self. Returns ERROR on error, or SUCCESS. */
+static int migrateDirectory(uint64_t old_start_block, dir_entry *parent, int depth,
+                            int is_legacy, old_dir_list *old_dirs, dir_entry *self) {
+    if (depth > MAX_PATHNAME_DEPTH) {
+        printf("Error: The directories are nested too deeply or in a loop. ");
+        return ERROR;
+    }
+
+    if (old_start_block >= vcb->num_blocks
+        || vcb->dir_blocks > vcb->num_blocks - old_start_block) {
+        printf("Error: Block %lu does not hold a directory. ", old_start_block);
+        return ERROR;
+    }
+
+    directory new_dir;
+    int new_dir_open = FALSE; // whether new_dir needs to be closed
+    char *old_dir = malloc(vcb->dir_blocks * vcb->block_size);
+    if (!old_dir) return ERROR;
+
+    if (customLBAread(old_dir, vcb->dir_blocks, old_start_block,
+        "migrateDirectory old_dir") == ERROR) {
+        goto free_and_return_error;
+    }
+
+    dir_entry old_self; // the old '.' entry. its dates carry over
+    readOldDirEntry(old_dir, SELF_ENTRY_INDEX, is_legacy, &old_self);
+    if (old_self.type != DIRECTORY || old_self.start_block != old_start_block) {
+        printf("Error: Block %lu does not hold a directory. ", old_start_block);
+        goto free_and_return_error;
+    }
+
+    uint64_t new_start_block = createDirectory(parent, old_self.creation_date);
+    if (new_start_block == UNSIGNED_ERROR) goto free_and_return_error;
+
+    if (openDirectory(new_start_block, &new_dir) == ERROR) goto free_and_return_error;
+    new_dir_open = TRUE;
+
+    if (readDirEntry(&new_dir, SELF_ENTRY_INDEX, self) == ERROR) goto free_and_return_error;
+    self->last_modified = old_self.last_modified;
+    self->last_opened = old_self.last_opened;
+    if (writeDirEntry(&new_dir, SELF_ENTRY_INDEX, self) == ERROR) goto free_and_return_error;
+
+    // the root is its own parent, so its '..' gets the same dates
+    if (!parent) {
+        dir_entry self_parent = *self;
+        strcpy(self_parent.name, "..");
+        if (writeDirEntry(&new_dir, PARENT_ENTRY_INDEX, &self_parent) == ERROR) {
+            goto free_and_return_error;
+        }
+    }
+
+    for (int i = PARENT_ENTRY_INDEX + 1; i < OLD_DIRECTORY_ENTRIES; i++) {
+        dir_entry entry;
+        readOldDirEntry(old_dir, i, is_legacy, &entry);
+        if (entry.type == FREE_ENTRY) continue;
+
+        entry.name[MAX_DE_NAME_LENGTH - 1] = '\0';
+        if (entry.type == DIRECTORY) {
+            dir_entry child_self;
+            if (migrateDirectory(entry.start_block, self, depth + 1, is_legacy,
+                old_dirs, &child_self) == ERROR) {
+                goto free_and_return_error;
+            }
+
+            entry.start_block = child_self.start_block;
+            entry.size = child_self.size;
+            memset(&entry.data, 0, sizeof(extent_map));
+        }
+
+        if (addDirEntry(&new_dir, &entry) == ERROR) goto free_and_return_error;
+    }
+
+    // '.' may have grown along with the directory
+    if (readDirEntry(&new_dir, SELF_ENTRY_INDEX, self) == ERROR) goto free_and_return_error;
+
+    new_dir_open = FALSE;
+    if (closeDirectory(&new_dir) == ERROR) goto free_and_return_error;
+    if (addOldDir(old_dirs, old_start_block) == ERROR) goto free_and_return_error;
+
+    free(old_dir);
+    old_dir = NULL;
+    return SUCCESS;
+
+    free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
+    if (new_dir_open) closeDirectory(&new_dir);
+    free(old_dir);
+    old_dir = NULL;
+    return ERROR;
+}
+
+int migrateVolume(int is_legacy) {
+    old_dir_list old_dirs = { NULL, 0, 0 };
+    uint64_t bitmap_bytes = vcb->bitmap_blocks * vcb->block_size;
+
+    // copies of the VCB and bitmap, put back if the migration fails
+    VCB old_vcb = *vcb;
+    uint32_t *old_bitmap = malloc(bitmap_bytes);
+    if (!old_bitmap) return ERROR;
+    memcpy(old_bitmap, bitmap, bitmap_bytes);
+
+    printf("Upgrading the volume to the current directory format...\n");
+
+    dir_entry root_self;
+    if (migrateDirectory(vcb->root_dir_start_block, NULL, 0, is_legacy, &old_dirs,
+        &root_self) == ERROR) {
+        goto restore_and_return_error;
+    }
+
+    // every directory was rebuilt, so the old ones can go
+    for (uint64_t i = 0; i < old_dirs.num_dirs; i++) {
+        markBlockRangeFree(bitmap, old_dirs.start_blocks[i], vcb->dir_blocks);
+        vcb->num_free_blocks += vcb->dir_blocks;
+    }
+
+    vcb->root_dir_start_block = root_self.start_block;
+    vcb->dir_blocks = getNewDirBlocks();
+
+    printf("Upgraded %lu directories.\n", old_dirs.num_dirs);
+
+    free(old_dirs.start_blocks);
+    old_dirs.start_blocks = NULL;
+    free(old_bitmap);
+    old_bitmap = NULL;
+    return SUCCESS;
+
+    restore_and_return_error: // Label for error handling. Undo the allocations and return ERROR.
+    printf("\nError: The volume could not be upgraded.\n");
+    *vcb = old_vcb;
+    memcpy(bitmap, old_bitmap, bitmap_bytes);
+    buildFreeSpaceIndex(bitmap, vcb->num_blocks);
+
+    // a grown directory may have written the VCB and bitmap already
+    customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK, "migrateVolume restore vcb");
+    customLBAwrite(bitmap, vcb->bitmap_blocks, vcb->bitmap_start_block,
+                   "migrateVolume restore bitmap");
+
+    free(old_dirs.start_blocks);
+    old_dirs.start_blocks = NULL;
+    free(old_bitmap);
+    old_bitmap = NULL;
+    return ERROR;
+}
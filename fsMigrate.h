@@ -0,0 +1,32 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsMigrate.h
+*
+* Description: Interface for upgrading volumes made with an older on-disk
+*  format. Older volumes store every directory as vcb->dir_blocks
+*  contiguous blocks holding a fixed number of directory entries.
+*
+**************************************************************/
+
+#ifndef _FS_MIGRATE_H
+#define _FS_MIGRATE_H
+
+#define OLD_DIRECTORY_ENTRIES 52 // directory entries in an old fixed-size directory
+#define LEGACY_DIR_ENTRY_SIZE 108 // size of a directory entry before files had extents
+
+/* Rebuilds every directory of an old volume in the current directory format, and
+ * points vcb->root_dir_start_block at the new root. If is_legacy is TRUE, the
+ * volume's directory entries have no extents, and each file is stored in
+ * ceil(size / block size) contiguous blocks at its start block.
+ * The old directories are only freed once every directory was rebuilt. On error,
+ * the VCB and bitmap are put back the way they were, so the old tree is untouched.
+ * Returns ERROR on error, or SUCCESS. */
+int migrateVolume(int is_legacy);
+
+#endif
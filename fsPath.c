@@ -15,30 +15,25 @@
 
 #include "fsInit.h"
 #include "mfs.h"
+#include "fsDentryCache.h"
+#include "fsDirectory.h"
 
 long long getParentBasenameStartBlock(const char *path) {
     if (strcmp(path, "/") == 0) return vcb->root_dir_start_block;
 
     int path_is_absolute = FALSE;
     if (path[0] == '/') path_is_absolute = TRUE;
-    
-    dir_entry *parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-
-    if (path_is_absolute) { // parent_dir = root dir
-        if (customLBAread(parent_dir, vcb->dir_blocks, vcb->root_dir_start_block,
-            "abs_path init parent_dir") == ERROR) {
-            free(parent_dir);
-            parent_dir = NULL;
-            return ERROR;
-        }
-    } else { // parent_dir = cwd
-        if (customLBAread(parent_dir, vcb->dir_blocks, getCWDstartBlock(),
-            "rel_path init parent_dir") == ERROR) {
-            free(parent_dir);
-            parent_dir = NULL;
-            return ERROR;
-        }
-    }
+
+    // the directory we are currently in while walking the path.
+    // the walk starts at the root dir for absolute paths and at the cwd otherwise.
+    uint64_t curr_dir_start_block = path_is_absolute ? vcb->root_dir_start_block
+                                                     : getCWDstartBlock();
+
+    // only read from disk when a directory entry is not in the dentry cache.
+    // parent_dir is the open directory starting at loaded_dir_start_block.
+    directory parent_dir;
+    uint64_t loaded_dir_start_block = 0;
+    int parent_dir_loaded = FALSE;
 
     // A copy of the path is needed since strtok_r modifies its source string.
     // This must be freed.
@@ -54,11 +49,7 @@ long long getParentBasenameStartBlock(const char *path) {
     for (int i = 0; i < path_length; i++) {
         if (last_char_was_slash && path_copy[i] == '/') { // check for repeated slashes
             printf("Invalid path due to repeated slashes.\n");
-            free(parent_dir);
-            parent_dir = NULL;
-            free(path_copy);
-            path_copy = NULL;
-            return ERROR;
+            goto free_and_return_error;
         }
 
         if (path_copy[i] == '/') {
@@ -74,52 +65,68 @@ long long getParentBasenameStartBlock(const char *path) {
     char *child_dir_name = strtok_r(path_copy, "/", &saveptr);
 
     int dir_path_index = 1; // current directory in path, starting at 1
-    int entry_index;
+    uint64_t child_start_block; // start block of child_dir_name
+    int child_type; // type of child_dir_name, or DCACHE_NEGATIVE if it does not exist
 
     while (child_dir_name && (dir_path_index < dirs_in_path)) {
-        // Search parent_dir for child_dir_name
-        entry_index = getDirEntryIndexByName(parent_dir, child_dir_name);
-        if (entry_index == ERROR || entry_index == NOT_FOUND) { // dir not found
+        // Search the current directory for child_dir_name, on disk if it is not cached
+        if (!dentryCacheLookup(curr_dir_start_block, child_dir_name,
+                               &child_start_block, &child_type)) {
+            if (!parent_dir_loaded || loaded_dir_start_block != curr_dir_start_block) {
+                if (parent_dir_loaded) closeDirectory(&parent_dir);
+                parent_dir_loaded = FALSE;
+
+                if (openDirectory(curr_dir_start_block, &parent_dir) == ERROR) {
+                    goto free_and_return_error;
+                }
+
+                loaded_dir_start_block = curr_dir_start_block;
+                parent_dir_loaded = TRUE;
+            }
+
+            dir_entry child;
+            long long entry_index = findDirEntry(&parent_dir, child_dir_name, &child);
+            if (entry_index == ERROR) goto free_and_return_error;
+
+            if (entry_index == NOT_FOUND) child_type = DCACHE_NEGATIVE;
+            else {
+                child_start_block = child.start_block;
+                child_type = child.type;
+            }
+
+            dentryCacheInsert(curr_dir_start_block, child_dir_name,
+                              child_start_block, child_type);
+        }
+
+        if (child_type == DCACHE_NEGATIVE) { // dir not found
             printf("Invalid path. Could not find directory entry '%s'.\n", child_dir_name);
-            free(parent_dir);
-            parent_dir = NULL;
-            free(path_copy);
-            path_copy = NULL;
-            return ERROR;
+            goto free_and_return_error;
         }
 
         // if the path was valid, but tried to path into a non-directory
-        if (parent_dir[entry_index].type != DIRECTORY) {
+        if (child_type != DIRECTORY) {
             printf("Invalid path. '%s' is not a directory.\n", child_dir_name);
-            free(parent_dir);
-            parent_dir = NULL;
-            free(path_copy);
-            path_copy = NULL;
-            return ERROR;
+            goto free_and_return_error;
         }
 
-        // read child directory into parent_dir
-        if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir[entry_index].start_block,
-            "getParentStartBlock update parent_dir") == ERROR) {
-            free(parent_dir);
-            parent_dir = NULL;
-            free(path_copy);
-            path_copy = NULL;
-            return ERROR;
-        }
+        curr_dir_start_block = child_start_block;
 
         child_dir_name = strtok_r(NULL, "/", &saveptr);
         dir_path_index++;
     }
 
-    long long parent_basename_start_block = parent_dir[0].start_block;
+    if (parent_dir_loaded) closeDirectory(&parent_dir);
+    free(path_copy);
+    path_copy = NULL;
+
+    return curr_dir_start_block;
 
-    free(parent_dir);
-    parent_dir = NULL;
+    free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
+    if (parent_dir_loaded) closeDirectory(&parent_dir);
     free(path_copy);
     path_copy = NULL;
 
-    return parent_basename_start_block;
+    return ERROR;
 }
 
 char* getBasename(const char *path) {
@@ -157,92 +164,48 @@ char* getBasename(const char *path) {
     return basename; // caller needs to free this
 }
 
-int getDirEntryIndexByName(dir_entry *dir, const char *dir_entry_name) {
-    if (dir[0].type != DIRECTORY) {
-        printf("Error: dir in getDirEntryIndexByName() was not a directory.\n");
-        return ERROR;
-    } else if (dir_entry_name == NULL) { // if root directory, return itself
-        return 0;
-    }
-
-    for (int i = 0; i < MAX_DIRECTORY_ENTRIES; i++) {
-        if ((dir[i].type != FREE_ENTRY) && (strcmp(dir[i].name, dir_entry_name) == 0)) {
-            return i;
-        }
-    }
-
-    return NOT_FOUND; // entry not found
-}
-
-int getDirEntryIndexByStartBlock(dir_entry *dir, uint64_t dir_entry_start_block) {
-    if (dir[0].type != DIRECTORY) {
-        printf("Error: dir in getDirEntryIndexByStartBlock() was not a directory.\n");
-        return ERROR;
-    }
-
-    for (int i = 0; i < MAX_DIRECTORY_ENTRIES; i++) {
-        if ((dir[i].type != FREE_ENTRY) && (dir[i].start_block == dir_entry_start_block)) {
-            return i;
-        }
-    }
-
-    return NOT_FOUND; // entry not found
+void clearDirEntry(dir_entry *entry) {
+    memset(entry, 0, sizeof(dir_entry));
+    entry->type = FREE_ENTRY;
 }
 
-int getDirFreeEntryIndex(dir_entry *dir) {
-    if (dir[0].type != DIRECTORY) {
-        printf("Error: dir in getDirFreeEntryIndex() was not a directory.\n");
-        return ERROR;
-    }
+/* Finds the parent of the directory starting at dir_start_block, and the name the
+ * directory has in its parent. name may be NULL if the name is not needed.
+ * Returns the parent's start block, or ERROR. */
+static long long getParentAndName(uint64_t dir_start_block, char *name) {
+    directory dir; // the directory, and then its parent
+    dir_entry entry;
 
-    for (int i = 0; i < MAX_DIRECTORY_ENTRIES; i++) {
-        if (dir[i].type == FREE_ENTRY) return i;
-    }
+    if (openDirectory(dir_start_block, &dir) == ERROR) return ERROR;
+    int result = readDirEntry(&dir, PARENT_ENTRY_INDEX, &entry);
+    closeDirectory(&dir);
+    if (result == ERROR) return ERROR;
 
-    return NOT_FOUND; // no free entries in dir
-}
+    uint64_t parent_start_block = entry.start_block;
+    if (!name) return parent_start_block;
 
-int getDirNextUsedEntryIndex(dir_entry *dir, int start_index) {
-    if (dir[0].type != DIRECTORY) {
-        printf("Error: dir in getDirNextUsedEntryIndex() was not a directory.\n");
-        return ERROR;
-    } else if (start_index < 0 || start_index >= MAX_DIRECTORY_ENTRIES) {
-        printf("Error: Invalid start index passed to getDirNextUsedEntryIndex().\n");
-        return ERROR;
-    }
-
-    for (int i = start_index; i < MAX_DIRECTORY_ENTRIES; i++) {
-        if (dir[i].type != FREE_ENTRY) return i;
-    }
+    // searches in the parent dir for the entry with the matching start block
+    if (openDirectory(parent_start_block, &dir) == ERROR) return ERROR;
+    long long entry_index = findDirEntryByStartBlock(&dir, dir_start_block, &entry);
+    closeDirectory(&dir);
 
-    return NOT_FOUND; // entries from start_index to MAX_DIR_ENTRIES are free
-}
-
-int getDirNumUsedEntries(dir_entry *dir) {
-    if (dir[0].type != DIRECTORY) {
-        printf("Error: dir in getDirNumUsedEntries() was not a directory.\n");
+    if (entry_index == ERROR || entry_index == NOT_FOUND) { // error
+        printf("Error: Directory %lu is missing from its parent. ", dir_start_block);
         return ERROR;
     }
 
-    int num_used_entries = 0;
-    for (int i = 0; i < MAX_DIRECTORY_ENTRIES; i++) {
-        if (dir[i].type != FREE_ENTRY) num_used_entries++;
-    }
-
-    return num_used_entries;
+    strcpy(name, entry.name);
+    return parent_start_block;
 }
 
-char* getDirAbsPath(dir_entry *dir, char *buf, size_t size) {
-    if (!buf || !dir) {
-        printf("buf or dir is NULL in getDirAbsPath.\n");
+char* getDirAbsPath(uint64_t dir_start_block, char *buf, size_t size) {
+    if (!buf) {
+        printf("buf is NULL in getDirAbsPath.\n");
         return NULL;
     } else if (size <= 1) { // needs space for null-terminator
         printf("Invalid size passed into getDirAbsPath.\n");
         return NULL;
-    } else if (dir[0].type != DIRECTORY) {
-        printf("dir is not a directory in getDirAbsPath.\n");
-        return NULL;
-    } else if (dir[0].start_block == vcb->root_dir_start_block) { // root dir
+    } else if (dir_start_block == vcb->root_dir_start_block) { // root dir
         strcpy(buf, "/");
         return buf;
     }
@@ -250,44 +213,22 @@ char* getDirAbsPath(dir_entry *dir, char *buf, size_t size) {
     // An array of filenames, later concatenated to create an absolute path.
     char dirs_in_path[MAX_PATHNAME_DEPTH][MAX_DE_NAME_LENGTH];
     int dir_num = 0;
-    uint64_t curr_start_block = dir[0].start_block;
-
-    dir_entry *parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-    if (customLBAread(parent_dir, vcb->dir_blocks, dir[1].start_block,
-        "getDirAbsPath parent init") == ERROR) {
-        free(parent_dir);
-        parent_dir = NULL;
-        return NULL;
-    }
+    uint64_t curr_start_block = dir_start_block;
 
     do {
-        // searches in the parent dir for the entry with the matching start block
-        int entry_index = getDirEntryIndexByStartBlock(parent_dir, curr_start_block);
-        if (entry_index == ERROR || entry_index == NOT_FOUND) { // error
-            printf("Error getting the directory entry index in getDirAbsPath.\n");
-            free(parent_dir);
-            parent_dir = NULL;
-            return NULL;
-        }
-
         if (dir_num >= MAX_PATHNAME_DEPTH) { // check that we do not write out of bounds
             printf("Maximum subdirectory depth of %d reached.\n", MAX_PATHNAME_DEPTH);
-            free(parent_dir);
-            parent_dir = NULL;
             return NULL;
         }
 
-        strcpy(dirs_in_path[dir_num], parent_dir[entry_index].name);
-        dir_num++;
-        curr_start_block = parent_dir[0].start_block;
-
-        // read the parent of parent_dir into parent_dir
-        if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir[1].start_block,
-            "getDirAbsPath parent loop") == ERROR) {
-            free(parent_dir);
-            parent_dir = NULL;
+        long long parent_start_block = getParentAndName(curr_start_block, dirs_in_path[dir_num]);
+        if (parent_start_block == ERROR) {
+            printf("Error getting the directory entry in getDirAbsPath.\n");
             return NULL;
         }
+
+        dir_num++;
+        curr_start_block = parent_start_block;
     } while (curr_start_block != vcb->root_dir_start_block);
 
     // size of buf >= 2 due to the check at the beginning of function
@@ -301,8 +242,6 @@ char* getDirAbsPath(dir_entry *dir, char *buf, size_t size) {
 
         if (buf_count + filename_len >= size) {
             printf("Error: Maximum path size of %ld exceeded.\n", size);
-            free(parent_dir);
-            parent_dir = NULL;
             return NULL;
         }
 
@@ -313,103 +252,54 @@ char* getDirAbsPath(dir_entry *dir, char *buf, size_t size) {
         dir_num--;
     }
 
-    free(parent_dir);
-    parent_dir = NULL;
-
     return buf;
 }
 
-char* getDirName(dir_entry *dir, char *buf, size_t buf_size) {
-    if (!dir || !buf) {
-        printf("buf or dir is NULL in getDirName.\n");
+char* getDirName(uint64_t dir_start_block, char *buf, size_t buf_size) {
+    if (!buf) {
+        printf("buf is NULL in getDirName.\n");
         return NULL;
     } else if (buf_size < MAX_DE_NAME_LENGTH) { // buf too small for dir name
         printf("buf_size in getDirName is too small to hold a dir entry name.\n");
         return NULL;
-    } else if (dir[0].type != DIRECTORY) {
-        printf("dir is not a directory in getDirName.\n");
-        return NULL;
-    } else if (dir[0].start_block == vcb->root_dir_start_block) { // root dir special case
+    } else if (dir_start_block == vcb->root_dir_start_block) { // root dir special case
         strcpy(buf, ROOT_NAME);
         return buf;
     }
 
-    dir_entry *parent_dir = NULL; // parent dir to search for the dir's name
-    uint64_t dir_start_block = dir[0].start_block;
-
-    parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-    if (customLBAread(parent_dir, vcb->dir_blocks, dir[1].start_block,
-        "getDirName parent init") == ERROR) {
-        goto free_and_return_null;
-    }
-
-    // searches in the parent dir for the entry with dir's start block
-    int entry_index = getDirEntryIndexByStartBlock(parent_dir, dir_start_block);
-    if (entry_index == ERROR || entry_index == NOT_FOUND) { // error
-        printf("Error getting the directory entry index in getDirName.\n");
-        goto free_and_return_null;
+    if (getParentAndName(dir_start_block, buf) == ERROR) {
+        printf("Error getting the directory entry in getDirName.\n");
+        return NULL;
     }
 
-    strcpy(buf, parent_dir[entry_index].name);
-
-    free(parent_dir);
-    parent_dir = NULL;
-
     return buf; // success
-
-    free_and_return_null: // Label for error handling. Free the mallocs and return NULL.
-    free(parent_dir);
-    parent_dir = NULL;
-
-    return NULL;
 }
 
-int isSubDirOf(dir_entry *dir, uint64_t ancestor_start_block) {
+int isSubDirOf(uint64_t dir_start_block, uint64_t ancestor_start_block) {
     // all dirs are subdirs of the root dir, except for the root dir itself
     if (ancestor_start_block == vcb->root_dir_start_block) {
-        if (dir[0].start_block == vcb->root_dir_start_block) return FALSE;
+        if (dir_start_block == vcb->root_dir_start_block) return FALSE;
         else return TRUE;
     }
 
-    dir_entry *parent_dir = NULL; // the parent dir of dir
-
-    int is_sub_dir_of = FALSE; // if dir is a sub dir of ancestor dir
     int dirs_checked = 0; // counter for how many dirs we have checked
-
-    parent_dir = malloc(vcb->dir_blocks * vcb->block_size);
-    if (customLBAread(parent_dir, vcb->dir_blocks, dir[1].start_block,
-        "isSubDirOf parent_dir init") == ERROR) {
-        goto free_and_return_error;
-    }
+    uint64_t curr_start_block = dir_start_block;
 
     // keep going up a directory until we hit the root or we checked the maximum number of dirs
-    do {
-        if (parent_dir[0].start_block == ancestor_start_block) { // match found
-            is_sub_dir_of = TRUE;
-            break;
-        }
+    while (curr_start_block != vcb->root_dir_start_block) {
+        long long parent_start_block = getParentAndName(curr_start_block, NULL);
+        if (parent_start_block == ERROR) return ERROR;
+
+        if (parent_start_block == ancestor_start_block) return TRUE; // match found
 
         dirs_checked++;
         if (dirs_checked >= MAX_PATHNAME_DEPTH) {
             printf("Maximum directory checks limit of %d reached.\n", MAX_PATHNAME_DEPTH);
-            goto free_and_return_error;
-        }
-
-        // read the parent of parent_dir into parent_dir
-        if (customLBAread(parent_dir, vcb->dir_blocks, parent_dir[1].start_block,
-            "isSubDirOf parent loop") == ERROR) {
-            goto free_and_return_error;
+            return ERROR;
         }
-    } while (parent_dir[0].start_block != vcb->root_dir_start_block);
-
-    free(parent_dir);
-    parent_dir = NULL;
 
-    return is_sub_dir_of;
-
-    free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
-    free(parent_dir);
-    parent_dir = NULL;
+        curr_start_block = parent_start_block;
+    }
 
-    return ERROR;
-}
\ No newline at end of file
+    return FALSE;
+}
@@ -0,0 +1,351 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsRefcount.c
+*
+* Description: The table of shared extents. The extents are sorted by
+*  start block and never overlap, and neighbouring extents with the same
+*  reference count are merged, so a clone of a file in a few extents adds
+*  only a few entries. Changes rebuild the table in one pass, into a
+*  second array of the same size that then takes the table's place, so
+*  a release that was reserved for never needs memory of its own. The
+*  table's blocks move to a larger run when it outgrows them, and to a
+*  smaller one, or none, when it shrinks.
+*
+**************************************************************/
+
+#include "fsRefcount.h"
+
+static shared_extent *shared = NULL; // the shared extents, sorted by start block
+static shared_extent *spare = NULL; // where the next change rebuilds the table
+static uint64_t num_shared = 0; // how many shared extents there are
+static uint64_t table_capacity = 0; // how many extents shared and spare can both hold
+static int refcounts_dirty = FALSE; // TRUE if the table changed since it was written
+
+/* Returns how many blocks a table of num_extents shared extents takes up. */
+static uint64_t tableBlocks(uint64_t num_extents) {
+    uint64_t bytes = sizeof(refcount_header) + num_extents * sizeof(shared_extent);
+    return (bytes + vcb->block_size - 1) / vcb->block_size;
+}
+
+/* Makes shared and spare both hold at least num_extents extents.
+ * Returns ERROR if memory ran out, or SUCCESS. */
+static int growTable(uint64_t num_extents) {
+    if (num_extents <= table_capacity) return SUCCESS;
+
+    uint64_t capacity = num_extents * 2; // room to grow
+    shared_extent *new_shared = realloc(shared, capacity * sizeof(shared_extent));
+    if (!new_shared) return ERROR;
+    shared = new_shared;
+
+    shared_extent *new_spare = realloc(spare, capacity * sizeof(shared_extent));
+    if (!new_spare) return ERROR; // shared keeps its extra room
+    spare = new_spare;
+
+    table_capacity = capacity;
+    return SUCCESS;
+}
+
+/* Returns the index of the first shared extent that ends after block, or num_shared. */
+static uint64_t findShared(uint64_t block) {
+    uint64_t low = 0, high = num_shared;
+    while (low < high) {
+        uint64_t mid = low + (high - low) / 2;
+        if (shared[mid].start_block + shared[mid].num_blocks <= block) low = mid + 1;
+        else high = mid;
+    }
+
+    return low;
+}
+
+/* Adds an extent to the end of out, merging it into the last one if they touch and
+ * have the same count. out has room for it. */
+static void pushShared(shared_extent *out, uint64_t *num_out, uint64_t start_block,
+                       uint64_t num_blocks, uint64_t refs) {
+    if (num_blocks == 0 || refs < 2) return; // a single reference is not kept
+
+    if (*num_out > 0) {
+        shared_extent *last = &out[*num_out - 1];
+        if (last->refs == refs && last->start_block + last->num_blocks == start_block) {
+            last->num_blocks += num_blocks;
+            return;
+        }
+    }
+
+    out[*num_out].start_block = start_block;
+    out[*num_out].num_blocks = num_blocks;
+    out[*num_out].refs = refs;
+    (*num_out)++;
+}
+
+/* Adds delta, which is 1 or -1, to the count of every block from start_block to
+ * start_block + num_blocks - 1. Blocks that drop to no references are freed.
+ * Returns how many blocks were freed, or ERROR if memory ran out, in which case
+ * nothing changes. */
+static long long adjustRefs(uint64_t start_block, uint64_t num_blocks, int delta) {
+    uint64_t end_block = start_block + num_blocks;
+    uint64_t first = findShared(start_block);
+
+    // the range can split the extents at both of its ends. adding a reference can
+    // also share the gap before each extent in it, while dropping one frees them
+    uint64_t max_out = (delta > 0) ? num_shared * 2 + 3 : num_shared + 2;
+    if (growTable(max_out) == ERROR) return ERROR;
+
+    shared_extent *out = spare;
+
+    uint64_t num_out = 0;
+    long long num_freed = 0;
+    for (uint64_t i = 0; i < first; i++) {
+        pushShared(out, &num_out, shared[i].start_block, shared[i].num_blocks, shared[i].refs);
+    }
+
+    uint64_t block = start_block; // the next block in the range to adjust
+    uint64_t i = first;
+    while (block < end_block) {
+        // the blocks up to the next shared extent have one reference
+        uint64_t gap_end = (i < num_shared && shared[i].start_block < end_block)
+                         ? shared[i].start_block : end_block;
+        if (gap_end > block) {
+            if (delta > 0) pushShared(out, &num_out, block, gap_end - block, 2);
+            else {
+                markBlockRangeFree(bitmap, block, gap_end - block);
+                vcb->num_free_blocks += gap_end - block;
+                num_freed += gap_end - block;
+            }
+            block = gap_end;
+        }
+        if (block >= end_block) break;
+
+        // the part of the extent before the range keeps its count
+        shared_extent *e = &shared[i];
+        uint64_t e_end = e->start_block + e->num_blocks;
+        if (e->start_block < block) pushShared(out, &num_out, e->start_block,
+                                               block - e->start_block, e->refs);
+
+        uint64_t overlap_end = (e_end < end_block) ? e_end : end_block;
+        pushShared(out, &num_out, block, overlap_end - block, e->refs + delta);
+
+        // and so does the part after it
+        if (e_end > end_block) pushShared(out, &num_out, end_block, e_end - end_block, e->refs);
+
+        block = overlap_end;
+        i++;
+    }
+
+    for (; i < num_shared; i++) {
+        pushShared(out, &num_out, shared[i].start_block, shared[i].num_blocks, shared[i].refs);
+    }
+
+    spare = shared;
+    shared = out;
+    num_shared = num_out;
+    refcounts_dirty = TRUE;
+
+    return num_freed;
+}
+
+int loadRefcounts() {
+    freeRefcounts();
+    if (vcb->refcount_blocks == 0) return SUCCESS; // nothing has been cloned yet
+
+    if (vcb->refcount_start_block == 0 || vcb->refcount_start_block >= vcb->num_blocks
+        || vcb->refcount_blocks > vcb->num_blocks - vcb->refcount_start_block) {
+        printf("Error: The block reference counts are corrupted.\n");
+        return ERROR;
+    }
+
+    char *table = malloc(vcb->refcount_blocks * vcb->block_size);
+    if (!table) return ERROR;
+
+    if (customLBAread(table, vcb->refcount_blocks, vcb->refcount_start_block,
+        "loadRefcounts") == ERROR) {
+        goto free_and_return_error;
+    }
+
+    refcount_header *header = (refcount_header *) table;
+    if (header->signature != REFCOUNT_SIGNATURE
+        || tableBlocks(header->num_extents) > vcb->refcount_blocks) {
+        printf("Error: The block reference counts are corrupted.\n");
+        goto free_and_return_error;
+    }
+
+    if (header->num_extents > 0) {
+        if (growTable(header->num_extents) == ERROR) goto free_and_return_error;
+
+        memcpy(shared, header + 1, header->num_extents * sizeof(shared_extent));
+        num_shared = header->num_extents;
+    }
+
+    free(table);
+    table = NULL;
+    return SUCCESS;
+
+    free_and_return_error: // Label for error handling. Free the mallocs and return ERROR.
+    free(table);
+    table = NULL;
+    return ERROR;
+}
+
+void freeRefcounts() {
+    free(shared);
+    shared = NULL;
+    free(spare);
+    spare = NULL;
+    num_shared = 0;
+    table_capacity = 0;
+    refcounts_dirty = FALSE;
+}
+
+int shareBlocks(uint64_t start_block, uint64_t num_blocks) {
+    if (num_blocks == 0) return SUCCESS;
+
+    return adjustRefs(start_block, num_blocks, 1) == ERROR ? ERROR : SUCCESS;
+}
+
+int reserveRefcounts(uint64_t num_releases) {
+    if (num_shared == 0) return SUCCESS; // every release skips the table
+
+    return growTable(num_shared + 2 * num_releases);
+}
+
+long long releaseBlocks(uint64_t start_block, uint64_t num_blocks) {
+    if (num_blocks == 0) return 0;
+
+    // nothing is shared in most volumes, so skip rebuilding the table
+    int shared_block;
+    if (getSharedRun(start_block, num_blocks, &shared_block) == num_blocks && !shared_block) {
+        markBlockRangeFree(bitmap, start_block, num_blocks);
+        vcb->num_free_blocks += num_blocks;
+        return num_blocks;
+    }
+
+    long long num_freed = adjustRefs(start_block, num_blocks, -1);
+    if (num_freed == ERROR) printf("Error: Out of memory. The shared blocks were not released. ");
+    return num_freed;
+}
+
+uint64_t getSharedRun(uint64_t start_block, uint64_t max_blocks, int *shared_block) {
+    uint64_t i = findShared(start_block);
+
+    if (i < num_shared && shared[i].start_block <= start_block) { // shared
+        *shared_block = TRUE;
+
+        // neighbouring extents with other counts are still shared
+        uint64_t end_block = shared[i].start_block + shared[i].num_blocks;
+        for (i++; i < num_shared && shared[i].start_block == end_block
+             && end_block - start_block < max_blocks; i++) {
+            end_block = shared[i].start_block + shared[i].num_blocks;
+        }
+
+        uint64_t run = end_block - start_block;
+        return run < max_blocks ? run : max_blocks;
+    }
+
+    *shared_block = FALSE;
+    if (i == num_shared) return max_blocks;
+
+    uint64_t run = shared[i].start_block - start_block;
+    return run < max_blocks ? run : max_blocks;
+}
+
+/* Gives the table's blocks back, and points the VCB at no table. */
+static void freeTableBlocks() {
+    if (vcb->refcount_blocks > 0) {
+        markBlockRangeFree(bitmap, vcb->refcount_start_block, vcb->refcount_blocks);
+        vcb->num_free_blocks += vcb->refcount_blocks;
+    }
+
+    vcb->refcount_start_block = 0;
+    vcb->refcount_blocks = 0;
+}
+
+int writeRefcounts() {
+    if (!refcounts_dirty) return SUCCESS;
+
+    // an empty table needs no blocks, so loadRefcounts starts an empty one
+    if (num_shared == 0) {
+        if (vcb->refcount_blocks > 0) {
+            freeTableBlocks();
+            if (customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK,
+                "writeRefcounts VCB") == ERROR) {
+                return ERROR;
+            }
+        }
+
+        refcounts_dirty = FALSE;
+        return SUCCESS;
+    }
+
+    uint64_t blocks_needed = tableBlocks(num_shared);
+    int moved = FALSE;
+
+    // move the table to a run of blocks with room to grow if it outgrew its own, or
+    // to a smaller one once it uses a quarter of them. the old blocks are only
+    // reused once the VCB that points at the new ones is committed
+    int outgrown = blocks_needed > vcb->refcount_blocks;
+    if (outgrown || blocks_needed * 4 <= vcb->refcount_blocks) {
+        uint64_t new_blocks = blocks_needed * 2;
+        uint64_t new_start_block = getContiguousFreeBlocks(new_blocks);
+        if (new_start_block == UNSIGNED_ERROR && outgrown) {
+            printf("Error: Not enough free blocks for the block reference counts. ");
+            return ERROR;
+        }
+
+        // a table that only shrank stays where it is if there is nowhere to move it
+        if (new_start_block != UNSIGNED_ERROR) {
+            markBlockRangeUsed(bitmap, new_start_block, new_blocks);
+            vcb->num_free_blocks -= new_blocks;
+            freeTableBlocks();
+
+            vcb->refcount_start_block = new_start_block;
+            vcb->refcount_blocks = new_blocks;
+            moved = TRUE;
+        }
+    }
+
+    char *table = calloc(blocks_needed, vcb->block_size);
+    if (!table) return ERROR;
+
+    refcount_header *header = (refcount_header *) table;
+    header->signature = REFCOUNT_SIGNATURE;
+    header->num_extents = num_shared;
+    if (num_shared > 0) memcpy(header + 1, shared, num_shared * sizeof(shared_extent));
+
+    // a table that moved is not logged, since only the new VCB points at it
+    long long blocks_written = moved
+        ? customLBAwriteNew(table, blocks_needed, vcb->refcount_start_block, "writeRefcounts")
+        : customLBAwrite(table, blocks_needed, vcb->refcount_start_block, "writeRefcounts");
+    if (blocks_written == ERROR) {
+        free(table);
+        table = NULL;
+        return ERROR;
+    }
+
+    free(table);
+    table = NULL;
+
+    if (moved && customLBAwrite(vcb, VCB_BLOCKS, VCB_START_BLOCK,
+        "writeRefcounts VCB") == ERROR) {
+        return ERROR;
+    }
+
+    refcounts_dirty = FALSE;
+    return SUCCESS;
+}
+
+void printRefcountStats() {
+    uint64_t shared_blocks = 0;
+    uint64_t saved_blocks = 0; // blocks that would be used if nothing was shared
+    for (uint64_t i = 0; i < num_shared; i++) {
+        shared_blocks += shared[i].num_blocks;
+        saved_blocks += shared[i].num_blocks * (shared[i].refs - 1);
+    }
+
+    printf("Shared blocks: %lu extents, %lu blocks, %lu blocks saved\n",
+           num_shared, shared_blocks, saved_blocks);
+}
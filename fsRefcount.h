@@ -0,0 +1,80 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsRefcount.h
+*
+* Description: Interface for the reference counts of blocks shared by
+*  cloned files. A used block that is not in the table belongs to exactly
+*  one file. Runs of blocks that belong to more than one file are kept in
+*  a sorted table of shared extents, which is loaded when the volume is
+*  mounted and written to its own blocks along with the bitmap. A shared
+*  block is only freed once the last file holding it lets go of it, and
+*  a file copies a shared block before changing it (copy-on-write).
+*
+**************************************************************/
+
+#ifndef _FS_REFCOUNT_H
+#define _FS_REFCOUNT_H
+
+#include "fsInit.h"
+
+#define REFCOUNT_SIGNATURE 0x52454643 // marks the first block of the table
+
+// blocks start_block to start_block + num_blocks - 1 each belong to refs files
+typedef struct shared_extent {
+    uint64_t start_block;
+    uint64_t num_blocks;
+    uint64_t refs; // always at least 2
+} shared_extent;
+
+// the table's first block starts with this, followed by the shared extents
+typedef struct refcount_header {
+    uint64_t signature; // REFCOUNT_SIGNATURE
+    uint64_t num_extents; // how many shared extents follow
+} refcount_header;
+
+/* Loads the table from vcb->refcount_start_block, or starts an empty one if the
+ * volume has none yet. Returns ERROR on error, or SUCCESS. */
+int loadRefcounts();
+
+/* Frees the table in memory. */
+void freeRefcounts();
+
+/* Adds one reference to each of the blocks from start_block to
+ * start_block + num_blocks - 1, which are all used. Changes the table in memory only.
+ * Returns ERROR if memory ran out, or SUCCESS. */
+int shareBlocks(uint64_t start_block, uint64_t num_blocks);
+
+/* Makes room for the table to take num_releases calls to releaseBlocks, so that
+ * they cannot run out of memory until the table changes some other way. Called before
+ * an operation gives up blocks, so that it fails before changing anything.
+ * Returns ERROR if memory ran out, or SUCCESS. */
+int reserveRefcounts(uint64_t num_releases);
+
+/* Drops one reference to each of the blocks from start_block to
+ * start_block + num_blocks - 1. Blocks that had no other reference are freed in the
+ * bitmap and VCB. Changes them in memory only. Returns how many blocks were freed, or
+ * ERROR if memory ran out and reserveRefcounts was not called, in which case nothing
+ * changes. */
+long long releaseBlocks(uint64_t start_block, uint64_t num_blocks);
+
+/* Returns how many of the up to max_blocks blocks from start_block on are all
+ * shared, or all not shared, like the first one. *shared is set to TRUE if they
+ * are shared, FALSE otherwise. */
+uint64_t getSharedRun(uint64_t start_block, uint64_t max_blocks, int *shared);
+
+/* Writes the table to disk if it changed, moving it to larger blocks if it outgrew
+ * its old ones, or to smaller ones if it shrank. An empty table gives up its blocks.
+ * If it moved, the VCB is written too, and the bitmap changed in memory.
+ * Returns ERROR on error, or SUCCESS. */
+int writeRefcounts();
+
+/* Prints how many blocks are shared. */
+void printRefcountStats();
+
+#endif
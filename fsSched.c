@@ -0,0 +1,362 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsSched.c
+*
+* Description: The I/O scheduler. Queued blocks are kept sorted by block
+*  number, each with its own block of queue memory, so a block that is
+*  written again while it is queued is overwritten in place. The queue
+*  is only ever emptied as a whole, so the blocks fill the queue memory
+*  in the order they were added. A dispatch is a C-LOOK sweep: it writes
+*  the queued blocks from where the last transfer ended up to the
+*  highest one, then goes back to the lowest one and writes the rest.
+*  A flush writes the queue without the cache locked instead: the queue
+*  is swapped with a second, held set of blocks, which reads copy from
+*  until it is written, and which is kept for the next flush if the
+*  write fails. Nothing here is locked, since only the block cache uses
+*  it, with the cache locked.
+*
+**************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "fsSched.h"
+#include "fsIOBuffer.h"
+#include "helperFunctions.h"
+
+typedef struct io_scheduler {
+    char *name; // the name the scheduler is selected by
+    int queues_writes; // FALSE if writes go to the device as they come
+    int expires_writes; // TRUE if the queue is dispatched once a write waited too long
+} io_scheduler;
+
+static io_scheduler schedulers[] = {
+    { "noop", FALSE, FALSE },
+    { "elevator", TRUE, FALSE },
+    { "deadline", TRUE, TRUE }
+};
+
+static io_scheduler *scheduler = NULL; // the scheduler in use, or NULL until one is set
+static uint64_t *queued_lbas = NULL; // the queued block numbers, sorted
+static int *queued_slots = NULL; // where in queue_data each of queued_lbas's blocks is
+static char *queue_data = NULL; // SCHED_QUEUE_BLOCKS blocks of queued data
+static int num_queued = 0; // how many blocks are queued
+// the blocks handed out by schedHoldQueue, laid out the same way. they are older than
+// the queued blocks, and swap places with them
+static uint64_t *held_lbas = NULL;
+static int *held_slots = NULL;
+static char *held_data = NULL;
+static int num_held = 0; // how many blocks are held
+static int held_writing = FALSE; // TRUE from schedHoldQueue until schedReleaseHeld
+static uint64_t sched_block_size = 0; // size of a block in bytes
+static uint64_t head_position = 0; // the block after the last transfer, where sweeps start
+static uint64_t oldest_queued_ms = 0; // when the oldest queued block was queued
+static sched_stats sched_counters;
+
+/* Returns the index of the first of the num_lbas sorted block numbers in lbas that is
+ * at least lba, or num_lbas. */
+static int findBlock(const uint64_t *lbas, int num_lbas, uint64_t lba) {
+    int low = 0, high = num_lbas;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (lbas[mid] < lba) low = mid + 1;
+        else high = mid;
+    }
+
+    return low;
+}
+
+/* Returns the index of the first queued block that is at least lba, or num_queued. */
+static int findQueued(uint64_t lba) {
+    return findBlock(queued_lbas, num_queued, lba);
+}
+
+/* Returns the data of queued_lbas[index]. */
+static char *queuedData(int index) {
+    return queue_data + (uint64_t) queued_slots[index] * sched_block_size;
+}
+
+/* Returns the data of held_lbas[index]. */
+static char *heldData(int index) {
+    return held_data + (uint64_t) held_slots[index] * sched_block_size;
+}
+
+/* Returns TRUE if any of the num_lbas sorted block numbers in lbas is one of the
+ * lba_count blocks from lba_position on. */
+static int holdsRange(const uint64_t *lbas, int num_lbas, uint64_t lba_count,
+                      uint64_t lba_position) {
+    int index = findBlock(lbas, num_lbas, lba_position);
+    return index < num_lbas && lbas[index] - lba_position < lba_count;
+}
+
+/* Copies the blocks among the num_lbas sorted block numbers in lbas, whose data is in
+ * data in the order of slots, that are among the lba_count blocks from lba_position
+ * on over buf, which holds those blocks. Returns how many were copied. */
+static uint64_t copyHeldBlocks(char *buf, uint64_t lba_count, uint64_t lba_position,
+                               const uint64_t *lbas, const int *slots, int num_lbas,
+                               const char *data) {
+    uint64_t num_copied = 0;
+    for (int i = findBlock(lbas, num_lbas, lba_position);
+         i < num_lbas && lbas[i] < lba_position + lba_count; i++) {
+        memcpy(buf + (lbas[i] - lba_position) * sched_block_size,
+               data + (uint64_t) slots[i] * sched_block_size, sched_block_size);
+        num_copied++;
+    }
+
+    return num_copied;
+}
+
+/* Writes the lbas' blocks, whose data is in data in the order of slots, to the device
+ * in one C-LOOK sweep from the head. Returns ERROR on error, or SUCCESS. */
+static int writeSweep(const uint64_t *lbas, const int *slots, int num_lbas,
+                      const char *data) {
+    lba_segment *segs = malloc(num_lbas * sizeof(lba_segment));
+    if (!segs) return ERROR;
+
+    // the sweep goes up from the head, then starts over from the lowest block
+    int first = findBlock(lbas, num_lbas, head_position);
+    for (int i = 0; i < num_lbas; i++) {
+        int index = (first + i) % num_lbas;
+        segs[i].buf = (char *) data + (uint64_t) slots[index] * sched_block_size;
+        segs[i].lba_count = 1;
+        segs[i].lba_position = lbas[index];
+    }
+
+    int num_up = num_lbas - first; // blocks at or after the head
+    int result = deviceTransferSegments(segs, num_up, TRUE);
+    if (result == SUCCESS) result = deviceTransferSegments(segs + num_up, first, TRUE);
+
+    free(segs);
+    segs = NULL;
+
+    if (result == SUCCESS) head_position = lbas[first > 0 ? first - 1 : num_lbas - 1] + 1;
+    return result;
+}
+
+int setScheduler(char *name) {
+    if (!name) name = DEFAULT_SCHEDULER;
+
+    io_scheduler *found = NULL;
+    for (size_t i = 0; i < sizeof(schedulers) / sizeof(schedulers[0]); i++) {
+        if (strcmp(schedulers[i].name, name) == 0) found = &schedulers[i];
+    }
+
+    if (!found) {
+        printf("Error: There is no '%s' scheduler. ", name);
+        return ERROR;
+    }
+
+    if (!found->queues_writes && schedDispatch() == ERROR) return ERROR;
+
+    scheduler = found;
+    return SUCCESS;
+}
+
+int initScheduler(uint64_t block_size) {
+    if (!scheduler && setScheduler(NULL) == ERROR) return ERROR;
+
+    sched_block_size = block_size;
+    queued_lbas = malloc(SCHED_QUEUE_BLOCKS * sizeof(uint64_t));
+    queued_slots = malloc(SCHED_QUEUE_BLOCKS * sizeof(int));
+    queue_data = allocIOBuffer(SCHED_QUEUE_BLOCKS * block_size);
+    held_lbas = malloc(SCHED_QUEUE_BLOCKS * sizeof(uint64_t));
+    held_slots = malloc(SCHED_QUEUE_BLOCKS * sizeof(int));
+    held_data = allocIOBuffer(SCHED_QUEUE_BLOCKS * block_size);
+
+    if (!queued_lbas || !queued_slots || !queue_data || !held_lbas || !held_slots
+        || !held_data) {
+        exitScheduler();
+        return ERROR;
+    }
+
+    num_queued = 0;
+    num_held = 0;
+    held_writing = FALSE;
+    head_position = 0;
+    memset(&sched_counters, 0, sizeof(sched_stats));
+
+    return SUCCESS;
+}
+
+uint64_t schedRead(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    uint64_t blocks_read = deviceRead(buf, lba_count, lba_position);
+    if (blocks_read != lba_count) return blocks_read;
+    head_position = lba_position + lba_count;
+
+    // the held and queued blocks are newer than the device's copy, and the queued ones
+    // are newer than the held ones
+    sched_counters.read_hits += copyHeldBlocks(buf, lba_count, lba_position, held_lbas,
+                                               held_slots, num_held, held_data);
+    sched_counters.read_hits += copyHeldBlocks(buf, lba_count, lba_position, queued_lbas,
+                                               queued_slots, num_queued, queue_data);
+
+    // the read is done, so it does not wait for the writes. they stay queued if the
+    // dispatch failed, and the next one tries them again
+    schedDispatchExpired(UINT64_MAX);
+    return lba_count;
+}
+
+uint64_t schedWrite(void *buf, uint64_t lba_count, uint64_t lba_position) {
+    uint64_t num_blocks = deviceNumBlocks();
+    int in_volume = lba_position <= num_blocks && lba_count <= num_blocks - lba_position;
+
+    // a long write is already one sequential transfer. one that is outside the volume
+    // is not queued, so that it fails now instead of failing every dispatch
+    if (!scheduler->queues_writes || !queue_data || lba_count >= SCHED_DIRECT_BLOCKS
+        || !in_volume) {
+        // queued copies of the blocks would overwrite them when they are dispatched
+        if (schedDispatchRange(lba_count, lba_position) == ERROR) return 0;
+
+        uint64_t blocks_written = deviceWrite(buf, lba_count, lba_position);
+        if (blocks_written == lba_count) head_position = lba_position + lba_count;
+        return blocks_written;
+    }
+
+    const char *src = buf;
+    for (uint64_t i = 0; i < lba_count; i++) {
+        uint64_t lba = lba_position + i;
+        int index = findQueued(lba);
+
+        if (index < num_queued && queued_lbas[index] == lba) { // written again
+            memcpy(queuedData(index), src + i * sched_block_size, sched_block_size);
+            sched_counters.merged++;
+            continue;
+        }
+
+        if (num_queued == SCHED_QUEUE_BLOCKS) {
+            if (schedDispatch() == ERROR) return i;
+            index = 0;
+        }
+        if (num_queued == 0) oldest_queued_ms = getMonotonicMs();
+
+        // the block goes into the next unused block of queue memory
+        memmove(&queued_lbas[index + 1], &queued_lbas[index],
+                (num_queued - index) * sizeof(uint64_t));
+        memmove(&queued_slots[index + 1], &queued_slots[index],
+                (num_queued - index) * sizeof(int));
+        queued_lbas[index] = lba;
+        queued_slots[index] = num_queued++;
+        memcpy(queuedData(index), src + i * sched_block_size, sched_block_size);
+        sched_counters.queued++;
+    }
+
+    schedDispatchExpired(UINT64_MAX);
+    return lba_count;
+}
+
+int schedQueueExpired(uint64_t max_age_ms) {
+    if (scheduler->expires_writes && max_age_ms > SCHED_WRITE_EXPIRE_MS) {
+        max_age_ms = SCHED_WRITE_EXPIRE_MS;
+    }
+    if (num_queued == 0 || getMonotonicMs() - oldest_queued_ms < max_age_ms) return FALSE;
+
+    sched_counters.expired++;
+    return TRUE;
+}
+
+int schedDispatchExpired(uint64_t max_age_ms) {
+    return schedQueueExpired(max_age_ms) ? schedDispatch() : SUCCESS;
+}
+
+uint64_t schedNextExpiryMs() {
+    if (!scheduler || !scheduler->expires_writes || num_queued == 0) return UINT64_MAX;
+    return oldest_queued_ms + SCHED_WRITE_EXPIRE_MS;
+}
+
+int schedDispatch() {
+    // blocks that are held from a write that failed go first, since they are older.
+    // while they are being written, the queue holds none of them
+    if (num_held > 0 && !held_writing) {
+        if (writeSweep(held_lbas, held_slots, num_held, held_data) == ERROR) return ERROR;
+        num_held = 0;
+    }
+    if (num_queued == 0) return SUCCESS;
+
+    if (writeSweep(queued_lbas, queued_slots, num_queued, queue_data) == ERROR) return ERROR;
+
+    num_queued = 0;
+    sched_counters.dispatches++;
+    return SUCCESS;
+}
+
+int schedDispatchRange(uint64_t lba_count, uint64_t lba_position) {
+    if (!holdsRange(queued_lbas, num_queued, lba_count, lba_position)
+        && (held_writing || !holdsRange(held_lbas, num_held, lba_count, lba_position))) {
+        return SUCCESS; // none of the blocks are queued
+    }
+
+    return schedDispatch();
+}
+
+int schedHoldQueue(lba_segment *segs) {
+    // what a failed write left is handed out again, on its own
+    if (num_held == 0) {
+        uint64_t *lbas = held_lbas;
+        int *slots = held_slots;
+        char *data = held_data;
+        held_lbas = queued_lbas;
+        held_slots = queued_slots;
+        held_data = queue_data;
+        queued_lbas = lbas;
+        queued_slots = slots;
+        queue_data = data;
+        num_held = num_queued;
+        num_queued = 0;
+        if (num_held > 0) sched_counters.dispatches++;
+    }
+
+    for (int i = 0; i < num_held; i++) {
+        segs[i] = (lba_segment) { heldData(i), 1, held_lbas[i] };
+    }
+
+    held_writing = TRUE;
+    return num_held;
+}
+
+void schedReleaseHeld(int written) {
+    if (written && num_held > 0) {
+        head_position = held_lbas[num_held - 1] + 1;
+        num_held = 0;
+    }
+
+    held_writing = FALSE;
+}
+
+int schedHasHeld() { return num_held > 0; }
+
+int exitScheduler() {
+    int result = schedDispatch();
+
+    free(queued_lbas);
+    queued_lbas = NULL;
+    free(queued_slots);
+    queued_slots = NULL;
+    free(queue_data);
+    queue_data = NULL;
+    num_queued = 0;
+    free(held_lbas);
+    held_lbas = NULL;
+    free(held_slots);
+    held_slots = NULL;
+    free(held_data);
+    held_data = NULL;
+    num_held = 0;
+
+    return result;
+}
+
+void printSchedulerStats() {
+    printf("I/O scheduler: %s, %d/%d blocks queued, %d being written\n"
+           "  queued: %lu blocks, %lu written again while queued\n"
+           "  dispatches: %lu, %lu when a write expired\n"
+           "  reads from the queue: %lu blocks\n",
+           scheduler ? scheduler->name : "none", num_queued, SCHED_QUEUE_BLOCKS, num_held,
+           sched_counters.queued, sched_counters.merged, sched_counters.dispatches,
+           sched_counters.expired, sched_counters.read_hits);
+}
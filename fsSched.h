@@ -0,0 +1,106 @@
+/**************************************************************
+* Class: CSC-415-02 Fall 2021
+* Names: Edel Jhon Cenario, Michael Wang, Michael Widergren, Anthony Zhang
+* Student IDs: 921121224, 921460979, 921363622, 921544101
+* GitHub Name: anthonyzhang1
+* Group Name: Michael
+* Project: Basic File System
+*
+* File: fsSched.h
+*
+* Description: Interface for the I/O scheduler between the block cache
+*  and the device. The cache hands it the blocks it writes back when it
+*  evicts them, which arrive in whatever order the file system touched
+*  them. The noop scheduler writes each one as it comes. The elevator
+*  scheduler holds them in a queue instead, and once the queue is full
+*  or the cache is flushed, writes them all in one sweep across the
+*  disk, with neighbouring blocks merged into one transfer. The deadline
+*  scheduler does the same, but also sweeps once the oldest queued write
+*  has waited SCHED_WRITE_EXPIRE_MS, which the flusher wakes up for. Reads are never queued: they go to
+*  the device at once, ahead of any queued writes, and take the queued
+*  blocks from the queue. The block cache can also take the whole queue
+*  and write it along with its own dirty blocks, without holding its lock.
+*
+**************************************************************/
+
+#ifndef _FS_SCHED_H
+#define _FS_SCHED_H
+
+#include "fsDevice.h"
+
+#define DEFAULT_SCHEDULER "deadline" // scheduler used when none is named
+#define SCHED_QUEUE_BLOCKS 256 // most blocks the queue holds before it is dispatched
+#define SCHED_DIRECT_BLOCKS 64 // writes of at least this many blocks are not queued
+#define SCHED_WRITE_EXPIRE_MS 500 // the deadline scheduler's limit on a write's wait
+
+// scheduler counters, printed by the stats command
+typedef struct sched_stats {
+    uint64_t queued; // blocks added to the queue
+    uint64_t merged; // queued blocks that were written again before they were dispatched
+    uint64_t dispatches; // times the queue was written to the device
+    uint64_t expired; // dispatches because a write waited too long
+    uint64_t read_hits; // blocks read from the queue instead of the device
+} sched_stats;
+
+/* Picks the scheduler named name, or DEFAULT_SCHEDULER if name is NULL. Writes that
+ * are queued are dispatched first if the new scheduler does not queue them.
+ * Returns ERROR if there is no such scheduler, or SUCCESS. */
+int setScheduler(char *name);
+
+/* Allocates the queue for blocks of block_size bytes. Returns ERROR if memory ran
+ * out, or SUCCESS. */
+int initScheduler(uint64_t block_size);
+
+/* Same as deviceRead, but the blocks that are queued are copied from the queue, since
+ * they are newer than the device's copy. Returns how many blocks were read. */
+uint64_t schedRead(void *buf, uint64_t lba_count, uint64_t lba_position);
+
+/* Same as deviceWrite, but the blocks may be queued instead, to be written when the
+ * queue is dispatched. Returns how many blocks were written or queued. */
+uint64_t schedWrite(void *buf, uint64_t lba_count, uint64_t lba_position);
+
+/* Writes every queued block to the device. The blocks stay queued if any of them
+ * could not be written. Returns ERROR on error, or SUCCESS. */
+int schedDispatch();
+
+/* Returns TRUE if the oldest queued block has waited max_age_ms, or
+ * SCHED_WRITE_EXPIRE_MS if that is sooner and the scheduler expires writes, and counts
+ * it as an expired dispatch, since the caller dispatches the queue. FALSE otherwise. */
+int schedQueueExpired(uint64_t max_age_ms);
+
+/* Same as schedDispatch, but only if schedQueueExpired. Returns ERROR on error, or
+ * SUCCESS. */
+int schedDispatchExpired(uint64_t max_age_ms);
+
+/* Returns the time, from getMonotonicMs, at which the oldest queued block will have
+ * waited SCHED_WRITE_EXPIRE_MS, or UINT64_MAX if nothing is queued or the scheduler
+ * does not expire writes. */
+uint64_t schedNextExpiryMs();
+
+/* Same as schedDispatch, but only if any of the lba_count blocks from lba_position on
+ * is queued, so that the device's copy of them is up to date before it is used
+ * directly. Returns ERROR on error, or SUCCESS. */
+int schedDispatchRange(uint64_t lba_count, uint64_t lba_position);
+
+/* Hands the queued blocks to the caller, which writes them to the device itself and
+ * then calls schedReleaseHeld. They are held apart from the queue, which starts over
+ * empty, and reads still copy them until they are released. If a write of held blocks
+ * failed before, those are handed out again instead, and the queue stays. Fills segs,
+ * which must have room for SCHED_QUEUE_BLOCKS segments, with one block each.
+ * Returns how many blocks are held. */
+int schedHoldQueue(lba_segment *segs);
+
+/* Ends the write of the blocks from schedHoldQueue. They are dropped if written is TRUE,
+ * and held for the next schedHoldQueue or dispatch otherwise. */
+void schedReleaseHeld(int written);
+
+/* Returns TRUE if blocks from a write that failed are still held, FALSE otherwise. */
+int schedHasHeld();
+
+/* Dispatches the queue, then frees it. Returns the result of the dispatch. */
+int exitScheduler();
+
+/* Prints which scheduler is in use and its counters. */
+void printSchedulerStats();
+
+#endif
@@ -24,6 +24,15 @@
 
 #include "fsLow.h"
 #include "mfs.h"
+#include "fsCache.h"
+#include "fsDentryCache.h"
+#include "fsFreeSpace.h"
+#include "fsJournal.h"
+#include "fsCopy.h"
+#include "fsRefcount.h"
+#include "fsDevice.h"
+#include "fsSched.h"
+#include "fsFlusher.h"
 
 
 
@@ -42,6 +51,7 @@
 #define CMDCP2FS_ON	1
 #define CMDCD_ON	1
 #define CMDPWD_ON	1
+#define CMDDU_ON	1
 
 
 typedef struct dispatch_t
@@ -61,12 +71,15 @@ int cmd_cp2l (int argcnt, char *argvec[]);
 int cmd_cp2fs (int argcnt, char *argvec[]);
 int cmd_cd (int argcnt, char *argvec[]);
 int cmd_pwd (int argcnt, char *argvec[]);
+int cmd_du (int argcnt, char *argvec[]);
+int cmd_sync (int argcnt, char *argvec[]);
+int cmd_stats (int argcnt, char *argvec[]);
 int cmd_history (int argcnt, char *argvec[]);
 int cmd_help (int argcnt, char *argvec[]);
 
 dispatch_t dispatchTable[] = {
 	{"ls", cmd_ls, "Lists the file in a directory"},
-	{"cp", cmd_cp, "Copies a file - source [dest]"},
+	{"cp", cmd_cp, "Copies a file, sharing its blocks unless -f - [-f] source [dest]"},
 	{"mv", cmd_mv, "Moves a file - source dest"},
 	{"md", cmd_md, "Make a new directory"},
 	{"rm", cmd_rm, "Removes a file or directory"},
@@ -74,6 +87,9 @@ dispatch_t dispatchTable[] = {
 	{"cp2fs", cmd_cp2fs, "Copies a file from the Linux file system to the test file system"},
 	{"cd", cmd_cd, "Changes directory"},
 	{"pwd", cmd_pwd, "Prints the working directory"},
+	{"du", cmd_du, "Prints the size of a directory tree - [path]"},
+	{"sync", cmd_sync, "Writes every change to the disk now"},
+	{"stats", cmd_stats, "Prints out the cache, scheduler, flusher and device statistics"},
 	{"history", cmd_history, "Prints out the history"},
 	{"help", cmd_help, "Prints out help"}
 };
@@ -90,15 +106,14 @@ int displayFiles (fdDir * dirp, int flall, int fllong)
 	struct fs_diriteminfo * di;
 	struct fs_stat statbuf;
 	
-	di = fs_readdir (dirp);
+	// the long format gets each entry's size and dates along with it
+	di = fllong ? fs_readdirplus (dirp, &statbuf) : fs_readdir (dirp);
 	while (di != NULL) 
 		{
 		if ((di->d_name[0] != '.') || (flall)) //if not all and starts with '.' it is hidden
 			{
 			if (fllong)
 				{
-				fs_stat (di->d_name, &statbuf);
-
 				char *create_time = ctime(&statbuf.st_createtime); // get dir_entry creation date
 				create_time[strlen(create_time) - 1] = '\0'; // get rid of newline character
 
@@ -111,7 +126,7 @@ int displayFiles (fdDir * dirp, int flall, int fllong)
 				printf ("%s\n", di->d_name);
 				}
 			}
-		di = fs_readdir (dirp);
+		di = fllong ? fs_readdirplus (dirp, &statbuf) : fs_readdir (dirp);
 		}
 	fs_closedir (dirp);
 #endif
@@ -233,14 +248,17 @@ int cmd_ls (int argcnt, char *argvec[])
 	
 int cmd_cp (int argcnt, char *argvec[])
 	{
-#if (CMDCP_ON == 1)	
-	int testfs_src_fd;
-	int testfs_dest_fd;
+#if (CMDCP_ON == 1)				
 	char * src;
 	char * dest;
-	int readcnt;
-	int writecnt;
-	char buf[BUFFERLEN];
+	int full = 0;	// copy the blocks instead of sharing them
+	
+	if (argcnt > 1 && (strcmp (argvec[1], "-f") == 0 || strcmp (argvec[1], "--full") == 0))
+		{
+		full = 1;
+		argcnt--;
+		argvec++;
+		}
 	
 	switch (argcnt)
 		{
@@ -255,20 +273,17 @@ int cmd_cp (int argcnt, char *argvec[])
 			break;
 		
 		default:
-			printf("Usage: cp srcfile [destfile]\n");
+			printf("Usage: cp [-f] srcfile [destfile]\n");
 			return (-1);
 		}
 	
-	
-	testfs_src_fd = b_open (src, O_RDONLY);
-	testfs_dest_fd = b_open (dest, O_WRONLY | O_CREAT | O_TRUNC);
-	do 
+	if (full)
 		{
-		readcnt = b_read (testfs_src_fd, buf, BUFFERLEN);
-		writecnt = b_write (testfs_dest_fd, buf, readcnt);
-		} while (readcnt == BUFFERLEN && writecnt > 0);
-	b_close (testfs_src_fd);
-	b_close (testfs_dest_fd);
+		if (copyInVolume (src, dest) == -1)
+			return (-1);
+		}
+	else if (fs_clone (src, dest) == -1)
+		return (-1);
 #endif
 	return 0;
 	}
@@ -344,12 +359,8 @@ int cmd_rm (int argcnt, char *argvec[])
 int cmd_cp2l (int argcnt, char *argvec[])
 	{
 #if (CMDCP2L_ON == 1)				
-	int testfs_fd;
-	int linux_fd;
 	char * src;
 	char * dest;
-	int readcnt;
-	char buf[BUFFERLEN];
 	
 	switch (argcnt)
 		{
@@ -368,19 +379,8 @@ int cmd_cp2l (int argcnt, char *argvec[])
 			return (-1);
 		}
 	
-	// calls linux's open with read and write permissions so that we do not need
-	// to manually change the permissions for each file to open them
-	// Credit: Robert Bierman
-	testfs_fd = b_open (src, O_RDONLY);
-	linux_fd = open (dest, O_WRONLY | O_CREAT | O_TRUNC,
-	                 S_IRUSR | S_IWUSR | S_IRGRP | S_IWGRP | S_IROTH | S_IWOTH);
-	do 
-		{
-		readcnt = b_read (testfs_fd, buf, BUFFERLEN);
-		write (linux_fd, buf, readcnt);
-		} while (readcnt == BUFFERLEN);
-	b_close (testfs_fd);
-	close (linux_fd);
+	if (copyFromVolume (src, dest) == -1)
+		return (-1);
 #endif
 	return 0;
 	}
@@ -391,13 +391,8 @@ int cmd_cp2l (int argcnt, char *argvec[])
 int cmd_cp2fs (int argcnt, char *argvec[])
 	{
 #if (CMDCP2FS_ON == 1)				
-	int testfs_fd;
-	int linux_fd;
 	char * src;
 	char * dest;
-	int readcnt;
-	int writecnt; // return value of b_write
-	char buf[BUFFERLEN];
 	
 	switch (argcnt)
 		{
@@ -416,18 +411,8 @@ int cmd_cp2fs (int argcnt, char *argvec[])
 			return (-1);
 		}
 	
-	
-	testfs_fd = b_open (dest, O_WRONLY | O_CREAT | O_TRUNC);
-	linux_fd = open (src, O_RDONLY);
-	do 
-		{
-		// check return val of b_write otherwise b_write might keep printing
-		// error messages until read has exhausted its file or returns -1
-		readcnt = read (linux_fd, buf, BUFFERLEN);
-		writecnt = b_write (testfs_fd, buf, readcnt);
-		} while (readcnt == BUFFERLEN && writecnt > 0);
-	b_close (testfs_fd);
-	close (linux_fd);
+	if (copyToVolume (src, dest) == -1)
+		return (-1);
 #endif
 	return 0;
 	}
@@ -489,6 +474,83 @@ int cmd_pwd (int argcnt, char *argvec[])
 	return 0;
 	}
 
+/****************************************************
+*  Disk usage commmand
+****************************************************/
+static uint64_t du_files, du_dirs, du_bytes; // totals counted by duVisitor
+
+int duVisitor (const char *path, const struct fs_stat *stat, int type,
+               struct fs_walkinfo *info)
+	{
+	if (type == FS_WALK_FILE)
+		du_files++;
+	else
+		du_dirs++;
+	du_bytes += stat->st_size;
+	return 0;
+	}
+
+int cmd_du (int argcnt, char *argvec[])
+	{
+#if (CMDDU_ON == 1)
+	if (argcnt > 2)
+		{
+		printf ("Usage: du [path]\n");
+		return -1;
+		}
+
+	char * path = (argcnt == 2) ? argvec[1] : ".";
+	du_files = 0;
+	du_dirs = 0;
+	du_bytes = 0;
+
+	if (fs_walk (path, duVisitor, 0) != 0)
+		{
+		printf ("du: could not walk '%s'\n", path);
+		return -1;
+		}
+
+	printf ("%lu bytes in %lu files and %lu directories\n", du_bytes, du_files, du_dirs);
+#endif
+	return 0;
+	}
+
+/****************************************************
+*  Sync commmand
+****************************************************/
+int cmd_sync (int argcnt, char *argvec[])
+	{
+	if (argcnt != 1)
+		{
+		printf ("Usage: sync\n");
+		return -1;
+		}
+
+	if (syncFileSystem() == ERROR)
+		{
+		printf ("sync: some changes could not be written to the disk\n");
+		return -1;
+		}
+
+	return 0;
+	}
+
+/****************************************************
+*  Stats commmand
+****************************************************/
+int cmd_stats (int argcnt, char *argvec[])
+	{
+	printBlockCacheStats();
+	printDentryCacheStats();
+	printFreeSpaceStats();
+	printJournalStats();
+	printRefcountStats();
+	printSchedulerStats();
+	printFlusherStats();
+	printDeviceStats();
+	return 0;
+	}
+
 /****************************************************
 *  History commmand
 ****************************************************/
@@ -639,6 +701,8 @@ int main (int argc, char * argv[])
 	char * filename;
 	uint64_t volumeSize;
 	uint64_t blockSize;
+	char * deviceName = NULL;	// the block device backend, uring unless named
+	char * schedulerName = NULL;	// the I/O scheduler, deadline unless named
     int retVal;
     
 	if (argc > 3)
@@ -646,14 +710,26 @@ int main (int argc, char * argv[])
 		filename = argv[1];
 		volumeSize = atoll (argv[2]);
 		blockSize = atoll (argv[3]);
+		if (argc > 4)
+			deviceName = argv[4];
+		if (argc > 5)
+			schedulerName = argv[5];
+		if (argc > 6)
+			setFlushWindow (atoll (argv[6]));
 		}
 	else
 		{
-		printf ("Usage: fsLowDriver volumeFileName volumeSize blockSize\n");
+		printf ("Usage: fsLowDriver volumeFileName volumeSize blockSize [uring|direct|threads|file|mmap|ram] [deadline|elevator|noop] [flushWindowMs]\n");
 		return -1;
 		}
 		
-	retVal = startPartitionSystem (filename, &volumeSize, &blockSize);	
+	if (setScheduler (schedulerName) == ERROR)
+		{
+		printf ("Choose deadline, elevator or noop.\n");
+		return -1;
+		}
+
+	retVal = startDevice (deviceName, filename, &volumeSize, &blockSize);	
 	printf("Opened %s, Volume Size: %llu;  BlockSize: %llu; Return %d\n", filename, (ull_t)volumeSize, (ull_t)blockSize, retVal);
 
 	if (retVal != PART_NOERROR)
@@ -667,7 +743,7 @@ int main (int argc, char * argv[])
 	if (retVal != 0)
 		{
 		printf ("Initialize File System Failed:  %d\n", retVal);
-		closePartitionSystem();
+		stopDevice();
 		return (retVal);
 		}
 		
@@ -692,7 +768,7 @@ int main (int argc, char * argv[])
 			free (cmd);
 			cmd = NULL;
 			exitFileSystem();
-			closePartitionSystem();
+			stopDevice();
 			// exit while loop and terminate shell
 			break;
 			}
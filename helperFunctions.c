@@ -14,6 +14,10 @@
 **************************************************************/
 
 #include "helperFunctions.h"
+#include "fsFreeSpace.h"
+#include "fsBitmap.h"
+#include "fsJournal.h"
+#include "fsRefcount.h"
 
 /* We search for free blocks in the bitmap at block number start_block_index.
  * start_block_index is incremented to the last block checked whenever we try
@@ -23,10 +27,33 @@
  * any gaps from deleted files when we search the bitmap for free blocks again. */
 uint64_t start_block_index = 0;
 
-int ceilingDivide(int numerator, int denominator) {
+/* One bit per bitmap block, set when the block changed since the bitmap was last
+ * written. writeBitmap only writes the set blocks. NULL until initBitmapDirtyBlocks. */
+static uint32_t *bitmap_dirty = NULL;
+static uint64_t bitmap_dirty_bits = 0; // how many bitmap blocks bitmap_dirty covers
+
+/* Marks the bitmap blocks that hold the bits of the given volume blocks as dirty. */
+static void markBitmapBlocksDirty(uint64_t start_block, uint64_t num_blocks) {
+    if (!bitmap_dirty || num_blocks == 0) return;
+
+    uint64_t bits_per_block = vcb->block_size * 8;
+    uint64_t first = start_block / bits_per_block;
+    uint64_t last = (start_block + num_blocks - 1) / bits_per_block;
+    if (last >= bitmap_dirty_bits) return; // past the bitmap. the callers check this too
+
+    bitmapSetRange(bitmap_dirty, first, last - first + 1);
+}
+
+uint64_t ceilingDivide(uint64_t numerator, uint64_t denominator) {
     return (numerator + denominator - 1) / denominator;
 }
 
+uint64_t getMonotonicMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+}
+
 /* Sources: stackoverflow.com/questions/2525310/how-to-define-and-work-with-an-array-of-bits-in-c
  *
  * Bit n is stored in the n/32th integer, rounded down. Hence, bitmap[block_num / 32].
@@ -43,6 +70,8 @@ void markBlockUsed(uint32_t *bitmap, uint64_t block_num) {
     }
 
     bitmap[block_num / 32] |= 1u << (block_num % 32);
+    markBitmapBlocksDirty(block_num, 1);
+    freeSpaceRemoveRange(block_num, 1); // keep the free extent index in sync
 }
 
 /* Sources: stackoverflow.com/questions/2525310/how-to-define-and-work-with-an-array-of-bits-in-c
@@ -62,6 +91,134 @@ void markBlockFree(uint32_t *bitmap, uint64_t block_num) {
     }
 
     bitmap[block_num / 32] &= ~(1u << (block_num % 32));
+    markBitmapBlocksDirty(block_num, 1);
+
+    // keep the free extent index in sync, once the journal lets go of the block
+    if (!journalDeferFree(block_num, 1)) freeSpaceAddRange(block_num, 1);
+}
+
+/* The range functions below hand the bitmap to the kernels in fsBitmap.c,
+ * which set, clear, and count a whole 64-bit word of blocks at a time. */
+void markBlockRangeUsed(uint32_t *bitmap, uint64_t start_block, uint64_t num_blocks) {
+    // check for out of bounds bitmap access
+    if (start_block >= vcb->num_blocks || num_blocks > vcb->num_blocks - start_block) {
+        printf("Out of bounds array access stopped in markBlockRangeUsed.\n");
+        return;
+    }
+
+    bitmapSetRange(bitmap, start_block, num_blocks);
+    markBitmapBlocksDirty(start_block, num_blocks);
+    freeSpaceRemoveRange(start_block, num_blocks); // keep the free extent index in sync
+}
+
+void markBlockRangeFree(uint32_t *bitmap, uint64_t start_block, uint64_t num_blocks) {
+    // check for out of bounds bitmap access
+    if (start_block >= vcb->num_blocks || num_blocks > vcb->num_blocks - start_block) {
+        printf("Out of bounds array access stopped in markBlockRangeFree.\n");
+        return;
+    }
+
+    bitmapClearRange(bitmap, start_block, num_blocks);
+    markBitmapBlocksDirty(start_block, num_blocks);
+
+    // keep the free extent index in sync, once the journal lets go of the blocks
+    if (!journalDeferFree(start_block, num_blocks)) {
+        freeSpaceAddRange(start_block, num_blocks);
+    }
+}
+
+int initBitmapDirtyBlocks(int all_dirty) {
+    freeBitmapDirtyBlocks();
+
+    // whole 64-bit words, since the bitmap kernels read whole words
+    uint64_t num_words = (vcb->bitmap_blocks + 63) / 64 * 2;
+    bitmap_dirty = calloc(num_words, sizeof(uint32_t));
+    if (!bitmap_dirty) return ERROR;
+
+    bitmap_dirty_bits = vcb->bitmap_blocks;
+    if (all_dirty) bitmapSetRange(bitmap_dirty, 0, bitmap_dirty_bits);
+
+    return SUCCESS;
+}
+
+void freeBitmapDirtyBlocks() {
+    free(bitmap_dirty);
+    bitmap_dirty = NULL;
+    bitmap_dirty_bits = 0;
+}
+
+/* Writes the VCB too if with_vcb is TRUE, then each run of adjacent dirty bitmap
+ * blocks, all with one customLBAwritev. The runs are found with the same kernels that
+ * scan the bitmap itself. */
+static int writeBitmapRuns(int with_vcb, char *msg) {
+    // the reference counts change along with the bitmap, and moving them to larger
+    // blocks changes the bitmap, so they go first
+    if (writeRefcounts() == ERROR) return ERROR;
+
+    // without a dirty set, there is no telling what changed
+    uint64_t num_runs = 1;
+    if (bitmap_dirty) {
+        num_runs = 0;
+        uint64_t run_start = bitmapNextSet(bitmap_dirty, bitmap_dirty_bits, 0);
+        while (run_start < bitmap_dirty_bits) {
+            uint64_t run_end = bitmapNextClear(bitmap_dirty, bitmap_dirty_bits, run_start);
+            run_start = bitmapNextSet(bitmap_dirty, bitmap_dirty_bits, run_end);
+            num_runs++;
+        }
+    }
+
+    lba_segment *segs = malloc((num_runs + 1) * sizeof(lba_segment));
+    if (!segs) return ERROR;
+
+    int num_segs = 0;
+    if (with_vcb) {
+        segs[num_segs++] = (lba_segment) { vcb, VCB_BLOCKS, VCB_START_BLOCK };
+    }
+
+    char *bitmap_bytes = (char *) bitmap;
+    if (!bitmap_dirty) {
+        segs[num_segs++] = (lba_segment) { bitmap, vcb->bitmap_blocks, vcb->bitmap_start_block };
+    } else {
+        uint64_t run_start = bitmapNextSet(bitmap_dirty, bitmap_dirty_bits, 0);
+        while (run_start < bitmap_dirty_bits) {
+            uint64_t run_end = bitmapNextClear(bitmap_dirty, bitmap_dirty_bits, run_start);
+            segs[num_segs++] = (lba_segment) { bitmap_bytes + run_start * vcb->block_size,
+                                               run_end - run_start,
+                                               vcb->bitmap_start_block + run_start };
+            run_start = bitmapNextSet(bitmap_dirty, bitmap_dirty_bits, run_end);
+        }
+    }
+
+    // the blocks stay dirty if the write fails, so the next write tries them again
+    int result = customLBAwritev(segs, num_segs, msg);
+    if (result == SUCCESS && bitmap_dirty) {
+        bitmapClearRange(bitmap_dirty, 0, bitmap_dirty_bits);
+    }
+
+    free(segs);
+    segs = NULL;
+    return result;
+}
+
+int writeBitmap(char *msg) {
+    return writeBitmapRuns(FALSE, msg);
+}
+
+int writeVCBandBitmap(char *msg) {
+    return writeBitmapRuns(TRUE, msg);
+}
+
+uint64_t getNumUsedBlocks(uint32_t *bitmap, uint64_t start_block, uint64_t num_blocks) {
+    if (start_block >= vcb->num_blocks) return num_blocks; // all out of bounds
+
+    // blocks past the end of the disk count as used, like in getBlockStatus
+    uint64_t out_of_bounds = 0;
+    if (num_blocks > vcb->num_blocks - start_block) {
+        out_of_bounds = num_blocks - (vcb->num_blocks - start_block);
+        num_blocks -= out_of_bounds;
+    }
+
+    return bitmapCountSet(bitmap, start_block, num_blocks) + out_of_bounds;
 }
 
 /* Sources: stackoverflow.com/questions/2525310/how-to-define-and-work-with-an-array-of-bits-in-c
@@ -79,39 +236,82 @@ int getBlockStatus(uint32_t *bitmap, uint64_t block_num) {
     return (bitmap[block_num / 32] & (1u << (block_num % 32))) != 0;
 }
 
+uint64_t getFreeRunLength(uint64_t start_block, uint64_t max_blocks) {
+    if (start_block >= vcb->num_blocks) return 0;
+    if (max_blocks > vcb->num_blocks - start_block) max_blocks = vcb->num_blocks - start_block;
+
+    uint64_t run_end = bitmapNextSet(bitmap, start_block + max_blocks, start_block);
+    return journalFirstPendingFree(start_block, run_end - start_block) - start_block;
+}
+
+/* Returns the first block at or after from_block that starts num_blocks contiguous free
+ * blocks, or UNSIGNED_ERROR if there is none. The free extent index answers this
+ * without walking the bitmap. Until it is built, the bitmap is scanned instead, and
+ * runs that hold blocks the journal has not let go of yet are skipped. */
+static uint64_t findFreeRun(uint64_t from_block, uint64_t num_blocks) {
+    if (freeSpaceIndexBuilt()) return freeSpaceNextFit(from_block, num_blocks);
+
+    uint64_t run_start = bitmapFindClearRun(bitmap, vcb->num_blocks, from_block, num_blocks);
+    while (run_start < vcb->num_blocks) {
+        uint64_t pending = journalFirstPendingFree(run_start, num_blocks);
+        if (pending == run_start + num_blocks) return run_start;
+
+        run_start = bitmapFindClearRun(bitmap, vcb->num_blocks, pending + 1, num_blocks);
+    }
+
+    return UNSIGNED_ERROR;
+}
+
 /* The search for free blocks starts at start_block_index, which is a global variable.
  * start_block_index is not reset to 0 after a search, so we essentially search the bitmap
  * for free blocks from where we stopped searching last time. start_block_index is reset to 0
  * after restarting the program, which allows us to fill in any holes left by deleted files
- * that start_block_index had already moved past. */
+ * that start_block_index had already moved past.
+ *
+ * The search itself is a next fit lookup in the free extent index, so it does not
+ * walk the bitmap unless the index is not built. If nothing fits after
+ * start_block_index, the search wraps around to vcb->free_space_start_block. */
 uint64_t getContiguousFreeBlocks(uint64_t num_blocks_wanted) {
     if (vcb->num_free_blocks < num_blocks_wanted) return UNSIGNED_ERROR;
 
-    if (start_block_index < vcb->free_space_start_block) {
+    if ((start_block_index < vcb->free_space_start_block)
+        || (start_block_index >= vcb->num_blocks)) {
         start_block_index = vcb->free_space_start_block;
     }
 
-    int cont_free_blocks_count = 0; // keeps track of contiguous free blocks
-    for (int iterations = 0; iterations < vcb->num_blocks; iterations++, start_block_index++) {
-        // loop back around if start_block_index reaches the end of the bitmap
-        if (start_block_index >= vcb->num_blocks) {
-            start_block_index = vcb->free_space_start_block;
-            cont_free_blocks_count = 0;
-        }
+    uint64_t free_start_block = findFreeRun(start_block_index, num_blocks_wanted);
 
-        // free block
-        if (getBlockStatus(bitmap, start_block_index) == FREE) cont_free_blocks_count++;
-        else cont_free_blocks_count = 0; // used block
+    // loop back around if there was no room between start_block_index and the end
+    if (free_start_block == UNSIGNED_ERROR) {
+        free_start_block = findFreeRun(vcb->free_space_start_block, num_blocks_wanted);
+    }
 
-        // found a set of contiguous free blocks that can fit num_blocks_wanted blocks
-        if (cont_free_blocks_count >= num_blocks_wanted) {
-            start_block_index++;
-            return start_block_index - cont_free_blocks_count;
-        }
+    // the blocks that operations freed since the last commit may make room
+    if (free_start_block == UNSIGNED_ERROR && commitPendingFrees()) {
+        free_start_block = findFreeRun(vcb->free_space_start_block, num_blocks_wanted);
     }
 
-    // Looked through the entire bitmap without finding enough contiguous free blocks
-    return UNSIGNED_ERROR;
+    // not enough contiguous free blocks anywhere in the volume
+    if (free_start_block == UNSIGNED_ERROR) return UNSIGNED_ERROR;
+
+    start_block_index = free_start_block + num_blocks_wanted;
+    return free_start_block;
+}
+
+uint64_t getBestFitFreeBlocks(uint64_t num_blocks_wanted) {
+    if (vcb->num_free_blocks < num_blocks_wanted) return UNSIGNED_ERROR;
+
+    // the bitmap alone cannot tell which run is the smallest without walking all of them
+    uint64_t free_start_block = freeSpaceIndexBuilt()
+        ? freeSpaceBestFit(vcb->free_space_start_block, num_blocks_wanted)
+        : findFreeRun(vcb->free_space_start_block, num_blocks_wanted);
+
+    // the blocks that operations freed since the last commit may make room
+    if (free_start_block == UNSIGNED_ERROR && commitPendingFrees()) {
+        return getBestFitFreeBlocks(num_blocks_wanted);
+    }
+
+    return free_start_block;
 }
 
 uint64_t modStartBlockIndex(long long num_blocks) {
@@ -126,8 +326,8 @@ uint64_t modStartBlockIndex(long long num_blocks) {
 }
 
 long long customLBAread(void *buf, uint64_t blocks_to_read, uint64_t start_block, char *msg) {
-    // LBAread returns the number of blocks read into the buffer.
-    uint64_t blocks_read = LBAread(buf, blocks_to_read, start_block);
+    // cacheLBAread returns the number of blocks read into the buffer.
+    uint64_t blocks_read = cacheLBAread(buf, blocks_to_read, start_block);
     
     if (blocks_read == blocks_to_read) return blocks_read;
     else {
@@ -136,9 +336,31 @@ long long customLBAread(void *buf, uint64_t blocks_to_read, uint64_t start_block
     }
 }
 
-long long customLBAwrite(void *buf, uint64_t blocks_to_write, uint64_t start_block, char *msg) {
-    // LBAwrite returns the number of blocks written to the disk.
-    uint64_t blocks_written = LBAwrite(buf, blocks_to_write, start_block);
+/* Checks with the journal before the num_blocks blocks from start_block on are written,
+ * since blocks it logged earlier must not be overwritten by a replay later. is_new is
+ * TRUE if the blocks were just allocated and are not logged by the transaction that
+ * writes them. Returns ERROR on error, or SUCCESS. */
+static int checkJournalWrite(uint64_t start_block, uint64_t num_blocks, int is_new,
+                             char *msg) {
+    int result = is_new ? checkJournalNewBlocks(start_block, num_blocks)
+                        : checkJournalOverwrite(start_block, num_blocks);
+    if (result == ERROR) {
+        printf("An error occurred with the journal. Error Message: %s\n", msg);
+    }
+
+    return result;
+}
+
+/* customLBAwrite (is_new == FALSE) or customLBAwriteNew (is_new == TRUE). */
+static long long writeBlocks(void *buf, uint64_t blocks_to_write, uint64_t start_block,
+                             int is_new, char *msg) {
+    if (checkJournalWrite(start_block, blocks_to_write, is_new, msg) == ERROR) return ERROR;
+
+    // cacheLBAwrite returns the number of blocks written to the disk.
+    // the blocks may stay in the block cache until it is flushed.
+    uint64_t blocks_written = is_new
+                            ? cacheLBAwriteUnpinned(buf, blocks_to_write, start_block)
+                            : cacheLBAwrite(buf, blocks_to_write, start_block);
 
     if (blocks_written == blocks_to_write) return blocks_written;
     else {
@@ -147,6 +369,63 @@ long long customLBAwrite(void *buf, uint64_t blocks_to_write, uint64_t start_blo
     }
 }
 
+long long customLBAwrite(void *buf, uint64_t blocks_to_write, uint64_t start_block, char *msg) {
+    return writeBlocks(buf, blocks_to_write, start_block, FALSE, msg);
+}
+
+long long customLBAwriteNew(void *buf, uint64_t blocks_to_write, uint64_t start_block,
+                            char *msg) {
+    return writeBlocks(buf, blocks_to_write, start_block, TRUE, msg);
+}
+
+int customLBAbatch(device_io *ios, int num_ios, char *msg) {
+    for (int i = 0; i < num_ios; i++) {
+        if (ios[i].is_write
+            && checkJournalWrite(ios[i].lba_position, ios[i].lba_count, FALSE, msg) == ERROR) {
+            return ERROR;
+        }
+    }
+
+    if (cacheTransferBatch(ios, num_ios) == ERROR) {
+        printf("An error occurred with a batch of LBA transfers. Error Message: %s\n", msg);
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+const void *customLBAview(uint64_t blocks_to_view, uint64_t start_block) {
+    return cacheViewBlocks(blocks_to_view, start_block);
+}
+
+void customLBAunview(const void *view) {
+    deviceReleaseView(view);
+}
+
+int customLBAreadv(lba_segment *segs, int num_segs, char *msg) {
+    if (cacheTransferSegments(segs, num_segs, FALSE) == ERROR) {
+        printf("An error occurred with LBAreadv(). Error Message: %s\n", msg);
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
+int customLBAwritev(lba_segment *segs, int num_segs, char *msg) {
+    for (int i = 0; i < num_segs; i++) {
+        if (checkJournalWrite(segs[i].lba_position, segs[i].lba_count, FALSE, msg) == ERROR) {
+            return ERROR;
+        }
+    }
+
+    if (cacheTransferSegments(segs, num_segs, TRUE) == ERROR) {
+        printf("An error occurred with LBAwritev(). Error Message: %s\n", msg);
+        return ERROR;
+    }
+
+    return SUCCESS;
+}
+
 void printVCBcontents() {
 	printf("\nVCB Contents:\n"
 		   "vcb->num_blocks: %ld\n"
@@ -159,8 +438,17 @@ void printVCBcontents() {
 		   "vcb->root_dir_start_block: %ld\n"
 		   "vcb->dir_blocks: %ld\n\n"
 
-		   "vcb->signature: %lX\n\n",
+		   "vcb->signature: %lX\n"
+		   "vcb->format_version: %ld\n\n"
+
+		   "vcb->journal_start_block: %ld\n"
+		   "vcb->journal_blocks: %ld\n\n"
+
+		   "vcb->refcount_start_block: %ld\n"
+		   "vcb->refcount_blocks: %ld\n\n",
 		   vcb->num_blocks, vcb->block_size, vcb->free_space_start_block,
            vcb->num_free_blocks, vcb->bitmap_start_block, vcb->bitmap_blocks,
-           vcb->root_dir_start_block, vcb->dir_blocks, vcb->signature);
+           vcb->root_dir_start_block, vcb->dir_blocks, vcb->signature,
+           vcb->format_version, vcb->journal_start_block, vcb->journal_blocks,
+           vcb->refcount_start_block, vcb->refcount_blocks);
 }
\ No newline at end of file
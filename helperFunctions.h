@@ -19,6 +19,7 @@
 #include <stdio.h>
 #include <sys/types.h>
 #include "fsInit.h"
+#include "fsCache.h"
 
 #define TRUE 1 // the boolean value TRUE
 #define FALSE 0 // the boolean value FALSE
@@ -31,7 +32,10 @@
 #define USED 1u // a 1 in the bitmap means that the corresponding block is used
 
 /* Returns the numerator divided by the denominator, rounded up. */
-int ceilingDivide(int numerator, int denominator);
+uint64_t ceilingDivide(uint64_t numerator, uint64_t denominator);
+
+/* Returns the time in milliseconds, from a clock that only moves forward. */
+uint64_t getMonotonicMs();
 
 /* Marks a block as used in the bitmap.
  * Does not modify the bitmap if block_num is out of bounds. */
@@ -45,27 +49,100 @@ void markBlockFree(uint32_t *bitmap, uint64_t block_num);
  * If block_num is out of bounds, return USED. */
 int getBlockStatus(uint32_t *bitmap, uint64_t block_num);
 
+/* Marks num_blocks blocks starting at start_block as used in the bitmap.
+ * Does not modify the bitmap if any of the blocks are out of bounds. */
+void markBlockRangeUsed(uint32_t *bitmap, uint64_t start_block, uint64_t num_blocks);
+
+/* Marks num_blocks blocks starting at start_block as free in the bitmap.
+ * Does not modify the bitmap if any of the blocks are out of bounds. */
+void markBlockRangeFree(uint32_t *bitmap, uint64_t start_block, uint64_t num_blocks);
+
+/* Sets up the set of bitmap blocks that changed since the bitmap was last written,
+ * for a bitmap of vcb->bitmap_blocks blocks. If all_dirty is TRUE, every block
+ * starts out dirty. Returns ERROR if memory ran out, or SUCCESS. */
+int initBitmapDirtyBlocks(int all_dirty);
+
+/* Frees the set of dirty bitmap blocks. */
+void freeBitmapDirtyBlocks();
+
+/* Writes the bitmap blocks that changed since the bitmap was last written to disk,
+ * or the whole bitmap if there is no dirty set yet, with one customLBAwritev, which
+ * msg is passed to.
+ * The shared block reference counts are written first if they changed.
+ * Returns ERROR on error, or SUCCESS. */
+int writeBitmap(char *msg);
+
+/* Same as writeBitmap, but the VCB is written along with the bitmap blocks, in the
+ * same customLBAwritev. Returns ERROR on error, or SUCCESS. */
+int writeVCBandBitmap(char *msg);
+
+/* Returns how many of the num_blocks blocks starting at start_block are used.
+ * Blocks that are out of bounds are counted as used. */
+uint64_t getNumUsedBlocks(uint32_t *bitmap, uint64_t start_block, uint64_t num_blocks);
+
+/* Returns how many of the up to max_blocks blocks from start_block on are free and may
+ * be allocated, counting until the first one that is not. */
+uint64_t getFreeRunLength(uint64_t start_block, uint64_t max_blocks);
+
 /* Gets num_blocks_wanted contiguous blocks in the bitmap.
  * Returns the starting block of these contiguous blocks.
  * Returns UNSIGNED_ERROR if num_blocks_wanted contiguous free blocks could not be found. */
 uint64_t getContiguousFreeBlocks(uint64_t num_blocks_wanted);
 
+/* Gets num_blocks_wanted contiguous blocks from the smallest run of free blocks that
+ * can hold them, which leaves the larger runs for files. Does not move start_block_index.
+ * Without the free extent index, it takes the first run that fits instead.
+ * Returns UNSIGNED_ERROR if num_blocks_wanted contiguous free blocks could not be found. */
+uint64_t getBestFitFreeBlocks(uint64_t num_blocks_wanted);
+
 /* Modify which block the bitmap starts searching from, denoted start_block_index.
  * start_block_index will be modified by num_blocks. If start_block_index will take
  * on an invalid start block, it will be reset back to vcb->free_space_start_block.
  * Returns the value of start_block_index. */
 uint64_t modStartBlockIndex(long long num_blocks);
 
-/* Same as LBAread but can take a message to help identify which function caused the error.
+/* Same as LBAread but goes through the block cache, and can take a message
+ * to help identify which function caused the error.
  * Returns the number of blocks read into the buffer, or returns ERROR
  * if the number of blocks read into the buffer is not the same as blocks_to_read. */
 long long customLBAread(void *buf, uint64_t blocks_to_read, uint64_t start_block, char *msg);
 
-/* Same as LBAwrite but can take a message to help identify which function caused the error.
+/* Same as LBAwrite but goes through the block cache, and can take a message
+ * to help identify which function caused the error.
  * Returns the number of blocks written to the disk, or returns ERROR
  * if the number of blocks written to the disk is not the same as blocks_to_write. */
 long long customLBAwrite(void *buf, uint64_t blocks_to_write, uint64_t start_block, char *msg);
 
+/* Same as customLBAwrite, for blocks that were just allocated and that nothing on disk
+ * points at yet. They are not logged by the journal even inside a transaction, but
+ * written to disk before the record that points at them, like file data, so that an
+ * operation filling many new blocks still fits in the journal. */
+long long customLBAwriteNew(void *buf, uint64_t blocks_to_write, uint64_t start_block,
+                            char *msg);
+
+/* Runs num_ios transfers that must not overlap through the block cache with
+ * cacheTransferBatch, so that the large ones run at the same time. Takes a message to
+ * help identify which function caused the error.
+ * Returns ERROR if any of them did not move all of its blocks, or SUCCESS. */
+int customLBAbatch(device_io *ios, int num_ios, char *msg);
+
+/* Same as customLBAread and customLBAwrite, for num_segs segments that must not
+ * overlap. The segments go through the cache together with cacheTransferSegments, and
+ * the large ones that bypass it are merged where they are next to each other on disk
+ * and queued on the device at once. Returns ERROR if any segment was not moved in full,
+ * or SUCCESS. */
+int customLBAreadv(lba_segment *segs, int num_segs, char *msg);
+int customLBAwritev(lba_segment *segs, int num_segs, char *msg);
+
+/* Returns a read-only view of the blocks_to_view blocks from start_block on, in place
+ * in the device's memory, through cacheViewBlocks. Returns NULL if there is no up to
+ * date view of them, in which case the caller reads them with customLBAread instead.
+ * A view must be given back with customLBAunview once the caller is done with it. */
+const void *customLBAview(uint64_t blocks_to_view, uint64_t start_block);
+
+/* Gives back a view from customLBAview. Does nothing if view is NULL. */
+void customLBAunview(const void *view);
+
 /* Prints the data members in the VCB. Used for debugging. */
 void printVCBcontents();
 
@@ -52,11 +52,15 @@ struct fs_diriteminfo {
 // Think of this like a file descriptor but for a directory - one can only read
 // from a directory. This structure helps you (the file system) keep track of
 // which directory entry you are currently processing so that everytime the caller
-// calls the function readdir, you give the next entry in the directory
+// calls the function readdir, you give the next entry in the directory.
+// Each handle owns its open directory and the item it returns, so any number of
+// directories can be listed at once.
 typedef struct {
 	unsigned short  d_reclen;		    /* length of this record */
-	unsigned short	dirEntryPosition;	/* which directory entry position, like file pos */
+	uint64_t	dirEntryPosition;	/* which directory entry position, like file pos */
 	uint64_t directoryStartLocation;	/* Starting LBA of directory */
+	struct directory *dir;			/* the open directory */
+	struct fs_diriteminfo di;		/* returned by fs_readdir, until the next call */
 } fdDir;
 
 // Key directory functions
@@ -70,7 +74,7 @@ int fs_rmdir(const char *pathname);
 fdDir* fs_opendir(const char *name);
 struct fs_diriteminfo* fs_readdir(fdDir *dirp);
 
-/* Frees all the pointers used by open and read. Returns SUCCESS. */
+/* Closes the directory and frees the handle. Returns SUCCESS. */
 int fs_closedir(fdDir *dirp);
 
 // Misc directory functions
@@ -86,6 +90,11 @@ int fs_isDir(char *path);
 /* Deletes a file. Returns SUCCESS on success. Returns ERROR on error. */
 int fs_delete(char *filename);
 
+/* Makes dest a clone of the file src that shares all of its blocks, replacing dest if
+ * it is a file. No data is copied. A shared block is copied once either file writes
+ * to it. Returns SUCCESS on success, ERROR on error. */
+int fs_clone(const char *src, const char *dest);
+
 /* Moves the src file/dir to the dest file/dir.
  * Returns SUCCESS on success, ERROR on error. */
 int fs_move(char *src, char *dest);
@@ -100,10 +109,48 @@ struct fs_stat {
 	time_t    st_createtime;   	/* time of last status change */
 };
 
+/* Fills buf with the size and dates of the file or directory at path.
+ * Returns SUCCESS on success, ERROR on error. */
 int fs_stat(const char *path, struct fs_stat *buf);
 
+/* Like fs_readdir, but also fills buf with the entry's size and dates, taken from
+ * the entry just read instead of looking it up again by name. Only a directory's
+ * size needs another read, of the directory's header block.
+ * Returns NULL if there are no more entries or on error. */
+struct fs_diriteminfo* fs_readdirplus(fdDir *dirp, struct fs_stat *buf);
+
+// types passed to an fs_walk visitor, like nftw's FTW_F, FTW_D and FTW_DP
+#define FS_WALK_FILE 0 // a file
+#define FS_WALK_DIR 1 // a directory, visited before its contents
+#define FS_WALK_DIR_POST 2 // a directory, visited after its contents
+
+// flags for fs_walk
+#define FS_WALK_DEPTH 1 // visit directories after their contents instead, like FTW_DEPTH
+
+#define FS_WALK_PREFETCH_DIRS 8 // subdirectories queued for reading ahead of the one being visited
+
+// passed to an fs_walk visitor along with each path
+struct fs_walkinfo {
+	int level;	/* depth below the starting path, which is level 0 */
+	int base;	/* offset of the basename in the path */
+};
+
+// called by fs_walk for each file and directory. returning non-zero stops the walk
+typedef int (*fs_walk_fn)(const char *path, const struct fs_stat *stat, int type,
+                          struct fs_walkinfo *info);
+
+/* Calls fn for path and, if it is a directory, for everything under it, depth first.
+ * Paths passed to fn start with path, less any trailing slashes. '.' and '..' are
+ * skipped. The next few subdirectories of each directory are read into the block cache
+ * by a helper thread while the visitor runs, so it does not wait on the disk for them.
+ * fn may delete the entry it was passed, e.g. with FS_WALK_DEPTH.
+ * Returns SUCCESS once everything was visited, fn's return value if it was non-zero,
+ * or ERROR on error. */
+int fs_walk(const char *path, fs_walk_fn fn, int flags);
+
 /* Given a path x/y/z, return's y's start block. It is up to the caller
- * to check z's validity. Returns ERROR on error. */
+ * to check z's validity. Returns ERROR on error.
+ * Directories along the path are only read from disk on a dentry cache miss. */
 long long getParentBasenameStartBlock(const char *path);
 
 /* Given a path x/y/z, return z as a string. Does not check the validity of x/y/.
@@ -111,66 +158,29 @@ long long getParentBasenameStartBlock(const char *path);
  * Returns NULL if the return string is empty, e.g. the path was "/". */
 char* getBasename(const char *path);
 
-/* Preconditions: dir must already be allocated and be LBAread into.
- *
- * Given the name of a dir_entry, search in dir for a dir_entry with a matching name.
- * Return that dir_entry's index in dir. On error, return ERROR.
- * If the dir_entry was not found in dir, return NOT_FOUND.
- * 
- * If NULL was passed in for dir_entry_name, return 0, the index referring to dir itself.
- * This feature is useful for dealing with the root directory, for instance. */
-int getDirEntryIndexByName(dir_entry *dir, const char *dir_entry_name);
-
-/* Preconditions: dir must already be allocated and be LBAread into.
- *
- * Given the start block of a dir_entry, search in dir for a dir_entry
- * with the matching start block. Return that dir_entry's index in dir.
- * If error, return ERROR.
- * If the dir_entry was not found in dir, return NOT_FOUND. */
-int getDirEntryIndexByStartBlock(dir_entry *dir, uint64_t dir_entry_start_block);
-
-/* Preconditions: dir must already be allocated and be LBAread into.
- *
- * Searches dir for the first free entry. Returns the index of that first free entry.
- * If error, return ERROR. If no free entry available, return NOT_FOUND. */
-int getDirFreeEntryIndex(dir_entry *dir);
-
-/* Preconditions: dir must already be allocated and be LBAread into.
- *
- * Given a directory, return the number of used entries. If error, return ERROR. */
-int getDirNumUsedEntries(dir_entry *dir);
-
-/* Preconditions: dir must already be allocated and be LBAread into.
- *                0 <= start_index < MAX_DIRECTORY_ENTRIES
- * 
- * Searches dir for the next used entry starting from start_index.
- * Returns the index of that used entry. Returns ERROR if error.
- * If a used entry was not found starting from start_index, return NOT_FOUND. */
-int getDirNextUsedEntryIndex(dir_entry *dir, int start_index);
+/* Wipes all of entry's data members and marks it as a free entry.
+ * Does not free any blocks. */
+void clearDirEntry(dir_entry *entry);
 
-/* Preconditions: dir must be malloced and LBAread into.
- *  buf must have space allocated for it via an array or malloc,
+/* Preconditions: buf must have space allocated for it via an array or malloc,
  *  and it might need to be initialized to all null characters.
  * 
  * The parameter size is the size of buf.
- * Returns the absolute path of the directory and writes it to buf.
- * If the absolute path generated is longer than size chars, return NULL.
- * Returns NULL for other errors too. */
-char* getDirAbsPath(dir_entry *dir, char *buf, size_t size);
+ * Returns the absolute path of the directory starting at dir_start_block and
+ * writes it to buf. If the absolute path generated is longer than size chars,
+ * return NULL. Returns NULL for other errors too. */
+char* getDirAbsPath(uint64_t dir_start_block, char *buf, size_t size);
 
-/* Preconditions: dir must be malloced and LBAread into.
- *  buf must have space allocated for it via an array or malloc,
+/* Preconditions: buf must have space allocated for it via an array or malloc,
  *  and it might need to be initialized to all null characters.
  *  buf_size should be at least MAX_DE_NAME_LENGTH.
  * 
- * Returns the name of dir and writes it to buf.
+ * Returns the name of the directory starting at dir_start_block and writes it to buf.
  * Returns ROOT_NAME if the root dir was passed in. Returns NULL on error. */
-char* getDirName(dir_entry *dir, char *buf, size_t buf_size);
+char* getDirName(uint64_t dir_start_block, char *buf, size_t buf_size);
 
-/* Preconditions: dir must be malloced and LBAread into.
- *
- * Returns TRUE if dir is a subdirectory of the directory located
- * at ancestor_start_block. Returns FALSE if not. Returns ERROR on error. */
-int isSubDirOf(dir_entry *dir, uint64_t ancestor_start_block);
+/* Returns TRUE if the directory starting at dir_start_block is a subdirectory of the
+ * directory starting at ancestor_start_block. Returns FALSE if not. Returns ERROR on error. */
+int isSubDirOf(uint64_t dir_start_block, uint64_t ancestor_start_block);
 
 #endif
\ No newline at end of file